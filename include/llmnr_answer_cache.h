@@ -0,0 +1,25 @@
+/** **************************************************************
+ * Cache of fully serialized answers. The possible answers are   *
+ * few and only change on netlink events or cdar outcomes, so    *
+ * instead of building every answer from scratch (See            *
+ * attachAnswer()) the whole packet is kept, keyed by receiving  *
+ * interface, QNAME (as received), QTYPE, QCLASS, ip type of the *
+ * query and answer buffer size. A hit only patches the ID and   *
+ * the 'T' flag.                                                 *
+ * Every entry is tagged with the answer generation of his       *
+ * interface ('answerGen' of 'iface', See llmnr_packet.h and     *
+ * llmnr_net_interface.h). Whatever                              *
+ * changes the answers of an interface gives it a new generation *
+ * (See invalidateAnswers()), making his entries stale.          *
+ * Lookups never lock: every entry is guarded by a sequence      *
+ * counter and a reader racing a writer just misses              *
+ *****************************************************************/
+
+#ifndef LLMNR_ANSWER_CACHE_H
+#define LLMNR_ANSWER_CACHE_H
+
+PUBLIC int startAnswerCache(int size);
+PUBLIC void stopAnswerCache();
+PUBLIC int attachCachedAnswer(PKTPARAMS *params, DSTRUCTURE *dsts);
+
+#endif
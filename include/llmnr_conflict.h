@@ -4,13 +4,25 @@
  * will perform, as described in RFC 4795, a conflict        *
  * resolution. Also will detect if two or more interfaces    *
  * are operating in the same network                         *
- * Note: Previous mutex sincronization is performed before   *
- * calling this "micro module"                               *
+ * Every (name, interface) check is a probe: a small state   *
+ * machine driven by a timer of the event loop, so all of    *
+ * them run at the same time (in the main thread). Probes    *
+ * share the sockets of their interface (opened when it      *
+ * becomes running, closed by cdarIfaceDown()) and responses *
+ * are told apart by query id. 'cdardone' is called (once    *
+ * per timer tick) when probes are done, so the changes can  *
+ * be published                                              *
  *************************************************************/
 
 #ifndef LLMNR_CONFLICT_H
 #define LLMNR_CONFLICT_H
 
-PUBLIC void cDar(NAME *name, NETIFACE *iface, NETIFACE *ifs);
+typedef void (*cdardone)();
+
+PUBLIC int startCdar(NETIFACE *ifs, cdardone done);
+PUBLIC void stopCdar();
+PUBLIC void cDar(NAME *name, NETIFACE *iface);
+PUBLIC void cdarIfaceDown(NETIFACE *iface);
+PUBLIC int runningProbes();
 
 #endif
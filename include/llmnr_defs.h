@@ -26,14 +26,18 @@
 #define IPV4LEN 4
 #define IPV6LEN 16
 #define HEADSZ 12
-#define MAXIFACES 16
+#define QUESTMINSZ 17
 #define LLMNRPORT 5355
 #define HOSTNAMEMAX 255
 #define LLMNR_TIMEOUT 150
 #define JITTER_INTERVAL 100
 
 #define SNDBUFSZ 150
+#define EDNSBUFSZ 1500
 #define RCVBUFSZ 512
 #define ANCBUFSZ 256
 #define TCPBUFFSZ 2048
+#define MAXRCVBATCH 64
+#define MAXSNDBATCH 64
+#define MAXSHARDS 64
 #endif
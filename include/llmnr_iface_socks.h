@@ -0,0 +1,42 @@
+/** *************************************************************
+ * Per interface UDP sockets ('iface_sockets' 1). Instead of    *
+ * one wildcard socket per family joining the LLMNR groups for  *
+ * every interface, every running interface gets his own pair   *
+ * of sockets bound to the device and to the multicast address  *
+ * (See createIfaceSocket()):                                   *
+ * - The memberships belong to the socket of the interface, so  *
+ *   'igmp_max_memberships' (per socket) is never reached       *
+ * - The interface is the one of the socket: no ancillary data  *
+ *   is parsed                                                  *
+ * - A chatty segment only fills the receive buffer of his own  *
+ *   sockets                                                    *
+ * Unicast queries still go to the socket of each family (or of *
+ * each shard), which joins no group (See createUdpSocket())    *
+ * The sockets are polled by the event loop (answered by the    *
+ * worker pool) or, in sharded mode, by the shard of the        *
+ * interface (See llmnr_shards.h), so the queries of an         *
+ * interface are answered on the CPU of his shard. The sockets  *
+ * of a family are opened when the interface joins the LLMNR    *
+ * group and closed when it leaves (same rules that             *
+ * joinMcastGroup() and leaveMcastGroup(), See                  *
+ * llmnr_sockets.h). Only the main thread uses it               *
+ ****************************************************************/
+
+#ifndef LLMNR_IFACE_SOCKS_H
+#define LLMNR_IFACE_SOCKS_H
+
+/*
+ * Called for every query received by the event loop. SUCCESS
+ * means answer it (the query is handed to the worker pool)
+ */
+typedef int (*ifsockfilter)(UDPCLIENT *client);
+
+PUBLIC int startIfaceSocks(int rcvBatch, ifsockfilter filter);
+PUBLIC void stopIfaceSocks();
+PUBLIC int ifaceSocksRunning();
+PUBLIC void openIfaceSocks(NETIFACE *iface);
+PUBLIC void closeIfaceSocks(NETIFACE *iface);
+PUBLIC void attachIfaceSocksFilter();
+PUBLIC void printIfaceSockStats();
+
+#endif
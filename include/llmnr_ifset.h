@@ -0,0 +1,39 @@
+/** *************************************************************
+ * Interface slots and sets of interfaces. Every 'NETIFACE'     *
+ * node of the master list gets a slot: the lowest number free  *
+ * when the node is created, his until the node is removed.     *
+ * Slots stay dense whatever the interface indexes are (on a    *
+ * container host they run into the thousands), so they are    *
+ * the members of the 'IFSET' bitsets: the interfaces a name is *
+ * (or is not) authoritative on (See llmnr_names.h) and the     *
+ * mirror interfaces of an interface (See                       *
+ * llmnr_net_interface.h). A set grows as needed and checking a *
+ * member is a single word test                                 *
+ * Note: slots are only handed out and taken back by the main   *
+ * thread                                                       *
+ ****************************************************************/
+
+#ifndef LLMNR_IFSET_H
+#define LLMNR_IFSET_H
+
+/*
+ * 'bits' has 'words' words (none for an empty set)
+ */
+typedef struct {
+        int words;
+        unsigned long *bits;
+} IFSET;
+
+PUBLIC int newIfSlot();
+PUBLIC void freeIfSlot(int slot);
+PUBLIC void freeIfSlots();
+PUBLIC int addIfSet(IFSET *set, int slot);
+PUBLIC void delIfSet(IFSET *set, int slot);
+PUBLIC int inIfSet(IFSET *set, int slot);
+PUBLIC int nextInIfSet(IFSET *set, int slot);
+PUBLIC int ifSetSz(IFSET *set);
+PUBLIC int ifSetsMeet(IFSET *set, IFSET *other);
+PUBLIC int copyIfSet(IFSET *copy, IFSET *set);
+PUBLIC void freeIfSet(IFSET *set);
+
+#endif
@@ -0,0 +1,37 @@
+/** **************************************************************
+ * Classic BPF socket filter ('SO_ATTACH_FILTER') attached to    *
+ * every LLMNR UDP socket, so the kernel drops the datagrams we  *
+ * would never answer before they wake anybody up:               *
+ * - Shorter than a header plus the smallest question            *
+ * - Responses ('QR' set) or opcode other than 0                 *
+ * - 'QDCOUNT' other than 1, 'ANCOUNT' or 'NSCOUNT' not 0        *
+ * On level 'KF_NAMES' the first label of the QNAME must also    *
+ * look like the first label of one of our names or of a hosted  *
+ * name (length and first bytes, case folded) or like a "PTR     *
+ * name" label. The userspace prefilter does the exact check     *
+ * (See llmnr_query_filter.h).                                   *
+ * The program is built at start up and attached to every UDP    *
+ * socket created afterwards (See llmnr_sockets.h). The 'NAME'   *
+ * list never changes after start up (only his nodes do) but     *
+ * the hosted names do (See llmnr_registry.h): on every reload   *
+ * the program is built again and attached again to every live   *
+ * UDP socket. Datagrams dropped by the filter are counted by    *
+ * the kernel along with the receive buffer overflows (See       *
+ * kernelDrops())                                                *
+ *****************************************************************/
+
+#ifndef LLMNR_KERNEL_FILTER_H
+#define LLMNR_KERNEL_FILTER_H
+
+enum KFILTER_LEVEL {
+        KF_NONE,
+        KF_HEADER,
+        KF_NAMES
+};
+
+PUBLIC int buildKernelFilter(NAME *names, REGISTRY *registry, int level);
+PUBLIC void freeKernelFilter();
+PUBLIC void attachKernelFilter(int fd);
+PUBLIC long kernelDrops(int fd);
+
+#endif
@@ -2,19 +2,35 @@
  * Linked list interface to handle the hostnames for which a host  *
  * is authoritative. A machine can be authoritative on several     *
  * hostnames (See RFC 4795).                                       *
- * The struct 'NAME' will hold an actual hostname and two arrays:  *
- * - 'notAuthOn' holds the interfaces numbers that aren't          *
- *   authoritative on that specific name (i.e name was taken)      *
- * - 'authOn' holds the interfaces numbers that are                *
- *   authoritative on that specific name. Having 'notAuthOn' this  *
- *   array ('authOn') seems unnecesary, but is needed for 'cDar'   *
+ * The struct 'NAME' will hold an actual hostname and two sets of *
+ * interface slots (See llmnr_ifset.h):                            *
+ * - 'notAuthOn' holds the interfaces that aren't authoritative on *
+ *   that specific name (i.e name was taken)                       *
+ * - 'authOn' holds the interfaces that are authoritative on that  *
+ *   specific name. Having 'notAuthOn' this set ('authOn') seems   *
+ *   unnecesary, but is needed for 'cDar'                          *
  * Note: In LLMNR a machine can be authoritative for several       *
  * hostnames                                                       *
+ * 'NAMEINDEX' is a case folded hash index over the (wire format)  *
+ * names of a list. A lookup costs a single full length compare    *
+ * and also tells if the name is authoritative on the receiving    *
+ * interface. The index is never changed once built: it is built   *
+ * along with every snapshot (See llmnr_snapshot.h)                *
  *******************************************************************/
 
 #ifndef LLMNR_NAMES_H
 #define LLMNR_NAMES_H
 
+/*
+ * FNV-1a of the case folded (ASCII only, See RFC 4343) name. Used
+ * by the index and by whoever hashes names on the fly (See
+ * parseQuery())
+ */
+#define NAMEHASHSEED 2166136261U
+#define NAMEHASHSTEP(hash, c) \
+        (((hash) ^ (U_CHAR)((c) >= 'A' && (c) <= 'Z' ? \
+                            (c) + ('a' - 'A') : (c))) * 16777619U)
+
 enum NAMESTATUS {
         OWNER,
         TENTATIVE,
@@ -26,23 +42,28 @@ typedef struct nameNode {
         char nameStatus;
         int ptrSz;
         U_CHAR *ptr;
-        U_SHORT authOnSz;
-        U_SHORT notAuthOnSz;
-        U_CHAR authOn[MAXIFACES];
-        U_CHAR notAuthOn[MAXIFACES];
+        IFSET authOn;
+        IFSET notAuthOn;
         struct nameNode *next;
 } NAME;
 
+typedef struct nameIndex NAMEINDEX;
+
 PUBLIC NAME *nameListHead();
 PUBLIC NAME *getNameNodeByName(char *name, NAME *names);
 PUBLIC void printNames(NAME *names);
 PUBLIC void deleteNameList(NAME **names);
-PUBLIC void addAuthOn(NAME *name, int ifIndex);
-PUBLIC void delAuthOn(NAME *name, int ifIndex);
-PUBLIC void addNotAuthOn(NAME *name, int ifIndex);
-PUBLIC void delNotAuthOn(NAME *name, int ifIndex);
+PUBLIC NAME *copyNameList(NAME *names);
+PUBLIC void addAuthOn(NAME *name, int slot);
+PUBLIC void delAuthOn(NAME *name, int slot);
+PUBLIC void addNotAuthOn(NAME *name, int slot);
+PUBLIC void delNotAuthOn(NAME *name, int slot);
 PUBLIC int newName(char *name, NAME *names);
 PUBLIC int nameListSz(NAME *names);
-PUBLIC int isNotAuthOn(NAME *name, int ifIndex);
+PUBLIC int isNotAuthOn(NAME *name, int slot);
+PUBLIC NAMEINDEX *newNameIndex(NAME *names);
+PUBLIC void delNameIndex(NAMEINDEX **index);
+PUBLIC NAME *lookupName(NAMEINDEX *index, char *name, int len,
+                        unsigned int hash, int ifSlot, int *auth);
 
 #endif
@@ -3,6 +3,17 @@
  * It stores the associated ip address, interface index, *
  * name and also a variable flag which describe a set    *
  * of states regarding a network interface               *
+ * 'IFTABLE' finds the interface of an index without     *
+ * walking the list: a dense array for small indexes and *
+ * a sorted array for the big ones (i.e containers).     *
+ * It also holds a hash set with the addresses of every  *
+ * interface (reverse lookups, See hasIfAddr()). It is   *
+ * never changed once built: it is built along with      *
+ * every snapshot (See llmnr_snapshot.h)                 *
+ * The local addresses set maps every address of the     *
+ * master list to his interface. Unlike 'IFTABLE' it is  *
+ * updated in place (netlink) and only the main thread   *
+ * uses it (conflict detection, TCP front end)           *
  *********************************************************/
 
 #ifndef LLMNR_NET_INTERFACE_H
@@ -10,8 +21,6 @@
 
 #define ARECORDSZ 10 + 4
 #define AAAARECORDSZ 10 + 16
-#define PTR4RECORDSZ 30
-#define PTR6RECORDSZ 75
 #define AF_DUAL AF_INET + AF_INET6
 
 enum IF_FLAGS {
@@ -56,14 +65,12 @@ enum _IPTYPE {
 
 /*
  * Struct that holds an IPv4 associated to an interface. Also
- * holds their corresponding 'A' record. 'PTR4RECORD' will hold
- * the "in-addr.arpa" name associated with an IPv4
+ * holds their corresponding 'A' record
  */
 typedef struct netIPv4 {
         U_CHAR ipType;
         struct in_addr ip4Addr;
         U_CHAR ARECORD[ARECORDSZ];
-        char PTR4RECORD[PTR4RECORDSZ];
         struct netIPv4 *next;
 } NETIFIPV4;
 
@@ -74,28 +81,47 @@ typedef struct netIPv6 {
         U_CHAR ipType;
         struct in6_addr ip6Addr;
         U_CHAR AAAARECORD[AAAARECORDSZ];
-        char PTR6RECORD[PTR6RECORDSZ];
         struct netIPv6 *next;
 } NETIFIPV6;
 
 /*
  * Generic network interface struct
- * 'mirroIfs' arrays hold the mirror interfaces regarding
- * this interface
+ * 'slot' is the dense number of the interface (See
+ * llmnr_ifset.h) and 'mirrorIfs' the set of (the slots of)
+ * the mirror interfaces regarding this interface
  * Mirror interface: Other local network Interface that
  * operates in the same network
+ * 'answerGen' changes every time the answers given on this
+ * interface might change (See llmnr_answer_cache.h)
  */
 typedef struct netIface {
         char *name;
         int flags;
         int ifIndex;
-        U_SHORT mirrorIfSz;
-        U_CHAR mirrorIfs[MAXIFACES];
+        int slot;
+        long answerGen;
+        IFSET mirrorIfs;
         NETIFIPV4 *IPv4s;
         NETIFIPV6 *IPv6s;
         struct netIface *next;
 } NETIFACE;
 
+typedef struct ifTable IFTABLE;
+
+/*
+ * An entry of the local addresses set: 'addr' is an address of
+ * type 'ipType' (See _IPTYPE) of 'iface'. 'family' 0 means a
+ * free slot and -1 a removed entry. IPv4s only use the first
+ * 'IPV4LEN' bytes of 'addr'
+ */
+typedef struct {
+        int family;
+        int ifIndex;
+        int ipType;
+        U_CHAR addr[IPV6LEN];
+        NETIFACE *iface;
+} LOCALADDR;
+
 //PUBLIC NETIFACE *newNetIfList();
 PUBLIC NETIFACE *NetIfListHead();
 PUBLIC NETIFACE *getNetIfNodeByIndex(NETIFACE *ifaces, int ifIndex);
@@ -103,13 +129,27 @@ PUBLIC NETIFACE *getNetIfNodeByName(NETIFACE *ifaces, char *name);
 PUBLIC NETIFIPV4 *getNetIfIpv4Node(NETIFACE *iface, INADDR *ip4);
 PUBLIC NETIFIPV6 *getNetIfIpv6Node(NETIFACE *iface, IN6ADDR *ip6);
 PUBLIC void delNetIfList(NETIFACE **ifaces);
+PUBLIC NETIFACE *copyNetIfList(NETIFACE *ifaces);
 PUBLIC void remNetIfNode(char *name, NETIFACE *ifaces);
+PUBLIC void delNetIfNode(NETIFACE *iface, NETIFACE *ifaces);
 PUBLIC void remNetIfIPv4(NETIFACE *iface, INADDR *remove);
 PUBLIC void remNetIfIPv6(NETIFACE *iface, IN6ADDR *remove);
-PUBLIC void addMirrorIf(NETIFACE *iface, int ifIndex);
-PUBLIC void delMirrorIf(NETIFACE *iface, int ifIndex);
+PUBLIC void addMirrorIf(NETIFACE *iface, int slot);
+PUBLIC void delMirrorIf(NETIFACE *iface, int slot);
+PUBLIC NETIFACE *getNetIfNodeBySlot(NETIFACE *ifaces, int slot);
+PUBLIC void invalidateAnswers(NETIFACE *iface);
+PUBLIC IFTABLE *newIfTable(NETIFACE *ifaces);
+PUBLIC void delIfTable(IFTABLE **table);
+PUBLIC NETIFACE *getIfByIndex(IFTABLE *table, int ifIndex);
+PUBLIC int hasIfAddr(IFTABLE *table, int ifIndex, int family, U_CHAR *addr);
+PUBLIC int fillLocalAddrs(NETIFACE *ifaces);
+PUBLIC void freeLocalAddrs();
+PUBLIC int addLocalAddr(NETIFACE *iface, int family, void *addr);
+PUBLIC void delLocalAddr(NETIFACE *iface, int family, void *addr);
+PUBLIC LOCALADDR *getLocalAddr(int family, void *addr, int exceptIf);
 PUBLIC void printIfaces(NETIFACE *ifaces);
-PUBLIC int addNetIfNode(char *name, int family, int flags, NETIFACE *ifaces);
+PUBLIC int addNetIfNode(char *name, int ifIndex, int family, int flags,
+                        NETIFACE *ifaces);
 PUBLIC int addNetIfIPv4(INADDR *ip, NETIFACE *iface);
 PUBLIC int addNetIfIPv6(IN6ADDR *ip, NETIFACE *iface);
 PUBLIC int ip6Type(IN6ADDR *ip);
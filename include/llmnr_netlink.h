@@ -0,0 +1,65 @@
+/** **********************************************************
+ * rtnetlink subsystem: kernel view of the network links     *
+ * (interfaces). At startup a RTM_GETLINK and a RTM_GETADDR  *
+ * dump fill the links table, then the notifications of the  *
+ * link and address groups (RTMGRP_LINK, RTMGRP_IPV4_IFADDR  *
+ * and RTMGRP_IPV6_IFADDR) keep it up to date: name, flags   *
+ * (IFF_UP, IFF_RUNNING, IFF_LOOPBACK...) and the addresses  *
+ * of every family. Lookups (index, name, addresses...) are  *
+ * answered from memory: no syscall nor file parsing.        *
+ * Notifications are read in bursts (See readNetlink()) and  *
+ * only mark the links they change; the owner applies the    *
+ * final state of every changed link at once (See            *
+ * commitNetlink()), so a link that flaps or gets hundreds   *
+ * of addresses is handled one time. If notifications were   *
+ * lost the table is rebuilt from a new dump. Only the main  *
+ * thread uses it                                            *
+ * Note: <net/if.h> must be included before this file        *
+ *************************************************************/
+
+#ifndef LLMNR_NETLINK_H
+#define LLMNR_NETLINK_H
+
+/*
+ * An address of a link. IPv4s only use the first 'IPV4LEN' bytes
+ * of 'addr'
+ */
+typedef struct nlAddr {
+        U_CHAR addr[IPV6LEN];
+        struct nlAddr *next;
+} NLADDR;
+
+/*
+ * A link. 'flags' are the kernel ones (See net/if.h), 'addrs4'
+ * and 'addrs6' the addresses of each family. 'changed' means
+ * not commited yet and 'gone' that the link was removed (it has
+ * no flags nor addresses and is freed once commited)
+ */
+typedef struct nlLink {
+        int ifIndex;
+        int changed;
+        int gone;
+        unsigned int flags;
+        char name[IFNAMSIZ];
+        NLADDR *addrs4;
+        NLADDR *addrs6;
+        struct nlLink *next;
+} NLLINK;
+
+/*
+ * Called on commit for every changed link
+ */
+typedef void (*nlapply)(NLLINK *link);
+
+PUBLIC int openNetlink();
+PUBLIC int netlinkSocket();
+PUBLIC int readNetlink(int fd);
+PUBLIC void commitNetlink(nlapply apply);
+PUBLIC void freeLinks();
+PUBLIC NLLINK *getLinks();
+PUBLIC NLLINK *getLink(int ifIndex);
+PUBLIC NLLINK *getLinkByName(char *name);
+PUBLIC int linkIndex(char *name);
+PUBLIC int linkHasAddr(NLLINK *link, int family, void *addr);
+
+#endif
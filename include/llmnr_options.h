@@ -0,0 +1,37 @@
+/** ****************************************************************
+ * Interface to hold the daemon tunable options. Every option has  *
+ * a default value and can be overwritten from the config file     *
+ * using the form: <option name> <integer value>                   *
+ * (i.e: "workers 8"). Values out of range are rejected            *
+ *******************************************************************/
+
+#ifndef LLMNR_OPTIONS_H
+#define LLMNR_OPTIONS_H
+
+enum OPTIONS {
+        OPT_WORKERS,
+        OPT_QUEUESZ,
+        OPT_RECVBATCH,
+        OPT_SENDBATCH,
+        OPT_SENDBUDGET,
+        OPT_SHARDS,
+        OPT_SHARDCPUS,
+        OPT_SHARDSTEER,
+        OPT_ANSWERCACHE,
+        OPT_KERNELFILTER,
+        OPT_TCPBACKLOG,
+        OPT_TCPCLIENTS,
+        OPT_TCPIDLE,
+        OPT_TCPLIFETIME,
+        OPT_EDNSPAYLOAD,
+        OPT_NLBATCH,
+        OPT_IFACESOCKS,
+        OPTIONSZ
+};
+
+PUBLIC long getOption(int option);
+PUBLIC int isOption(char *name);
+PUBLIC int setOption(char *name, char *value);
+PUBLIC void printOptions();
+
+#endif
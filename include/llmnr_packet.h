@@ -6,31 +6,83 @@
 #define LLMNR_PACKET_H
 //#include "llmnr_defs.h"
 
+/*
+ * Masks of the header flags (second 16 bit word, host order)
+ */
+#define HFLAG_QR 0x8000
+#define HFLAG_OPCODE 0x7800
+#define HFLAG_C 0x0400
+#define HFLAG_TC 0x0200
+#define HFLAG_T 0x0100
+#define HFLAG_Z0 0x0080
+#define HFLAG_Z1 0x0040
+#define HFLAG_Z2 0x0020
+#define HFLAG_Z3 0x0010
+#define HFLAG_RCODE 0x000F
+
+/*
+ * EDNS0 (RFC 6891). The OPT record we attach is always the same
+ * size: root name, TYPE, CLASS (payload size), TTL (extended
+ * RCODE, version and flags) and an empty RDATA
+ */
+#define OPTRECORDSZ 11
+#define EDNSMINSZ 512
+#define EDNSVERSION 0
+#define EDNSBADVERS 1
+#define EDNSFLAG_DO 0x8000
+
+/*
+ * Names (label starts) of an answer that can be pointed to
+ * (See 'COMPTABLE')
+ */
+#define MAXCOMPLABELS 64
+
 /* Enums & Structs */
+
+/*
+ * 'FLAGS' is the second 16 bit word of the header as is (host
+ * order). Use the HFLAG_* masks to read or set the flags
+ */
 typedef struct {
         unsigned short ID;
-        unsigned char QR;
-        unsigned char OPCODE;
-        unsigned char C;
-        unsigned char TC;
-        unsigned char T;
-        unsigned char Z0;
-        unsigned char Z1;
-        unsigned char Z2;
-        unsigned char Z3;
-        unsigned char RCODE;
+        unsigned short FLAGS;
         unsigned short QDCOUNT;
         unsigned short ANCOUNT;
         unsigned short NSCOUNT;
         unsigned short ARCOUNT;
 } HEADER;
 
+/*
+ * 'nameLen' is the QNAME size (trailing zero included) and
+ * 'nameHash' the hash of the case folded QNAME (See
+ * parseQuery() and lookupName())
+ * 'udpSize' is the payload size advertised by the OPT record
+ * of the query (never under 'EDNSMINSZ'), 0 when there is no
+ * OPT record. 'ednsVersion' and 'ednsFlags' come from the same
+ * record
+ */
 typedef struct {
         char *QNAME;
+        int nameLen;
+        unsigned int nameHash;
+        U_SHORT udpSize;
+        U_SHORT ednsFlags;
+        U_CHAR ednsVersion;
         unsigned short QTYPE;
         unsigned short QCLASS;
 } QUERY;
 
+/*
+ * Compression table of the answer being built: offsets of every
+ * label written uncompressed so far (the QNAME first). A name in
+ * the RDATA of a record is written up to his longest suffix
+ * found here, then a pointer (See attachRecord())
+ */
+typedef struct {
+        int count;
+        U_SHORT offsets[MAXCOMPLABELS];
+} COMPTABLE;
+
 typedef struct {
         int fd;
         int pktSz;
@@ -41,15 +93,22 @@ typedef struct {
 
 /*
  * struct to synthetize a list of function parameters
+ * 'iface' is the interface that received the query ('rcvIface'),
+ * resolved once by the caller, as 'hosted' (the QNAME in the
+ * registry, NULL if not hosted, See llmnr_registry.h). 'cTable'
+ * is set by attachAnswer()
  */
 typedef struct {
         HEADER *head;
         QUERY *query;
         int ipType;
         int rcvIface;
+        NETIFACE *iface;
+        HOSTED *hosted;
         U_CHAR *pktBuff;
         U_SHORT pktBuffSz;
         U_SHORT *namePtr;
+        COMPTABLE *cTable;
 } PKTPARAMS;
 
 /*
@@ -63,11 +122,16 @@ typedef struct {
 
 PUBLIC void printHead(HEADER *head);
 PUBLIC void getHeader(U_CHAR *buffer, HEADER *head);
-PUBLIC void getQuery(U_CHAR *buffer, QUERY *query);
+PUBLIC int parseQuery(U_CHAR *buffer, int bufferSz, HEADER *head,
+                      QUERY *query);
 PUBLIC int attachHeader(HEADER *header, U_CHAR *pktBuff);
 PUBLIC int attachQuery(QUERY *query, U_CHAR *pktBuff);
 PUBLIC int attachAnswer(PKTPARAMS *params, DSTRUCTURE *dsts);
+PUBLIC int attachBadVersion(PKTPARAMS *params);
+PUBLIC int attachOptRecord(U_CHAR *pktBuff, int pktSz, QUERY *query,
+                           int maxPayload);
+PUBLIC int answerBufferSz(QUERY *query, int maxPayload);
 PUBLIC int sendUDPacket(PKTSND *pktSnd);
-PUBLIC int sendTCPacket(PKTSND *pktSnd);
+PUBLIC int sendUDPBatch(PKTSND *pkts, int count);
 
 #endif
@@ -0,0 +1,35 @@
+/** **************************************************************
+ * Receive path prefilter. Most of the queries seen on a link    *
+ * are for the names of other hosts, so before a query is queued *
+ * to the workers (or answered by a shard) the receiving thread  *
+ * checks it without allocating anything:                        *
+ * - The header must be the one of a standard query              *
+ * - The QNAME must be well formed (See parseQuery())            *
+ * - The QNAME must be in the filter: a bloom filter (and the    *
+ *   set of lengths) of the owned names, of the hosted names     *
+ *   (See llmnr_registry.h) and of the "PTR names" of every      *
+ *   address of every interface                                 *
+ * False positives are harmless (the workers do the real         *
+ * lookup). The filter is never changed once built: it is       *
+ * built along with every snapshot, so it follows the name and   *
+ * address changes (See llmnr_snapshot.h)                        *
+ *****************************************************************/
+
+#ifndef LLMNR_QUERY_FILTER_H
+#define LLMNR_QUERY_FILTER_H
+
+enum QFILTER_RESULT {
+        QF_PASS,
+        QF_HEADER,
+        QF_QNAME,
+        QF_NOTOURS
+};
+
+typedef struct queryFilter QFILTER;
+
+PUBLIC QFILTER *newQueryFilter(NAME *names, NETIFACE *ifaces,
+                               REGISTRY *registry);
+PUBLIC void delQueryFilter(QFILTER **filter);
+PUBLIC int filterQuery(QFILTER *filter, U_CHAR *buffer, int bufferSz);
+
+#endif
@@ -0,0 +1,27 @@
+/** **************************************************************
+ * Interface to the daemon event loop (epoll based). Every       *
+ * descriptor is registered along with the handler that is       *
+ * called when the descriptor is ready, so there is no linear    *
+ * scan per wakeup. Timers are timerfd descriptors registered    *
+ * the same way (their expiration count is read before calling   *
+ * the handler).                                                 *
+ * The loop runs only in the main thread (handlers may add or    *
+ * remove descriptors, even their own)                           *
+ *****************************************************************/
+
+#ifndef LLMNR_REACTOR_H
+#define LLMNR_REACTOR_H
+
+typedef void (*evhandler)(int fd, unsigned int events, void *data);
+
+PUBLIC int newReactor();
+PUBLIC void closeReactor();
+PUBLIC int runReactor(int timeout);
+PUBLIC int addHandler(int fd, unsigned int events, evhandler handler,
+                      void *data);
+PUBLIC int modHandler(int fd, unsigned int events);
+PUBLIC int delHandler(int fd);
+PUBLIC int newTimer(evhandler handler, void *data);
+PUBLIC int armTimer(int fd, long ms);
+
+#endif
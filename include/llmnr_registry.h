@@ -0,0 +1,46 @@
+/** **************************************************************
+ * Registry of the hosted names. Besides his own hostnames (See  *
+ * llmnr_names.h) the daemon answers for the names listed in the *
+ * hosts file, one record per line:                             *
+ *   <name> a <IPv4>                                             *
+ *   <name> aaaa <IPv6>                                          *
+ *   <name> txt <text>                                           *
+ *   <name> srv <priority> <weight> <port> <target>              *
+ *   <name> mx <preference> <exchange>                           *
+ * Every name holds a bucket per record type: his records of     *
+ * that type serialized back to back the way they go in an       *
+ * answer (pointer to the QNAME, 'TYPE', 'CLASS', 'TTL',         *
+ * 'RDLENGTH' and 'RDATA'), and the buckets of a name are        *
+ * contiguous, so attaching them is a single copy. Names are     *
+ * looked up in a case folded hash index with the hash that      *
+ * parseQuery() already computed (See NAMEHASHSTEP): the cost    *
+ * does not depend on how many names are hosted.                 *
+ * A bucket replaces the records of his type the name would have *
+ * otherwise (the ips of the receiving interface, the records of *
+ * the config file). Hosted names are answered on every          *
+ * interface and never probed (See llmnr_conflict.h): they are   *
+ * meant for names nobody else on the link hands out.            *
+ * A registry is never changed once built. The file is loaded    *
+ * again (on 'SIGHUP') into a new one, published along with the  *
+ * next snapshot (See llmnr_snapshot.h). Every snapshot holds a  *
+ * reference, the last one gone frees it                         *
+ *****************************************************************/
+
+#ifndef LLMNR_REGISTRY_H
+#define LLMNR_REGISTRY_H
+
+typedef struct registry REGISTRY;
+typedef struct hosted HOSTED;
+
+PUBLIC int loadRegistry(char *filePath, REGISTRY **registry);
+PUBLIC REGISTRY *holdRegistry(REGISTRY *registry);
+PUBLIC void dropRegistry(REGISTRY **registry);
+PUBLIC HOSTED *lookupHosted(REGISTRY *registry, char *name, int len,
+                            unsigned int hash);
+PUBLIC int registrySz(REGISTRY *registry);
+PUBLIC char *hostedName(REGISTRY *registry, int i, int *len);
+PUBLIC U_CHAR *hostedRecords(HOSTED *hosted, U_SHORT type, int *count,
+                             int *len);
+PUBLIC void printRegistry(REGISTRY *registry);
+
+#endif
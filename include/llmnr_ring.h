@@ -0,0 +1,35 @@
+/** **************************************************************
+ * Bounded lock-free MPMC (multiple producers, multiple          *
+ * consumers) ring of pointers. Every cell carries a sequence    *
+ * number, so producers and consumers only contend on their own  *
+ * position counter (See D. Vyukov bounded MPMC queue).          *
+ * The ring never blocks: ringPush() fails when the ring is full *
+ * and ringPop() returns NULL when the ring is empty             *
+ *****************************************************************/
+
+#ifndef LLMNR_RING_H
+#define LLMNR_RING_H
+
+typedef struct {
+        unsigned long seq;
+        void *data;
+} RINGCELL;
+
+typedef struct {
+        unsigned long mask;
+        RINGCELL *cells;
+        char pad0[64];
+        unsigned long head;
+        char pad1[64];
+        unsigned long tail;
+        char pad2[64];
+} RING;
+
+PUBLIC RING *newRing(unsigned long size);
+PUBLIC void deleteRing(RING **ring);
+PUBLIC int ringPush(RING *ring, void *data);
+PUBLIC void *ringPop(RING *ring);
+PUBLIC unsigned long ringCount(RING *ring);
+PUBLIC unsigned long ringSize(RING *ring);
+
+#endif
@@ -8,7 +8,9 @@
  * respectively. 'PTR' records will be hold into 'ptr' (See      *
  * llmnr_names.h)                                                *
  * Build and store (in their respective buffer) all types        *
- * of resource records and "PTR names" (reverse lookup)          *
+ * of resource records. "PTR names" (reverse lookup) are not     *
+ * stored: they are decoded into the address they point to       *
+ * (See ptrNameToAddr())                                         *
  *****************************************************************/
 
 #ifndef LLMNR_RR_H
@@ -16,6 +18,7 @@
 
 #define RRTTL 30
 #define INCLASS 1
+#define PTRNAMEMAX 74
 
 enum RRTYPE {
         NONE = 0,
@@ -29,6 +32,7 @@ enum RRTYPE {
         TXT = 16,
         AAAA = 28,
         SRV = 33,
+        OPT = 41,
         ANY = 255
 };
 
@@ -109,8 +113,10 @@ typedef struct {
 PUBLIC RRLIST *rrListHead();
 PUBLIC void printRList(RRLIST *list);
 PUBLIC void fillPtrRecord(NAME *names);
-PUBLIC void buildARecord(INADDR *ipv4, U_CHAR *aRec, char *ptrRec);
-PUBLIC void buildAAAARecord(IN6ADDR *ipv6, U_CHAR *aaaaRec, char *ptrRec);
+PUBLIC void buildARecord(INADDR *ipv4, U_CHAR *aRec);
+PUBLIC void buildAAAARecord(IN6ADDR *ipv6, U_CHAR *aaaaRec);
+PUBLIC int ptrNameToAddr(char *name, int *family, U_CHAR *addr);
+PUBLIC int addrToPtrName(int family, U_CHAR *addr, char *name);
 PUBLIC void getType(int type, char *buff);
 PUBLIC int newResRecord(RRLIST *list, RESRECORD *resRec);
 PUBLIC int deleteRList(RRLIST **list);
@@ -0,0 +1,42 @@
+/** **************************************************************
+ * Sharded UDP mode. Instead of one socket per family polled by  *
+ * the main thread, K 'SO_REUSEPORT' sockets per family are      *
+ * opened and every pair is owned by a shard thread, pinned to   *
+ * one CPU of the configured set, that receives and answers by   *
+ * itself (the worker pool only provides the client slots).      *
+ * Multicast queries are sharded by interface: the LLMNR groups  *
+ * of an interface are joined on the sockets of the shard        *
+ * 'ifIndex % K' only (See getShardSocket()). Unicast queries    *
+ * are spread by the kernel: 4-tuple hash, SO_INCOMING_CPU or a  *
+ * reuseport cBPF program steering by the receiving CPU          *
+ * With per interface sockets (See llmnr_iface_socks.h) the      *
+ * shard sockets join no group (unicast queries only) and the    *
+ * shard 'ifIndex % K' also polls the sockets of the interface   *
+ * 'ifIndex' (See addShardSocket())                              *
+ *****************************************************************/
+
+#ifndef LLMNR_SHARDS_H
+#define LLMNR_SHARDS_H
+
+enum STEERING {
+        STEER_HASH,
+        STEER_INCOMING_CPU,
+        STEER_CBPF
+};
+
+/*
+ * Called for every received query. SUCCESS means answer it
+ */
+typedef int (*shardfilter)(UDPCLIENT *client);
+
+PUBLIC int startShards(int shards, long cpuMask, int steering, int rcvBatch,
+                       int perIface, shardfilter filter);
+PUBLIC void stopShards();
+PUBLIC int shardsRunning();
+PUBLIC int getShardSocket(int family, int ifIndex);
+PUBLIC int addShardSocket(int fd, int ifIndex);
+PUBLIC void delShardSocket(int fd, int ifIndex);
+PUBLIC void attachShardsFilter();
+PUBLIC void printShardStats();
+
+#endif
@@ -6,8 +6,8 @@
 #define LLMNR_SIGNALS_H
 
 typedef void (*sighandler)(int);
-PUBLIC void sendSignal(const pthread_t tid);
 PUBLIC void handleSignals();
-PUBLIC void handleSpecSignals(int signo, sighandler funcHandler);
+PUBLIC int createSignalFd();
+PUBLIC int readSignalFd(int fd);
 
 #endif
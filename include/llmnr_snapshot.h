@@ -0,0 +1,43 @@
+/** **************************************************************
+ * Read-mostly snapshots of the data structures ('NAME',         *
+ * 'NETIFACE' and 'RRLIST') used to answer queries.              *
+ * The master lists are only changed by the writers (netlink     *
+ * handler and cdar threads), which publish an immutable copy    *
+ * of them once they are done (See publishSnapshot()). Readers   *
+ * (the threads answering queries) never lock: they enter a      *
+ * read section, use the current snapshot and leave it.          *
+ * Old snapshots are freed by epoch: a retired snapshot is       *
+ * freed once every reader that could have seen it left his      *
+ * read section                                                  *
+ * Every snapshot also holds the hash index of his names, the    *
+ * index table of his interfaces and the receive path prefilter  *
+ * (See 'NAMEINDEX', 'IFTABLE' and 'QFILTER')                    *
+ * Note: 'RRLIST' is never changed after start up, so every      *
+ * snapshot shares the master list. The registry of the hosted   *
+ * names is never changed either (it is replaced), every         *
+ * snapshot holds a reference to his (See 'REGISTRY')            *
+ *****************************************************************/
+
+#ifndef LLMNR_SNAPSHOT_H
+#define LLMNR_SNAPSHOT_H
+
+typedef struct snapshot {
+        NAME *names;
+        NAMEINDEX *nameIndex;
+        NETIFACE *ifaces;
+        IFTABLE *ifTable;
+        QFILTER *qFilter;
+        RRLIST *rList;
+        REGISTRY *registry;
+        long epoch;
+        struct snapshot *next;
+} SNAPSHOT;
+
+PUBLIC int publishSnapshot(NAME *names, NETIFACE *ifaces, RRLIST *rList,
+                           REGISTRY *registry);
+PUBLIC SNAPSHOT *enterSnapshot();
+PUBLIC void exitSnapshot();
+PUBLIC void freeSnapshots();
+PUBLIC void printSnapshotStats();
+
+#endif
@@ -11,8 +11,11 @@ typedef struct {
         int socket;
         int iptype;
         int recviface;
+        int rcvSz;
+        int delay;
+        int sndSz;
         SA_STORAGE from;
-        U_CHAR sndPkt[SNDBUFSZ];
+        U_CHAR sndPkt[EDNSBUFSZ];
         U_CHAR ancBuffer[ANCBUFSZ];
         U_CHAR rcvBuffer[RCVBUFSZ];
         struct in_pktinfo *pktinfo4;
@@ -24,20 +27,22 @@ typedef struct {
         int ipType;
         int recvIface;
         SA_IN6 from;
-        U_CHAR sndPkt[TCPBUFFSZ];
-        U_CHAR rcvBuffer[RCVBUFSZ];
 } TCPCLIENT;
 
 PUBLIC int createNetLinkSocket();
-PUBLIC int createUdpSocket(int family);
-PUBLIC int createTcpSock();
-PUBLIC int createC4Sock(INADDR *ip);
+PUBLIC int createUdpSocket(int family, int unicast);
+PUBLIC int createShardSocket(int family, int unicast);
+PUBLIC int createIfaceSocket(int family, int ifIndex);
+PUBLIC int createTcpSock(int backlog);
+PUBLIC int createC4Sock(int ifIndex);
 PUBLIC int createC6Sock(int ifIndex);
 PUBLIC int getPktInfo(int family, struct msghdr *msg, UDPCLIENT *client);
+PUBLIC int recvUdpBatch(int fd, UDPCLIENT **clients, int count, int ifIndex);
 PUBLIC int __getPktInfo(int family, void *ip, struct msghdr *msg);
-PUBLIC void joinMcastGroup(POLLFD *polling, NETIFACE *iface);
-PUBLIC void leaveMcastGroup(POLLFD *polling, NETIFACE *iface, INADDR *copy);
-PUBLIC void getTcpPktInfo(SA_IN6 *name, TCPCLIENT *client, NETIFACE *ifaces);
+PUBLIC void joinMcastGroup(int sock4, int sock6, NETIFACE *iface);
+PUBLIC void leaveMcastGroup(int sock4, int sock6, NETIFACE *iface,
+                            INADDR *copy);
+PUBLIC void getTcpPktInfo(SA_IN6 *name, TCPCLIENT *client);
 PUBLIC void fillMcastVars();
 
 #endif
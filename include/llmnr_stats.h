@@ -0,0 +1,47 @@
+/** *************************************************************
+ * Interface to keep the daemon counters. Counters are updated  *
+ * from several threads at the same time so every update is     *
+ * atomic. Counters are printed along with the debug info       *
+ * (See 'SIGUSR2' in llmnr_responder_s2.c)                      *
+ ****************************************************************/
+
+#ifndef LLMNR_STATS_H
+#define LLMNR_STATS_H
+
+enum STATS {
+        STAT_UDPRCVD,
+        STAT_UDPBATCHES,
+        STAT_UDPQUEUED,
+        STAT_UDPDROPFULL,
+        STAT_UDPQUEUEMAX,
+        STAT_UDPSENT,
+        STAT_UDPSNDBATCHES,
+        STAT_UDPDELAYED,
+        STAT_CACHEHITS,
+        STAT_CACHEMISSES,
+        STAT_DROPIFACE,
+        STAT_DROPHEADER,
+        STAT_DROPQNAME,
+        STAT_DROPNOTOURS,
+        STAT_TCPACCEPTED,
+        STAT_TCPREFUSED,
+        STAT_TCPQUERIES,
+        STAT_TCPTIMEOUTS,
+        STAT_EDNSQUERIES,
+        STAT_EDNSSAVED,
+        STAT_UDPTRUNCATED,
+        STAT_TCPFALLBACKS,
+        STAT_NLMESSAGES,
+        STAT_NLBATCHES,
+        STAT_NLRESYNCS,
+        STAT_HOSTEDQUERIES,
+        STATSZ
+};
+
+PUBLIC void incStat(int stat);
+PUBLIC void addStat(int stat, long value);
+PUBLIC void maxStat(int stat, long value);
+PUBLIC long getStat(int stat);
+PUBLIC void printStats();
+
+#endif
@@ -23,11 +23,12 @@ enum LLMNRERROR {
         ECREATECONFFILE,
         ECREATEPIDFILE,
         EWRITECONFFILE,
-        EGETIFADDRS,
-        EPOLLERR,
+        EIFDUMP,
+        ESOCKPOLL,
         ESOCKERR,
         ESYSFAIL1,
         ESYSFAIL2,
+        ENOMEMORY,
         FORCED_EXIT,
         LOGCONFLICT
 };
@@ -0,0 +1,42 @@
+/** **************************************************************
+ * Event-driven TCP front end. The listening socket and every    *
+ * connection are non-blocking and handled by the event loop     *
+ * (See llmnr_reactor.h), one state machine per connection:      *
+ * - Queries are framed by their 2 byte length (RFC 4795 section *
+ *   2.5, as DNS over TCP) and may be pipelined: every complete  *
+ *   query in the input buffer is answered, in order             *
+ * - Partial reads are kept until the query is complete and      *
+ *   partial writes until the socket is writable again. While    *
+ *   the output buffer can't hold another answer the connection  *
+ *   is not read (backpressure)                                  *
+ * - A connection idle for 'tcp_idle' milliseconds, or open for  *
+ *   'tcp_lifetime' milliseconds, is closed. Connections over    *
+ *   'tcp_clients' are refused                                   *
+ * No thread is ever parked on a peer: the answers are built in  *
+ * the event loop thread, from the current snapshot              *
+ *****************************************************************/
+
+#ifndef LLMNR_TCP_H
+#define LLMNR_TCP_H
+
+/*
+ * Called for every accepted connection, fills the receiving
+ * interface (and ip type) of 'client'. SUCCESS means keep it
+ */
+typedef int (*tcpaccept)(TCPCLIENT *client);
+
+/*
+ * Called for every query ('querySz' bytes, no length prefix)
+ * Returns the size of the answer wrote in 'answer' ('answerSz'
+ * bytes at most), 0 if nothing must be sent
+ */
+typedef int (*tcpanswer)(TCPCLIENT *client, U_CHAR *query, int querySz,
+                         U_CHAR *answer, int answerSz);
+
+PUBLIC int startTcp(int maxClients, long idleMs, long lifeMs,
+                    tcpaccept accept, tcpanswer answer);
+PUBLIC void stopTcp();
+PUBLIC void acceptTcpClients(int fd);
+PUBLIC void printTcpStats();
+
+#endif
@@ -0,0 +1,22 @@
+/** **************************************************************
+ * Hashed timer wheel with millisecond resolution. Used to       *
+ * delay work (i.e the RFC 4795 jitter before sending an answer) *
+ * without parking the calling thread: the work is queued along  *
+ * with his deadline and the thread moves on.                    *
+ * Timers can be added from any thread. Callbacks are called by  *
+ * the main thread (the wheel is driven by a timerfd registered  *
+ * in the event loop, See llmnr_reactor.h), so they must be      *
+ * short and never block                                         *
+ *****************************************************************/
+
+#ifndef LLMNR_TIMER_WHEEL_H
+#define LLMNR_TIMER_WHEEL_H
+
+typedef void (*timercb)(void *data);
+
+PUBLIC int startTimerWheel();
+PUBLIC void stopTimerWheel();
+PUBLIC int addTimer(long ms, timercb callback, void *data);
+PUBLIC int pendingTimers();
+
+#endif
@@ -0,0 +1,38 @@
+/** ***************************************************************
+ * Fixed pool of worker threads answering UDP queries. The pool   *
+ * preallocates 'queue_size' client slots ('UDPCLIENT') that are  *
+ * handed around through two lock-free rings:                     *
+ * - A free ring holding the slots ready to receive a packet      *
+ * - A work ring holding the slots waiting to be answered         *
+ * The receiving thread takes a free slot, fills it and enqueues  *
+ * it. A worker pops it and calls the pool handler, which returns *
+ * the size of the answer left in the slot (0 if none).           *
+ * Answers are held by the worker (along with their slots) and    *
+ * flushed together with sendmmsg() when the work ring runs dry,  *
+ * when 'send_batch' answers are held or when the oldest one has  *
+ * waited 'send_budget' microseconds. The worker gives the slots  *
+ * back once they are sent. Answers that must wait the RFC 4795   *
+ * jitter are handed to the timer wheel instead (See              *
+ * llmnr_timer_wheel.h).                                          *
+ * When no free slot is left the query is dropped (and counted)   *
+ * A pool started with no workers only holds the slots: the       *
+ * receiving threads answer with answerInline() (See              *
+ * llmnr_shards.h)                                                *
+ ******************************************************************/
+
+#ifndef LLMNR_WORKER_POOL_H
+#define LLMNR_WORKER_POOL_H
+
+typedef int (*poolhandler)(UDPCLIENT *client);
+
+PUBLIC int startPool(int workers, int queueSz, int sndBatch, int sndBudget,
+                     poolhandler handler);
+PUBLIC void stopPool();
+PUBLIC void releasePoolSlot(UDPCLIENT *client);
+PUBLIC void printPoolStats();
+PUBLIC int enqueueClient(UDPCLIENT *client);
+PUBLIC int receiveClients(int fd, UDPCLIENT **clients, int max, int ifIndex);
+PUBLIC void answerInline(UDPCLIENT **clients, int count);
+PUBLIC UDPCLIENT *getPoolSlot();
+
+#endif
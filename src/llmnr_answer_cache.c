@@ -0,0 +1,228 @@
+/* Macros */
+#define CACHEPKTSZ EDNSBUFSZ
+#define FNVPRIME 16777619U
+
+/* Includes */
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+
+/* Own includes */
+#include "../include/llmnr_defs.h"
+#include "../include/llmnr_ifset.h"
+#include "../include/llmnr_names.h"
+#include "../include/llmnr_net_interface.h"
+#include "../include/llmnr_rr.h"
+#include "../include/llmnr_registry.h"
+#include "../include/llmnr_packet.h"
+#include "../include/llmnr_stats.h"
+#include "../include/llmnr_answer_cache.h"
+
+/* Enums & Structs */
+
+/*
+ * A cached answer. 'seq' is odd while the entry is being
+ * written. 'flags' are the answer flags without 'T' (which
+ * depends on the name status, See checkName())
+ */
+typedef struct {
+        unsigned int seq;
+        long answerGen;
+        int ifIndex;
+        int pktSz;
+        U_SHORT ipType;
+        U_SHORT qType;
+        U_SHORT qClass;
+        U_SHORT bufSz;
+        U_SHORT nameLen;
+        U_SHORT flags;
+        U_CHAR pkt[CACHEPKTSZ];
+} ANSWERENTRY;
+
+/* Private prototypes */
+PRIVATE int isCacheable(HEADER *head);
+PRIVATE int getAnswer(ANSWERENTRY *entry, PKTPARAMS *params, long answerGen,
+                      int nameLen);
+PRIVATE void putAnswer(ANSWERENTRY *entry, PKTPARAMS *params, long answerGen,
+                       int nameLen, U_SHORT qType, int pktSz);
+PRIVATE int sameKey(ANSWERENTRY *entry, PKTPARAMS *params, long answerGen,
+                    int nameLen, U_SHORT qType);
+PRIVATE unsigned int hashKey(PKTPARAMS *params, int nameLen);
+
+/* Glocal variables */
+PRIVATE unsigned int CacheMask;
+PRIVATE ANSWERENTRY *Cache;
+
+/* Functions definitions */
+PUBLIC int startAnswerCache(int size)
+{
+    /*
+     * Allocate 'size' entries (rounded up to a power of two)
+     * 0 disables the cache
+     */
+        unsigned int entries;
+
+        if (size <= 0)
+                return SUCCESS;
+        for (entries = 1; entries < (unsigned int)size; entries <<= 1)
+                ;
+        Cache = calloc(entries,sizeof(ANSWERENTRY));
+        if (Cache == NULL)
+                return FAILURE;
+        CacheMask = entries - 1;
+        return SUCCESS;
+}
+
+PUBLIC void stopAnswerCache()
+{
+        if (Cache != NULL)
+                free(Cache);
+        Cache = NULL;
+        CacheMask = 0;
+}
+
+PUBLIC int attachCachedAnswer(PKTPARAMS *params, DSTRUCTURE *dsts)
+{
+    /*
+     * Same thing that does attachAnswer() but first looks for the
+     * answer in the cache. On a miss the answer is built and
+     * cached. Queries with flags that are echoed back (other than
+     * the ones we set) skip the cache
+     * Returns the number of bytes wrote into the buffer
+     */
+        int nameLen, pktSz;
+        long answerGen;
+        U_SHORT qType;
+        ANSWERENTRY *entry;
+
+        if (Cache == NULL || !isCacheable(params->head))
+                return attachAnswer(params,dsts);
+        nameLen = params->query->nameLen;
+        qType = params->query->QTYPE;
+        answerGen = params->iface->answerGen;
+        entry = &Cache[hashKey(params,nameLen) & CacheMask];
+        pktSz = getAnswer(entry,params,answerGen,nameLen);
+        if (pktSz > 0) {
+                incStat(STAT_CACHEHITS);
+                return pktSz;
+        }
+        incStat(STAT_CACHEMISSES);
+        pktSz = attachAnswer(params,dsts);
+        putAnswer(entry,params,answerGen,nameLen,qType,pktSz);
+        return pktSz;
+}
+
+PRIVATE int isCacheable(HEADER *head)
+{
+        return !(head->FLAGS & (HFLAG_OPCODE | HFLAG_C | HFLAG_TC |
+                                HFLAG_Z0 | HFLAG_Z1 | HFLAG_Z2 |
+                                HFLAG_Z3 | HFLAG_RCODE));
+}
+
+PRIVATE int getAnswer(ANSWERENTRY *entry, PKTPARAMS *params, long answerGen,
+                      int nameLen)
+{
+    /*
+     * Copy the cached answer into the packet buffer and patch
+     * ID and flags. The entry is read without locking: if it was
+     * written meanwhile ('seq' changed) it is a miss
+     * Returns the answer size (0 on a miss)
+     */
+        int pktSz;
+        unsigned int seq;
+        U_SHORT value;
+
+        seq = __atomic_load_n(&entry->seq,__ATOMIC_ACQUIRE);
+        if (seq & 1)
+                return 0;
+        if (sameKey(entry,params,answerGen,nameLen,params->query->QTYPE))
+                return 0;
+        pktSz = entry->pktSz;
+        if (pktSz <= HEADSZ || pktSz > CACHEPKTSZ ||
+            pktSz > params->pktBuffSz)
+                return 0;
+        memcpy(params->pktBuff,entry->pkt,pktSz);
+        value = entry->flags;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&entry->seq,__ATOMIC_RELAXED) != seq)
+                return 0;
+        if (params->head->FLAGS & HFLAG_T)
+                value |= HFLAG_T;
+        value = htons(value);
+        memcpy(params->pktBuff + sizeof(U_SHORT),&value,sizeof(U_SHORT));
+        value = htons(params->head->ID);
+        memcpy(params->pktBuff,&value,sizeof(U_SHORT));
+        return pktSz;
+}
+
+PRIVATE void putAnswer(ANSWERENTRY *entry, PKTPARAMS *params, long answerGen,
+                       int nameLen, U_SHORT qType, int pktSz)
+{
+    /*
+     * Store a freshly built answer. If another thread is
+     * writing the entry this answer is just not cached
+     */
+        unsigned int seq;
+        U_SHORT flags;
+
+        if (pktSz <= HEADSZ || pktSz > CACHEPKTSZ)
+                return;
+        seq = __atomic_load_n(&entry->seq,__ATOMIC_RELAXED);
+        if (seq & 1)
+                return;
+        if (!__atomic_compare_exchange_n(&entry->seq,&seq,seq + 1,0,
+                                         __ATOMIC_ACQUIRE,__ATOMIC_RELAXED))
+                return;
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        memcpy(&flags,params->pktBuff + sizeof(U_SHORT),sizeof(U_SHORT));
+        entry->flags = ntohs(flags) & ~HFLAG_T;
+        entry->answerGen = answerGen;
+        entry->ifIndex = params->rcvIface;
+        entry->ipType = params->ipType;
+        entry->qType = qType;
+        entry->qClass = params->query->QCLASS;
+        entry->bufSz = params->pktBuffSz;
+        entry->nameLen = nameLen;
+        entry->pktSz = pktSz;
+        memcpy(entry->pkt,params->pktBuff,pktSz);
+        __atomic_store_n(&entry->seq,seq + 2,__ATOMIC_RELEASE);
+}
+
+PRIVATE int sameKey(ANSWERENTRY *entry, PKTPARAMS *params, long answerGen,
+                    int nameLen, U_SHORT qType)
+{
+    /*
+     * The QNAME is compared with the question of the cached
+     * packet (the answers point to it)
+     */
+        if (entry->answerGen != answerGen ||
+            entry->ifIndex != params->rcvIface ||
+            entry->ipType != params->ipType || entry->qType != qType ||
+            entry->qClass != params->query->QCLASS ||
+            entry->bufSz != params->pktBuffSz || entry->nameLen != nameLen)
+                return FAILURE;
+        if (HEADSZ + nameLen > CACHEPKTSZ)
+                return FAILURE;
+        if (memcmp(entry->pkt + HEADSZ,params->query->QNAME,nameLen))
+                return FAILURE;
+        return SUCCESS;
+}
+
+PRIVATE unsigned int hashKey(PKTPARAMS *params, int nameLen)
+{
+    /*
+     * The QNAME hash computed by parseQuery() (case folded, the
+     * exact name is compared by sameKey()) mixed with the rest
+     * of the key
+     */
+        unsigned int hash;
+
+        hash = params->query->nameHash;
+        hash = (hash ^ (unsigned int)nameLen) * FNVPRIME;
+        hash = (hash ^ params->query->QTYPE) * FNVPRIME;
+        hash = (hash ^ params->query->QCLASS) * FNVPRIME;
+        hash = (hash ^ params->ipType) * FNVPRIME;
+        hash = (hash ^ params->pktBuffSz) * FNVPRIME;
+        hash = (hash ^ (unsigned int)params->rcvIface) * FNVPRIME;
+        return hash;
+}
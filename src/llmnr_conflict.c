@@ -1,27 +1,30 @@
 /* Macros */
-#define CHECK 1
 #define _GNU_SOURCE
-#define POLLSOCKSZ 2
-#define QUESTMINSZ 17
 #define QUERYMAXTRIES 3
+#define PROBEBUCKETS 64
+#define PROBEPKTSZ (HEADSZ + HOSTNAMEMAX + 1 + 2 * sizeof(U_SHORT))
 //#define PRIORITY_IPV4
 
 /* Includes */
+#include <time.h>
 #include <errno.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
-#include <sys/poll.h>
+#include <sys/epoll.h>
 #include <netinet/in.h>
 
 /* Own includes */
 #include "../include/llmnr_defs.h"
+#include "../include/llmnr_ifset.h"
 #include "../include/llmnr_names.h"
 #include "../include/llmnr_net_interface.h"
 #include "../include/llmnr_rr.h"
 #include "../include/llmnr_utils.h"
 #include "../include/llmnr_sockets.h"
+#include "../include/llmnr_registry.h"
 #include "../include/llmnr_packet.h"
+#include "../include/llmnr_reactor.h"
 #include "../include/llmnr_conflict.h"
 
 /* Enums & Structs */
@@ -32,356 +35,569 @@ enum RESFLAGS {
         _LOST = 1 << 3
 };
 
-typedef struct {
+/*
+ * The probe sockets of the interface 'ifIndex', one per family
+ * (-1 if it couldn't be created). They are kept while the
+ * interface is running and shared by all its probes
+ */
+typedef struct probeSocks {
+        int ifIndex;
+        int fd4;
+        int fd6;
+        struct probeSocks *next;
+} PROBESOCKS;
+
+/*
+ * A probe: conflict detection of 'name' on 'iface'. 'tries'
+ * queries sent so far, the current one waits until 'deadline'
+ * (milliseconds, monotonic clock). 'resFlag4' and 'resFlag6' keep
+ * the outcome (RESFLAGS) of the responses received for the
+ * current query. 'jitter' is set once a response with the 'C'
+ * flag delayed the deadline. Probes are linked by 'next' (all of
+ * them) and by 'idNext' (same bucket of 'ById')
+ */
+typedef struct probe {
         U_SHORT id;
+        U_CHAR tries;
+        U_CHAR jitter;
+        U_CHAR resFlag4;
+        U_CHAR resFlag6;
+        long deadline;
+        int pktSz;
         NAME *name;
-        U_CHAR *jitter;
-        NETIFACE *cIface;
-        NETIFACE *ifaces;
-} RCVMSG;
+        NETIFACE *iface;
+        PROBESOCKS *socks;
+        U_CHAR pkt[PROBEPKTSZ];
+        struct probe *next;
+        struct probe *idNext;
+} PROBE;
 
 /* Prototypes */
-PRIVATE void sendQuery(int fd4, int fd6, U_CHAR *pktBuffer, int pktSz);
-PRIVATE void wonAction(RCVMSG *params);
-PRIVATE void lostAction(RCVMSG *params);
-PRIVATE int recvMsg(int fd4, int fd6, RCVMSG *params);
-PRIVATE int recvMsg4(int fd, RCVMSG *params);
-PRIVATE int recvMsg6(int fd, RCVMSG *params);
-PRIVATE int _recvMsg4(RCVMSG *params, struct msghdr *msg);
-PRIVATE int _recvMsg6(RCVMSG *params, struct msghdr *msg);
+PRIVATE void tick(int fd, unsigned int events, void *__);
+PRIVATE void handleResponses(int fd, unsigned int events, void *data);
+PRIVATE int decide(PROBE *probe);
+PRIVATE void sendProbe(PROBE *probe);
+PRIVATE void armProbes();
+PRIVATE void freeProbe(PROBE *probe);
+PRIVATE PROBE *getProbe(U_SHORT id);
+PRIVATE PROBE *getProbeByTarget(NAME *name, NETIFACE *iface);
+PRIVATE PROBESOCKS *getSocks(NETIFACE *iface);
+PRIVATE void closeSocks(PROBESOCKS *socks);
+PRIVATE void wonAction(PROBE *probe);
+PRIVATE void lostAction(PROBE *probe);
+PRIVATE int _recvMsg4(PROBE *probe, struct msghdr *msg);
+PRIVATE int _recvMsg6(PROBE *probe, struct msghdr *msg);
+PRIVATE int mirrorFound(PROBE *probe, NETIFACE *iface);
 PRIVATE int createPkt(char *name, U_SHORT id, U_CHAR *pktBuffer);
 PRIVATE int lexCmp(void *ownIp, void *peerIp, int ipSz);
+PRIVATE long nowMs();
 
 /* Glocal variables */
+PRIVATE int Timer = -1;
+PRIVATE int ProbesSz;
+PRIVATE PROBE *Probes;
+PRIVATE PROBE *ById[PROBEBUCKETS];
+PRIVATE PROBESOCKS *Socks;
+PRIVATE NETIFACE *Ifaces;
+PRIVATE cdardone Done;
 
 /* Functions definitions */
-PUBLIC void cDar(NAME *name, NETIFACE *iface, NETIFACE *ifs)
+PUBLIC int startCdar(NETIFACE *ifs, cdardone done)
+{
+    /*
+     * Create the timer that drives the probes. The sockets are
+     * opened per interface, by his first probe (See getSocks())
+     */
+        Ifaces = ifs;
+        Done = done;
+        Timer = newTimer(tick,NULL);
+        if (Timer < 0)
+                return FAILURE;
+        return SUCCESS;
+}
+
+PUBLIC void stopCdar()
+{
+        PROBESOCKS *next;
+
+        while (Probes != NULL)
+                freeProbe(Probes);
+        while (Socks != NULL) {
+                next = Socks->next;
+                closeSocks(Socks);
+                Socks = next;
+        }
+        if (Timer >= 0)
+                delHandler(Timer);
+        Timer = -1;
+}
+
+PUBLIC void cdarIfaceDown(NETIFACE *iface)
+{
+    /*
+     * 'iface' is not running anymore: his probes are dropped and
+     * his sockets closed (the next probe on it opens them again)
+     */
+        PROBE *current, *next;
+        PROBESOCKS **ptr, *socks;
+
+        if (iface == NULL)
+                return;
+        for (current = Probes; current != NULL; current = next) {
+                next = current->next;
+                if (current->iface != iface)
+                        continue;
+                current->name->nameStatus = OWNER;
+                freeProbe(current);
+        }
+        armProbes();
+        for (ptr = &Socks; *ptr != NULL; ptr = &(*ptr)->next) {
+                if ((*ptr)->ifIndex == iface->ifIndex) {
+                        socks = *ptr;
+                        *ptr = socks->next;
+                        closeSocks(socks);
+                        break;
+                }
+        }
+}
+
+PUBLIC void cDar(NAME *name, NETIFACE *iface)
 {
     /*
+     * Start the conflict detection of 'name' on 'iface' (RFC
+     * 4795) and return right away:
      * - "Creates" a LLMNR query packet, quering 'name' for 'ANY'
-     *   resource record. The packet id is randomly created
-     * - "Creates" two sending sockets, IPv4 and IPv6
-     * - "Sends" two packets (IPv4 and IPv6), forcing 'iface'
-     *   as exit interface
-     * - "Checks" if any response was received
-     * - If no response received then send again (See RFC 4795)
-     * - If after every attempt no response was received then
-     *   "mark me" as winner
-     * - Once its done marks 'name' as checked
+     *   resource record. The packet id is randomly created (and
+     *   unique among the running probes, responses are told
+     *   apart by it)
+     * - "Sends" two packets (IPv4 and IPv6) through the sockets
+     *   of 'iface'
+     * - The timer "checks" if any response was received and if
+     *   not sends again (See tick())
+     * A probe already running for the same name and interface
+     * is not started twice
      * - Note: doble quotes words are delegated actions
-     * - Note 2: struct RCVMSG just holds a list of function parameters
      */
-        RCVMSG params;
-        U_CHAR *pktBuffer;
-        NETIFACE *currentIf;
-        int count, fd4, fd6, pktSz;
+        PROBE *probe;
+        PROBESOCKS *socks;
 
-        pktBuffer = calloc(1,SNDBUFSZ);
-        if (pktBuffer == NULL)
-                return;
         if (name == NULL || name->name == NULL)
                 return;
-        if (ifs == NULL)
-                return;
-        if (iface == NULL)
+        if (iface == NULL || Ifaces == NULL)
                 return;
         if (iface->flags & _IFF_NOIF)
                 return;
-
-        fd4 = 0;
-        fd6 = 0;
-        count = 0;
-        pktSz = 0;
-        currentIf = iface;
-        memset(&params,0,sizeof(RCVMSG));
-        params.id = (U_SHORT)random();
-        params.name = name;
-        params.cIface = iface;
-        params.ifaces = ifs;
-        params.jitter = NULL;
-        pktSz = createPkt(name->name,params.id,pktBuffer);
-        fd4 = createC4Sock(getFirstValidAddr(currentIf));
-        fd6 = createC6Sock(currentIf->ifIndex);
-
-        if (fd4 < 0 && fd6 < 0)
+        if (getProbeByTarget(name,iface) != NULL)
+                return;
+        socks = getSocks(iface);
+        if (socks == NULL)
                 return;
-        while (count < QUERYMAXTRIES) {
+        probe = calloc(1,sizeof(PROBE));
+        if (probe == NULL)
+                return;
+        do {
+                probe->id = (U_SHORT)random();
+        } while (getProbe(probe->id) != NULL);
+        probe->name = name;
+        probe->iface = iface;
+        probe->socks = socks;
+        probe->pktSz = createPkt(name->name,probe->id,probe->pkt);
+        probe->next = Probes;
+        Probes = probe;
+        probe->idNext = ById[probe->id % PROBEBUCKETS];
+        ById[probe->id % PROBEBUCKETS] = probe;
+        ProbesSz++;
+        sendProbe(probe);
+        armProbes();
+}
 
-                sendQuery(fd4,fd6,pktBuffer,pktSz);
-                if (!recvMsg(fd4,fd6,&params))
-                        break;
-                count++;
+PUBLIC int runningProbes()
+{
+        return ProbesSz;
+}
+
+PRIVATE void tick(int fd, unsigned int events, void *__)
+{
+    /*
+     * Every probe whose query timed out is decided (See
+     * decide()). Probes that are done are freed and, if any,
+     * the caller is told (once) to publish the changes
+     */
+        long now;
+        int finished;
+        PROBE *current, *next;
+
+        fd = fd;
+        events = events;
+        __ = __;
+        finished = 0;
+        now = nowMs();
+        for (current = Probes; current != NULL; current = next) {
+                next = current->next;
+                if (current->deadline > now)
+                        continue;
+                if (!decide(current))
+                        continue;
+                current->name->nameStatus = OWNER;
+                freeProbe(current);
+                finished++;
         }
-        if (count >= QUERYMAXTRIES)
-                wonAction(&params);
-        if (fd4 > 0)
-                close(fd4);
-        if (fd6 > 0)
-                close(fd6);
-        name->nameStatus = OWNER;
-        free(pktBuffer);
+        armProbes();
+        if (finished > 0 && Done != NULL)
+                Done();
 }
 
-PRIVATE int recvMsg(int fd4, int fd6, RCVMSG *params)
+PRIVATE int decide(PROBE *probe)
 {
     /*
-     * Wait 'LLMNR_TIMEOUT' for potential responses (See RFC 4795)
-     * According to a defined priority, first "receive" a pontential
-     * response on one socket (either IPv4 or IPv6). If no response
-     * then check the other socket. A priority is used because on
-     * potenital responses a winner must be determined. The winner is
-     * selected by comparing the lower ip address between the
+     * The wait of the current query ('LLMNR_TIMEOUT', See RFC
+     * 4795) is over. According to a defined priority, first look
+     * at the responses of one family (either IPv4 or IPv6), then
+     * the other. A priority is used because on potential
+     * responses a winner must be determined. No response (or
+     * only our own ones, See _recvMsg4()) then query again. If
+     * after every attempt no response was received then "mark
+     * me" as winner
+     * Returns SUCCESS while the probe goes on
      */
-        poll(0,0,LLMNR_TIMEOUT);
+        int i;
+        U_CHAR flags[2];
+
+        if (!(probe->iface->flags & _IFF_RUNNING))
+                return FAILURE;
+        #ifdef PRIORITY_IPV4
+                flags[0] = probe->resFlag4;
+                flags[1] = probe->resFlag6;
+        #else
+                flags[0] = probe->resFlag6;
+                flags[1] = probe->resFlag4;
+        #endif
+        for (i = 0; i < 2; i++) {
+                if (flags[i] & _LOST) {
+                        lostAction(probe);
+                        return FAILURE;
+                } else if (flags[i] & _WON) {
+                        wonAction(probe);
+                        return FAILURE;
+                }
+        }
+        if (probe->tries >= QUERYMAXTRIES) {
+                wonAction(probe);
+                return FAILURE;
+        }
+        sendProbe(probe);
+        return SUCCESS;
+}
+
+PRIVATE void sendProbe(PROBE *probe)
+{
+    /*
+     * Send the query to the multicast destinies (224.0.0.252 and
+     * FF02::1:3) through the sockets of the interface of the
+     * probe. IPv4 only if the interface has an IPv4 address. The
+     * responses of the previous query are forgotten
+     */
+        SA_IN dest4;
+        SA_IN6 dest6;
+        int fd4, fd6, ok4, ok6;
+
+        fillMcastDest(&dest4,&dest6);
+        fd4 = probe->socks->fd4;
+        fd6 = probe->socks->fd6;
+        ok4 = fd4 >= 0 && getFirstValidAddr(probe->iface) != NULL;
+        ok6 = fd6 >= 0;
         #ifdef PRIORITY_IPV4
-                if (!recvMsg4(fd4,params))
-                        return SUCCESS;
-                else if (!recvMsg6(fd6,params))
-                        return SUCCESS;
+                if (ok4)
+                        sendto(fd4,probe->pkt,probe->pktSz,0,(SA *)&dest4,
+                               sizeof(SA_IN));
+                if (ok6)
+                        sendto(fd6,probe->pkt,probe->pktSz,0,(SA *)&dest6,
+                               sizeof(SA_IN6));
         #else
-                if (!recvMsg6(fd6,params))
-                        return SUCCESS;
-                else if (!recvMsg4(fd4,params))
-                        return SUCCESS;
+                if (ok6)
+                        sendto(fd6,probe->pkt,probe->pktSz,0,(SA *)&dest6,
+                               sizeof(SA_IN6));
+                if (ok4)
+                        sendto(fd4,probe->pkt,probe->pktSz,0,(SA *)&dest4,
+                               sizeof(SA_IN));
         #endif
-        return FAILURE;
+        probe->tries++;
+        probe->jitter = 0;
+        probe->resFlag4 = _NONE;
+        probe->resFlag6 = _NONE;
+        probe->deadline = nowMs() + LLMNR_TIMEOUT;
 }
 
-PRIVATE int recvMsg4(int fd, RCVMSG *params)
+PRIVATE void handleResponses(int fd, unsigned int events, void *data)
 {
     /*
-     * - Receive all potential IPv4 responses (may be none or
-     *   several responses)
+     * - Receive all potential responses (may be none or
+     *   several responses) of one socket of 'data' (the
+     *   sockets of an interface)
      * - recvmsg instead of recvfrom (needs to know destiny
      *   ip addres in the response)
      * - ancBuffer will hold the ancillary data (See socket api)
-     * - Once a response its received "checks" if the response
-     *   came from one of my own interfaces. In that case the two
-     *   involved interfaces are marked as 'mirror interfaces'
-     * - If the response came from other peer then "checks" who
-     *   wins the conflict (See RFC 4795)
-     * - a flag variable (resFlag) is used beacause there might
-     *   be several responses, and i need to keep track of the
-     *   outcome of every response to make a final decision about
-     *   the 'overall' winner in this conflict resolution
-     * - Note: for winning a conflict a peer must prevail (or win)
-     *   against every response received
-     * - Note: doble quote works are delegated actions
+     * - Every response goes to the probe with his id (among the
+     *   ones of the interface). Its
+     *   outcome is added to the ones of the current query of
+     *   the probe, they are looked at once the query times out
+     *   (a peer must prevail against every response received)
      */
         int rcved;
-        SA_IN from;
+        HEADER head;
+        PROBE *probe;
+        SA_IN6 from;
+        PROBESOCKS *socks;
         struct iovec iov;
         struct msghdr msg;
-        U_CHAR resFlag, jitter;
         U_CHAR rcvBuffer[RCVBUFSZ];
         U_CHAR ancBuffer[ANCBUFSZ];
 
-        if (fd < 0)
-                return FAILURE;
-        jitter = 0;
+        events = events;
+        socks = (PROBESOCKS *)data;
         memset(&iov,0,sizeof(iov));
         memset(&msg,0,sizeof(msg));
         iov.iov_base = rcvBuffer;
         iov.iov_len = RCVBUFSZ;
         msg.msg_name = &from;
-        msg.msg_namelen = sizeof(from);
         msg.msg_iov = &iov;
         msg.msg_iovlen = 1;
         msg.msg_control = ancBuffer;
-        msg.msg_controllen = ANCBUFSZ;
-        resFlag = _NONE;
-        params->jitter = &jitter;
-
-        if (params->ifaces == NULL)
-                return SUCCESS;
-        if (!(params->cIface->flags & _IFF_RUNNING))
-                return SUCCESS;
-        while (CHECK) {
+        while (1) {
                 memset(&from,0,sizeof(from));
-                memset(rcvBuffer,0,RCVBUFSZ);
-                memset(ancBuffer,0,ANCBUFSZ);
+                msg.msg_namelen = sizeof(from);
+                msg.msg_controllen = ANCBUFSZ;
                 rcved = recvmsg(fd,&msg,MSG_DONTWAIT);
                 if (rcved < 0) {
-                        if (errno == EAGAIN || errno == EWOULDBLOCK)
-                                break;
+                        if (errno == EINTR)
+                                continue;
+                        break;
                 }
                 if (rcved < QUESTMINSZ)
                         continue;
-                resFlag |= _recvMsg4(params,&msg);
+                getHeader(rcvBuffer,&head);
+                probe = getProbe(head.ID);
+                if (probe == NULL || probe->socks != socks)
+                        continue;
+                if (rcved < HEADSZ + (int)strlen(probe->name->name))
+                        continue;
+                if (fd == socks->fd4)
+                        probe->resFlag4 |= _recvMsg4(probe,&msg);
+                else
+                        probe->resFlag6 |= _recvMsg6(probe,&msg);
         }
-        if (resFlag & _LOST)
-                lostAction(params);
-        else if (resFlag & _WON )
-                wonAction(params);
-        else if (resFlag & _SELF || resFlag & _NONE)
-                return FAILURE;
-        return SUCCESS;
+        armProbes();
 }
 
-PRIVATE int recvMsg6(int fd, RCVMSG *params)
+PRIVATE void armProbes()
 {
     /*
-     * See 'recvMsg4()'. Same thing but with IPv6
+     * Arm the timer for the nearest deadline (disarm it if
+     * there are no probes)
      */
-        int rcved;
-        SA_IN6 from;
-        struct iovec iov;
-        struct msghdr msg;
-        U_CHAR resFlag, jitter;
-        U_CHAR rcvBuffer[RCVBUFSZ];
-        U_CHAR ancBuffer[ANCBUFSZ];
+        long now, next;
+        PROBE *current;
+
+        if (Timer < 0)
+                return;
+        if (Probes == NULL) {
+                armTimer(Timer,0);
+                return;
+        }
+        next = Probes->deadline;
+        for (current = Probes; current != NULL; current = current->next) {
+                if (current->deadline < next)
+                        next = current->deadline;
+        }
+        now = nowMs();
+        armTimer(Timer,next > now ? next - now : 1);
+}
 
+PRIVATE void freeProbe(PROBE *probe)
+{
+        PROBE **ptr;
 
-        if (fd < 0)
-                return FAILURE;
-        jitter = 0;
-        memset(&iov,0,sizeof(iov));
-        memset(&msg,0,sizeof(msg));
-        iov.iov_base = rcvBuffer;
-        iov.iov_len = RCVBUFSZ;
-        msg.msg_name = &from;
-        msg.msg_namelen = sizeof(from);
-        msg.msg_iov = &iov;
-        msg.msg_iovlen = 1;
-        msg.msg_control = ancBuffer;
-        msg.msg_controllen = ANCBUFSZ;
-        resFlag = _NONE;
-        params->jitter = &jitter;
-
-        if (params->ifaces == NULL)
-                return SUCCESS;
-        if (!(params->cIface->flags & _IFF_RUNNING))
-                return SUCCESS;
-        while (CHECK) {
-                memset(&from,0,sizeof(from));
-                memset(rcvBuffer,0,RCVBUFSZ);
-                memset(ancBuffer,0,ANCBUFSZ);
-                rcved = recvmsg(fd,&msg,MSG_DONTWAIT);
-                if (rcved < 0) {
-                        if (errno == EAGAIN || errno == EWOULDBLOCK)
-                                break;
+        for (ptr = &Probes; *ptr != NULL; ptr = &(*ptr)->next) {
+                if (*ptr == probe) {
+                        *ptr = probe->next;
+                        break;
                 }
-                if (rcved < QUESTMINSZ)
-                        continue;
-                resFlag |= _recvMsg6(params,&msg);
         }
-        if (resFlag & _LOST)
-                lostAction(params);
-        else if (resFlag & _WON )
-                wonAction(params);
-        else if (resFlag & _SELF || resFlag & _NONE)
-                return FAILURE;
-        return SUCCESS;
+        ptr = &ById[probe->id % PROBEBUCKETS];
+        for (; *ptr != NULL; ptr = &(*ptr)->idNext) {
+                if (*ptr == probe) {
+                        *ptr = probe->idNext;
+                        break;
+                }
+        }
+        ProbesSz--;
+        free(probe);
+}
+
+PRIVATE PROBE *getProbe(U_SHORT id)
+{
+        PROBE *current;
+
+        current = ById[id % PROBEBUCKETS];
+        for (; current != NULL; current = current->idNext) {
+                if (current->id == id)
+                        return current;
+        }
+        return NULL;
+}
+
+PRIVATE PROBE *getProbeByTarget(NAME *name, NETIFACE *iface)
+{
+        PROBE *current;
+
+        for (current = Probes; current != NULL; current = current->next) {
+                if (current->name == name && current->iface == iface)
+                        return current;
+        }
+        return NULL;
 }
 
-PRIVATE int _recvMsg4(RCVMSG *params, struct msghdr *msg)
+PRIVATE PROBESOCKS *getSocks(NETIFACE *iface)
 {
     /*
-     * On a given IPv4 respond checks several things:
-     * - Check if Answer id packet matches the query
+     * The probe sockets of 'iface'. They are opened (and their
+     * handlers registered) by the first probe on it, i.e when
+     * the interface becomes running
+     * Returns NULL if none of them can be opened
+     */
+        PROBESOCKS *socks;
+
+        for (socks = Socks; socks != NULL; socks = socks->next) {
+                if (socks->ifIndex == iface->ifIndex)
+                        return socks;
+        }
+        socks = calloc(1,sizeof(PROBESOCKS));
+        if (socks == NULL)
+                return NULL;
+        socks->ifIndex = iface->ifIndex;
+        socks->fd4 = createC4Sock(iface->ifIndex);
+        if (socks->fd4 >= 0 && addHandler(socks->fd4,EPOLLIN,
+                                          handleResponses,socks)) {
+                close(socks->fd4);
+                socks->fd4 = -1;
+        }
+        socks->fd6 = createC6Sock(iface->ifIndex);
+        if (socks->fd6 >= 0 && addHandler(socks->fd6,EPOLLIN,
+                                          handleResponses,socks)) {
+                close(socks->fd6);
+                socks->fd6 = -1;
+        }
+        if (socks->fd4 < 0 && socks->fd6 < 0) {
+                free(socks);
+                return NULL;
+        }
+        socks->next = Socks;
+        Socks = socks;
+        return socks;
+}
+
+PRIVATE void closeSocks(PROBESOCKS *socks)
+{
+        if (socks->fd4 >= 0) {
+                delHandler(socks->fd4);
+                close(socks->fd4);
+        }
+        if (socks->fd6 >= 0) {
+                delHandler(socks->fd6);
+                close(socks->fd6);
+        }
+        free(socks);
+}
+
+PRIVATE int _recvMsg4(PROBE *probe, struct msghdr *msg)
+{
+    /*
+     * On a given IPv4 respond (his id matches 'probe') checks
+     * several things:
      * - Check if Answer name matches the query
-     * - Check if Answer came from the same interface for which
-     *   the query was sent
+     * - If the Answer has the 'C' flag then the probe waits
+     *   'JITTER_INTERVAL' more (once per query)
      * - Check if Answer came from one of my own interfaces (if
-     *   so then mark both interfaces as 'mirror interfaces')
+     *   so then mark both interfaces as 'mirror interfaces').
+     *   One lookup in the local addresses set (See
+     *   llmnr_net_interface.h)
+     * - An Answer from my own address on the interface for
+     *   which the query was sent is my own packet: ignored
      * - "Checks" the conflict resolution winner
      */
         HEADER head;
         void *rcvBuffer;
-        NETIFIPV4 *ipv4s;
-        NETIFACE *current;
+        LOCALADDR *local;
         INADDR toIp ,*fromIp;
 
-        current = params->ifaces;
         memset(&head,0,sizeof(head));
         rcvBuffer = msg->msg_iov->iov_base;
         getHeader(rcvBuffer,&head);
-        if (params->id != head.ID)
-                return _NONE;
-        if (strncasecmp(params->name->name,(char *)(rcvBuffer + HEADSZ),
-                        strlen(params->name->name)))
+        if (strncasecmp(probe->name->name,(char *)(rcvBuffer + HEADSZ),
+                        strlen(probe->name->name)))
                 return _NONE;
-        if (head.C && !*params->jitter) {
-                poll(0,0,JITTER_INTERVAL);
-                *params->jitter = 0xA;
+        if (head.FLAGS & HFLAG_C && !probe->jitter) {
+                probe->deadline += JITTER_INTERVAL;
+                probe->jitter = 1;
         }
         __getPktInfo(AF_INET,&toIp,msg);
         fromIp = &(((SA_IN *)msg->msg_name)->sin_addr);
-
-        for (; current != NULL; current = current->next) {
-                if (current->flags & _IFF_NOIF)
-                        continue;
-                if (!(current->flags & _IFF_RUNNING))
-                        continue;
-                if (current->ifIndex == params->cIface->ifIndex)
-                        continue;
-                ipv4s = current->IPv4s;
-                for (; ipv4s != NULL; ipv4s = ipv4s->next) {
-                        if (ipv4s->ipType == NOIP)
-                                continue;
-                        if (!memcmp(fromIp,&ipv4s->ip4Addr,sizeof(INADDR))) {
-                                addMirrorIf(params->cIface,current->ifIndex);
-                                addMirrorIf(current,params->cIface->ifIndex);
-                                params->cIface->flags |= _IFF_CONFLICT;
-                                current->flags |= _IFF_CONFLICT;
-                                return _SELF;
-                        }
-                }
-        }
+        local = getLocalAddr(AF_INET,fromIp,probe->iface->ifIndex);
+        if (local != NULL && local->iface->flags & _IFF_RUNNING)
+                return mirrorFound(probe,local->iface);
+        if (getLocalAddr(AF_INET,fromIp,0) != NULL)
+                return _NONE;
         return lexCmp(&toIp,fromIp,sizeof(INADDR));
 }
 
-PRIVATE int _recvMsg6(RCVMSG *params, struct msghdr *msg)
+PRIVATE int _recvMsg6(PROBE *probe, struct msghdr *msg)
 {
     /*
      * See _recvMsg4(). Same thing but with IPv6
      */
         HEADER head;
         void *rcvBuffer;
-        NETIFIPV6 *ipv6s;
-        NETIFACE *current;
+        LOCALADDR *local;
         IN6ADDR toIp ,*fromIp;
 
-        current = params->ifaces;
         memset(&head,0,sizeof(head));
         rcvBuffer = msg->msg_iov->iov_base;
         getHeader(rcvBuffer,&head);
-        if (params->id != head.ID)
+        if (strncasecmp(probe->name->name,(char *)(rcvBuffer + HEADSZ),
+                        strlen(probe->name->name)))
                 return _NONE;
-        if (strncasecmp(params->name->name,(char *)(rcvBuffer + HEADSZ),
-                        strlen(params->name->name)))
-                return _NONE;
-        if (head.C && !*params->jitter) {
-                poll(0,0,JITTER_INTERVAL);
-                *params->jitter = 0xB;
+        if (head.FLAGS & HFLAG_C && !probe->jitter) {
+                probe->deadline += JITTER_INTERVAL;
+                probe->jitter = 1;
         }
         __getPktInfo(AF_INET6,&toIp,msg);
         fromIp = &(((SA_IN6 *)msg->msg_name)->sin6_addr);
-        for (; current != NULL; current = current->next) {
-                if (current->flags & _IFF_NOIF)
-                        continue;
-                if (current->ifIndex == params->cIface->ifIndex)
-                        continue;
-                if (!(current->flags & _IFF_RUNNING))
-                        continue;
-                ipv6s = current->IPv6s;
-                for (; ipv6s != NULL; ipv6s = ipv6s->next) {
-                        if (ipv6s->ipType == NOIP)
-                                continue;
-                        if (!memcmp(fromIp,&ipv6s->ip6Addr,sizeof(IN6ADDR))) {
-                                addMirrorIf(params->cIface,current->ifIndex);
-                                addMirrorIf(current,params->cIface->ifIndex);
-                                params->cIface->flags |= _IFF_CONFLICT;
-                                current->flags |= _IFF_CONFLICT;
-                                return _SELF;
-                        }
-                }
-        }
-	if (head.T == 0)
+        local = getLocalAddr(AF_INET6,fromIp,probe->iface->ifIndex);
+        if (local != NULL && local->iface->flags & _IFF_RUNNING)
+                return mirrorFound(probe,local->iface);
+        if (getLocalAddr(AF_INET6,fromIp,0) != NULL)
+                return _NONE;
+	if (!(head.FLAGS & HFLAG_T))
 		return _LOST;
         return lexCmp(&toIp,fromIp,sizeof(IN6ADDR));
 }
 
+PRIVATE int mirrorFound(PROBE *probe, NETIFACE *iface)
+{
+    /*
+     * The query of 'probe' was answered by 'iface' (one of my
+     * own interfaces): both interfaces are marked as 'mirror
+     * interfaces'
+     */
+        addMirrorIf(probe->iface,iface->slot);
+        addMirrorIf(iface,probe->iface->slot);
+        probe->iface->flags |= _IFF_CONFLICT;
+        iface->flags |= _IFF_CONFLICT;
+        invalidateAnswers(probe->iface);
+        invalidateAnswers(iface);
+        return _SELF;
+}
+
 PRIVATE int createPkt(char *name, U_SHORT id, U_CHAR *pktBuffer)
 {
     /*
@@ -398,6 +614,7 @@ PRIVATE int createPkt(char *name, U_SHORT id, U_CHAR *pktBuffer)
         head.ID = id;
         head.QDCOUNT = 1;
         query.QNAME = name;
+        query.nameLen = strlen(name) + 1;
         query.QTYPE = ANY;
         query.QCLASS = INCLASS;
         pktSz += attachHeader(&head,pktBuffer);
@@ -405,28 +622,6 @@ PRIVATE int createPkt(char *name, U_SHORT id, U_CHAR *pktBuffer)
         return pktSz;
 }
 
-PRIVATE void sendQuery(int fd4, int fd6, U_CHAR *pktBuffer, int pktSz)
-{
-    /*
-     * Send a packet to a multicast destiny (224.0.0.252 and FF::1:3)
-     */
-        SA_IN dest4;
-        SA_IN6 dest6;
-
-        fillMcastDest(&dest4,&dest6);
-	#ifdef PRIORITY_IPV4
-        	if (fd4 > 0)
-            		sendto(fd4,pktBuffer,pktSz,0,(SA *)&dest4,sizeof(SA_IN));
-        	if (fd6 > 0)
-            		sendto(fd6,pktBuffer,pktSz,0,(SA *)&dest6,sizeof(SA_IN6));
-	#else
-		if (fd6 > 0)
-			sendto(fd6,pktBuffer,pktSz,0,(SA *)&dest6,sizeof(SA_IN6));
-		if (fd4 > 0)
-			sendto(fd4,pktBuffer,pktSz,0,(SA *)&dest4,sizeof(SA_IN));
-	#endif
-}
-
 PRIVATE int lexCmp(void *ownIp, void *peerIp, int ipSz)
 {
     /*
@@ -437,33 +632,35 @@ PRIVATE int lexCmp(void *ownIp, void *peerIp, int ipSz)
         return _WON;
 }
 
-PRIVATE void wonAction(RCVMSG *params)
+PRIVATE void wonAction(PROBE *probe)
 {
     /*
      * - Add to 'NAME' authoritative list the 'current' interface
      * - Checks if any mirror interface belongs to 'NAME'
      *   no-authoritativelist. If so then remove it and add it to
-     *   'NAME' authoritative list
-     * - NOTE: RCVMSG holds a list of parameters
+     *   'NAME' authoritative list (his answers change)
      */
 
         int i;
         NAME *name;
         NETIFACE *iface;
 
-        name = params->name;
-        iface = params->cIface;
-        addAuthOn(name,iface->ifIndex);
-        for (i = 0; i < iface->mirrorIfSz; i++) {
-                if (!isNotAuthOn(name,iface->mirrorIfs[i])) {
-                    delNotAuthOn(name,iface->mirrorIfs[i]);
-                    addAuthOn(name,iface->mirrorIfs[i]);
+        name = probe->name;
+        iface = probe->iface;
+        addAuthOn(name,iface->slot);
+        i = nextInIfSet(&iface->mirrorIfs,0);
+        for (; i >= 0; i = nextInIfSet(&iface->mirrorIfs,i + 1)) {
+                if (!isNotAuthOn(name,i)) {
+                    delNotAuthOn(name,i);
+                    addAuthOn(name,i);
+                    invalidateAnswers(getNetIfNodeBySlot(Ifaces,i));
                 }
         }
         iface->flags |= _IFF_CDAR;
+        invalidateAnswers(iface);
 }
 
-PRIVATE void lostAction(RCVMSG *params)
+PRIVATE void lostAction(PROBE *probe)
 {
     /*
      * - Checks if any mirror interface belongs to 'NAME'
@@ -473,24 +670,27 @@ PRIVATE void lostAction(RCVMSG *params)
      * - If no mirror interface won the conflict then add
      *   'current' interface to 'NAME' no-authoritative list
      */
-        int i, j;
         NAME *name;
         U_CHAR res;
         NETIFACE *iface;
 
         res = _LOST;
-        name = params->name;
-        iface = params->cIface;
-        for (i = 0; i < name->authOnSz; i++) {
-                for (j = 0; j < iface->mirrorIfSz; j++) {
-                        if (iface->mirrorIfs[j] == name->authOn[i])
-                                res = _WON;
-                }
-        }
+        name = probe->name;
+        iface = probe->iface;
+        if (ifSetsMeet(&name->authOn,&iface->mirrorIfs))
+                res = _WON;
         if (res == _LOST)
-                addNotAuthOn(name,iface->ifIndex);
+                addNotAuthOn(name,iface->slot);
         if (res == _WON)
-                addAuthOn(name,iface->ifIndex);
+                addAuthOn(name,iface->slot);
         iface->flags |= _IFF_CDAR;
+        invalidateAnswers(iface);
 }
 
+PRIVATE long nowMs()
+{
+        struct timespec now;
+
+        clock_gettime(CLOCK_MONOTONIC,&now);
+        return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
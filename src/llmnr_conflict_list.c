@@ -11,6 +11,7 @@
 
 /* Own includes */
 #include "../include/llmnr_defs.h"
+#include "../include/llmnr_ifset.h"
 #include "../include/llmnr_names.h"
 #include "../include/llmnr_rr.h"
 #include "../include/llmnr_utils.h"
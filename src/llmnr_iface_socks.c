@@ -0,0 +1,286 @@
+/* Macros */
+#define _GNU_SOURCE
+
+/* Includes */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+
+/* Own includes */
+#include "../include/llmnr_defs.h"
+#include "../include/llmnr_ifset.h"
+#include "../include/llmnr_names.h"
+#include "../include/llmnr_net_interface.h"
+#include "../include/llmnr_print.h"
+#include "../include/llmnr_sockets.h"
+#include "../include/llmnr_registry.h"
+#include "../include/llmnr_kernel_filter.h"
+#include "../include/llmnr_worker_pool.h"
+#include "../include/llmnr_shards.h"
+#include "../include/llmnr_reactor.h"
+#include "../include/llmnr_iface_socks.h"
+
+/* Enums & Structs */
+/*
+ * The sockets of the interface of 'slot' (See llmnr_ifset.h),
+ * bound to 'ifIndex'. -1 if the family is not joined
+ */
+typedef struct ifaceSocks {
+        int slot;
+        int ifIndex;
+        int fd4;
+        int fd6;
+        struct ifaceSocks *next;
+} IFACESOCKS;
+
+/* Private prototypes */
+PRIVATE IFACESOCKS *getSocks(NETIFACE *iface);
+PRIVATE int openSock(IFACESOCKS *socks, int family);
+PRIVATE void closeSock(IFACESOCKS *socks, int *fd);
+PRIVATE void freeSocks(IFACESOCKS *socks);
+PRIVATE void handleIfaceSock(int fd, unsigned int events, void *data);
+
+/* Glocal variables */
+PRIVATE int Running;
+PRIVATE int RcvBatch;
+PRIVATE IFACESOCKS *Socks;
+PRIVATE ifsockfilter Filter;
+
+/* Functions definitions */
+PUBLIC int startIfaceSocks(int rcvBatch, ifsockfilter filter)
+{
+    /*
+     * No socket is opened here, the interfaces open theirs when
+     * they join (See openIfaceSocks())
+     */
+        if (filter == NULL)
+                return FAILURE;
+        RcvBatch = rcvBatch;
+        Filter = filter;
+        Running = TRUE;
+        return SUCCESS;
+}
+
+PUBLIC void stopIfaceSocks()
+{
+    /*
+     * Close every socket (before the shards are stopped, See
+     * llmnr_shards.h)
+     */
+        IFACESOCKS *next;
+
+        while (Socks != NULL) {
+                next = Socks->next;
+                closeSock(Socks,&Socks->fd4);
+                closeSock(Socks,&Socks->fd6);
+                free(Socks);
+                Socks = next;
+        }
+        Running = FALSE;
+}
+
+PUBLIC int ifaceSocksRunning()
+{
+        return Running;
+}
+
+PUBLIC void openIfaceSocks(NETIFACE *iface)
+{
+    /*
+     * Same thing that joinMcastGroup() (See llmnr_sockets.h) but
+     * the interface joins through his own sockets: one per
+     * family he has ips of
+     */
+        IFACESOCKS *socks;
+
+        if (!Running || !(iface->flags & _IFF_RUNNING))
+                return;
+        if (!(iface->flags & (_IFF_INET | _IFF_INET6)))
+                return;
+        socks = getSocks(iface);
+        if (socks == NULL)
+                return;
+        if (socks->ifIndex != iface->ifIndex) {
+                /*
+                 * The link of the interface came back with
+                 * another index: the old sockets are useless
+                 */
+                closeSock(socks,&socks->fd4);
+                closeSock(socks,&socks->fd6);
+                iface->flags &= ~(_IFF_MCAST4 | _IFF_MCAST6);
+                socks->ifIndex = iface->ifIndex;
+        }
+        if (iface->flags & _IFF_INET && !(iface->flags & _IFF_MCAST4)) {
+                if (!openSock(socks,AF_INET))
+                        iface->flags |= _IFF_MCAST4;
+        }
+        if (iface->flags & _IFF_INET6 && !(iface->flags & _IFF_MCAST6)) {
+                if (!openSock(socks,AF_INET6))
+                        iface->flags |= _IFF_MCAST6;
+        }
+        freeSocks(socks);
+}
+
+PUBLIC void closeIfaceSocks(NETIFACE *iface)
+{
+    /*
+     * Same thing that leaveMcastGroup(): the socket of a family
+     * the interface has no ips of is closed (and his membership
+     * goes with it)
+     */
+        IFACESOCKS *socks;
+
+        if (!Running)
+                return;
+        for (socks = Socks; socks != NULL; socks = socks->next) {
+                if (socks->slot == iface->slot)
+                        break;
+        }
+        if (!(iface->flags & _IFF_INET) && iface->flags & _IFF_MCAST4) {
+                if (socks != NULL)
+                        closeSock(socks,&socks->fd4);
+                iface->flags &= ~_IFF_MCAST4;
+        }
+        if (!(iface->flags & _IFF_INET6) && iface->flags & _IFF_MCAST6) {
+                if (socks != NULL)
+                        closeSock(socks,&socks->fd6);
+                iface->flags &= ~_IFF_MCAST6;
+        }
+        if (socks != NULL)
+                freeSocks(socks);
+}
+
+PUBLIC void attachIfaceSocksFilter()
+{
+    /*
+     * Attach the current kernel filter to every socket (See
+     * llmnr_kernel_filter.h)
+     */
+        IFACESOCKS *socks;
+
+        for (socks = Socks; socks != NULL; socks = socks->next) {
+                attachKernelFilter(socks->fd4);
+                attachKernelFilter(socks->fd6);
+        }
+}
+
+PUBLIC void printIfaceSockStats()
+{
+        IFACESOCKS *socks;
+
+        for (socks = Socks; socks != NULL; socks = socks->next)
+                printToStream("Interface %d sockets: kernel drops: "
+                              "IPv4 %ld, IPv6 %ld\n",socks->ifIndex,
+                              kernelDrops(socks->fd4),
+                              kernelDrops(socks->fd6));
+}
+
+PRIVATE IFACESOCKS *getSocks(NETIFACE *iface)
+{
+    /*
+     * The sockets of 'iface' (a new node, with none, the first
+     * time)
+     */
+        IFACESOCKS *socks;
+
+        for (socks = Socks; socks != NULL; socks = socks->next) {
+                if (socks->slot == iface->slot)
+                        return socks;
+        }
+        socks = calloc(1,sizeof(IFACESOCKS));
+        if (socks == NULL)
+                return NULL;
+        socks->slot = iface->slot;
+        socks->ifIndex = iface->ifIndex;
+        socks->fd4 = -1;
+        socks->fd6 = -1;
+        socks->next = Socks;
+        Socks = socks;
+        return socks;
+}
+
+PRIVATE int openSock(IFACESOCKS *socks, int family)
+{
+    /*
+     * Open the socket of 'family' and hand it to whoever polls
+     * it: the shard of the interface or the event loop
+     */
+        int fd, res;
+
+        fd = createIfaceSocket(family,socks->ifIndex);
+        if (fd < 0)
+                return FAILURE;
+        if (shardsRunning())
+                res = addShardSocket(fd,socks->ifIndex);
+        else
+                res = addHandler(fd,EPOLLIN,handleIfaceSock,socks);
+        if (res) {
+                close(fd);
+                return FAILURE;
+        }
+        if (family == AF_INET)
+                socks->fd4 = fd;
+        else
+                socks->fd6 = fd;
+        return SUCCESS;
+}
+
+PRIVATE void closeSock(IFACESOCKS *socks, int *fd)
+{
+        if (*fd < 0)
+                return;
+        if (shardsRunning()) {
+                delShardSocket(*fd,socks->ifIndex);
+        } else {
+                delHandler(*fd);
+                close(*fd);
+        }
+        *fd = -1;
+}
+
+PRIVATE void freeSocks(IFACESOCKS *socks)
+{
+    /*
+     * The node of an interface with no sockets left is freed
+     */
+        IFACESOCKS **ptr;
+
+        if (socks->fd4 >= 0 || socks->fd6 >= 0)
+                return;
+        for (ptr = &Socks; *ptr != NULL; ptr = &(*ptr)->next) {
+                if (*ptr == socks) {
+                        *ptr = socks->next;
+                        free(socks);
+                        return;
+                }
+        }
+}
+
+PRIVATE void handleIfaceSock(int fd, unsigned int events, void *data)
+{
+    /*
+     * Handler of the sockets in the event loop: drain up to
+     * 'recv_batch' queries and queue the ones the filter accepts
+     * (See handleUdpQuery() in llmnr_responder_s2.c)
+     */
+        int i, err, count;
+        socklen_t errLen;
+        IFACESOCKS *socks;
+        UDPCLIENT *clients[MAXRCVBATCH];
+
+        socks = (IFACESOCKS *)data;
+        if (events & EPOLLIN) {
+                count = receiveClients(fd,clients,RcvBatch,socks->ifIndex);
+                for (i = 0; i < count; i++) {
+                        if (Filter(clients[i]))
+                                releasePoolSlot(clients[i]);
+                        else
+                                enqueueClient(clients[i]);
+                }
+        } else if (events & EPOLLERR) {
+                errLen = sizeof(err);
+                getsockopt(fd,SOL_SOCKET,SO_ERROR,&err,&errLen);
+        }
+}
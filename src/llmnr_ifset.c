@@ -0,0 +1,176 @@
+/* Macros */
+#define SETBITS (8 * sizeof(unsigned long))
+
+/* Includes */
+#include <stdlib.h>
+#include <string.h>
+
+/* Own includes */
+#include "../include/llmnr_defs.h"
+#include "../include/llmnr_ifset.h"
+
+/* Enums & Structs */
+
+/* Private prototypes */
+PRIVATE int growIfSet(IFSET *set, int words);
+
+/* Glocal variables */
+PRIVATE IFSET Slots;
+
+/* Functions definitions */
+PUBLIC int newIfSlot()
+{
+    /*
+     * Hand out the lowest free slot
+     * Returns the slot or FAILURE (no memory)
+     */
+        int i, slot;
+
+        for (i = 0; i < Slots.words; i++) {
+                if (~Slots.bits[i] != 0)
+                        break;
+        }
+        slot = i * SETBITS;
+        if (i < Slots.words)
+                slot += __builtin_ctzl(~Slots.bits[i]);
+        if (addIfSet(&Slots,slot))
+                return FAILURE;
+        return slot;
+}
+
+PUBLIC void freeIfSlot(int slot)
+{
+    /*
+     * 'slot' can be handed out again. Whoever owned it must
+     * not be in any set anymore
+     */
+        delIfSet(&Slots,slot);
+}
+
+PUBLIC void freeIfSlots()
+{
+        freeIfSet(&Slots);
+}
+
+PUBLIC int addIfSet(IFSET *set, int slot)
+{
+    /*
+     * Add 'slot' to the set (growing it if needed)
+     */
+        if (slot < 0)
+                return FAILURE;
+        if (slot / (int)SETBITS >= set->words) {
+                if (growIfSet(set,slot / SETBITS + 1))
+                        return FAILURE;
+        }
+        set->bits[slot / SETBITS] |= 1UL << (slot % SETBITS);
+        return SUCCESS;
+}
+
+PUBLIC void delIfSet(IFSET *set, int slot)
+{
+        if (slot < 0 || slot / (int)SETBITS >= set->words)
+                return;
+        set->bits[slot / SETBITS] &= ~(1UL << (slot % SETBITS));
+}
+
+PUBLIC int inIfSet(IFSET *set, int slot)
+{
+        if (slot < 0 || slot / (int)SETBITS >= set->words)
+                return FALSE;
+        return (set->bits[slot / SETBITS] >> (slot % SETBITS)) & 1UL;
+}
+
+PUBLIC int nextInIfSet(IFSET *set, int slot)
+{
+    /*
+     * The first member of the set from 'slot' on (FAILURE if
+     * none). The members are walked with:
+     * for (i = nextInIfSet(set,0); i >= 0; i = nextInIfSet(set,i + 1))
+     */
+        int i;
+        unsigned long word;
+
+        if (slot < 0)
+                slot = 0;
+        i = slot / SETBITS;
+        if (i >= set->words)
+                return FAILURE;
+        word = set->bits[i] & (~0UL << (slot % SETBITS));
+        while (word == 0) {
+                if (++i >= set->words)
+                        return FAILURE;
+                word = set->bits[i];
+        }
+        return i * SETBITS + __builtin_ctzl(word);
+}
+
+PUBLIC int ifSetSz(IFSET *set)
+{
+        int i, count;
+
+        count = 0;
+        for (i = 0; i < set->words; i++)
+                count += __builtin_popcountl(set->bits[i]);
+        return count;
+}
+
+PUBLIC int ifSetsMeet(IFSET *set, IFSET *other)
+{
+    /*
+     * Check whether both sets have a member in common
+     */
+        int i;
+
+        for (i = 0; i < set->words && i < other->words; i++) {
+                if (set->bits[i] & other->bits[i])
+                        return TRUE;
+        }
+        return FALSE;
+}
+
+PUBLIC int copyIfSet(IFSET *copy, IFSET *set)
+{
+    /*
+     * 'copy' gets his own copy of 'set' (whatever it had is
+     * not freed)
+     */
+        copy->words = 0;
+        copy->bits = NULL;
+        if (set->words == 0)
+                return SUCCESS;
+        copy->bits = malloc(set->words * sizeof(unsigned long));
+        if (copy->bits == NULL)
+                return FAILURE;
+        memcpy(copy->bits,set->bits,set->words * sizeof(unsigned long));
+        copy->words = set->words;
+        return SUCCESS;
+}
+
+PUBLIC void freeIfSet(IFSET *set)
+{
+        if (set->bits != NULL)
+                free(set->bits);
+        set->bits = NULL;
+        set->words = 0;
+}
+
+PRIVATE int growIfSet(IFSET *set, int words)
+{
+    /*
+     * Make room for 'words' words (at least twice the old ones,
+     * the new ones are empty)
+     */
+        unsigned long *bits;
+
+        if (words < 2 * set->words)
+                words = 2 * set->words;
+        bits = realloc(set->bits,words * sizeof(unsigned long));
+        if (bits == NULL)
+                return FAILURE;
+        memset(bits + set->words,0,
+               (words - set->words) * sizeof(unsigned long));
+        set->bits = bits;
+        set->words = words;
+        return SUCCESS;
+}
@@ -0,0 +1,222 @@
+/* Macros */
+#define UDPHDRSZ 8
+#define HEADERINSNS 15
+#define PREFIXSZ 4
+#define PTRLABELMAX 3
+#define ACCEPTALL 0xFFFFFFFF
+
+/* Includes */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/filter.h>
+#include <linux/sock_diag.h>
+
+/* Own includes */
+#include "../include/llmnr_defs.h"
+#include "../include/llmnr_ifset.h"
+#include "../include/llmnr_names.h"
+#include "../include/llmnr_net_interface.h"
+#include "../include/llmnr_rr.h"
+#include "../include/llmnr_registry.h"
+#include "../include/llmnr_packet.h"
+#include "../include/llmnr_kernel_filter.h"
+
+/* Enums & Structs */
+
+/* Private prototypes */
+PRIVATE void emitHeader(struct sock_filter *code, int *n);
+PRIVATE void emitName(struct sock_filter *code, int *n, U_CHAR *name);
+PRIVATE int nameSize(U_CHAR *name);
+
+/* Glocal variables */
+PRIVATE struct sock_fprog Program;
+
+/* Functions definitions */
+PUBLIC int buildKernelFilter(NAME *names, REGISTRY *registry, int level)
+{
+    /*
+     * Build the program of 'level' (See KFILTER_LEVEL) for our
+     * names and the names of 'registry'. If the names don't fit
+     * in a program (BPF_MAXINSNS) only the header is checked.
+     * On failure there is no program (See attachKernelFilter())
+     */
+        int i, n, len, size;
+        NAME *current;
+        struct sock_filter *code;
+
+        freeKernelFilter();
+        if (level == KF_NONE)
+                return SUCCESS;
+        size = HEADERINSNS + 4;
+        if (level == KF_NAMES) {
+                for (current = names; current != NULL; current = current->next)
+                        if (current->name != NULL)
+                                size += nameSize((U_CHAR *)current->name);
+                for (i = 0; i < registrySz(registry); i++)
+                        size += nameSize((U_CHAR *)hostedName(registry,i,
+                                                              &len));
+                if (size > BPF_MAXINSNS)
+                        level = KF_HEADER;
+        }
+        code = calloc(size,sizeof(struct sock_filter));
+        if (code == NULL)
+                return FAILURE;
+        n = 0;
+        emitHeader(code,&n);
+        if (level == KF_NAMES) {
+                /*
+                 * Labels up to 'PTRLABELMAX' bytes might start a
+                 * "PTR name" (or be one of our names)
+                 */
+                code[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_B |
+                                                         BPF_ABS,
+                                                         UDPHDRSZ + HEADSZ);
+                code[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JGT |
+                                                         BPF_K,
+                                                         PTRLABELMAX,1,0);
+                code[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K,
+                                                         ACCEPTALL);
+                for (current = names; current != NULL; current = current->next)
+                        if (current->name != NULL)
+                                emitName(code,&n,(U_CHAR *)current->name);
+                for (i = 0; i < registrySz(registry); i++)
+                        emitName(code,&n,(U_CHAR *)hostedName(registry,i,
+                                                              &len));
+                code[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K,0);
+        } else {
+                code[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K,
+                                                         ACCEPTALL);
+        }
+        Program.len = n;
+        Program.filter = code;
+        return SUCCESS;
+}
+
+PUBLIC void freeKernelFilter()
+{
+        if (Program.filter != NULL)
+                free(Program.filter);
+        Program.filter = NULL;
+        Program.len = 0;
+}
+
+PUBLIC void attachKernelFilter(int fd)
+{
+    /*
+     * Attach the program to 'fd', replacing the one it had. With
+     * no program the old one is detached. If the kernel refuses
+     * the program every datagram is received (the userspace
+     * prefilter still applies)
+     */
+        int none;
+
+        if (fd < 0)
+                return;
+        none = 0;
+        if (Program.filter == NULL) {
+                setsockopt(fd,SOL_SOCKET,SO_DETACH_FILTER,&none,sizeof(none));
+                return;
+        }
+        if (setsockopt(fd,SOL_SOCKET,SO_ATTACH_FILTER,&Program,
+                       sizeof(Program)))
+                setsockopt(fd,SOL_SOCKET,SO_DETACH_FILTER,&none,sizeof(none));
+}
+
+PUBLIC long kernelDrops(int fd)
+{
+    /*
+     * Datagrams dropped by the kernel on 'fd' (filtered or
+     * receive buffer full). -1 if unknown
+     */
+        socklen_t len;
+        unsigned int memInfo[SK_MEMINFO_VARS];
+
+        len = sizeof(memInfo);
+        if (fd < 0 || getsockopt(fd,SOL_SOCKET,SO_MEMINFO,memInfo,&len) < 0 ||
+            len <= SK_MEMINFO_DROPS * sizeof(unsigned int))
+                return FAILURE;
+        return memInfo[SK_MEMINFO_DROPS];
+}
+
+PRIVATE void emitHeader(struct sock_filter *code, int *n)
+{
+    /*
+     * The header checks ('HEADERINSNS' instructions). Every
+     * failed check falls into a 'return 0' (drop), so no jump
+     * is longer than one instruction. Offsets are relative to
+     * the UDP header
+     */
+        int i;
+
+        code[(*n)++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_LEN,
+                                                    0);
+        code[(*n)++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K,
+                                                    UDPHDRSZ + QUESTMINSZ,
+                                                    1,0);
+        code[(*n)++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K,0);
+        code[(*n)++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_H | BPF_ABS,
+                                                    UDPHDRSZ + 2);
+        code[(*n)++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JSET |
+                                                    BPF_K,
+                                                    HFLAG_QR | HFLAG_OPCODE,
+                                                    0,1);
+        code[(*n)++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K,0);
+        for (i = 0; i < 3; i++) {
+                /*
+                 * QDCOUNT 1, ANCOUNT 0, NSCOUNT 0
+                 */
+                code[(*n)++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_H |
+                                                            BPF_ABS,
+                                                            UDPHDRSZ + 4 +
+                                                            2 * i);
+                code[(*n)++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ |
+                                                            BPF_K,i == 0,1,0);
+                code[(*n)++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K,
+                                                            0);
+        }
+}
+
+PRIVATE void emitName(struct sock_filter *code, int *n, U_CHAR *name)
+{
+    /*
+     * Accept if the first label has the length and the first
+     * 'PREFIXSZ' bytes (case folded with | 0x20, which only
+     * lets a few more bytes through) of 'name'. A mismatch
+     * jumps to the next name
+     */
+        int i, end, prefix;
+
+        prefix = name[0] < PREFIXSZ ? name[0] : PREFIXSZ;
+        end = *n + nameSize(name);
+        code[*n] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_B | BPF_ABS,
+                                                UDPHDRSZ + HEADSZ);
+        (*n)++;
+        code[*n] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+                                                name[0],0,end - *n - 1);
+        (*n)++;
+        for (i = 1; i <= prefix; i++) {
+                code[*n] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_B |
+                                                        BPF_ABS,
+                                                        UDPHDRSZ + HEADSZ + i);
+                (*n)++;
+                code[*n] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_OR |
+                                                        BPF_K,0x20);
+                (*n)++;
+                code[*n] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ |
+                                                        BPF_K,name[i] | 0x20,
+                                                        0,end - *n - 1);
+                (*n)++;
+        }
+        code[*n] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K,ACCEPTALL);
+        (*n)++;
+}
+
+PRIVATE int nameSize(U_CHAR *name)
+{
+    /*
+     * Instructions emitted by emitName()
+     */
+        return 3 + 3 * (name[0] < PREFIXSZ ? name[0] : PREFIXSZ);
+}
@@ -7,10 +7,32 @@
 
 /* Own includes */
 #include "../include/llmnr_defs.h"
+#include "../include/llmnr_ifset.h"
 #include "../include/llmnr_print.h"
 #include "../include/llmnr_names.h"
 
+/* Enums & Structs */
+
+/*
+ * 'name' is the case folded wire format name ('len' bytes,
+ * trailing zero included)
+ */
+typedef struct {
+        unsigned int hash;
+        int len;
+        char *name;
+        NAME *node;
+} NAMEENTRY;
+
+struct nameIndex {
+        unsigned int mask;
+        NAMEENTRY *entries;
+};
+
 /* Private prototypes */
+PRIVATE unsigned int nameHash(char *name, int len);
+PRIVATE int nameCmp(char *folded, char *name, int len);
+PRIVATE char foldChar(char c);
 
 /* Glocal variables */
 
@@ -62,7 +84,6 @@ PUBLIC int newName(char *name, NAME *names)
                 return SYSFAILURE;
         }
         newNode->nameStatus = TENTATIVE;
-        newNode->notAuthOnSz = 0;
         newNode->ptr = NULL;
         newNode->ptrSz = 0;
         strcpy(newNode->name,name);
@@ -85,11 +106,60 @@ PUBLIC void deleteNameList(NAME **names)
                         free(dispose->name);
                 if (dispose->ptr != NULL)
                         free(dispose->ptr);
+                freeIfSet(&dispose->authOn);
+                freeIfSet(&dispose->notAuthOn);
                 free(dispose);
         }
         *names = NULL;
 }
 
+PUBLIC NAME *copyNameList(NAME *names)
+{
+    /*
+     * Returns a deep copy of 'names' (NULL on failure)
+     */
+        NAME *current, *head, *last, *newNode;
+
+        head = NULL;
+        last = NULL;
+        for (current = names; current != NULL; current = current->next) {
+                newNode = malloc(sizeof(NAME));
+                if (newNode == NULL)
+                        goto CleanCNL;
+                memcpy(newNode,current,sizeof(NAME));
+                newNode->name = NULL;
+                newNode->ptr = NULL;
+                newNode->next = NULL;
+                memset(&newNode->authOn,0,sizeof(IFSET));
+                memset(&newNode->notAuthOn,0,sizeof(IFSET));
+                if (last == NULL)
+                        head = newNode;
+                else
+                        last->next = newNode;
+                last = newNode;
+                if (current->name != NULL) {
+                        newNode->name = calloc(1,strlen(current->name) + 1);
+                        if (newNode->name == NULL)
+                                goto CleanCNL;
+                        strcpy(newNode->name,current->name);
+                }
+                if (current->ptr != NULL) {
+                        newNode->ptr = malloc(current->ptrSz);
+                        if (newNode->ptr == NULL)
+                                goto CleanCNL;
+                        memcpy(newNode->ptr,current->ptr,current->ptrSz);
+                }
+                if (copyIfSet(&newNode->authOn,&current->authOn) ||
+                    copyIfSet(&newNode->notAuthOn,&current->notAuthOn))
+                        goto CleanCNL;
+        }
+        return head;
+
+        CleanCNL:
+        deleteNameList(&head);
+        return NULL;
+}
+
 PUBLIC int nameListSz(NAME *names)
 {
         int count;
@@ -106,6 +176,10 @@ PUBLIC int nameListSz(NAME *names)
 
 PUBLIC NAME *getNameNodeByName(char *name, NAME *names)
 {
+    /*
+     * Linear lookup (case insensitive, whole name). Queries
+     * are looked up with lookupName()
+     */
         NAME *current;
 
         if (names == NULL)
@@ -114,110 +188,181 @@ PUBLIC NAME *getNameNodeByName(char *name, NAME *names)
         for (; current != NULL; current = current->next ) {
                 if (current->name == NULL)
                         continue;
-                if (!strncasecmp(current->name,name,strlen(current->name)))
+                if (!strcasecmp(current->name,name))
                         return current;
         }
         return NULL;
 }
 
-PUBLIC void addAuthOn(NAME *name, int ifIndex)
+PUBLIC NAMEINDEX *newNameIndex(NAME *names)
 {
     /*
-     * Add an interface number into 'authOn' array
+     * Build the hash index of 'names' (open addressing, linear
+     * probing, at most half full). The nodes are referenced, so
+     * 'names' must outlive the index
      */
-        int i;
+        int i, len, count;
+        unsigned int hash, size, slot;
+        NAME *current;
+        NAMEENTRY *entry;
+        NAMEINDEX *index;
 
-        for (i = 0; i < name->authOnSz; i++) {
-                if (name->authOn[i] == ifIndex)
-                        return;
+        count = nameListSz(names);
+        for (size = 8; size < 2 * (unsigned int)count; size <<= 1)
+                ;
+        index = calloc(1,sizeof(NAMEINDEX));
+        if (index == NULL)
+                return NULL;
+        index->entries = calloc(size,sizeof(NAMEENTRY));
+        if (index->entries == NULL) {
+                free(index);
+                return NULL;
         }
-        name->authOn[name->authOnSz++] = ifIndex;
+        index->mask = size - 1;
+        for (current = names; current != NULL; current = current->next) {
+                if (current->name == NULL)
+                        continue;
+                len = strlen(current->name) + 1;
+                hash = nameHash(current->name,len);
+                if (lookupName(index,current->name,len,hash,0,NULL) != NULL)
+                        continue;
+                slot = hash & index->mask;
+                while (index->entries[slot].name != NULL)
+                        slot = (slot + 1) & index->mask;
+                entry = &index->entries[slot];
+                entry->name = malloc(len);
+                if (entry->name == NULL) {
+                        delNameIndex(&index);
+                        return NULL;
+                }
+                for (i = 0; i < len; i++)
+                        entry->name[i] = foldChar(current->name[i]);
+                entry->len = len;
+                entry->hash = hash;
+                entry->node = current;
+        }
+        return index;
 }
 
-PUBLIC void delAuthOn(NAME *name, int ifIndex)
+PUBLIC void delNameIndex(NAMEINDEX **index)
 {
-    /*
-     * Delete an interface number from 'authOn' array
-     */
-        U_CHAR *ptr;
-        int i, mark;
-
-        mark = -1;
-        ptr = name->authOn;
-        for (i = 0; i < name->authOnSz; i++) {
-                if (mark >= 0) {
-                        ptr[mark++] = ptr[i];
-                        ptr[i] = 0;
-                }
-                if (ptr[i] == ifIndex) {
-                        mark = i;
-                        if (name->authOnSz == 1) {
-                                ptr[i] = 0;
-                                break;
-                        }
-                }
+        unsigned int i;
+
+        if (*index == NULL)
+                return;
+        for (i = 0; i <= (*index)->mask; i++) {
+                if ((*index)->entries[i].name != NULL)
+                        free((*index)->entries[i].name);
         }
-        if (mark >= 0)
-                name->authOnSz--;
+        free((*index)->entries);
+        free(*index);
+        *index = NULL;
 }
 
-PUBLIC void addNotAuthOn(NAME *name, int ifIndex)
+PUBLIC NAME *lookupName(NAMEINDEX *index, char *name, int len,
+                        unsigned int hash, int ifSlot, int *auth)
 {
     /*
-     * Add an interface number into 'notAuthOn' array
+     * Look up the wire format 'name' ('len' bytes, trailing zero
+     * included) whose hash is 'hash' (See NAMEHASHSTEP). If 'auth'
+     * is given, it tells if the name is authoritative on the
+     * interface of slot 'ifSlot' (See llmnr_ifset.h)
+     * Returns the 'NAME' node (NULL if not found)
      */
-        int i;
+        unsigned int slot;
+        NAMEENTRY *entry;
 
-        for (i = 0; i < name->notAuthOnSz; i++) {
-                if (name->notAuthOn[i] == ifIndex)
-                        return;
+        if (index == NULL || name == NULL)
+                return NULL;
+        slot = hash & index->mask;
+        for (; index->entries[slot].name != NULL;
+             slot = (slot + 1) & index->mask) {
+                entry = &index->entries[slot];
+                if (entry->hash != hash || entry->len != len)
+                        continue;
+                if (nameCmp(entry->name,name,len))
+                        continue;
+                if (auth != NULL)
+                        *auth = !inIfSet(&entry->node->notAuthOn,ifSlot);
+                return entry->node;
         }
-        name->notAuthOn[name->notAuthOnSz++] = ifIndex;
+        return NULL;
 }
 
-PUBLIC void delNotAuthOn(NAME *name, int ifIndex)
+PUBLIC void addAuthOn(NAME *name, int slot)
 {
     /*
-     * Delete an interface number from 'notAuthOn' array
+     * The name is authoritative on the interface of 'slot'
      */
-        U_CHAR *ptr;
-        int i, mark;
-
-        mark = -1;
-        ptr = name->notAuthOn;
-        for (i = 0; i < name->notAuthOnSz; i++) {
-                if (mark >= 0) {
-                        ptr[mark++] = ptr[i];
-                        ptr[i] = 0;
-                }
-                if (ptr[i] == ifIndex) {
-                        mark = i;
-                        if (name->notAuthOnSz == 1) {
-                                ptr[i] = 0;
-                                break;
-                        }
-                }
-        }
-        if (mark >= 0)
-                name->notAuthOnSz--;
+        addIfSet(&name->authOn,slot);
 }
 
-PUBLIC int isNotAuthOn(NAME *name, int ifIndex)
+PUBLIC void delAuthOn(NAME *name, int slot)
+{
+        delIfSet(&name->authOn,slot);
+}
+
+PUBLIC void addNotAuthOn(NAME *name, int slot)
 {
     /*
-     * Checks if a given interface number is into 'notAuthOn'
+     * The name is not authoritative on the interface of 'slot'
      */
-        int i;
+        addIfSet(&name->notAuthOn,slot);
+}
+
+PUBLIC void delNotAuthOn(NAME *name, int slot)
+{
+        delIfSet(&name->notAuthOn,slot);
+}
 
+PUBLIC int isNotAuthOn(NAME *name, int slot)
+{
+    /*
+     * Checks if the interface of 'slot' is into 'notAuthOn'
+     */
         if (name == NULL)
                 return SUCCESS;
-        for (i = 0; i < name->notAuthOnSz; i++) {
-                if (name->notAuthOn[i] == ifIndex)
-                        return SUCCESS;
-        }
+        if (inIfSet(&name->notAuthOn,slot))
+                return SUCCESS;
         return FAILURE;
 }
 
+PRIVATE unsigned int nameHash(char *name, int len)
+{
+    /*
+     * See NAMEHASHSTEP
+     */
+        int i;
+        unsigned int hash;
+
+        hash = NAMEHASHSEED;
+        for (i = 0; i < len; i++)
+                hash = NAMEHASHSTEP(hash,name[i]);
+        return hash;
+}
+
+PRIVATE int nameCmp(char *folded, char *name, int len)
+{
+        int i;
+
+        for (i = 0; i < len; i++) {
+                if (folded[i] != foldChar(name[i]))
+                        return FAILURE;
+        }
+        return SUCCESS;
+}
+
+PRIVATE char foldChar(char c)
+{
+    /*
+     * ASCII only (See RFC 4343). Label lengths are never
+     * folded, they are 63 at most
+     */
+        if (c >= 'A' && c <= 'Z')
+                return c + ('a' - 'A');
+        return c;
+}
+
 PUBLIC void printNames(NAME *names)
 {
         int i;
@@ -239,13 +384,16 @@ PUBLIC void printNames(NAME *names)
                 printToStream("ptrsz: %d. ",current->ptrSz);
                 printBytes(current->ptr,current->ptrSz);
 
-                printToStream("authsz = %d:  ",current->authOnSz);
-                for (i = 0; i < current->authOnSz; i++)
-                        printToStream("%d, ",current->authOn[i]);
+                printToStream("authsz = %d:  ",ifSetSz(&current->authOn));
+                i = nextInIfSet(&current->authOn,0);
+                for (; i >= 0; i = nextInIfSet(&current->authOn,i + 1))
+                        printToStream("%d, ",i);
                 printToStream("\n");
-                printToStream("notAuthsz = %d:  ",current->notAuthOnSz);
-                for (i = 0; i < current->notAuthOnSz; i++)
-                        printToStream("%d, ",current->notAuthOn[i]);
+                printToStream("notAuthsz = %d:  ",
+                              ifSetSz(&current->notAuthOn));
+                i = nextInIfSet(&current->notAuthOn,0);
+                for (; i >= 0; i = nextInIfSet(&current->notAuthOn,i + 1))
+                        printToStream("%d, ",i);
                 printToStream("\n----------------------------------\n");
         }
 }
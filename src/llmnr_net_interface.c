@@ -1,4 +1,8 @@
 /* Macros */
+#define DENSEIFACES 256
+#define MINADDRSETSZ 8
+#define FNVOFFSET 2166136261U
+#define FNVPRIME 16777619U
 
 /* Includes */
 #include <stdlib.h>
@@ -8,23 +12,64 @@
 
 /* Own Includes */
 #include "../include/llmnr_defs.h"
+#include "../include/llmnr_ifset.h"
 #include "../include/llmnr_print.h"
 #include "../include/llmnr_net_interface.h"
 
 /* Enums & Structs */
 
+/*
+ * An address of an interface ('family' 0 means a free slot)
+ * IPv4s only use the first 'IPV4LEN' bytes of 'addr'
+ */
+typedef struct {
+        int ifIndex;
+        int family;
+        U_CHAR addr[IPV6LEN];
+} IFADDR;
+
+/*
+ * 'dense' is indexed by interface index (up to 'DENSEIFACES').
+ * 'sparse' holds the rest, sorted by interface index
+ * 'addrs' is an open addressing hash set (linear probing, never
+ * more than half full) of the addresses of the interfaces
+ */
+struct ifTable {
+        int denseSz;
+        int sparseSz;
+        unsigned int addrMask;
+        NETIFACE **dense;
+        NETIFACE **sparse;
+        IFADDR *addrs;
+};
+
 /* Private prototypes */
 PRIVATE void printType(NETIFIPV6 *ip6);
 PRIVATE void printFlags(NETIFACE *iface);
 PRIVATE void delNetIfIPv4List(NETIFIPV4 **ipv4s);
 PRIVATE void delNetIfIPv6List(NETIFIPV6 **ipv6s);
+PRIVATE int copyNetIfIPv4List(NETIFIPV4 *ipv4s, NETIFIPV4 **copy);
+PRIVATE int copyNetIfIPv6List(NETIFIPV6 *ipv6s, NETIFIPV6 **copy);
 PRIVATE void updateIfaceStatus(NETIFACE *iface);
 PRIVATE int countIps(void *ipList, int iptype);
 PRIVATE int repeatedInterface(int family, NETIFACE *iface);
 PRIVATE NETIFIPV4 *newNetIfIPv4List();
 PRIVATE NETIFIPV6 *newNetIfIPv6List();
+PRIVATE int ifIndexCmp(const void *a, const void *b);
+PRIVATE int newIfAddrSet(IFTABLE *table, NETIFACE *ifaces);
+PRIVATE void putIfAddr(IFTABLE *table, int ifIndex, int family, void *addr);
+PRIVATE IFADDR *getIfAddr(IFTABLE *table, int ifIndex, int family,
+                          U_CHAR *addr);
+PRIVATE unsigned int ifAddrHash(int ifIndex, int family, U_CHAR *addr);
+PRIVATE int growLocalAddrs();
+PRIVATE unsigned int localAddrHash(int family, U_CHAR *addr);
 
 /* Glocal variables */
+PRIVATE long AnswerGen;
+PRIVATE LOCALADDR *LocalAddrs;
+PRIVATE unsigned int LocalMask;
+PRIVATE unsigned int LocalCount;
+PRIVATE unsigned int LocalUsed;
 
 /* Functions definitions */
 PUBLIC NETIFACE *NetIfListHead()
@@ -39,6 +84,7 @@ PUBLIC NETIFACE *NetIfListHead()
                 return NULL;
         head->name = NULL;
         head->ifIndex = -255;
+        head->slot = FAILURE;
         head->flags = _IFF_NOIF;
         head->IPv4s = NULL;
         head->IPv6s = NULL;
@@ -46,17 +92,19 @@ PUBLIC NETIFACE *NetIfListHead()
         return head;
 }
 
-PUBLIC int addNetIfNode(char *name, int family, int flags, NETIFACE *ifaces)
+PUBLIC int addNetIfNode(char *name, int ifIndex, int family, int flags,
+                        NETIFACE *ifaces)
 {
     /*
-     * - Add a new 'NETIFACE' node to the list
+     * - Add a new 'NETIFACE' node to the list. 'ifIndex' is 0 if
+     *   the interface does not exist (yet)
      * - This is an ordered list (ordered by 'ifIndex')
      * - Before creating a new node first checks if a node with 'name'
      *   allready exists. In that case 'repeatedInterface' is called
+     * - The new node gets his slot (See llmnr_ifset.h)
      * Note: a repeated inteface can happens when interfaces are added
      * by config file and not dinamically
      */
-        int ifIndex;
         NETIFACE *current, *previous, *newNode;
 
         if (ifaces == NULL)
@@ -65,7 +113,6 @@ PUBLIC int addNetIfNode(char *name, int family, int flags, NETIFACE *ifaces)
                 return SUCCESS;
         current = ifaces;
         previous = current;
-        ifIndex = if_nametoindex(name);
 
         for (; current != NULL; current = current->next) {
                 if (current->name == NULL || current->ifIndex < 0)
@@ -88,8 +135,16 @@ PUBLIC int addNetIfNode(char *name, int family, int flags, NETIFACE *ifaces)
         if (newNode == NULL)
                 return SYSFAILURE;
         newNode->name = calloc(1,strlen(name) + 1);
-        if (newNode->name == NULL)
+        if (newNode->name == NULL) {
+                free(newNode);
                 return SYSFAILURE;
+        }
+        newNode->slot = newIfSlot();
+        if (newNode->slot < 0) {
+                free(newNode->name);
+                free(newNode);
+                return SYSFAILURE;
+        }
         strcpy(newNode->name,name);
         newNode->ifIndex = ifIndex;
         newNode->flags |= flags;
@@ -197,40 +252,107 @@ PUBLIC void delNetIfList(NETIFACE **ifaces)
                         free(dispose->name);
                 delNetIfIPv4List(&dispose->IPv4s);
                 delNetIfIPv6List(&dispose->IPv6s);
+                freeIfSet(&dispose->mirrorIfs);
                 free(dispose);
         }
         *ifaces = NULL;
 }
 
+PUBLIC NETIFACE *copyNetIfList(NETIFACE *ifaces)
+{
+    /*
+     * Returns a deep copy of a 'NETIFACE' list, ips
+     * included (NULL on failure)
+     */
+        NETIFACE *current, *head, *last, *newNode;
+
+        head = NULL;
+        last = NULL;
+        for (current = ifaces; current != NULL; current = current->next) {
+                newNode = malloc(sizeof(NETIFACE));
+                if (newNode == NULL)
+                        goto CleanCNIL;
+                memcpy(newNode,current,sizeof(NETIFACE));
+                newNode->name = NULL;
+                newNode->IPv4s = NULL;
+                newNode->IPv6s = NULL;
+                newNode->next = NULL;
+                memset(&newNode->mirrorIfs,0,sizeof(IFSET));
+                if (last == NULL)
+                        head = newNode;
+                else
+                        last->next = newNode;
+                last = newNode;
+                if (current->name != NULL) {
+                        newNode->name = calloc(1,strlen(current->name) + 1);
+                        if (newNode->name == NULL)
+                                goto CleanCNIL;
+                        strcpy(newNode->name,current->name);
+                }
+                if (copyNetIfIPv4List(current->IPv4s,&newNode->IPv4s))
+                        goto CleanCNIL;
+                if (copyNetIfIPv6List(current->IPv6s,&newNode->IPv6s))
+                        goto CleanCNIL;
+                if (copyIfSet(&newNode->mirrorIfs,&current->mirrorIfs))
+                        goto CleanCNIL;
+        }
+        return head;
+
+        CleanCNIL:
+        delNetIfList(&head);
+        return NULL;
+}
+
 PUBLIC void remNetIfNode(char *name, NETIFACE *ifaces)
 {
     /*
      * Remove a 'NETIFACE' node from list
      */
-        NETIFACE *current, *previous, *dispose;
+        NETIFACE *current;
 
         if (ifaces == NULL)
                 return;
         if (name == NULL)
                 return;
         current = ifaces;
-        previous = current;
         for (; current != NULL; current = current->next) {
                 if (current->name == NULL)
                         continue;
                 if (!(strncasecmp(name,current->name,strlen(name)))) {
-                        dispose = current;
-                        previous->next = current->next;
-                        free(dispose->name);
-                        delNetIfIPv4List(&dispose->IPv4s);
-                        delNetIfIPv6List(&dispose->IPv6s);
-                        free(dispose);
+                        delNetIfNode(current,ifaces);
                         return;
                 }
-                previous = current;
         }
 }
 
+PUBLIC void delNetIfNode(NETIFACE *iface, NETIFACE *ifaces)
+{
+    /*
+     * Remove the node 'iface' from the list. His slot is free
+     * again (See llmnr_ifset.h): no name nor interface may have
+     * it in their sets
+     */
+        NETIFACE *previous;
+
+        if (ifaces == NULL || iface == NULL || iface == ifaces)
+                return;
+        previous = ifaces;
+        for (; previous->next != NULL; previous = previous->next) {
+                if (previous->next == iface)
+                        break;
+        }
+        if (previous->next != iface)
+                return;
+        previous->next = iface->next;
+        freeIfSlot(iface->slot);
+        if (iface->name != NULL)
+                free(iface->name);
+        delNetIfIPv4List(&iface->IPv4s);
+        delNetIfIPv6List(&iface->IPv6s);
+        freeIfSet(&iface->mirrorIfs);
+        free(iface);
+}
+
 PUBLIC void remNetIfIPv4(NETIFACE *iface, INADDR *remove)
 {
     /*
@@ -419,45 +541,451 @@ PUBLIC int ip6Type(IN6ADDR *ip)
         return type;
 }
 
-PUBLIC void addMirrorIf(NETIFACE *iface, int ifIndex)
+PUBLIC void addMirrorIf(NETIFACE *iface, int slot)
 {
     /*
-     * Add a mirror interface index to the 'mirroIfs' array
+     * The interface of 'slot' is a mirror interface of 'iface'
      */
-        int i;
+        addIfSet(&iface->mirrorIfs,slot);
+}
 
-        for (i = 0; i < iface->mirrorIfSz; i++) {
-                if (iface->mirrorIfs[i] == ifIndex)
-                        return;
+PUBLIC void delMirrorIf(NETIFACE *iface, int slot)
+{
+        delIfSet(&iface->mirrorIfs,slot);
+}
+
+PUBLIC NETIFACE *getNetIfNodeBySlot(NETIFACE *ifaces, int slot)
+{
+    /*
+     * The node of the master list that owns 'slot' (See
+     * llmnr_ifset.h)
+     */
+        NETIFACE *current;
+
+        if (slot < 0)
+                return NULL;
+        for (current = ifaces; current != NULL; current = current->next) {
+                if (current->slot == slot)
+                        return current;
+        }
+        return NULL;
+}
+
+PUBLIC void invalidateAnswers(NETIFACE *iface)
+{
+    /*
+     * Give 'iface' a new answer generation, so his cached
+     * answers are not used anymore (See llmnr_answer_cache.h)
+     */
+        if (iface == NULL)
+                return;
+        iface->answerGen = __atomic_add_fetch(&AnswerGen,1,__ATOMIC_RELAXED);
+}
+
+PUBLIC IFTABLE *newIfTable(NETIFACE *ifaces)
+{
+    /*
+     * Build the index table of 'ifaces' (the nodes are
+     * referenced, so 'ifaces' must outlive the table). As
+     * getNetIfNodeByIndex() does, the first node of an index
+     * wins
+     */
+        int maxIndex, count;
+        IFTABLE *table;
+        NETIFACE *current;
+
+        table = calloc(1,sizeof(IFTABLE));
+        if (table == NULL)
+                return NULL;
+        maxIndex = -1;
+        count = 0;
+        for (current = ifaces; current != NULL; current = current->next) {
+                if (current->ifIndex < 0)
+                        continue;
+                if (current->ifIndex >= DENSEIFACES)
+                        count++;
+                else if (current->ifIndex > maxIndex)
+                        maxIndex = current->ifIndex;
+        }
+        table->denseSz = maxIndex + 1;
+        if (table->denseSz > 0)
+                table->dense = calloc(table->denseSz,sizeof(NETIFACE *));
+        if (count > 0)
+                table->sparse = calloc(count,sizeof(NETIFACE *));
+        if ((table->denseSz > 0 && table->dense == NULL) ||
+            (count > 0 && table->sparse == NULL)) {
+                delIfTable(&table);
+                return NULL;
+        }
+        for (current = ifaces; current != NULL; current = current->next) {
+                if (current->ifIndex < 0)
+                        continue;
+                if (current->ifIndex < DENSEIFACES) {
+                        if (table->dense[current->ifIndex] == NULL)
+                                table->dense[current->ifIndex] = current;
+                } else if (getIfByIndex(table,current->ifIndex) == NULL) {
+                        table->sparse[table->sparseSz++] = current;
+                        qsort(table->sparse,table->sparseSz,
+                              sizeof(NETIFACE *),ifIndexCmp);
+                }
+        }
+        if (newIfAddrSet(table,ifaces)) {
+                delIfTable(&table);
+                return NULL;
+        }
+        return table;
+}
+
+PUBLIC void delIfTable(IFTABLE **table)
+{
+        if (*table == NULL)
+                return;
+        if ((*table)->dense != NULL)
+                free((*table)->dense);
+        if ((*table)->sparse != NULL)
+                free((*table)->sparse);
+        if ((*table)->addrs != NULL)
+                free((*table)->addrs);
+        free(*table);
+        *table = NULL;
+}
+
+PUBLIC NETIFACE *getIfByIndex(IFTABLE *table, int ifIndex)
+{
+    /*
+     * Same thing that getNetIfNodeByIndex() but O(1) for the
+     * dense indexes and O(log n) for the sparse ones
+     */
+        int low, high, mid;
+
+        if (table == NULL || ifIndex < 0)
+                return NULL;
+        if (ifIndex < DENSEIFACES) {
+                if (ifIndex >= table->denseSz)
+                        return NULL;
+                return table->dense[ifIndex];
+        }
+        low = 0;
+        high = table->sparseSz - 1;
+        while (low <= high) {
+                mid = (low + high) / 2;
+                if (table->sparse[mid]->ifIndex == ifIndex)
+                        return table->sparse[mid];
+                if (table->sparse[mid]->ifIndex < ifIndex)
+                        low = mid + 1;
+                else
+                        high = mid - 1;
         }
-        iface->mirrorIfs[iface->mirrorIfSz++] = ifIndex;
+        return NULL;
+}
+
+PUBLIC int hasIfAddr(IFTABLE *table, int ifIndex, int family, U_CHAR *addr)
+{
+    /*
+     * Check whether 'addr' (of family 'family', network order)
+     * is an address of interface 'ifIndex'
+     */
+        if (table == NULL || table->addrs == NULL)
+                return FALSE;
+        return getIfAddr(table,ifIndex,family,addr) != NULL;
 }
 
-PUBLIC void delMirrorIf(NETIFACE *iface, int ifIndex)
+PUBLIC int fillLocalAddrs(NETIFACE *ifaces)
 {
     /*
-     * remove an interface index from the 'mirrorIfs' array
+     * (Re)build the local addresses set with every address of
+     * 'ifaces'. From then on it is kept up to date with
+     * addLocalAddr() and delLocalAddr()
      */
-        U_CHAR *ptr;
-        int i, mark;
+        NETIFACE *current;
+        NETIFIPV4 *ip4;
+        NETIFIPV6 *ip6;
 
-        mark = -1;
-        ptr = iface->mirrorIfs;
-        for (i = 0; i < iface->mirrorIfSz; i++) {
-                if (mark >= 0) {
-                        ptr[mark++] = ptr[i];
-                        ptr[i] = 0;
+        freeLocalAddrs();
+        for (current = ifaces; current != NULL; current = current->next) {
+                for (ip4 = current->IPv4s; ip4 != NULL; ip4 = ip4->next) {
+                        if (ip4->ipType == NOIP)
+                                continue;
+                        if (addLocalAddr(current,AF_INET,&ip4->ip4Addr))
+                                return FAILURE;
                 }
-                if (ptr[i] == ifIndex) {
-                        mark = i;
-                        if (iface->mirrorIfSz == 1) {
-                                ptr[i] = 0;
-                                break;
-                        }
+                for (ip6 = current->IPv6s; ip6 != NULL; ip6 = ip6->next) {
+                        if (ip6->ipType == NOIP)
+                                continue;
+                        if (addLocalAddr(current,AF_INET6,&ip6->ip6Addr))
+                                return FAILURE;
+                }
+        }
+        return SUCCESS;
+}
+
+PUBLIC void freeLocalAddrs()
+{
+        if (LocalAddrs != NULL)
+                free(LocalAddrs);
+        LocalAddrs = NULL;
+        LocalMask = 0;
+        LocalCount = 0;
+        LocalUsed = 0;
+}
+
+PUBLIC int addLocalAddr(NETIFACE *iface, int family, void *addr)
+{
+    /*
+     * 'addr' is now an address of 'iface'. The set never gets
+     * more than half full (removed entries included). The whole
+     * probe chain is checked for the entry before reusing the
+     * first removed one found, so an address is never stored
+     * twice
+     */
+        unsigned int i;
+        LOCALADDR *entry, *removed;
+
+        if (iface == NULL || addr == NULL)
+                return FAILURE;
+        if (LocalAddrs == NULL || 2 * (LocalUsed + 1) > LocalMask + 1) {
+                if (growLocalAddrs())
+                        return FAILURE;
+        }
+        removed = NULL;
+        i = localAddrHash(family,addr) & LocalMask;
+        for (;; i = (i + 1) & LocalMask) {
+                entry = &LocalAddrs[i];
+                if (entry->family == 0)
+                        break;
+                if (entry->family < 0) {
+                        if (removed == NULL)
+                                removed = entry;
+                        continue;
+                }
+                if (entry->family == family &&
+                    entry->ifIndex == iface->ifIndex &&
+                    !memcmp(entry->addr,addr,
+                            family == AF_INET ? IPV4LEN : IPV6LEN))
+                        return SUCCESS;
+        }
+        if (removed != NULL)
+                entry = removed;
+        else
+                LocalUsed++;
+        memset(entry,0,sizeof(LOCALADDR));
+        entry->family = family;
+        entry->ifIndex = iface->ifIndex;
+        entry->iface = iface;
+        memcpy(entry->addr,addr,family == AF_INET ? IPV4LEN : IPV6LEN);
+        if (family == AF_INET)
+                entry->ipType = IPV4IP;
+        else
+                entry->ipType = ip6Type((IN6ADDR *)addr);
+        LocalCount++;
+        return SUCCESS;
+}
+
+PUBLIC void delLocalAddr(NETIFACE *iface, int family, void *addr)
+{
+    /*
+     * 'addr' is not an address of 'iface' anymore. Its entry is
+     * marked as removed (the probe chains must not be broken)
+     */
+        unsigned int i;
+        LOCALADDR *entry;
+
+        if (LocalAddrs == NULL || iface == NULL || addr == NULL)
+                return;
+        i = localAddrHash(family,addr) & LocalMask;
+        for (;; i = (i + 1) & LocalMask) {
+                entry = &LocalAddrs[i];
+                if (entry->family == 0)
+                        return;
+                if (entry->family == family &&
+                    entry->ifIndex == iface->ifIndex &&
+                    !memcmp(entry->addr,addr,
+                            family == AF_INET ? IPV4LEN : IPV6LEN)) {
+                        entry->family = -1;
+                        entry->iface = NULL;
+                        LocalCount--;
+                        return;
                 }
         }
-        if (mark >= 0)
-                iface->mirrorIfSz--;
+}
+
+PUBLIC LOCALADDR *getLocalAddr(int family, void *addr, int exceptIf)
+{
+    /*
+     * Look for 'addr' among the addresses of the LLMNR
+     * interfaces (the list head doesn't count) but the one with
+     * index 'exceptIf' (0 = any interface). The same address
+     * may belong to several interfaces: the entries share the
+     * probe chain, so the first other one is returned
+     */
+        int len;
+        unsigned int i;
+        LOCALADDR *entry;
+
+        if (LocalAddrs == NULL || addr == NULL)
+                return NULL;
+        len = family == AF_INET ? IPV4LEN : IPV6LEN;
+        i = localAddrHash(family,addr) & LocalMask;
+        for (;; i = (i + 1) & LocalMask) {
+                entry = &LocalAddrs[i];
+                if (entry->family == 0)
+                        return NULL;
+                if (entry->family != family || memcmp(entry->addr,addr,len))
+                        continue;
+                if (entry->ifIndex == exceptIf)
+                        continue;
+                if (entry->iface->flags & _IFF_NOIF)
+                        continue;
+                return entry;
+        }
+}
+
+PRIVATE int ifIndexCmp(const void *a, const void *b)
+{
+        return (*(NETIFACE **)a)->ifIndex - (*(NETIFACE **)b)->ifIndex;
+}
+
+PRIVATE int newIfAddrSet(IFTABLE *table, NETIFACE *ifaces)
+{
+    /*
+     * newIfTable() helper: hash every address of the interfaces
+     * found by the table (so the first node of an index)
+     */
+        int count;
+        unsigned int size;
+        NETIFACE *current;
+        NETIFIPV4 *ip4;
+        NETIFIPV6 *ip6;
+
+        count = 0;
+        for (current = ifaces; current != NULL; current = current->next) {
+                if (getIfByIndex(table,current->ifIndex) != current)
+                        continue;
+                count += countIps(current->IPv4s,IPV4IP);
+                count += countIps(current->IPv6s,IPV6IP);
+        }
+        for (size = MINADDRSETSZ; size < 2 * (unsigned int)count; size <<= 1)
+                ;
+        table->addrs = calloc(size,sizeof(IFADDR));
+        if (table->addrs == NULL)
+                return FAILURE;
+        table->addrMask = size - 1;
+        for (current = ifaces; current != NULL; current = current->next) {
+                if (getIfByIndex(table,current->ifIndex) != current)
+                        continue;
+                for (ip4 = current->IPv4s; ip4 != NULL; ip4 = ip4->next)
+                        if (ip4->ipType != NOIP)
+                                putIfAddr(table,current->ifIndex,AF_INET,
+                                          &ip4->ip4Addr);
+                for (ip6 = current->IPv6s; ip6 != NULL; ip6 = ip6->next)
+                        if (ip6->ipType != NOIP)
+                                putIfAddr(table,current->ifIndex,AF_INET6,
+                                          &ip6->ip6Addr);
+        }
+        return SUCCESS;
+}
+
+PRIVATE void putIfAddr(IFTABLE *table, int ifIndex, int family, void *addr)
+{
+        unsigned int i;
+        IFADDR key;
+
+        memset(&key,0,sizeof(IFADDR));
+        key.ifIndex = ifIndex;
+        key.family = family;
+        memcpy(key.addr,addr,family == AF_INET ? IPV4LEN : IPV6LEN);
+        if (getIfAddr(table,ifIndex,family,key.addr) != NULL)
+                return;
+        i = ifAddrHash(ifIndex,family,key.addr) & table->addrMask;
+        while (table->addrs[i].family != 0)
+                i = (i + 1) & table->addrMask;
+        table->addrs[i] = key;
+}
+
+PRIVATE IFADDR *getIfAddr(IFTABLE *table, int ifIndex, int family,
+                          U_CHAR *addr)
+{
+        int len;
+        unsigned int i;
+        IFADDR *entry;
+
+        len = family == AF_INET ? IPV4LEN : IPV6LEN;
+        i = ifAddrHash(ifIndex,family,addr) & table->addrMask;
+        for (;; i = (i + 1) & table->addrMask) {
+                entry = &table->addrs[i];
+                if (entry->family == 0)
+                        return NULL;
+                if (entry->ifIndex == ifIndex && entry->family == family &&
+                    !memcmp(entry->addr,addr,len))
+                        return entry;
+        }
+}
+
+PRIVATE unsigned int ifAddrHash(int ifIndex, int family, U_CHAR *addr)
+{
+    /*
+     * FNV-1a of the address mixed with the interface index
+     */
+        int i, len;
+        unsigned int hash;
+
+        len = family == AF_INET ? IPV4LEN : IPV6LEN;
+        hash = FNVOFFSET;
+        for (i = 0; i < len; i++)
+                hash = (hash ^ addr[i]) * FNVPRIME;
+        hash = (hash ^ (unsigned int)ifIndex) * FNVPRIME;
+        hash = (hash ^ (unsigned int)family) * FNVPRIME;
+        return hash;
+}
+
+PRIVATE int growLocalAddrs()
+{
+    /*
+     * Rehash the local addresses set into a table at least four
+     * times bigger than the live entries (the removed ones are
+     * dropped)
+     */
+        unsigned int i, j, size, oldSz;
+        LOCALADDR *table, *old;
+
+        for (size = MINADDRSETSZ; size < 4 * (LocalCount + 1); size <<= 1)
+                ;
+        table = calloc(size,sizeof(LOCALADDR));
+        if (table == NULL)
+                return FAILURE;
+        old = LocalAddrs;
+        oldSz = old == NULL ? 0 : LocalMask + 1;
+        for (i = 0; i < oldSz; i++) {
+                if (old[i].family <= 0)
+                        continue;
+                j = localAddrHash(old[i].family,old[i].addr) & (size - 1);
+                while (table[j].family != 0)
+                        j = (j + 1) & (size - 1);
+                table[j] = old[i];
+        }
+        if (old != NULL)
+                free(old);
+        LocalAddrs = table;
+        LocalMask = size - 1;
+        LocalUsed = LocalCount;
+        return SUCCESS;
+}
+
+PRIVATE unsigned int localAddrHash(int family, U_CHAR *addr)
+{
+    /*
+     * Same thing that ifAddrHash() but without the interface
+     * index (an address is looked up on every interface)
+     */
+        int i, len;
+        unsigned int hash;
+
+        len = family == AF_INET ? IPV4LEN : IPV6LEN;
+        hash = FNVOFFSET;
+        for (i = 0; i < len; i++)
+                hash = (hash ^ addr[i]) * FNVPRIME;
+        hash = (hash ^ (unsigned int)family) * FNVPRIME;
+        return hash;
 }
 
 PRIVATE int repeatedInterface(int family, NETIFACE *iface)
@@ -554,6 +1082,48 @@ PRIVATE NETIFIPV6 *newNetIfIPv6List()
         return head;
 }
 
+PRIVATE int copyNetIfIPv4List(NETIFIPV4 *ipv4s, NETIFIPV4 **copy)
+{
+    /*
+     * Copy a 'NETIFIPV4' list into 'copy'. On failure
+     * the partial copy is left in 'copy' (to be deleted
+     * along with his interface)
+     */
+        NETIFIPV4 *current, *newNode, **last;
+
+        last = copy;
+        for (current = ipv4s; current != NULL; current = current->next) {
+                newNode = malloc(sizeof(NETIFIPV4));
+                if (newNode == NULL)
+                        return FAILURE;
+                memcpy(newNode,current,sizeof(NETIFIPV4));
+                newNode->next = NULL;
+                *last = newNode;
+                last = &newNode->next;
+        }
+        return SUCCESS;
+}
+
+PRIVATE int copyNetIfIPv6List(NETIFIPV6 *ipv6s, NETIFIPV6 **copy)
+{
+    /*
+     * Same thing that does copyNetIfIPv4List() but for IPv6
+     */
+        NETIFIPV6 *current, *newNode, **last;
+
+        last = copy;
+        for (current = ipv6s; current != NULL; current = current->next) {
+                newNode = malloc(sizeof(NETIFIPV6));
+                if (newNode == NULL)
+                        return FAILURE;
+                memcpy(newNode,current,sizeof(NETIFIPV6));
+                newNode->next = NULL;
+                *last = newNode;
+                last = &newNode->next;
+        }
+        return SUCCESS;
+}
+
 PRIVATE void delNetIfIPv4List(NETIFIPV4 **ipv4s)
 {
     /*
@@ -601,11 +1171,12 @@ PUBLIC void printIfaces(NETIFACE *ifaces)
                 return;
         aux = ifaces;
         for (; aux != NULL; aux = aux->next) {
-                printToStream("Name: %s. Index: %d\n",
-                       aux->name,aux->ifIndex);
-                printToStream("mirroSz %d:  ",aux->mirrorIfSz);
-                for (i = 0; i < aux->mirrorIfSz; i++)
-                        printToStream("%d, ",aux->mirrorIfs[i]);
+                printToStream("Name: %s. Index: %d. Slot: %d\n",
+                       aux->name,aux->ifIndex,aux->slot);
+                printToStream("mirroSz %d:  ",ifSetSz(&aux->mirrorIfs));
+                i = nextInIfSet(&aux->mirrorIfs,0);
+                for (; i >= 0; i = nextInIfSet(&aux->mirrorIfs,i + 1))
+                        printToStream("%d, ",i);
                 printToStream("\n");
                 printFlags(aux);
                 ip4 = aux->IPv4s;
@@ -618,7 +1189,6 @@ PUBLIC void printIfaces(NETIFACE *ifaces)
                                 printToStream("Unk IPv4 type\n");
                         printBytes(&ip4->ip4Addr,sizeof(INADDR));
                         printBytes(ip4->ARECORD,sizeof(ip4->ARECORD));
-                        nPrintBytes(ip4->PTR4RECORD,sizeof(ip4->PTR4RECORD));
                         ip4 = ip4->next;
                 }
                 ip6 = aux->IPv6s;
@@ -626,7 +1196,6 @@ PUBLIC void printIfaces(NETIFACE *ifaces)
                         printType(ip6);
                         printBytes(&ip6->ip6Addr,sizeof(IN6ADDR));
                         printBytes(&ip6->AAAARECORD,sizeof(ip6->AAAARECORD));
-                        nPrintBytes(ip6->PTR6RECORD,sizeof(ip6->PTR6RECORD));
                         ip6 = ip6->next;
                 }
                 printToStream("\n--------------------------------------------------\n");
@@ -0,0 +1,530 @@
+/* Macros */
+#define _GNU_SOURCE
+#define NLBUFSZ 32768
+
+/* Includes */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+/* Own includes */
+#include "../include/llmnr_defs.h"
+#include "../include/llmnr_ifset.h"
+#include "../include/llmnr_net_interface.h"
+#include "../include/llmnr_sockets.h"
+#include "../include/llmnr_stats.h"
+#include "../include/llmnr_netlink.h"
+
+/* Enums & Structs */
+
+/* Private prototypes */
+PRIVATE int resync(int fd);
+PRIVATE int dump(int fd, int type);
+PRIVATE int parseMsg(struct nlmsghdr *nlMsg);
+PRIVATE int parseLink(struct nlmsghdr *nlMsg);
+PRIVATE int parseAddr(struct nlmsghdr *nlMsg);
+PRIVATE NLLINK *addLink(int ifIndex);
+PRIVATE NLLINK *findLink(NLLINK *links, int ifIndex);
+PRIVATE void remLink(NLLINK *link);
+PRIVATE int addLinkAddr(NLLINK *link, int family, void *addr);
+PRIVATE int remLinkAddr(NLLINK *link, int family, void *addr);
+PRIVATE void freeLinkAddrs(NLADDR **addrs);
+
+/* Glocal variables */
+PRIVATE int NlFd = -1;
+PRIVATE unsigned int Seq;
+PRIVATE NLLINK *Links;
+PRIVATE U_CHAR Buffer[NLBUFSZ];
+
+/* Functions definitions */
+PUBLIC int openNetlink()
+{
+    /*
+     * Open the netlink socket (See createNetLinkSocket()) and
+     * (re)build the links table with a RTM_GETLINK and a
+     * RTM_GETADDR dump (See resync()). The socket is subscribed
+     * before the dumps, so no change is lost: the ones that
+     * happen while (or after) dumping are read later, as any
+     * notification
+     * Returns the socket
+     */
+        int fd;
+
+        fd = createNetLinkSocket();
+        if (fd < 0)
+                return FAILURE;
+        if (resync(fd)) {
+                close(fd);
+                return FAILURE;
+        }
+        NlFd = fd;
+        return fd;
+}
+
+PUBLIC int netlinkSocket()
+{
+        return NlFd;
+}
+
+PUBLIC int readNetlink(int fd)
+{
+    /*
+     * Drain the pending notifications into the links table.
+     * The changed links are just marked (See commitNetlink()).
+     * If the kernel dropped notifications (the socket buffer
+     * overran: ENOBUFS) or one did not fit in the buffer
+     * (MSG_TRUNC) the table is not trustworthy anymore, so it
+     * is rebuilt with a new dump (See resync())
+     * Returns how many changes were read or FAILURE if the
+     * table could not be rebuilt
+     */
+        int len, changes, overrun;
+        struct iovec iov;
+        struct msghdr msg;
+        struct nlmsghdr *nlMsg;
+
+        changes = 0;
+        overrun = FALSE;
+        iov.iov_base = Buffer;
+        iov.iov_len = NLBUFSZ;
+        while (1) {
+                memset(&msg,0,sizeof(msg));
+                msg.msg_iov = &iov;
+                msg.msg_iovlen = 1;
+                len = recvmsg(fd,&msg,MSG_DONTWAIT);
+                if (len < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        if (errno == ENOBUFS)
+                                overrun = TRUE;
+                        break;
+                }
+                if (len == 0)
+                        break;
+                if (msg.msg_flags & MSG_TRUNC) {
+                        overrun = TRUE;
+                        continue;
+                }
+                nlMsg = (struct nlmsghdr *)Buffer;
+                for (; NLMSG_OK(nlMsg,len); nlMsg = NLMSG_NEXT(nlMsg,len)) {
+                        incStat(STAT_NLMESSAGES);
+                        changes += parseMsg(nlMsg);
+                }
+        }
+        if (overrun) {
+                incStat(STAT_NLRESYNCS);
+                if (resync(fd))
+                        return FAILURE;
+                changes++;
+        }
+        return changes;
+}
+
+PUBLIC void commitNetlink(nlapply apply)
+{
+    /*
+     * Hand every link changed since the last commit to 'apply'
+     * (once, whatever the number of notifications) and forget
+     * the links that are gone. With no 'apply' the changes are
+     * just forgotten
+     */
+        NLLINK *current, *next;
+
+        for (current = Links; current != NULL; current = next) {
+                next = current->next;
+                if (!current->changed)
+                        continue;
+                current->changed = FALSE;
+                if (apply != NULL)
+                        apply(current);
+                if (current->gone)
+                        remLink(current);
+        }
+}
+
+PUBLIC void freeLinks()
+{
+        NLLINK *next;
+
+        while (Links != NULL) {
+                next = Links->next;
+                freeLinkAddrs(&Links->addrs4);
+                freeLinkAddrs(&Links->addrs6);
+                free(Links);
+                Links = next;
+        }
+}
+
+PUBLIC NLLINK *getLinks()
+{
+        return Links;
+}
+
+PUBLIC NLLINK *getLink(int ifIndex)
+{
+        NLLINK *current;
+
+        for (current = Links; current != NULL; current = current->next) {
+                if (current->ifIndex == ifIndex && !current->gone)
+                        return current;
+        }
+        return NULL;
+}
+
+PUBLIC NLLINK *getLinkByName(char *name)
+{
+        NLLINK *current;
+
+        if (name == NULL)
+                return NULL;
+        for (current = Links; current != NULL; current = current->next) {
+                if (!strcmp(current->name,name) && !current->gone)
+                        return current;
+        }
+        return NULL;
+}
+
+PUBLIC int linkIndex(char *name)
+{
+    /*
+     * Same thing that if_nametoindex(): 0 if there is no such
+     * link
+     */
+        NLLINK *link;
+
+        link = getLinkByName(name);
+        if (link == NULL)
+                return 0;
+        return link->ifIndex;
+}
+
+PUBLIC int linkHasAddr(NLLINK *link, int family, void *addr)
+{
+    /*
+     * Check whether 'addr' (of 'family') belongs to 'link'
+     */
+        int len;
+        NLADDR *current;
+
+        len = family == AF_INET ? IPV4LEN : IPV6LEN;
+        current = family == AF_INET ? link->addrs4 : link->addrs6;
+        for (; current != NULL; current = current->next) {
+                if (!memcmp(current->addr,addr,len))
+                        return TRUE;
+        }
+        return FALSE;
+}
+
+PRIVATE int resync(int fd)
+{
+    /*
+     * Build the links table again from a dump. Every link is
+     * marked as changed, the ones that are not there anymore are
+     * kept (without flags nor addresses) as gone until the next
+     * commit. If the dump fails the old table is kept
+     */
+        NLLINK *old, *current, *next;
+
+        old = Links;
+        Links = NULL;
+        if (dump(fd,RTM_GETLINK) || dump(fd,RTM_GETADDR)) {
+                freeLinks();
+                Links = old;
+                return FAILURE;
+        }
+        for (current = Links; current != NULL; current = current->next)
+                current->changed = TRUE;
+        for (current = old; current != NULL; current = next) {
+                next = current->next;
+                if (findLink(Links,current->ifIndex) != NULL) {
+                        current->next = NULL;
+                        freeLinkAddrs(&current->addrs4);
+                        freeLinkAddrs(&current->addrs6);
+                        free(current);
+                        continue;
+                }
+                freeLinkAddrs(&current->addrs4);
+                freeLinkAddrs(&current->addrs6);
+                current->flags = 0;
+                current->gone = TRUE;
+                current->changed = TRUE;
+                current->next = Links;
+                Links = current;
+        }
+        return SUCCESS;
+}
+
+PRIVATE int dump(int fd, int type)
+{
+    /*
+     * Ask the kernel for every link (RTM_GETLINK) or address
+     * (RTM_GETADDR) and read the answer until it is done.
+     * Notifications received in the meantime update the table
+     * as well
+     */
+        int len;
+        unsigned int seq;
+        struct iovec iov;
+        struct msghdr msg;
+        struct nlmsghdr *nlMsg;
+        struct sockaddr_nl kernel;
+        struct {
+                struct nlmsghdr nlMsg;
+                struct rtgenmsg gen;
+        } req;
+
+        seq = ++Seq;
+        memset(&req,0,sizeof(req));
+        req.nlMsg.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtgenmsg));
+        req.nlMsg.nlmsg_type = type;
+        req.nlMsg.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+        req.nlMsg.nlmsg_seq = seq;
+        req.gen.rtgen_family = AF_UNSPEC;
+        memset(&kernel,0,sizeof(kernel));
+        kernel.nl_family = AF_NETLINK;
+        if (sendto(fd,&req,req.nlMsg.nlmsg_len,0,(SA *)&kernel,
+                   sizeof(kernel)) < 0)
+                return FAILURE;
+        iov.iov_base = Buffer;
+        iov.iov_len = NLBUFSZ;
+        while (1) {
+                memset(&msg,0,sizeof(msg));
+                msg.msg_iov = &iov;
+                msg.msg_iovlen = 1;
+                len = recvmsg(fd,&msg,0);
+                if (len < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return FAILURE;
+                }
+                if (msg.msg_flags & MSG_TRUNC)
+                        return FAILURE;
+                nlMsg = (struct nlmsghdr *)Buffer;
+                for (; NLMSG_OK(nlMsg,len); nlMsg = NLMSG_NEXT(nlMsg,len)) {
+                        if (nlMsg->nlmsg_seq == seq) {
+                                if (nlMsg->nlmsg_type == NLMSG_DONE)
+                                        return SUCCESS;
+                                if (nlMsg->nlmsg_type == NLMSG_ERROR)
+                                        return FAILURE;
+                        }
+                        parseMsg(nlMsg);
+                }
+        }
+}
+
+PRIVATE int parseMsg(struct nlmsghdr *nlMsg)
+{
+    /*
+     * Returns TRUE if the message changed the links table
+     */
+        switch (nlMsg->nlmsg_type) {
+        case RTM_NEWLINK:
+        case RTM_DELLINK:
+                return parseLink(nlMsg);
+        case RTM_NEWADDR:
+        case RTM_DELADDR:
+                return parseAddr(nlMsg);
+        }
+        return FALSE;
+}
+
+PRIVATE int parseLink(struct nlmsghdr *nlMsg)
+{
+    /*
+     * Parse a link message (See RTNETLINK(7)). The ones of the
+     * bridge family talk about bridge ports, not links. Only a
+     * new link, a new name or new flags are a change (the kernel
+     * also notifies statistics and the like)
+     */
+        int len;
+        char *name;
+        NLLINK *link;
+        struct rtattr *attrs;
+        struct ifinfomsg *info;
+
+        if (nlMsg->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg)))
+                return FALSE;
+        info = (struct ifinfomsg *)NLMSG_DATA(nlMsg);
+        if (info->ifi_family == AF_BRIDGE)
+                return FALSE;
+        if (nlMsg->nlmsg_type == RTM_DELLINK) {
+                link = getLink(info->ifi_index);
+                if (link == NULL)
+                        return FALSE;
+                freeLinkAddrs(&link->addrs4);
+                freeLinkAddrs(&link->addrs6);
+                link->flags = 0;
+                link->gone = TRUE;
+                link->changed = TRUE;
+                return TRUE;
+        }
+        name = NULL;
+        len = IFLA_PAYLOAD(nlMsg);
+        attrs = IFLA_RTA(info);
+        for (; RTA_OK(attrs,len); attrs = RTA_NEXT(attrs,len)) {
+                if (attrs->rta_type == IFLA_IFNAME)
+                        name = (char *)RTA_DATA(attrs);
+        }
+        link = getLink(info->ifi_index);
+        if (link != NULL && link->flags == info->ifi_flags &&
+            (name == NULL || !strncmp(link->name,name,IFNAMSIZ - 1)))
+                return FALSE;
+        link = addLink(info->ifi_index);
+        if (link == NULL)
+                return FALSE;
+        link->flags = info->ifi_flags;
+        if (name != NULL)
+                strncpy(link->name,name,IFNAMSIZ - 1);
+        link->changed = TRUE;
+        return TRUE;
+}
+
+PRIVATE int parseAddr(struct nlmsghdr *nlMsg)
+{
+    /*
+     * Parse an address message (See RTNETLINK(7)). The local
+     * address is 'IFA_LOCAL' if present (point to point links,
+     * 'IFA_ADDRESS' is then the peer one), if not 'IFA_ADDRESS'
+     */
+        int len, family, changed;
+        void *local, *address;
+        NLLINK *link;
+        struct rtattr *attrs;
+        struct ifaddrmsg *ip;
+
+        if (nlMsg->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifaddrmsg)))
+                return FALSE;
+        ip = (struct ifaddrmsg *)NLMSG_DATA(nlMsg);
+        family = ip->ifa_family;
+        if (family != AF_INET && family != AF_INET6)
+                return FALSE;
+        local = NULL;
+        address = NULL;
+        len = IFA_PAYLOAD(nlMsg);
+        attrs = IFA_RTA(ip);
+        for (; RTA_OK(attrs,len); attrs = RTA_NEXT(attrs,len)) {
+                if (attrs->rta_type == IFA_LOCAL)
+                        local = RTA_DATA(attrs);
+                else if (attrs->rta_type == IFA_ADDRESS)
+                        address = RTA_DATA(attrs);
+        }
+        if (local != NULL)
+                address = local;
+        if (address == NULL)
+                return FALSE;
+        if (nlMsg->nlmsg_type == RTM_NEWADDR) {
+                link = addLink(ip->ifa_index);
+                if (link == NULL)
+                        return FALSE;
+                changed = addLinkAddr(link,family,address);
+        } else {
+                link = getLink(ip->ifa_index);
+                if (link == NULL)
+                        return FALSE;
+                changed = remLinkAddr(link,family,address);
+        }
+        if (changed)
+                link->changed = TRUE;
+        return changed;
+}
+
+PRIVATE NLLINK *addLink(int ifIndex)
+{
+    /*
+     * The link 'ifIndex' (a new one if there is none). A gone
+     * link whose index is reused is back
+     */
+        NLLINK *link;
+
+        link = findLink(Links,ifIndex);
+        if (link != NULL) {
+                link->gone = FALSE;
+                return link;
+        }
+        link = calloc(1,sizeof(NLLINK));
+        if (link == NULL)
+                return NULL;
+        link->ifIndex = ifIndex;
+        link->next = Links;
+        Links = link;
+        return link;
+}
+
+PRIVATE NLLINK *findLink(NLLINK *links, int ifIndex)
+{
+    /*
+     * Same thing that getLink() but gone links are found too
+     */
+        for (; links != NULL; links = links->next) {
+                if (links->ifIndex == ifIndex)
+                        return links;
+        }
+        return NULL;
+}
+
+PRIVATE void remLink(NLLINK *link)
+{
+        NLLINK **ptr;
+
+        for (ptr = &Links; *ptr != NULL; ptr = &(*ptr)->next) {
+                if (*ptr == link) {
+                        *ptr = link->next;
+                        break;
+                }
+        }
+        freeLinkAddrs(&link->addrs4);
+        freeLinkAddrs(&link->addrs6);
+        free(link);
+}
+
+PRIVATE int addLinkAddr(NLLINK *link, int family, void *addr)
+{
+        int len;
+        NLADDR **addrs, *current;
+
+        if (linkHasAddr(link,family,addr))
+                return FALSE;
+        len = family == AF_INET ? IPV4LEN : IPV6LEN;
+        addrs = family == AF_INET ? &link->addrs4 : &link->addrs6;
+        current = calloc(1,sizeof(NLADDR));
+        if (current == NULL)
+                return FALSE;
+        memcpy(current->addr,addr,len);
+        current->next = *addrs;
+        *addrs = current;
+        return TRUE;
+}
+
+PRIVATE int remLinkAddr(NLLINK *link, int family, void *addr)
+{
+        int len;
+        NLADDR **ptr, *current;
+
+        len = family == AF_INET ? IPV4LEN : IPV6LEN;
+        ptr = family == AF_INET ? &link->addrs4 : &link->addrs6;
+        for (; *ptr != NULL; ptr = &(*ptr)->next) {
+                if (!memcmp((*ptr)->addr,addr,len)) {
+                        current = *ptr;
+                        *ptr = current->next;
+                        free(current);
+                        return TRUE;
+                }
+        }
+        return FALSE;
+}
+
+PRIVATE void freeLinkAddrs(NLADDR **addrs)
+{
+        NLADDR *next;
+
+        while (*addrs != NULL) {
+                next = (*addrs)->next;
+                free(*addrs);
+                *addrs = next;
+        }
+}
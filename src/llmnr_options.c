@@ -0,0 +1,134 @@
+/* Macros */
+
+/* Includes */
+#include <ctype.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Own includes */
+#include "../include/llmnr_defs.h"
+#include "../include/llmnr_print.h"
+#include "../include/llmnr_options.h"
+
+/* Enums & Structs */
+typedef struct {
+        char *name;
+        long value;
+        long min;
+        long max;
+} OPTION;
+
+/* Private prototypes */
+PRIVATE int getOptionIndex(char *name);
+
+/* Glocal variables */
+PRIVATE OPTION Options[OPTIONSZ] = {
+        /* Worker threads answering UDP queries */
+        {"workers", 4, 1, 64},
+        /* Client slots preallocated for the UDP queue */
+        {"queue_size", 256, 16, 65536},
+        /* Datagrams drained per recvmmsg() (See MAXRCVBATCH) */
+        {"recv_batch", 16, 1, MAXRCVBATCH},
+        /* Answers flushed per sendmmsg() (See MAXSNDBATCH) */
+        {"send_batch", 16, 1, MAXSNDBATCH},
+        /* Microseconds an answer may wait for his batch */
+        {"send_budget", 500, 0, 10000},
+        /* SO_REUSEPORT shards per family (0: not sharded) */
+        {"shards", 0, 0, MAXSHARDS},
+        /* CPUs the shards are pinned to (bit N: CPU N, 0: all) */
+        {"shard_cpus", 0, 0, LONG_MAX},
+        /* 0: kernel hash, 1: SO_INCOMING_CPU, 2: cBPF by CPU
+         * (See STEERING in llmnr_shards.h) */
+        {"shard_steering", 0, 0, 2},
+        /* Serialized answers cached (0: no cache) */
+        {"answer_cache", 1024, 0, 65536},
+        /* 0: no socket filter, 1: header checks, 2: header and
+         * first label (See KFILTER_LEVEL in llmnr_kernel_filter.h) */
+        {"kernel_filter", 2, 0, 2},
+        /* Pending connections of the TCP listening socket */
+        {"tcp_backlog", 16, 1, 4096},
+        /* TCP connections open at the same time */
+        {"tcp_clients", 64, 1, 4096},
+        /* Milliseconds a TCP connection may stay idle */
+        {"tcp_idle", 2000, 100, 600000},
+        /* Milliseconds a TCP connection may stay open */
+        {"tcp_lifetime", 10000, 100, 3600000},
+        /* Largest UDP answer to an EDNS0 query (0: OPT records
+         * ignored, under 'EDNSMINSZ' means 'EDNSMINSZ') */
+        {"edns_payload", 1232, 0, EDNSBUFSZ},
+        /* Milliseconds the interface changes are gathered before
+         * being applied (0: applied right away) */
+        {"netlink_batch", 50, 0, 1000},
+        /* 0: one UDP socket per family for every interface, 1: UDP
+         * sockets per interface (See llmnr_iface_socks.h) */
+        {"iface_sockets", 0, 0, 1},
+};
+
+/* Functions definitions */
+PUBLIC long getOption(int option)
+{
+    /*
+     * Returns the current value of 'option'
+     */
+        if (option < 0 || option >= OPTIONSZ)
+                return 0;
+        return Options[option].value;
+}
+
+PUBLIC int isOption(char *name)
+{
+    /*
+     * Checks if 'name' is a known option
+     */
+        return getOptionIndex(name) >= 0;
+}
+
+PUBLIC int setOption(char *name, char *value)
+{
+    /*
+     * Set the option called 'name' to the integer in 'value'.
+     * Fails if the option does not exists or if the value is
+     * not a number inside the option range
+     */
+        int i;
+        long val;
+        char *ptr;
+
+        i = getOptionIndex(name);
+        if (i < 0 || value == NULL)
+                return FAILURE;
+        for (ptr = value; *ptr; ptr++) {
+                if (!isdigit(*ptr))
+                        return FAILURE;
+        }
+        val = atol(value);
+        if (val < Options[i].min || val > Options[i].max)
+                return FAILURE;
+        Options[i].value = val;
+        return SUCCESS;
+}
+
+PRIVATE int getOptionIndex(char *name)
+{
+    /*
+     * Returns the position of 'name' in the options table
+     */
+        int i;
+
+        if (name == NULL)
+                return FAILURE;
+        for (i = 0; i < OPTIONSZ; i++) {
+                if (!strcasecmp(Options[i].name,name))
+                        return i;
+        }
+        return FAILURE;
+}
+
+PUBLIC void printOptions()
+{
+        int i;
+
+        for (i = 0; i < OPTIONSZ; i++)
+                printToStream("%s: %ld\n",Options[i].name,Options[i].value);
+}
@@ -1,7 +1,10 @@
 /* Macros */
 #define _GNU_SOURCE
 #define HEADERFIELDS 6
-#define HEADERFLAGS 10
+#define MAXLABELSZ 63
+#define RRFIXEDSZ 10
+#define COMPPTR 0xC0
+#define MAXCOMPOFFSET 0x3FFF
 
 /* Includes */
 #include <string.h>
@@ -9,18 +12,23 @@
 
 /* Own includes */
 #include "../include/llmnr_defs.h"
+#include "../include/llmnr_ifset.h"
 #include "../include/llmnr_names.h"
 #include "../include/llmnr_net_interface.h"
 #include "../include/llmnr_rr.h"
+#include "../include/llmnr_registry.h"
 #include "../include/llmnr_packet.h"
 
 /* Enums & Structs */
 typedef union {
         struct cmsghdr hdr;
-        U_CHAR buff[CMSG_SPACE(sizeof(struct in_pktinfo))];
-} IPV4CMSG;
+        U_CHAR buff[CMSG_SPACE(sizeof(struct in6_pktinfo))];
+} PKTINFOCMSG;
 
 /* Private functions prototypes */
+PRIVATE void parseAdditionals(U_CHAR *buffer, int bufferSz, int offset,
+                             int count, QUERY *query);
+PRIVATE int skipName(U_CHAR *buffer, int bufferSz, int offset);
 PRIVATE int _attachAnswer(PKTPARAMS *paras, DSTRUCTURE *dsts, int offset);
 PRIVATE int attachARecord(PKTPARAMS *params, DSTRUCTURE *dsts, int offset);
 PRIVATE int attachAAAARecord(PKTPARAMS *params, DSTRUCTURE *dsts, int offset);
@@ -29,10 +37,15 @@ PRIVATE int __attachAAARecord(PKTPARAMS *params, DSTRUCTURE *dsts, int offset);
 PRIVATE int attachOtherecord(PKTPARAMS *params, DSTRUCTURE *dsts, int offset);
 PRIVATE int attachAnyRecord(PKTPARAMS *params, DSTRUCTURE *dsts, int offset);
 PRIVATE int attachPtrRecord(PKTPARAMS *params, DSTRUCTURE *dsts, int offset);
+PRIVATE int attachHostedRecords(PKTPARAMS *params, U_SHORT type, int offset);
+PRIVATE int attachRecord(PKTPARAMS *params, U_CHAR *rr, int rrLen,
+                         int offset);
+PRIVATE int attachName(PKTPARAMS *params, U_CHAR *name, int offset);
+PRIVATE void addCompLabels(COMPTABLE *table, U_CHAR *pktBuff, int offset);
+PRIVATE int sameName(U_CHAR *pktBuff, int offset, U_CHAR *name);
 PRIVATE int _sendPacket(PKTSND *pktSnd);
-PRIVATE int testEndianness();
-PRIVATE void copyShortValues(U_CHAR *dest, U_CHAR *values, int valuesSz);
-PRIVATE U_SHORT flagsToShortValue(U_CHAR *flags);
+PRIVATE void setPktInfo(PKTSND *pktSnd, struct msghdr *msg, struct iovec *iov,
+                        PKTINFOCMSG *ancData);
 
 /* Glocal variables */
 
@@ -43,73 +56,154 @@ PUBLIC void getHeader(U_CHAR *buffer, HEADER *head)
      * Given a buffer, extract the LLMNR header within
      * and store it into a 'HEADER' struct
      */
-        U_CHAR byte1, byte2;
+        int i;
+        U_SHORT words[HEADERFIELDS];
 
         if (head == NULL)
                 return;
-        byte1 = *((U_CHAR *)buffer + 2);
-        byte2 = *((U_CHAR *)buffer + 3);
-        head->ID = ntohs(*((U_SHORT *)buffer));
-        head->QR = ((0x1 << 7) & byte1) >> 7;
-        head->OPCODE = ((0xF << 3) & byte1) >> 3;
-        head->C = ((0x1 << 2) & byte1) >> 2;
-        head->TC = ((0x1 << 1) & byte1) >> 1;
-        head->T = 0x1 & byte1;
-        head->Z0 = ((0x1 << 7) & byte2) >> 7;
-        head->Z1 = ((0x1 << 6) & byte2) >> 6;
-        head->Z2 = ((0x1 << 5) & byte2) >> 5;
-        head->Z3 = ((0x1 << 4) & byte2) >> 4;
-        head->RCODE = 0xF & byte2;
-        head->QDCOUNT = ntohs(*((U_SHORT *)(buffer + 4)));
-        head->ANCOUNT = ntohs(*((U_SHORT *)(buffer + 6)));
-        head->NSCOUNT = ntohs(*((U_SHORT *)(buffer + 8)));
-        head->ARCOUNT = ntohs(*((U_SHORT *)(buffer + 10)));
+        memcpy(words,buffer,HEADSZ);
+        for (i = 0; i < HEADERFIELDS; i++)
+                words[i] = ntohs(words[i]);
+        head->ID = words[0];
+        head->FLAGS = words[1];
+        head->QDCOUNT = words[2];
+        head->ANCOUNT = words[3];
+        head->NSCOUNT = words[4];
+        head->ARCOUNT = words[5];
 }
 
-PUBLIC void getQuery(U_CHAR *buffer, QUERY *query)
+PUBLIC int parseQuery(U_CHAR *buffer, int bufferSz, HEADER *head,
+                      QUERY *query)
 {
     /*
-     * Given a buffer, extract the LLMNR query within
-     * and store it into a 'QUERY' struct
+     * Decode header and question of the 'bufferSz' bytes received
+     * in a single pass. The header must be the one of a standard
+     * query with one question (and no answers). The QNAME labels
+     * are checked against 'bufferSz' (no compression, 63 bytes per
+     * label, 255 per name) while the name is hashed (See
+     * NAMEHASHSTEP), so nobody has to scan it again
+     * Returns SUCCESS if the query can be answered
      */
+        int i, len, offset;
+        unsigned int hash;
+        U_SHORT aux;
+
+        if (bufferSz < QUESTMINSZ)
+                return FAILURE;
+        getHeader(buffer,head);
+        if (head->FLAGS & (HFLAG_QR | HFLAG_OPCODE) || head->QDCOUNT != 1 ||
+            head->ANCOUNT != 0 || head->NSCOUNT != 0)
+                return FAILURE;
+        hash = NAMEHASHSEED;
+        offset = HEADSZ;
+        while (offset < bufferSz && buffer[offset] != 0) {
+                len = buffer[offset];
+                if (len > MAXLABELSZ || offset + len + 1 >= bufferSz)
+                        return FAILURE;
+                hash = NAMEHASHSTEP(hash,buffer[offset]);
+                for (i = offset + 1; i <= offset + len; i++)
+                        hash = NAMEHASHSTEP(hash,buffer[i]);
+                offset += len + 1;
+        }
+        if (offset >= bufferSz)
+                return FAILURE;
+        hash = NAMEHASHSTEP(hash,0);
+        offset++;
+        if (offset - HEADSZ > HOSTNAMEMAX ||
+            offset + 2 * (int)sizeof(U_SHORT) > bufferSz)
+                return FAILURE;
         query->QNAME = (char *)buffer + HEADSZ;
-        query->QTYPE = *((U_SHORT *)(buffer + HEADSZ +
-                          strlen(query->QNAME) + 1));
-        query->QTYPE = ntohs(query->QTYPE);
-        query->QCLASS = *((U_SHORT *)(buffer + HEADSZ +
-                           strlen(query->QNAME) + 1 + sizeof(U_SHORT)));
-        query->QCLASS = ntohs(query->QCLASS);
+        query->nameLen = offset - HEADSZ;
+        query->nameHash = hash;
+        memcpy(&aux,buffer + offset,sizeof(U_SHORT));
+        query->QTYPE = ntohs(aux);
+        memcpy(&aux,buffer + offset + sizeof(U_SHORT),sizeof(U_SHORT));
+        query->QCLASS = ntohs(aux);
+        parseAdditionals(buffer,bufferSz,offset + 2 * sizeof(U_SHORT),
+                         head->ARCOUNT,query);
+        return SUCCESS;
+}
+
+PRIVATE void parseAdditionals(U_CHAR *buffer, int bufferSz, int offset,
+                             int count, QUERY *query)
+{
+    /*
+     * Walk the 'count' additional records starting at 'offset'
+     * looking for the OPT record (EDNS0). A malformed additional
+     * section is not an error, the query is just answered as if
+     * it had no OPT record (as always was). Only the first OPT
+     * record counts
+     */
+        int i;
+        U_SHORT type, rdLen;
+
+        query->udpSize = 0;
+        query->ednsFlags = 0;
+        query->ednsVersion = 0;
+        for (i = 0; i < count; i++) {
+                if (offset < bufferSz && buffer[offset] == 0 &&
+                    offset + 1 + RRFIXEDSZ <= bufferSz) {
+                        memcpy(&type,buffer + offset + 1,sizeof(U_SHORT));
+                        if (ntohs(type) == OPT) {
+                                memcpy(&rdLen,buffer + offset + 3,
+                                       sizeof(U_SHORT));
+                                query->udpSize = ntohs(rdLen);
+                                if (query->udpSize < EDNSMINSZ)
+                                        query->udpSize = EDNSMINSZ;
+                                query->ednsVersion = buffer[offset + 6];
+                                memcpy(&rdLen,buffer + offset + 7,
+                                       sizeof(U_SHORT));
+                                query->ednsFlags = ntohs(rdLen);
+                                return;
+                        }
+                }
+                offset = skipName(buffer,bufferSz,offset);
+                if (offset < 0 || offset + RRFIXEDSZ > bufferSz)
+                        return;
+                memcpy(&rdLen,buffer + offset + RRFIXEDSZ - sizeof(U_SHORT),
+                       sizeof(U_SHORT));
+                offset += RRFIXEDSZ + ntohs(rdLen);
+        }
+}
+
+PRIVATE int skipName(U_CHAR *buffer, int bufferSz, int offset)
+{
+    /*
+     * Returns the offset that follows the name at 'offset' (a
+     * compression pointer ends the name), FAILURE if the name
+     * goes beyond 'bufferSz'
+     */
+        while (offset < bufferSz) {
+                if ((buffer[offset] & 0xC0) == 0xC0)
+                        return offset + 2 <= bufferSz ? offset + 2 : FAILURE;
+                if (buffer[offset] == 0)
+                        return offset + 1;
+                if (buffer[offset] > MAXLABELSZ)
+                        return FAILURE;
+                offset += buffer[offset] + 1;
+        }
+        return FAILURE;
 }
 
 PUBLIC int attachHeader(HEADER *header, U_CHAR *pktBuff)
 {
     /*
-     * Given a 'HEADER' struct, "decompose" it and store it into
-     * 'pktBuff'. Returns the number of bytes copied into 'pktBuff'
+     * Given a 'HEADER' struct, store it into 'pktBuff' (network
+     * order). Returns the number of bytes copied into 'pktBuff'
      * in this case will always be 'HEADSZ'
      */
-        U_CHAR headerFlags[HEADERFLAGS];
-        U_SHORT headerValues[HEADERFIELDS];
-
-        memset(headerFlags,0,HEADERFLAGS);
-        memset(headerValues,0,HEADERFIELDS);
-        headerFlags[0] = header->QR ;
-        headerFlags[1] = header->OPCODE;
-        headerFlags[2] = header->C;
-        headerFlags[3] = header->TC;
-        headerFlags[4] = header->T;
-        headerFlags[5] = header->Z0;
-        headerFlags[6] = header->Z1;
-        headerFlags[7] = header->Z2;
-        headerFlags[8] = header->Z3;
-        headerFlags[9] = header->RCODE;
-        headerValues[0] = header->ID;
-        headerValues[1] = flagsToShortValue(headerFlags);
-        headerValues[2] = header->QDCOUNT;
-        headerValues[3] = header->ANCOUNT;
-        headerValues[4] = header->NSCOUNT;
-        headerValues[5] = header->ARCOUNT;
-        copyShortValues(pktBuff,(U_CHAR *)headerValues,HEADERFIELDS);
+        int i;
+        U_SHORT words[HEADERFIELDS];
+
+        words[0] = header->ID;
+        words[1] = header->FLAGS;
+        words[2] = header->QDCOUNT;
+        words[3] = header->ANCOUNT;
+        words[4] = header->NSCOUNT;
+        words[5] = header->ARCOUNT;
+        for (i = 0; i < HEADERFIELDS; i++)
+                words[i] = htons(words[i]);
+        memcpy(pktBuff,words,HEADSZ);
         return HEADSZ;
 }
 
@@ -117,18 +211,17 @@ PUBLIC int attachQuery(QUERY *query, U_CHAR *pktBuff)
 {
     /*
      * Given a 'QUERY' struct, "decompose" it and store it into
-     * 'pktBuff'. Returns the numbers of bytes copied into 'pktBuff'
-     * in this case: strlen of QNAME + QTYPE (2 bytes) + QCLASS (2 bytes)
+     * 'pktBuff': QNAME ('nameLen' bytes) + QTYPE (2 bytes) +
+     * QCLASS (2 bytes)
      * Returns the number of bytes wrote into the buffer
      */
         int pktSz;
         U_SHORT aux;
         int u_shortSz;
 
-        pktSz = 0;
         u_shortSz = sizeof(U_SHORT);
-        strcpy((char *)pktBuff,query->QNAME);
-        pktSz = strlen(query->QNAME) + 1;
+        memcpy(pktBuff,query->QNAME,query->nameLen);
+        pktSz = query->nameLen;
         aux = htons(query->QTYPE);
         memcpy(pktBuff + pktSz,&aux,u_shortSz);
         pktSz += u_shortSz;
@@ -147,17 +240,106 @@ PUBLIC int attachAnswer(PKTPARAMS *params, DSTRUCTURE *dsts)
      * Note: The resource records that the daemon holds are stored
      * into 3 different places, 'A' and 'AAAA' in a 'NETIFACE'
      * list. 'PTR' in a 'NAME' list. Any other than that ('SOA',
-     * 'MX', etc) in a 'RRLIST'.
+     * 'MX', etc) in a 'RRLIST'. The records of a hosted name
+     * (See llmnr_registry.h) replace the ones of their type.
+     * Names inside the RDATA are compressed against the names
+     * already in the answer (See 'COMPTABLE'). The answer cache
+     * keeps the result, so it is only done on misses
      * Returns the number of bytes wrote into the buffer
      */
         int pktSz;
+        COMPTABLE cTable;
 
         pktSz = attachQuery(params->query,params->pktBuff + HEADSZ);
+        cTable.count = 0;
+        addCompLabels(&cTable,params->pktBuff,HEADSZ);
+        params->cTable = &cTable;
         pktSz += _attachAnswer(params,dsts,pktSz + HEADSZ);
+        params->cTable = NULL;
         pktSz += attachHeader(params->head,params->pktBuff);
         return pktSz;
 }
 
+PUBLIC int attachBadVersion(PKTPARAMS *params)
+{
+    /*
+     * Answer to a query whose OPT record has an EDNS version
+     * we do not speak: HEADER + QUERY and no records. The
+     * extended RCODE (BADVERS) goes in the OPT record (See
+     * attachOptRecord())
+     * Returns the number of bytes wrote into the buffer
+     */
+        int pktSz;
+
+        params->head->FLAGS |= HFLAG_QR;
+        params->head->FLAGS &= ~(HFLAG_TC | HFLAG_RCODE);
+        params->head->ANCOUNT = 0;
+        params->head->NSCOUNT = 0;
+        params->head->ARCOUNT = 0;
+        pktSz = attachQuery(params->query,params->pktBuff + HEADSZ);
+        pktSz += attachHeader(params->head,params->pktBuff);
+        return pktSz;
+}
+
+PUBLIC int attachOptRecord(U_CHAR *pktBuff, int pktSz, QUERY *query,
+                           int maxPayload)
+{
+    /*
+     * Append our OPT record to the 'pktSz' bytes answer in
+     * 'pktBuff' when the query had one (and EDNS is enabled,
+     * 'maxPayload' not 0). The buffer must have room for it
+     * (See answerBufferSz()). The answer (maybe a cached one)
+     * never has additional records, so ARCOUNT becomes 1
+     * Returns the new answer size
+     */
+        U_SHORT aux;
+        U_CHAR *opt;
+
+        if (pktSz <= HEADSZ || query->udpSize == 0 || maxPayload <= 0)
+                return pktSz;
+        if (maxPayload < EDNSMINSZ)
+                maxPayload = EDNSMINSZ;
+        opt = pktBuff + pktSz;
+        opt[0] = 0;
+        aux = htons(OPT);
+        memcpy(opt + 1,&aux,sizeof(U_SHORT));
+        aux = htons(maxPayload);
+        memcpy(opt + 3,&aux,sizeof(U_SHORT));
+        opt[5] = 0;
+        if (query->ednsVersion > EDNSVERSION)
+                opt[5] = EDNSBADVERS;
+        opt[6] = EDNSVERSION;
+        aux = htons(query->ednsFlags & EDNSFLAG_DO);
+        memcpy(opt + 7,&aux,sizeof(U_SHORT));
+        opt[9] = 0;
+        opt[10] = 0;
+        aux = htons(1);
+        memcpy(pktBuff + HEADSZ - sizeof(U_SHORT),&aux,sizeof(U_SHORT));
+        return pktSz + OPTRECORDSZ;
+}
+
+PUBLIC int answerBufferSz(QUERY *query, int maxPayload)
+{
+    /*
+     * Room for the records of a UDP answer to 'query'. Without
+     * EDNS it is the usual 'SNDBUFSZ'. Otherwise the payload
+     * size advertised by the query, up to 'maxPayload', leaving
+     * room for our OPT record
+     */
+        int size;
+
+        if (query->udpSize == 0 || maxPayload <= 0)
+                return SNDBUFSZ;
+        if (maxPayload < EDNSMINSZ)
+                maxPayload = EDNSMINSZ;
+        size = query->udpSize;
+        if (size > maxPayload)
+                size = maxPayload;
+        if (size > EDNSBUFSZ)
+                size = EDNSBUFSZ;
+        return size - OPTRECORDSZ;
+}
+
 PRIVATE int _attachAnswer(PKTPARAMS *params, DSTRUCTURE *dsts, int offset)
 {
     /*
@@ -169,11 +351,11 @@ PRIVATE int _attachAnswer(PKTPARAMS *params, DSTRUCTURE *dsts, int offset)
      */
         int pktSz;
         U_SHORT type;
-        NETIFACE *iface;
 
         pktSz = 0;
         type = params->query->QTYPE;
         params->head->ANCOUNT = 0;
+        params->head->ARCOUNT = 0;
         if (type == A)
                 pktSz = attachARecord(params,dsts,offset);
         else if (type == AAAA)
@@ -184,12 +366,9 @@ PRIVATE int _attachAnswer(PKTPARAMS *params, DSTRUCTURE *dsts, int offset)
                 pktSz = attachPtrRecord(params,dsts,offset);
         else
                 pktSz = attachOtherecord(params,dsts,offset);
-        params->head->QR = 1;
-        iface = getNetIfNodeByIndex(dsts->ifaces,params->rcvIface);
-        if (iface != NULL) {
-                if (iface->flags & _IFF_CONFLICT)
-                        params->head->C = 1;
-        }
+        params->head->FLAGS |= HFLAG_QR;
+        if (params->iface->flags & _IFF_CONFLICT)
+                params->head->FLAGS |= HFLAG_C;
         if (params->head->ANCOUNT == 0) {
                 params->query->QTYPE = SOA;
                 pktSz = attachOtherecord(params,dsts,offset);
@@ -211,16 +390,18 @@ PRIVATE int attachARecord(PKTPARAMS *params, DSTRUCTURE *dsts, int offset)
      */
         U_SHORT uSz;
         U_CHAR *pktBuff;
-        NETIFACE *iface;
         NETIFIPV4 *current;
         int pktSz, anCount;
 
+        dsts = dsts;
+        pktSz = attachHostedRecords(params,A,offset);
+        if (pktSz >= 0)
+                return pktSz;
         pktSz = 0;
         anCount = 0;
         uSz = sizeof(U_SHORT);
         pktBuff = params->pktBuff + offset;
-        iface = getNetIfNodeByIndex(dsts->ifaces,params->rcvIface);
-        current = iface->IPv4s;
+        current = params->iface->IPv4s;
         if (current == NULL) {
                 params->head->ANCOUNT = anCount;
                 return pktSz;
@@ -230,7 +411,7 @@ PRIVATE int attachARecord(PKTPARAMS *params, DSTRUCTURE *dsts, int offset)
                 if (current->ipType == NOIP)
                         continue;
                 if (offset + pktSz + uSz + ARECORDSZ > params->pktBuffSz) {
-                        params->head->TC = 1;
+                        params->head->FLAGS |= HFLAG_TC;
                         break;
                 }
                 memcpy(pktBuff,params->namePtr,uSz);
@@ -258,7 +439,9 @@ PRIVATE int attachAAAARecord(PKTPARAMS *params, DSTRUCTURE *dsts, int offset)
      */
         int pktSz;
 
-        pktSz = 0;
+        pktSz = attachHostedRecords(params,AAAA,offset);
+        if (pktSz >= 0)
+                return pktSz;
         if (params->ipType == IPV4IP)
                 pktSz = _attachAAARecord(params,dsts,offset);
         else
@@ -275,22 +458,21 @@ PRIVATE int _attachAAARecord(PKTPARAMS *params, DSTRUCTURE *dsts, int offset)
 
         U_SHORT uSz;
         U_CHAR *pktBuff;
-        NETIFACE *iface;
         NETIFIPV6 *current;
         int pktSz, anCount;
 
+        dsts = dsts;
         pktSz = 0;
         anCount = 0;
         uSz = sizeof(U_SHORT);
         pktBuff = params->pktBuff + offset;
-        iface = getNetIfNodeByIndex(dsts->ifaces,params->rcvIface);
-        current = iface->IPv6s;
+        current = params->iface->IPv6s;
 
         for (; current != NULL; current = current->next) {
                 if (current->ipType == NOIP)
                         continue;
                 if (offset + pktSz + uSz + AAAARECORDSZ > params->pktBuffSz) {
-                        params->head->TC = 1;
+                        params->head->FLAGS |= HFLAG_TC;
                         break;
                 }
                 memcpy(pktBuff,params->namePtr,uSz);
@@ -313,22 +495,21 @@ PRIVATE int __attachAAARecord(PKTPARAMS *params, DSTRUCTURE *dsts, int offset)
 
         U_SHORT uSz;
         U_CHAR *pktBuff;
-        NETIFACE *iface;
         NETIFIPV6 *current;
         int pktSz, anCount;
 
+        dsts = dsts;
         pktSz = 0;
         anCount = 0;
         uSz = sizeof(U_SHORT);
         pktBuff = params->pktBuff + offset;
-        iface = getNetIfNodeByIndex(dsts->ifaces,params->rcvIface);
-        current = iface->IPv6s;
+        current = params->iface->IPv6s;
 
         for (; current != NULL; current = current->next) {
                 if (current->ipType != params->ipType)
                         continue;
                 if (offset + pktSz + uSz + AAAARECORDSZ > params->pktBuffSz) {
-                        params->head->TC = 1;
+                        params->head->FLAGS |= HFLAG_TC;
                         break;
                 }
                 memcpy(pktBuff,params->namePtr,uSz);
@@ -338,14 +519,14 @@ PRIVATE int __attachAAARecord(PKTPARAMS *params, DSTRUCTURE *dsts, int offset)
                 pktBuff += AAAARECORDSZ;
                 pktSz += uSz + AAAARECORDSZ;
         }
-        current = iface->IPv6s;
+        current = params->iface->IPv6s;
         for (; current != NULL; current = current->next) {
                 if (current->ipType == NOIP)
                         continue;
                 if (current->ipType == params->ipType)
                         continue;
                 if (offset + pktSz + uSz + AAAARECORDSZ > params->pktBuffSz) {
-                        params->head->TC = 1;
+                        params->head->FLAGS |= HFLAG_TC;
                         break;
                 }
                 memcpy(pktBuff,params->namePtr,uSz);
@@ -363,37 +544,46 @@ PRIVATE int attachOtherecord(PKTPARAMS *params, DSTRUCTURE *dsts, int offset)
 {
     /*
      * Fetch the requested resource record (other than 'A', 'AAAA' or
-     * 'PTR')
+     * 'PTR'). The ones of a hosted name come first, the 'RRLIST'
+     * ones of a type he has records of are left out
      * Returns the number of bytes wrote into the buffer
      */
         RRLIST *current;
         U_SHORT type, uSz;
-        U_CHAR *pktBuff;
-        int pktSz, anCount;
+        int rrSz, pktSz, anCount, count, len;
 
+        type = params->query->QTYPE;
+        pktSz = attachHostedRecords(params,type,offset);
+        if (pktSz >= 0 && type != ANY)
+                return pktSz;
+        if (pktSz < 0)
+                pktSz = 0;
         if (dsts->rList == NULL)
-                return SUCCESS;
-        pktSz = 0;
+                return pktSz;
         anCount = 0;
         uSz = sizeof(U_SHORT);
         current = dsts->rList;
-        type = params->query->QTYPE;
-        pktBuff = params->pktBuff + offset;
 
         for (; current != NULL; current = current->NEXT) {
                 if (current->TYPE == NONE)
                         continue;
+                if (type == ANY && hostedRecords(params->hosted,current->TYPE,
+                                                 &count,&len) != NULL)
+                        continue;
                 if (current->TYPE == type || type == ANY) {
-                        if (offset + pktSz + uSz + current->LEN > params->pktBuffSz) {
-                                params->head->TC = 1;
+                        rrSz = FAILURE;
+                        if (offset + pktSz + uSz <= params->pktBuffSz)
+                                rrSz = attachRecord(params,current->RR,
+                                                    current->LEN,
+                                                    offset + pktSz + uSz);
+                        if (rrSz < 0) {
+                                params->head->FLAGS |= HFLAG_TC;
                                 break;
                         }
-                        memcpy(pktBuff,params->namePtr,uSz);
-                        pktBuff += uSz;
-                        memcpy(pktBuff,current->RR,current->LEN);
+                        memcpy(params->pktBuff + offset + pktSz,
+                               params->namePtr,uSz);
                         anCount++;
-                        pktBuff += current->LEN;
-                        pktSz += uSz + current->LEN;
+                        pktSz += uSz + rrSz;
                 }
         }
         params->head->ANCOUNT += anCount;
@@ -423,48 +613,209 @@ PRIVATE int attachPtrRecord(PKTPARAMS *params, DSTRUCTURE *dsts, int offset)
      * if the receiving interface is "name authoritative"
      * Returns the number of bytes wrote into the buffer
      */
-        char flag;
         NAME *current;
         U_SHORT uSz;
-        U_CHAR *pktBuff;
-        int i, pktSz, anCount;
+        int rrSz, pktSz, anCount;
 
         pktSz = 0;
         anCount = 0;
         uSz = sizeof(U_SHORT);
         current = dsts->names;
-        pktBuff = params->pktBuff + offset;
 
         for (; current != NULL; current = current->next) {
-                flag = 0;
                 if (current->name == NULL)
                         continue;
-                for (i = 0; i < current->notAuthOnSz; i++) {
-                        if (current->notAuthOn[i] == params->rcvIface) {
-                                flag = 1;
-                                break;
-                        }
-                }
-                if (!flag) {
+                if (!inIfSet(&current->notAuthOn,params->iface->slot)) {
                         if (current->ptr == NULL)
                                 continue;
 
-                        if (offset + pktSz + uSz + current->ptrSz > params->pktBuffSz) {
-                                params->head->TC = 1;
+                        rrSz = FAILURE;
+                        if (offset + pktSz + uSz <= params->pktBuffSz)
+                                rrSz = attachRecord(params,current->ptr,
+                                                    current->ptrSz,
+                                                    offset + pktSz + uSz);
+                        if (rrSz < 0) {
+                                params->head->FLAGS |= HFLAG_TC;
                                 break;
                         }
-                        memcpy(pktBuff,params->namePtr,uSz);
-                        pktBuff += uSz;
-                        memcpy(pktBuff,current->ptr,current->ptrSz);
+                        memcpy(params->pktBuff + offset + pktSz,
+                               params->namePtr,uSz);
                         anCount++;
-                        pktBuff += current->ptrSz;
-                        pktSz += uSz + current->ptrSz;
+                        pktSz += uSz + rrSz;
                 }
         }
         params->head->ANCOUNT = anCount;
         return pktSz;
 }
 
+PRIVATE int attachHostedRecords(PKTPARAMS *params, U_SHORT type, int offset)
+{
+    /*
+     * Copy the records of 'type' of the hosted name (See
+     * hostedRecords()): in one go, or the ones that fit
+     * Returns the number of bytes wrote into the buffer, FAILURE
+     * if the name has no records of 'type'
+     */
+        int len, count, rrSz, pktSz, anCount;
+        U_SHORT rdLen;
+        U_CHAR *rrs;
+
+        rrs = hostedRecords(params->hosted,type,&count,&len);
+        if (rrs == NULL)
+                return FAILURE;
+        pktSz = len;
+        anCount = count;
+        if (offset + len > params->pktBuffSz) {
+                params->head->FLAGS |= HFLAG_TC;
+                pktSz = 0;
+                anCount = 0;
+                while (pktSz < len) {
+                        memcpy(&rdLen,rrs + pktSz + sizeof(U_SHORT) +
+                               RRFIXEDSZ - sizeof(U_SHORT),sizeof(U_SHORT));
+                        rrSz = sizeof(U_SHORT) + RRFIXEDSZ + ntohs(rdLen);
+                        if (offset + pktSz + rrSz > params->pktBuffSz)
+                                break;
+                        pktSz += rrSz;
+                        anCount++;
+                }
+        }
+        memcpy(params->pktBuff + offset,rrs,pktSz);
+        params->head->ANCOUNT += anCount;
+        return pktSz;
+}
+
+PRIVATE int attachRecord(PKTPARAMS *params, U_CHAR *rr, int rrLen,
+                         int offset)
+{
+    /*
+     * Write at 'offset' a prebuilt (partial) resource record
+     * ('TYPE', 'CLASS', 'TTL', 'RDLENGTH' and 'RDATA', See
+     * llmnr_rr.h). The names inside the RDATA of 'PTR', 'NS',
+     * 'CNAME' and 'MX' records are compressed, so 'RDLENGTH' is
+     * rewritten. Any other RDATA is copied as is ('SOA' already
+     * points to the QNAME, 'SRV' targets must not be compressed)
+     * Returns the number of bytes wrote into the buffer, FAILURE
+     * if the record does not fit
+     */
+        int nameOff, nameSz;
+        U_SHORT type, rdLen;
+        U_CHAR *pktBuff;
+
+        pktBuff = params->pktBuff + offset;
+        memcpy(&type,rr,sizeof(U_SHORT));
+        type = ntohs(type);
+        nameOff = -1;
+        if (type == PTR || type == NS || type == CNAME)
+                nameOff = RRFIXEDSZ;
+        else if (type == MX)
+                nameOff = RRFIXEDSZ + sizeof(U_SHORT);
+        if (nameOff < 0 || nameOff >= rrLen || params->cTable == NULL) {
+                if (offset + rrLen > params->pktBuffSz)
+                        return FAILURE;
+                memcpy(pktBuff,rr,rrLen);
+                return rrLen;
+        }
+        if (offset + nameOff > params->pktBuffSz)
+                return FAILURE;
+        memcpy(pktBuff,rr,nameOff);
+        nameSz = attachName(params,rr + nameOff,offset + nameOff);
+        if (nameSz < 0)
+                return FAILURE;
+        rdLen = htons(nameOff + nameSz - RRFIXEDSZ);
+        memcpy(pktBuff + RRFIXEDSZ - sizeof(U_SHORT),&rdLen,sizeof(U_SHORT));
+        return nameOff + nameSz;
+}
+
+PRIVATE int attachName(PKTPARAMS *params, U_CHAR *name, int offset)
+{
+    /*
+     * Write the (uncompressed) 'name' at 'offset': his labels up
+     * to the longest suffix already in the answer, then a pointer
+     * to it. The labels written are added to the compression
+     * table
+     * Returns the number of bytes wrote into the buffer, FAILURE
+     * if the name does not fit
+     */
+        int i, len, match;
+        U_SHORT ptr;
+        COMPTABLE *table;
+
+        len = 0;
+        match = -1;
+        table = params->cTable;
+        while (match < 0) {
+                for (i = 0; i < table->count; i++) {
+                        if (!sameName(params->pktBuff,table->offsets[i],
+                                      name + len)) {
+                                match = table->offsets[i];
+                                break;
+                        }
+                }
+                if (match >= 0 || name[len] == 0)
+                        break;
+                len += name[len] + 1;
+        }
+        if (match < 0)
+                len++;
+        if (offset + len + (match < 0 ? 0 : 2) > params->pktBuffSz)
+                return FAILURE;
+        memcpy(params->pktBuff + offset,name,len);
+        if (match < 0) {
+                addCompLabels(table,params->pktBuff,offset);
+                return len;
+        }
+        ptr = htons((COMPPTR << 8) | match);
+        memcpy(params->pktBuff + offset + len,&ptr,sizeof(U_SHORT));
+        addCompLabels(table,params->pktBuff,offset);
+        return len + sizeof(U_SHORT);
+}
+
+PRIVATE void addCompLabels(COMPTABLE *table, U_CHAR *pktBuff, int offset)
+{
+    /*
+     * Add every label of the name at 'offset' (up to his end
+     * or his pointer) to the compression table. Full table or
+     * offsets a pointer can not hold, nothing is added
+     */
+        while (pktBuff[offset] != 0 &&
+               (pktBuff[offset] & COMPPTR) != COMPPTR) {
+                if (table->count >= MAXCOMPLABELS || offset > MAXCOMPOFFSET)
+                        return;
+                table->offsets[table->count++] = offset;
+                offset += pktBuff[offset] + 1;
+        }
+}
+
+PRIVATE int sameName(U_CHAR *pktBuff, int offset, U_CHAR *name)
+{
+    /*
+     * Compare the name at 'offset' of the answer (following
+     * pointers) with the uncompressed 'name'. Byte by byte, so
+     * the case of 'name' is kept
+     * Returns SUCCESS if they are the same
+     */
+        int i, hops;
+
+        for (hops = 0; hops <= HOSTNAMEMAX; hops++) {
+                if ((pktBuff[offset] & COMPPTR) == COMPPTR) {
+                        offset = ((pktBuff[offset] & ~COMPPTR) << 8) |
+                                 pktBuff[offset + 1];
+                        continue;
+                }
+                if (pktBuff[offset] != *name)
+                        return FAILURE;
+                if (*name == 0)
+                        return SUCCESS;
+                for (i = 1; i <= *name; i++) {
+                        if (pktBuff[offset + i] != name[i])
+                                return FAILURE;
+                }
+                offset += *name + 1;
+                name += *name + 1;
+        }
+        return FAILURE;
+}
+
 PUBLIC int sendUDPacket(PKTSND *pktSnd)
 {
     /*
@@ -487,24 +838,48 @@ PUBLIC int sendUDPacket(PKTSND *pktSnd)
         return sent;
 }
 
-PUBLIC int sendTCPacket(PKTSND *pktSnd)
+PUBLIC int sendUDPBatch(PKTSND *pkts, int count)
 {
     /*
-     * Returns the number of bytes sent
+     * Send up to 'count' answers with as few sendmmsg() as
+     * possible. Consecutive answers that go out through the
+     * same socket are sent together, each one carrying his own
+     * exit interface as ancillary data. A message refused by
+     * sendmmsg() is retried alone with sendUDPacket() and the
+     * rest of the run goes on with sendmmsg()
+     * Returns the number of answers sent by sendmmsg()
      */
-    int n, total, bytesLeft;
-
-    n = 0;
-    total = 0;
-    bytesLeft = pktSnd->pktSz;
-    while (total < pktSnd->pktSz) {
-            n = send(pktSnd->fd,pktSnd->pktBuff + total,bytesLeft,0);
-            if (n < 0)
-                    break;
-            total += n;
-            bytesLeft -= n;
-    }
-    return total;
+        int i, j, run, sent, total;
+        struct iovec iov[MAXSNDBATCH];
+        struct mmsghdr msgs[MAXSNDBATCH];
+        PKTINFOCMSG ancData[MAXSNDBATCH];
+
+        if (count > MAXSNDBATCH)
+                count = MAXSNDBATCH;
+        for (i = 0; i < count; i++) {
+                setPktInfo(&pkts[i],&msgs[i].msg_hdr,&iov[i],&ancData[i]);
+                msgs[i].msg_len = 0;
+        }
+        total = 0;
+        for (i = 0; i < count; i += run) {
+                for (run = 1; i + run < count; run++) {
+                        if (pkts[i + run].fd != pkts[i].fd)
+                                break;
+                }
+                j = i;
+                while (j < i + run) {
+                        sent = sendmmsg(pkts[i].fd,msgs + j,i + run - j,0);
+                        if (sent < 0)
+                                sent = 0;
+                        total += sent;
+                        j += sent;
+                        if (j < i + run) {
+                                sendUDPacket(&pkts[j]);
+                                j++;
+                        }
+                }
+        }
+        return total;
 }
 
 PRIVATE int _sendPacket(PKTSND *pktSnd)
@@ -515,33 +890,12 @@ PRIVATE int _sendPacket(PKTSND *pktSnd)
      * Returns the number of bytes sent
      */
         int sent;
-        void *vPtr;
-        IPV4CMSG ancData;
         struct iovec iov;
         struct msghdr msg;
-        struct cmsghdr *cmsgPtr;
-        struct in_pktinfo pktInfo;
+        PKTINFOCMSG ancData;
 
         sent = 0;
-        memset(&iov,0,sizeof(iov));
-        memset(&msg,0,sizeof(msg));
-        memset(&ancData,0,sizeof(ancData));
-        memset(&pktInfo,0,sizeof(pktInfo));
-        iov.iov_base = pktSnd->pktBuff;
-        iov.iov_len = pktSnd->pktSz;
-        msg.msg_name = (void *)pktSnd->to;
-        msg.msg_namelen = sizeof(SA_IN);
-        msg.msg_iov = &iov;
-        msg.msg_iovlen = 1;
-        msg.msg_control = ancData.buff;
-        msg.msg_controllen = sizeof(ancData.buff);
-        pktInfo.ipi_ifindex = pktSnd->ifIndex;
-        cmsgPtr = CMSG_FIRSTHDR(&msg);
-        cmsgPtr->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
-        cmsgPtr->cmsg_level = IPPROTO_IP;
-        cmsgPtr->cmsg_type = IP_PKTINFO;
-        vPtr = (void *)CMSG_DATA(cmsgPtr);
-        memcpy(vPtr,&pktInfo,sizeof(pktInfo));
+        setPktInfo(pktSnd,&msg,&iov,&ancData);
         sent = sendmsg(pktSnd->fd,&msg,0);
         if (sent < 0)
                 sent = sendto(pktSnd->fd,pktSnd->pktBuff,pktSnd->pktSz,
@@ -549,77 +903,52 @@ PRIVATE int _sendPacket(PKTSND *pktSnd)
         return sent;
 }
 
-PRIVATE U_SHORT flagsToShortValue(U_CHAR *flags)
-{
-    /*
-     * This function builds the corresponding short value
-     * regarding the LLMNR header flags position
-     */
-
-        U_SHORT aux , final;
-        U_CHAR i, sizeActual;
-
-        final = 0;
-        sizeActual = 16;
-
-        for (i=0; i < 10; i++) {
-                if (i==1 || i==9) {
-                        sizeActual = sizeActual - 4;
-                        flags[i] = flags[i] & ((1 << 4) - 1);
-
-                        if (i==9)
-                                sizeActual = 0;
-                } else {
-                        sizeActual--;
-                        flags[i] = flags[i] & 1;
-                }
-                aux = flags[i] << sizeActual;
-
-                if (i==0)
-                        final = aux;
-                else
-                        final = final | aux;
-        }
-        return final;
-}
-
-PRIVATE void copyShortValues(U_CHAR *dest, U_CHAR *values, int valuesSz)
+PRIVATE void setPktInfo(PKTSND *pktSnd, struct msghdr *msg, struct iovec *iov,
+                        PKTINFOCMSG *ancData)
 {
     /*
-     * Copy a string of short values into a buffer
-     * This "string" of short values holds the values
-     * related to a LLMNR 'HEADER'
+     * Fill 'msg' to send 'pktSnd' forcing the exit interface
+     * through IP_PKTINFO (or IPV6_PKTINFO). The source address
+     * is left to the kernel
      */
-        int i, offset, u_shortSz;
-
-        u_shortSz = sizeof(U_SHORT);
-        if (testEndianness()) {
-                offset = valuesSz * u_shortSz;
-                memcpy(dest,values,offset);
-        }
-        for (i = 0; i < valuesSz * u_shortSz; i = i + u_shortSz) {
-                dest[i] = values[i + 1];
-                dest[i + 1] = values[i];
+        void *vPtr;
+        struct cmsghdr *cmsgPtr;
+        struct in_pktinfo pktInfo;
+        struct in6_pktinfo pktInfo6;
+
+        memset(iov,0,sizeof(struct iovec));
+        memset(msg,0,sizeof(struct msghdr));
+        memset(ancData,0,sizeof(PKTINFOCMSG));
+        iov->iov_base = pktSnd->pktBuff;
+        iov->iov_len = pktSnd->pktSz;
+        msg->msg_name = (void *)pktSnd->to;
+        msg->msg_iov = iov;
+        msg->msg_iovlen = 1;
+        msg->msg_control = ancData->buff;
+        msg->msg_controllen = sizeof(ancData->buff);
+        cmsgPtr = CMSG_FIRSTHDR(msg);
+        vPtr = (void *)CMSG_DATA(cmsgPtr);
+        if (pktSnd->to->sa_family == AF_INET) {
+                memset(&pktInfo,0,sizeof(pktInfo));
+                pktInfo.ipi_ifindex = pktSnd->ifIndex;
+                msg->msg_namelen = sizeof(SA_IN);
+                msg->msg_controllen = CMSG_SPACE(sizeof(pktInfo));
+                cmsgPtr->cmsg_len = CMSG_LEN(sizeof(pktInfo));
+                cmsgPtr->cmsg_level = IPPROTO_IP;
+                cmsgPtr->cmsg_type = IP_PKTINFO;
+                memcpy(vPtr,&pktInfo,sizeof(pktInfo));
+        } else {
+                memset(&pktInfo6,0,sizeof(pktInfo6));
+                pktInfo6.ipi6_ifindex = pktSnd->ifIndex;
+                msg->msg_namelen = sizeof(SA_IN6);
+                msg->msg_controllen = CMSG_SPACE(sizeof(pktInfo6));
+                cmsgPtr->cmsg_len = CMSG_LEN(sizeof(pktInfo6));
+                cmsgPtr->cmsg_level = IPPROTO_IPV6;
+                cmsgPtr->cmsg_type = IPV6_PKTINFO;
+                memcpy(vPtr,&pktInfo6,sizeof(pktInfo6));
         }
 }
 
-PRIVATE int testEndianness()
-{
-    /** ********************
-    * 0 --> Little-Endian *
-    * !0 --> Big-Endian   *
-    ***********************/
-        char *ptr;
-        unsigned int test;
-
-        test = 0xFF;
-        ptr = (char *)&test;
-        if (ptr != 0x0)
-                return SUCCESS;
-        else
-                return FAILURE;
-}
-
 /*PUBLIC void printHead(HEADER *head)
 {
         printf("\n");
@@ -0,0 +1,180 @@
+/* Macros */
+#define BITSPERNAME 16
+#define PROBES 3
+#define MINFILTERBITS 512
+#define WORDBITS (8 * sizeof(unsigned long))
+#define LENWORDS ((HOSTNAMEMAX + 1) / WORDBITS + 1)
+
+/* Includes */
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+
+/* Own includes */
+#include "../include/llmnr_defs.h"
+#include "../include/llmnr_ifset.h"
+#include "../include/llmnr_names.h"
+#include "../include/llmnr_net_interface.h"
+#include "../include/llmnr_rr.h"
+#include "../include/llmnr_registry.h"
+#include "../include/llmnr_packet.h"
+#include "../include/llmnr_query_filter.h"
+
+/* Enums & Structs */
+
+/*
+ * 'bits' is the bloom filter ('PROBES' bits per name, derived
+ * from the name hash, See NAMEHASHSTEP). 'lens' the set of the name
+ * sizes (trailing zero included)
+ */
+struct queryFilter {
+        unsigned int mask;
+        unsigned long *bits;
+        unsigned long lens[LENWORDS];
+};
+
+/* Private prototypes */
+PRIVATE void addName(QFILTER *filter, char *name, int len);
+PRIVATE void addAddr(QFILTER *filter, int family, void *addr);
+PRIVATE int testBit(unsigned long *bits, unsigned int bit);
+PRIVATE void setBit(unsigned long *bits, unsigned int bit);
+PRIVATE unsigned int probe(unsigned int hash, int i);
+
+/* Glocal variables */
+
+/* Functions definitions */
+PUBLIC QFILTER *newQueryFilter(NAME *names, NETIFACE *ifaces,
+                               REGISTRY *registry)
+{
+    /*
+     * Build the filter of the names of 'names' and 'registry'
+     * and the PTR names of the addresses of 'ifaces'
+     */
+        int i, len, count;
+        char *name;
+        unsigned int size;
+        QFILTER *filter;
+        NAME *cName;
+        NETIFACE *cIface;
+        NETIFIPV4 *ip4;
+        NETIFIPV6 *ip6;
+
+        count = nameListSz(names) + registrySz(registry);
+        for (cIface = ifaces; cIface != NULL; cIface = cIface->next) {
+                for (ip4 = cIface->IPv4s; ip4 != NULL; ip4 = ip4->next)
+                        count++;
+                for (ip6 = cIface->IPv6s; ip6 != NULL; ip6 = ip6->next)
+                        count++;
+        }
+        for (size = MINFILTERBITS; size < BITSPERNAME * (unsigned int)count;
+             size <<= 1)
+                ;
+        filter = calloc(1,sizeof(QFILTER));
+        if (filter == NULL)
+                return NULL;
+        filter->bits = calloc(size / WORDBITS,sizeof(unsigned long));
+        if (filter->bits == NULL) {
+                free(filter);
+                return NULL;
+        }
+        filter->mask = size - 1;
+        for (cName = names; cName != NULL; cName = cName->next) {
+                if (cName->name != NULL)
+                        addName(filter,cName->name,strlen(cName->name) + 1);
+        }
+        for (i = 0; i < registrySz(registry); i++) {
+                name = hostedName(registry,i,&len);
+                addName(filter,name,len);
+        }
+        for (cIface = ifaces; cIface != NULL; cIface = cIface->next) {
+                for (ip4 = cIface->IPv4s; ip4 != NULL; ip4 = ip4->next)
+                        if (ip4->ipType != NOIP)
+                                addAddr(filter,AF_INET,&ip4->ip4Addr);
+                for (ip6 = cIface->IPv6s; ip6 != NULL; ip6 = ip6->next)
+                        if (ip6->ipType != NOIP)
+                                addAddr(filter,AF_INET6,&ip6->ip6Addr);
+        }
+        return filter;
+}
+
+PUBLIC void delQueryFilter(QFILTER **filter)
+{
+        if (*filter == NULL)
+                return;
+        free((*filter)->bits);
+        free(*filter);
+        *filter = NULL;
+}
+
+PUBLIC int filterQuery(QFILTER *filter, U_CHAR *buffer, int bufferSz)
+{
+    /*
+     * Check the 'bufferSz' bytes received against 'filter'
+     * (a NULL filter lets every well formed query pass)
+     * Returns QF_PASS or the reason to drop the query
+     */
+        int i;
+        HEADER head;
+        QUERY query;
+
+        if (bufferSz < HEADSZ)
+                return QF_HEADER;
+        getHeader(buffer,&head);
+        if (head.FLAGS & (HFLAG_QR | HFLAG_OPCODE) || head.QDCOUNT != 1 ||
+            head.ANCOUNT != 0 || head.NSCOUNT != 0)
+                return QF_HEADER;
+        if (parseQuery(buffer,bufferSz,&head,&query))
+                return QF_QNAME;
+        if (filter == NULL)
+                return QF_PASS;
+        if (!testBit(filter->lens,query.nameLen))
+                return QF_NOTOURS;
+        for (i = 0; i < PROBES; i++) {
+                if (!testBit(filter->bits,probe(query.nameHash,i) &
+                                          filter->mask))
+                        return QF_NOTOURS;
+        }
+        return QF_PASS;
+}
+
+PRIVATE void addName(QFILTER *filter, char *name, int len)
+{
+        int i;
+        unsigned int hash;
+
+        if (len > HOSTNAMEMAX)
+                return;
+        hash = NAMEHASHSEED;
+        for (i = 0; i < len; i++)
+                hash = NAMEHASHSTEP(hash,name[i]);
+        setBit(filter->lens,len);
+        for (i = 0; i < PROBES; i++)
+                setBit(filter->bits,probe(hash,i) & filter->mask);
+}
+
+PRIVATE void addAddr(QFILTER *filter, int family, void *addr)
+{
+        int len;
+        char name[PTRNAMEMAX];
+
+        len = addrToPtrName(family,(U_CHAR *)addr,name);
+        addName(filter,name,len);
+}
+
+PRIVATE int testBit(unsigned long *bits, unsigned int bit)
+{
+        return (bits[bit / WORDBITS] >> (bit % WORDBITS)) & 1;
+}
+
+PRIVATE void setBit(unsigned long *bits, unsigned int bit)
+{
+        bits[bit / WORDBITS] |= 1UL << (bit % WORDBITS);
+}
+
+PRIVATE unsigned int probe(unsigned int hash, int i)
+{
+    /*
+     * Double hashing: h1 + i * h2 (h2 odd, from the high bits)
+     */
+        return hash + i * ((hash >> 16 | hash << 16) | 1);
+}
@@ -0,0 +1,252 @@
+/* Macros */
+#define MAXEVENTS 32
+#define REGSCHUNK 64
+
+/* Includes */
+#include <time.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+/* Own includes */
+#include "../include/llmnr_defs.h"
+#include "../include/llmnr_reactor.h"
+
+/* Enums & Structs */
+typedef struct evreg {
+        int fd;
+        U_CHAR timer;
+        evhandler handler;
+        void *data;
+        struct evreg *next;
+} EVREG;
+
+/* Private prototypes */
+PRIVATE EVREG *getReg(int fd);
+PRIVATE int growRegs(int fd);
+PRIVATE void freeZombies();
+
+/* Glocal variables */
+PRIVATE int EpollFd = -1;
+PRIVATE int RegsSz;
+PRIVATE EVREG **Regs;
+PRIVATE EVREG *Zombies;
+
+/* Functions definitions */
+PUBLIC int newReactor()
+{
+    /*
+     * Create the epoll instance
+     */
+        if (EpollFd >= 0)
+                return SUCCESS;
+        EpollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (EpollFd < 0)
+                return FAILURE;
+        return SUCCESS;
+}
+
+PUBLIC void closeReactor()
+{
+    /*
+     * Forget every handler and close the epoll instance. Timers
+     * are owned by the reactor so they are closed too, any
+     * other descriptor belongs to whoever registered it
+     */
+        int i;
+
+        for (i = 0; i < RegsSz; i++) {
+                if (Regs[i] == NULL)
+                        continue;
+                if (Regs[i]->timer)
+                        close(Regs[i]->fd);
+                free(Regs[i]);
+        }
+        freeZombies();
+        if (Regs != NULL)
+                free(Regs);
+        Regs = NULL;
+        RegsSz = 0;
+        if (EpollFd >= 0)
+                close(EpollFd);
+        EpollFd = -1;
+}
+
+PUBLIC int runReactor(int timeout)
+{
+    /*
+     * Wait up to 'timeout' milliseconds (-1 forever) for ready
+     * descriptors and call their handlers. A handler removed by
+     * a previous handler of the same round is not called
+     * Returns FAILURE on epoll errors (except EINTR)
+     */
+        int i, ready;
+        EVREG *reg;
+        uint64_t expirations;
+        struct epoll_event events[MAXEVENTS];
+
+        ready = epoll_wait(EpollFd,events,MAXEVENTS,timeout);
+        if (ready < 0)
+                return errno == EINTR ? SUCCESS : FAILURE;
+        for (i = 0; i < ready; i++) {
+                reg = (EVREG *)events[i].data.ptr;
+                if (reg->handler == NULL)
+                        continue;
+                if (reg->timer) {
+                        if (read(reg->fd,&expirations,sizeof(uint64_t)) < 0)
+                                continue;
+                }
+                reg->handler(reg->fd,events[i].events,reg->data);
+        }
+        freeZombies();
+        return SUCCESS;
+}
+
+PUBLIC int addHandler(int fd, unsigned int events, evhandler handler,
+                      void *data)
+{
+    /*
+     * Register 'fd' to be watched for 'events' (EPOLLIN, ...).
+     * 'handler' is called with 'data' when 'fd' is ready
+     */
+        EVREG *reg;
+        struct epoll_event event;
+
+        if (fd < 0 || handler == NULL || getReg(fd) != NULL)
+                return FAILURE;
+        if (growRegs(fd))
+                return FAILURE;
+        reg = calloc(1,sizeof(EVREG));
+        if (reg == NULL)
+                return FAILURE;
+        reg->fd = fd;
+        reg->handler = handler;
+        reg->data = data;
+        memset(&event,0,sizeof(event));
+        event.events = events;
+        event.data.ptr = reg;
+        if (epoll_ctl(EpollFd,EPOLL_CTL_ADD,fd,&event) < 0) {
+                free(reg);
+                return FAILURE;
+        }
+        Regs[fd] = reg;
+        return SUCCESS;
+}
+
+PUBLIC int modHandler(int fd, unsigned int events)
+{
+    /*
+     * Change the events watched on 'fd' (0 mutes it)
+     */
+        EVREG *reg;
+        struct epoll_event event;
+
+        reg = getReg(fd);
+        if (reg == NULL)
+                return FAILURE;
+        memset(&event,0,sizeof(event));
+        event.events = events;
+        event.data.ptr = reg;
+        if (epoll_ctl(EpollFd,EPOLL_CTL_MOD,fd,&event) < 0)
+                return FAILURE;
+        return SUCCESS;
+}
+
+PUBLIC int delHandler(int fd)
+{
+    /*
+     * Stop watching 'fd'. The descriptor is not closed (unless
+     * it is a timer). The registration is freed once the
+     * current round of handlers is done, as it might still be
+     * referenced by a pending event
+     */
+        EVREG *reg;
+
+        reg = getReg(fd);
+        if (reg == NULL)
+                return FAILURE;
+        epoll_ctl(EpollFd,EPOLL_CTL_DEL,fd,NULL);
+        if (reg->timer)
+                close(fd);
+        Regs[fd] = NULL;
+        reg->handler = NULL;
+        reg->next = Zombies;
+        Zombies = reg;
+        return SUCCESS;
+}
+
+PUBLIC int newTimer(evhandler handler, void *data)
+{
+    /*
+     * Create a (disarmed) timer and register it
+     * Returns the timer descriptor
+     */
+        int fd;
+
+        fd = timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK | TFD_CLOEXEC);
+        if (fd < 0)
+                return FAILURE;
+        if (addHandler(fd,EPOLLIN,handler,data)) {
+                close(fd);
+                return FAILURE;
+        }
+        Regs[fd]->timer = TRUE;
+        return fd;
+}
+
+PUBLIC int armTimer(int fd, long ms)
+{
+    /*
+     * One shot expiration in 'ms' milliseconds (0 disarms it)
+     */
+        struct itimerspec spec;
+
+        memset(&spec,0,sizeof(spec));
+        spec.it_value.tv_sec = ms / 1000;
+        spec.it_value.tv_nsec = (ms % 1000) * 1000000;
+        if (timerfd_settime(fd,0,&spec,NULL) < 0)
+                return FAILURE;
+        return SUCCESS;
+}
+
+PRIVATE EVREG *getReg(int fd)
+{
+        if (fd < 0 || fd >= RegsSz)
+                return NULL;
+        return Regs[fd];
+}
+
+PRIVATE int growRegs(int fd)
+{
+    /*
+     * Registrations are indexed by descriptor. Make room
+     * for 'fd'
+     */
+        int newSz;
+        EVREG **newRegs;
+
+        if (fd < RegsSz)
+                return SUCCESS;
+        newSz = (fd / REGSCHUNK + 1) * REGSCHUNK;
+        newRegs = realloc(Regs,newSz * sizeof(EVREG *));
+        if (newRegs == NULL)
+                return FAILURE;
+        memset(newRegs + RegsSz,0,(newSz - RegsSz) * sizeof(EVREG *));
+        Regs = newRegs;
+        RegsSz = newSz;
+        return SUCCESS;
+}
+
+PRIVATE void freeZombies()
+{
+        EVREG *next;
+
+        for (; Zombies != NULL; Zombies = next) {
+                next = Zombies->next;
+                free(Zombies);
+        }
+}
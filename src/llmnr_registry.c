@@ -0,0 +1,618 @@
+/* Macros */
+#define _GNU_SOURCE
+#define HOSTEDTYPES 5
+#define MININDEXSZ 16
+#define LABELSZ 63
+#define RECORDHEADSZ (sizeof(U_SHORT) + 10)
+#define RDATAMAX (3 * sizeof(U_SHORT) + HOSTNAMEMAX + 1)
+
+/* Includes */
+#include <stdio.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+/* Own includes */
+#include "../include/llmnr_defs.h"
+#include "../include/llmnr_ifset.h"
+#include "../include/llmnr_names.h"
+#include "../include/llmnr_rr.h"
+#include "../include/llmnr_print.h"
+#include "../include/llmnr_utils.h"
+#include "../include/llmnr_syslog.h"
+#include "../include/llmnr_str_list.h"
+#include "../include/llmnr_registry.h"
+
+/* Enums & Structs */
+
+/*
+ * The 'count' records of type 'type' ('len' bytes from 'offset'
+ * of the records of the name)
+ */
+typedef struct {
+        U_SHORT type;
+        U_SHORT count;
+        int offset;
+        int len;
+} RRBUCKET;
+
+/*
+ * 'name' is the case folded wire format name ('len' bytes,
+ * trailing zero included). 'rrs' holds every bucket ('rrsSz'
+ * bytes)
+ */
+struct hosted {
+        char *name;
+        int len;
+        unsigned int hash;
+        int nBuckets;
+        RRBUCKET buckets[HOSTEDTYPES];
+        int rrsSz;
+        U_CHAR *rrs;
+};
+
+/*
+ * 'hosted' holds the 'count' names ('size' allocated). 'index'
+ * is the hash index over them (open addressing, linear probing,
+ * at most half full): position in 'hosted' plus one, 0 if empty
+ */
+struct registry {
+        int refs;
+        int count;
+        int size;
+        int records;
+        unsigned int mask;
+        int *index;
+        HOSTED *hosted;
+};
+
+/* Private prototypes */
+PRIVATE int parseLine(REGISTRY *registry, STRNODE *tokens);
+PRIVATE int wireName(char *name, char *buff);
+PRIVATE int txtData(STRNODE *tokens, int count, U_CHAR *rData);
+PRIVATE int targetData(STRNODE *tokens, int count, U_CHAR *rData);
+PRIVATE int compressTarget(char *name, int len, U_CHAR *target,
+                           int targetLen);
+PRIVATE HOSTED *getHosted(REGISTRY *registry, char *name, int len);
+PRIVATE int growIndex(REGISTRY *registry, unsigned int size);
+PRIVATE int addRecord(HOSTED *hosted, U_SHORT type, U_CHAR *rData,
+                      int rdLen);
+PRIVATE int addrsSz(HOSTED *hosted);
+PRIVATE void freeRegistry(REGISTRY *registry);
+PRIVATE int foldCmp(char *folded, char *name, int len);
+PRIVATE char foldChar(char c);
+
+/* Glocal variables */
+
+/* Functions definitions */
+PUBLIC int loadRegistry(char *filePath, REGISTRY **registry)
+{
+    /*
+     * Build a registry with the records of the hosts file
+     * 'filePath' ('#' starts a comment). Lines that can't be
+     * parsed are logged and skipped. '*registry' is NULL when
+     * there is no file (nothing is hosted), otherwise it comes
+     * with one reference (See dropRegistry())
+     * Returns FAILURE only when out of memory
+     */
+        int res;
+        FILE *file;
+        char *line, *c;
+        size_t lineSz;
+        REGISTRY *reg;
+        STRNODE *tokens;
+
+        *registry = NULL;
+        file = fopen(filePath,"r");
+        if (file == NULL)
+                return SUCCESS;
+        line = NULL;
+        lineSz = 0;
+        reg = calloc(1,sizeof(REGISTRY));
+        if (reg == NULL)
+                goto CleanLR;
+        reg->refs = 1;
+        while (getline(&line,&lineSz,file) >= 0) {
+                line[strcspn(line,"#\r\n")] = 0;
+                for (c = line; *c != 0; c++) {
+                        if (*c == '\t')
+                                *c = ' ';
+                }
+                if (line[strspn(line," ")] == 0)
+                        continue;
+                tokens = split(line,' ');
+                if (tokens == NULL)
+                        goto CleanLR;
+                res = parseLine(reg,tokens);
+                deleteStrNodeList(&tokens);
+                if (res < 0)
+                        goto CleanLR;
+                if (res > 0)
+                        logError(res,line);
+        }
+        free(line);
+        fclose(file);
+        *registry = reg;
+        return SUCCESS;
+
+        CleanLR:
+        free(line);
+        fclose(file);
+        if (reg != NULL)
+                freeRegistry(reg);
+        return FAILURE;
+}
+
+PUBLIC REGISTRY *holdRegistry(REGISTRY *registry)
+{
+    /*
+     * One more reference to 'registry'
+     */
+        if (registry != NULL)
+                __atomic_add_fetch(&registry->refs,1,__ATOMIC_RELAXED);
+        return registry;
+}
+
+PUBLIC void dropRegistry(REGISTRY **registry)
+{
+    /*
+     * Give back a reference. The last one frees the registry
+     */
+        if (*registry == NULL)
+                return;
+        if (__atomic_sub_fetch(&(*registry)->refs,1,__ATOMIC_ACQ_REL) == 0)
+                freeRegistry(*registry);
+        *registry = NULL;
+}
+
+PUBLIC HOSTED *lookupHosted(REGISTRY *registry, char *name, int len,
+                            unsigned int hash)
+{
+    /*
+     * Look up the wire format 'name' ('len' bytes, trailing zero
+     * included) whose hash is 'hash' (See NAMEHASHSTEP)
+     * Returns the hosted name (NULL if not hosted)
+     */
+        unsigned int slot;
+        HOSTED *hosted;
+
+        if (registry == NULL || registry->count == 0 || name == NULL)
+                return NULL;
+        slot = hash & registry->mask;
+        for (; registry->index[slot] != 0;
+             slot = (slot + 1) & registry->mask) {
+                hosted = &registry->hosted[registry->index[slot] - 1];
+                if (hosted->hash != hash || hosted->len != len)
+                        continue;
+                if (!foldCmp(hosted->name,name,len))
+                        return hosted;
+        }
+        return NULL;
+}
+
+PUBLIC int registrySz(REGISTRY *registry)
+{
+        if (registry == NULL)
+                return 0;
+        return registry->count;
+}
+
+PUBLIC char *hostedName(REGISTRY *registry, int i, int *len)
+{
+    /*
+     * The (case folded, wire format) name at position 'i'
+     * (0 to registrySz() - 1) and his size
+     */
+        *len = registry->hosted[i].len;
+        return registry->hosted[i].name;
+}
+
+PUBLIC U_CHAR *hostedRecords(HOSTED *hosted, U_SHORT type, int *count,
+                             int *len)
+{
+    /*
+     * The bucket of 'type': 'count' records, 'len' bytes ready
+     * to be copied into an answer (See llmnr_registry.h). 'ANY'
+     * are the records of every type but 'A' and 'AAAA' (they
+     * follow the address buckets, See addRecord())
+     * Returns NULL if the name has no records of 'type'
+     */
+        int i, offset;
+
+        if (hosted == NULL)
+                return NULL;
+        if (type == ANY) {
+                offset = addrsSz(hosted);
+                if (offset == hosted->rrsSz)
+                        return NULL;
+                *count = 0;
+                for (i = 0; i < hosted->nBuckets; i++) {
+                        if (hosted->buckets[i].offset >= offset)
+                                *count += hosted->buckets[i].count;
+                }
+                *len = hosted->rrsSz - offset;
+                return hosted->rrs + offset;
+        }
+        for (i = 0; i < hosted->nBuckets; i++) {
+                if (hosted->buckets[i].type != type)
+                        continue;
+                *count = hosted->buckets[i].count;
+                *len = hosted->buckets[i].len;
+                return hosted->rrs + hosted->buckets[i].offset;
+        }
+        return NULL;
+}
+
+PUBLIC void printRegistry(REGISTRY *registry)
+{
+        printToStream("Hosted names: %d (%d records)\n",
+                      registrySz(registry),
+                      registry == NULL ? 0 : registry->records);
+}
+
+PRIVATE int parseLine(REGISTRY *registry, STRNODE *tokens)
+{
+    /*
+     * Add the record of a line of the hosts file (already split,
+     * See llmnr_registry.h)
+     * Returns SUCCESS, the error to log or FAILURE (out of
+     * memory)
+     */
+        char *type;
+        int count, len, rdLen;
+        U_SHORT rrType;
+        HOSTED *hosted;
+        U_CHAR rData[RDATAMAX];
+        char name[HOSTNAMEMAX + 1];
+
+        count = countStrNodes(tokens);
+        if (count < 4)
+                return EBADPARAMETER;
+        len = wireName(getNodeAt(tokens,1),name);
+        if (len < 0)
+                return EBADNAME;
+        type = getNodeAt(tokens,2);
+        rdLen = FAILURE;
+        if (count == 4 && !strcasecmp(type,"a")) {
+                rrType = A;
+                if (inet_pton(AF_INET,getNodeAt(tokens,3),rData) == 1)
+                        rdLen = IPV4LEN;
+        } else if (count == 4 && !strcasecmp(type,"aaaa")) {
+                rrType = AAAA;
+                if (inet_pton(AF_INET6,getNodeAt(tokens,3),rData) == 1)
+                        rdLen = IPV6LEN;
+        } else if (!strcasecmp(type,"txt")) {
+                rrType = TXT;
+                rdLen = txtData(tokens,count,rData);
+        } else if (count == 7 && !strcasecmp(type,"srv")) {
+                rrType = SRV;
+                rdLen = targetData(tokens,count,rData);
+        } else if (count == 5 && !strcasecmp(type,"mx")) {
+                rrType = MX;
+                rdLen = targetData(tokens,count,rData);
+                if (rdLen > 0)
+                        rdLen = sizeof(U_SHORT) +
+                                compressTarget(name,len,
+                                               rData + sizeof(U_SHORT),
+                                               rdLen - sizeof(U_SHORT));
+        } else {
+                return EBADPARAMETER;
+        }
+        if (rdLen < 0)
+                return EBADPARAMETER;
+        hosted = getHosted(registry,name,len);
+        if (hosted == NULL || addRecord(hosted,rrType,rData,rdLen))
+                return FAILURE;
+        registry->records++;
+        return SUCCESS;
+}
+
+PRIVATE int wireName(char *name, char *buff)
+{
+    /*
+     * Check 'name' (labels of letters, digits, '-' and '_', the
+     * leading underscore labels of 'SRV' names included) and
+     * write it in wire format into 'buff'
+     * Returns the wire format size (FAILURE if not valid)
+     */
+        int i, len, label;
+
+        len = strlen(name);
+        if (len == 0 || len > HOSTNAMEMAX - 2)
+                return FAILURE;
+        label = 0;
+        for (i = 0; i < len; i++) {
+                if (name[i] == '.') {
+                        if (label == 0)
+                                return FAILURE;
+                        label = 0;
+                        continue;
+                }
+                if (!isalnum((U_CHAR)name[i]) && name[i] != '-' &&
+                    name[i] != '_')
+                        return FAILURE;
+                if (++label > LABELSZ)
+                        return FAILURE;
+        }
+        if (label == 0)
+                return FAILURE;
+        memset(buff,0,HOSTNAMEMAX + 1);
+        strToDnsStr(name,buff);
+        return len + 2;
+}
+
+PRIVATE int txtData(STRNODE *tokens, int count, U_CHAR *rData)
+{
+    /*
+     * The text (every token from the fourth one, separated by a
+     * space) as a single character string
+     * Returns the 'RDATA' size (FAILURE if the text is too long)
+     */
+        int i, len, tokenSz;
+        char *token;
+
+        len = 0;
+        for (i = 3; i < count; i++) {
+                token = getNodeAt(tokens,i);
+                tokenSz = strlen(token);
+                if (len + tokenSz + (i > 3) > 255)
+                        return FAILURE;
+                if (i > 3)
+                        rData[1 + len++] = ' ';
+                memcpy(rData + 1 + len,token,tokenSz);
+                len += tokenSz;
+        }
+        rData[0] = len;
+        return len + 1;
+}
+
+PRIVATE int targetData(STRNODE *tokens, int count, U_CHAR *rData)
+{
+    /*
+     * 'MX' (preference, exchange) and 'SRV' (priority, weight,
+     * port, target): 16 bits numbers followed by an
+     * uncompressed name, from the fourth token
+     * Returns the 'RDATA' size (FAILURE if not valid)
+     */
+        int i, len;
+        long value;
+        char *end, *token;
+        U_SHORT aux;
+        char name[HOSTNAMEMAX + 1];
+
+        for (i = 3; i < count - 1; i++) {
+                token = getNodeAt(tokens,i);
+                value = strtol(token,&end,10);
+                if (*token == 0 || *end != 0 || value < 0 || value > 65535)
+                        return FAILURE;
+                aux = htons((U_SHORT)value);
+                memcpy(rData + (i - 3) * sizeof(U_SHORT),&aux,
+                       sizeof(U_SHORT));
+        }
+        len = wireName(getNodeAt(tokens,count - 1),name);
+        if (len < 0)
+                return FAILURE;
+        memcpy(rData + (count - 4) * sizeof(U_SHORT),name,len);
+        return (count - 4) * sizeof(U_SHORT) + len;
+}
+
+PRIVATE int compressTarget(char *name, int len, U_CHAR *target,
+                           int targetLen)
+{
+    /*
+     * A record of the name 'name' ('len' bytes, wire format) only
+     * answers a query for it, so his QNAME is always at 'HEADSZ'
+     * of the answer. The longest suffix (whole labels, case
+     * folded) 'target' shares with 'name' is replaced by a
+     * pointer to the same suffix of the QNAME (See RFC 1035
+     * 4.1.4). Only for 'MX' exchanges, 'SRV' targets must not be
+     * compressed (See RFC 2782)
+     * Returns the new size of 'target'
+     */
+        int i, j, k, offset;
+
+        for (i = 0; target[i] != 0; i += target[i] + 1) {
+                offset = len - (targetLen - i);
+                if (offset < 0)
+                        continue;
+                for (j = 0; j < offset; j += (U_CHAR)name[j] + 1)
+                        ;
+                if (j != offset)
+                        continue;
+                for (k = 0; k < targetLen - i; k++) {
+                        if (foldChar((char)target[i + k]) !=
+                            foldChar(name[j + k]))
+                                break;
+                }
+                if (k < targetLen - i)
+                        continue;
+                offset += HEADSZ;
+                target[i] = 0xC0 | (offset >> 8);
+                target[i + 1] = offset & 0xFF;
+                return i + sizeof(U_SHORT);
+        }
+        return targetLen;
+}
+
+PRIVATE HOSTED *getHosted(REGISTRY *registry, char *name, int len)
+{
+    /*
+     * The hosted 'name' (wire format, 'len' bytes). Added the
+     * first time
+     */
+        int i;
+        unsigned int hash, slot;
+        HOSTED *hosted;
+
+        hash = NAMEHASHSEED;
+        for (i = 0; i < len; i++)
+                hash = NAMEHASHSTEP(hash,name[i]);
+        hosted = lookupHosted(registry,name,len,hash);
+        if (hosted != NULL)
+                return hosted;
+        if (2 * (unsigned int)(registry->count + 1) > registry->mask) {
+                if (growIndex(registry,registry->index == NULL ?
+                                       MININDEXSZ : 2 * (registry->mask + 1)))
+                        return NULL;
+        }
+        if (registry->count == registry->size) {
+                hosted = realloc(registry->hosted,2 * (registry->size + 1) *
+                                 sizeof(HOSTED));
+                if (hosted == NULL)
+                        return NULL;
+                registry->hosted = hosted;
+                registry->size = 2 * (registry->size + 1);
+        }
+        hosted = &registry->hosted[registry->count];
+        memset(hosted,0,sizeof(HOSTED));
+        hosted->name = malloc(len);
+        if (hosted->name == NULL)
+                return NULL;
+        for (i = 0; i < len; i++)
+                hosted->name[i] = foldChar(name[i]);
+        hosted->len = len;
+        hosted->hash = hash;
+        slot = hash & registry->mask;
+        while (registry->index[slot] != 0)
+                slot = (slot + 1) & registry->mask;
+        registry->index[slot] = ++registry->count;
+        return hosted;
+}
+
+PRIVATE int growIndex(REGISTRY *registry, unsigned int size)
+{
+    /*
+     * Rebuild the index with 'size' (a power of two) slots
+     */
+        int i, *index;
+        unsigned int slot;
+
+        index = calloc(size,sizeof(int));
+        if (index == NULL)
+                return FAILURE;
+        for (i = 0; i < registry->count; i++) {
+                slot = registry->hosted[i].hash & (size - 1);
+                while (index[slot] != 0)
+                        slot = (slot + 1) & (size - 1);
+                index[slot] = i + 1;
+        }
+        free(registry->index);
+        registry->index = index;
+        registry->mask = size - 1;
+        return SUCCESS;
+}
+
+PRIVATE int addRecord(HOSTED *hosted, U_SHORT type, U_CHAR *rData,
+                      int rdLen)
+{
+    /*
+     * Serialize the record at the end of the bucket of 'type'
+     * (a new one the first time: after the 'A' and 'AAAA' ones,
+     * or after every other one if it is not an address bucket).
+     * The buckets after it move, so the buckets stay contiguous
+     * and the records other than addresses stay at the end (See
+     * hostedRecords())
+     */
+        int i, end, recSz;
+        U_SHORT aux;
+        unsigned int ttl;
+        U_CHAR *rrs, *record;
+        RRBUCKET *bucket;
+
+        bucket = NULL;
+        for (i = 0; i < hosted->nBuckets; i++) {
+                if (hosted->buckets[i].type == type)
+                        bucket = &hosted->buckets[i];
+        }
+        if (bucket == NULL && hosted->nBuckets == HOSTEDTYPES)
+                return FAILURE;
+        recSz = RECORDHEADSZ + rdLen;
+        rrs = realloc(hosted->rrs,hosted->rrsSz + recSz);
+        if (rrs == NULL)
+                return FAILURE;
+        hosted->rrs = rrs;
+        if (bucket == NULL) {
+                bucket = &hosted->buckets[hosted->nBuckets++];
+                bucket->type = type;
+                bucket->count = 0;
+                bucket->len = 0;
+                bucket->offset = hosted->rrsSz;
+                if (type == A || type == AAAA)
+                        bucket->offset = addrsSz(hosted);
+        }
+        end = bucket->offset + bucket->len;
+        memmove(rrs + end + recSz,rrs + end,hosted->rrsSz - end);
+        for (i = 0; i < hosted->nBuckets; i++) {
+                if (hosted->buckets[i].offset >= end &&
+                    &hosted->buckets[i] != bucket)
+                        hosted->buckets[i].offset += recSz;
+        }
+        record = rrs + end;
+        record[0] = 0xC0;
+        record[1] = HEADSZ;
+        aux = htons(type);
+        memcpy(record + 2,&aux,sizeof(U_SHORT));
+        aux = htons(INCLASS);
+        memcpy(record + 4,&aux,sizeof(U_SHORT));
+        ttl = htonl(RRTTL);
+        memcpy(record + 6,&ttl,sizeof(ttl));
+        aux = htons(rdLen);
+        memcpy(record + 10,&aux,sizeof(U_SHORT));
+        memcpy(record + RECORDHEADSZ,rData,rdLen);
+        bucket->count++;
+        bucket->len += recSz;
+        hosted->rrsSz += recSz;
+        return SUCCESS;
+}
+
+PRIVATE int addrsSz(HOSTED *hosted)
+{
+    /*
+     * Size of the 'A' and 'AAAA' buckets (the first ones)
+     */
+        int i, size;
+
+        size = 0;
+        for (i = 0; i < hosted->nBuckets; i++) {
+                if (hosted->buckets[i].type == A ||
+                    hosted->buckets[i].type == AAAA)
+                        size += hosted->buckets[i].len;
+        }
+        return size;
+}
+
+PRIVATE void freeRegistry(REGISTRY *registry)
+{
+        int i;
+
+        for (i = 0; i < registry->count; i++) {
+                free(registry->hosted[i].name);
+                free(registry->hosted[i].rrs);
+        }
+        free(registry->hosted);
+        free(registry->index);
+        free(registry);
+}
+
+PRIVATE int foldCmp(char *folded, char *name, int len)
+{
+        int i;
+
+        for (i = 0; i < len; i++) {
+                if (folded[i] != foldChar(name[i]))
+                        return FAILURE;
+        }
+        return SUCCESS;
+}
+
+PRIVATE char foldChar(char c)
+{
+    /*
+     * ASCII only (See RFC 4343)
+     */
+        if (c >= 'A' && c <= 'Z')
+                return c + ('a' - 'A');
+        return c;
+}
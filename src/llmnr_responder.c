@@ -8,6 +8,7 @@
 
 /* Own includes */
 #include "../include/llmnr_defs.h"
+#include "../include/llmnr_ifset.h"
 #include "../include/llmnr_names.h"
 #include "../include/llmnr_net_interface.h"
 #include "../include/llmnr_rr.h"
@@ -1,7 +1,7 @@
 /* Macros */
 #define LINESZ 300
 #define LABELSZ 63
-#define MAXLINES 40
+#define TXTMAX 255
 
 /* Includes */
 #include <time.h>
@@ -13,11 +13,11 @@
 #include <unistd.h>
 #include <string.h>
 #include <net/if.h>
-#include <ifaddrs.h>
 #include <netinet/in.h>
 
 /* Own includes */
 #include "../include/llmnr_defs.h"
+#include "../include/llmnr_ifset.h"
 #include "../include/llmnr_names.h"
 #include "../include/llmnr_net_interface.h"
 #include "../include/llmnr_rr.h"
@@ -25,6 +25,8 @@
 #include "../include/llmnr_syslog.h"
 #include "../include/llmnr_utils.h"
 #include "../include/llmnr_str_list.h"
+#include "../include/llmnr_options.h"
+#include "../include/llmnr_netlink.h"
 #include "../include/llmnr_responder_s1.h"
 
 /* Enums & Structs */
@@ -35,9 +37,8 @@ PRIVATE void getSysName();
 PRIVATE void fillSoaRR();
 PRIVATE void createConfigFile(char *filePath);
 PRIVATE void remLoopback(NETIFACE *ifaces);
-PRIVATE void createInterfaces(struct ifaddrs *head);
-PRIVATE void fillInterfaces(struct ifaddrs *head);
-PRIVATE void _fillInterfaces(NETIFACE *copy, struct ifaddrs *aux);
+PRIVATE void createInterfaces();
+PRIVATE void fillInterfaces();
 PRIVATE void fillARecord();
 PRIVATE void fillAAAARecord();
 PRIVATE void saveLogPath(char *name);
@@ -54,6 +55,7 @@ PRIVATE int validLogConflicts(char *name);
 PRIVATE int validLogConflictsOn(char *name);
 PRIVATE int validMx(char *pref, char *exchange);
 PRIVATE int validIface(char *ifName, char *ifProto);
+PRIVATE int validOption(char *name, char *value);
 PRIVATE int checkFQDN(char *name);
 PRIVATE int checkDigits(char *str);
 
@@ -85,18 +87,23 @@ PUBLIC void startS1(NAME *_N, NETIFACE *_I, RRLIST *_R, CONFLICT *_C)
 PRIVATE void start()
 {
     /*
+     * - Open the netlink socket, it dumps the network interfaces
+     *   and their ips (See llmnr_netlink.h)
      * - Check if config file exists. If not create it
      * - If exists then read it and parse it to get config parameters
-     * - Call getifaddrs() to get interfaces and ip interfaces
      * - Fill or build interfaces ips, 'A', 'AAAA', 'PTR'
      *   and 'SOA' records
      */
         //int res;
-        struct ifaddrs *head;
         char filePath[] = "/etc/llmnr/llmnr.conf";
         char pidFilePath[] = "/etc/llmnr/llmnr.pid";
         char defLogOnPath[] = "syslog";
 
+        if (openNetlink() < 0) {
+                Errno = errno;
+                logError(EIFDUMP,strerror(Errno));
+                freeResources();
+        }
         if (!access(filePath,F_OK)) {
                 if (readConfigFile(filePath) == SYSFAILURE)
                         logError(ESYSFAIL1,strerror(Errno));
@@ -105,15 +112,8 @@ PRIVATE void start()
         }
         if (nameListSz(Names) <= 1)
                 getSysName();
-        if (getifaddrs(&head) < 0) {
-                Errno = errno;
-                logError(EGETIFADDRS,strerror(Errno));
-                if (head != NULL)
-                        freeifaddrs(head);
-                freeResources();
-        }
         if (netIfaceListSz(Ifaces) <= 1) {
-                createInterfaces(head);
+                createInterfaces();
                 Ifaces->flags |= _IFF_DYNAMIC;
         } else {
                 Ifaces->flags |= _IFF_STATIC;
@@ -121,8 +121,7 @@ PRIVATE void start()
         if (Conflicts->logPath == NULL && LogOn)
                 validLogConflictsOn(defLogOnPath);
         fillPtrRecord(Names);
-        fillInterfaces(head);
-        freeifaddrs(head);
+        fillInterfaces();
         fillARecord();
         fillAAAARecord();
         remLoopback(Ifaces);
@@ -161,12 +160,67 @@ PRIVATE void createConfigFile(char *filePath)
         "# log_conflicts yes\n"
         "# log_conflicts_on /var/log/llmnr.conflicts\n"
         "#\n"
-        "# Resource records config. Only 'MX' and 'TXT' supported:\n"
+        "# Resource records config. Only 'MX' and 'TXT' supported\n"
+        "# (every hostname answers them):\n"
         "# MX 10 mx.com.ve\n"
         "# TXT some text\n"
+        "# TXT some other text\n"
+        "#\n"
+        "# Hosted names, each with his own records, go in\n"
+        "# /etc/llmnr/llmnr.hosts (loaded again on SIGHUP), one\n"
+        "# record per line. 'A' and 'AAAA' records replace the ips of\n"
+        "# the interface, the other ones the records above:\n"
+        "# build-42 a 192.168.1.42\n"
+        "# build-42 aaaa fe80::42\n"
+        "# build-42 txt commit 1a2b3c\n"
+        "# _http._tcp.build-42 srv 0 0 8080 build-42\n"
+        "# build-42 mx 10 mail.build-42\n"
         "#\n"
         "# 'CNAME' and 'NS' make no much sense to have in LLMNR\n"
-        "# 'A', 'AAAA', 'PTR' and 'SOA' are automatically derivated\n";
+        "# 'A', 'AAAA', 'PTR' and 'SOA' are automatically derivated\n"
+        "#\n"
+        "# Performance tuning. Threads answering UDP queries and number\n"
+        "# of queries that can wait to be answered:\n"
+        "# workers 4\n"
+        "# queue_size 256\n"
+        "# Datagrams read per receive syscall (1 - 64):\n"
+        "# recv_batch 16\n"
+        "# Answers sent per send syscall (1 - 64):\n"
+        "# send_batch 16\n"
+        "# Microseconds an answer may wait to be sent along\n"
+        "# with others (0 - 10000):\n"
+        "# send_budget 500\n"
+        "# Sharded UDP mode: SO_REUSEPORT sockets (and threads) per\n"
+        "# family (0 - 64, 0 disables it):\n"
+        "# shards 0\n"
+        "# CPUs the shard threads are pinned to, as a bitmask\n"
+        "# (i.e 15 = CPUs 0 to 3, 0 = every CPU):\n"
+        "# shard_cpus 0\n"
+        "# Unicast steering (0: kernel hash, 1: SO_INCOMING_CPU,\n"
+        "# 2: cBPF program by receiving CPU):\n"
+        "# shard_steering 0\n"
+        "# Serialized answers kept in the answer cache (0 disables it):\n"
+        "# answer_cache 1024\n"
+        "# Kernel filter on the UDP sockets (0: none, 1: header\n"
+        "# checks, 2: header and first label of the name):\n"
+        "# kernel_filter 2\n"
+        "# TCP: pending connections, connections open at the same\n"
+        "# time, and milliseconds a connection may stay idle or open:\n"
+        "# tcp_backlog 16\n"
+        "# tcp_clients 64\n"
+        "# tcp_idle 2000\n"
+        "# tcp_lifetime 10000\n"
+        "# Largest UDP answer to a query carrying an EDNS0 OPT\n"
+        "# record (0 ignores OPT records, at most 1500):\n"
+        "# edns_payload 1232\n"
+        "# Milliseconds the network interface changes are gathered\n"
+        "# before being applied as a single batch (0 applies them\n"
+        "# right away):\n"
+        "# netlink_batch 50\n"
+        "# UDP sockets per interface, bound to the device, instead of\n"
+        "# one per family for every interface (0: off, 1: on). With\n"
+        "# shards, every interface is answered by the same shard:\n"
+        "# iface_sockets 0\n";
 
         file = fopen(filePath,"w");
         if (file == NULL) {
@@ -189,11 +243,10 @@ PRIVATE int readConfigFile(char *filePath)
      * into a 'strList' list for later parsing
      */
         STRNODE *params;
-        int i, fd, lineCount;
+        int i, fd;
         char readChar, commentary, line[LINESZ];
 
         i = 0;
-        lineCount = 0;
         commentary = 0;
         memset(line,0,LINESZ + 1);
         fd = open(filePath,O_RDONLY);
@@ -203,7 +256,7 @@ PRIVATE int readConfigFile(char *filePath)
                 return SYSFAILURE;
         }
         params = strNodeHead();
-        while (read(fd,&readChar,sizeof(char)) > 0 && lineCount < MAXLINES) {
+        while (read(fd,&readChar,sizeof(char)) > 0) {
                 if (readChar == '#')
                         commentary = 1;
                 if (readChar == 10) {
@@ -213,7 +266,6 @@ PRIVATE int readConfigFile(char *filePath)
                                         deleteStrNodeList(&params);
                                         return SYSFAILURE;
                                 }
-                                lineCount++;
                         }
                         i = 0;
                         commentary = 0;
@@ -286,6 +338,8 @@ PRIVATE int _parseConfigFile(STRNODE *param)
                 return validLogConflicts(getNodeAt(param,2));
         else if (strNodeCount == 3 && !strcasecmp("log_conflicts_on",key))
                 return validLogConflictsOn(getNodeAt(param,2));
+        else if (strNodeCount == 3 && isOption(key))
+                return validOption(key,getNodeAt(param,2));
         else
                 return EBADPARAMETER;
         return SUCCESS;
@@ -317,15 +371,18 @@ PRIVATE int validIface(char *ifName, char *family)
      * is created
      */
         if (!strcasecmp(family,"ipv4")) {
-                if (addNetIfNode(ifName,AF_INET,_IFF_STATIC,Ifaces) == FAILURE)
+                if (addNetIfNode(ifName,linkIndex(ifName),AF_INET,_IFF_STATIC,
+                                 Ifaces) == FAILURE)
                         return EREPEATIF;
         }
         else if (!strcasecmp(family,"ipv6")) {
-                if (addNetIfNode(ifName,AF_INET6,_IFF_STATIC,Ifaces) == FAILURE)
+                if (addNetIfNode(ifName,linkIndex(ifName),AF_INET6,_IFF_STATIC,
+                                 Ifaces) == FAILURE)
                         return EREPEATIF;
         }
         else if (!strcasecmp(family,"dual")) {
-                if (addNetIfNode(ifName,AF_DUAL,_IFF_STATIC,Ifaces))
+                if (addNetIfNode(ifName,linkIndex(ifName),AF_DUAL,_IFF_STATIC,
+                                 Ifaces))
                         return EREPEATIF;
         }
         else
@@ -368,16 +425,13 @@ PRIVATE int validTxt(STRNODE *line)
     /*
      * Checks if the given 'TXT' (read from config file
      * is valid. If valid then a new 'RRLIST' node
-     * is created
+     * is created (a name answers every 'TXT' defined)
      */
         TXT_RR txtrr;
         RESRECORD rr;
         int i, lineC;
-        static char txtDef = 0;
         char fBuff[LINESZ], *buff;
 
-        if (txtDef > 0)
-                return ETXTDEFINED;
         memset(fBuff,0,LINESZ);
         lineC = countStrNodes(line);
 
@@ -387,6 +441,8 @@ PRIVATE int validTxt(STRNODE *line)
                 if (i < lineC - 1)
                         strcat(buff," ");
         }
+        if (strlen(buff) > TXTMAX)
+                return EBADPARAMETER;
         *fBuff = strlen(buff);
         txtrr.TXTDATA = fBuff;
         rr.TYPE = TXT;
@@ -489,6 +545,18 @@ PRIVATE int validLogConflictsOn(char *name)
         return SUCCESS;
 }
 
+PRIVATE int validOption(char *name, char *value)
+{
+    /*
+     * Checks if the given tunable option (read from config
+     * file) has a valid value. If valid then the option is
+     * setted (See llmnr_options.h)
+     */
+        if (setOption(name,value))
+                return EBADPARAMETER;
+        return SUCCESS;
+}
+
 PRIVATE int checkFQDN(char *name)
 {
     /*
@@ -546,87 +614,58 @@ PRIVATE int checkDigits(char *str)
         return SUCCESS;
 }
 
-PRIVATE void createInterfaces(struct ifaddrs *head)
+PRIVATE void createInterfaces()
 {
     /*
      * Dinamic interfaces. No interface were specify in
      * config file. Add to 'NETIFACE' list every network
-     * interface available in the system
+     * interface available in the system (with an ip)
      */
-        int family;
-        struct ifaddrs *current;
+        NLLINK *link;
 
-        if (head == NULL)
-                return;
-        current = head;
-        for (; current != NULL; current = current->ifa_next) {
-                if (current->ifa_addr == NULL)
-                        continue;
-                family = current->ifa_addr->sa_family;
-                if (current->ifa_flags & IFF_LOOPBACK)
+        for (link = getLinks(); link != NULL; link = link->next) {
+                if (link->flags & IFF_LOOPBACK)
                         continue;
-                if (family == AF_INET)
-                        addNetIfNode(current->ifa_name,AF_INET,_IFF_DYNAMIC,
-                                     Ifaces);
-                else if (family == AF_INET6)
-                        addNetIfNode(current->ifa_name,AF_INET6,_IFF_DYNAMIC,
-                                     Ifaces);
+                if (link->addrs4 != NULL)
+                        addNetIfNode(link->name,link->ifIndex,AF_INET,
+                                     _IFF_DYNAMIC,Ifaces);
+                if (link->addrs6 != NULL)
+                        addNetIfNode(link->name,link->ifIndex,AF_INET6,
+                                     _IFF_DYNAMIC,Ifaces);
         }
 }
 
-PRIVATE void fillInterfaces(struct ifaddrs *head)
+PRIVATE void fillInterfaces()
 {
     /*
      * For every interface in the 'NETIFACE' list add
-     * their corresponding ips (Both IPv4 & IPv6)
+     * their corresponding ips (Both IPv4 & IPv6), as the
+     * netlink dump found them. Once done the dump has nothing
+     * left to commit (See llmnr_netlink.h)
      */
+        NLLINK *link;
+        NLADDR *addr;
         NETIFACE *copy;
-        int index, family;
-        struct ifaddrs *aux;
 
         copy = Ifaces;
         for (; copy != NULL; copy = copy->next) {
-                for (aux = head; aux != NULL; aux = aux->ifa_next) {
-                        index = if_nametoindex(aux->ifa_name);
-                        if (index == copy->ifIndex) {
-                                if (aux->ifa_addr == NULL)
-                                        continue;
-                                family = aux->ifa_addr->sa_family;
-                                if (family != AF_INET && family != AF_INET6)
-                                        continue;
-                                if (aux->ifa_flags & IFF_LOOPBACK) {
-                                        copy->flags |= _IFF_LOOPBACK;
-                                        continue;
-                                }
-                                _fillInterfaces(copy,aux);
-                        }
+                link = getLink(copy->ifIndex);
+                if (link == NULL)
+                        continue;
+                if (link->addrs4 == NULL && link->addrs6 == NULL)
+                        continue;
+                if (link->flags & IFF_LOOPBACK) {
+                        copy->flags |= _IFF_LOOPBACK;
+                        continue;
                 }
-        }
-}
-
-PRIVATE void _fillInterfaces(NETIFACE *copy, struct ifaddrs *aux)
-{
-    /*
-     * Helper function for fillInterfaces()
-     */
-        INADDR *ip4;
-        IN6ADDR *ip6;
-
-        switch (aux->ifa_addr->sa_family) {
-
-        case AF_INET:
-                ip4 = (INADDR *)(&((SA_IN *)aux->ifa_addr)->sin_addr);
-                addNetIfIPv4(ip4,copy);
-                if (!(aux->ifa_flags & IFF_RUNNING))
-                        copy->flags &= ~_IFF_RUNNING;
-                break;
-        case AF_INET6:
-                ip6 = (IN6ADDR *)(&((SA_IN6 *)aux->ifa_addr)->sin6_addr);
-                addNetIfIPv6(ip6,copy);
-                if (!(aux->ifa_flags & IFF_RUNNING))
+                for (addr = link->addrs4; addr != NULL; addr = addr->next)
+                        addNetIfIPv4((INADDR *)addr->addr,copy);
+                for (addr = link->addrs6; addr != NULL; addr = addr->next)
+                        addNetIfIPv6((IN6ADDR *)addr->addr,copy);
+                if (!(link->flags & IFF_RUNNING))
                         copy->flags &= ~_IFF_RUNNING;
-                break;
         }
+        commitNetlink(NULL);
 }
 
 PRIVATE void remLoopback(NETIFACE *ifaces)
@@ -667,8 +706,7 @@ PRIVATE void fillARecord()
                 for (; ipv4Ptr != NULL; ipv4Ptr = ipv4Ptr->next) {
                         if (ipv4Ptr->ipType == NOIP)
                                 continue;
-                        buildARecord(&ipv4Ptr->ip4Addr,ipv4Ptr->ARECORD,
-                                     ipv4Ptr->PTR4RECORD);
+                        buildARecord(&ipv4Ptr->ip4Addr,ipv4Ptr->ARECORD);
                 }
         }
 }
@@ -690,8 +728,7 @@ PRIVATE void fillAAAARecord()
             for (; ipv6Ptr != NULL; ipv6Ptr = ipv6Ptr->next) {
                     if (ipv6Ptr->ipType == NOIP)
                             continue;
-                    buildAAAARecord(&ipv6Ptr->ip6Addr,ipv6Ptr->AAAARECORD,
-                                    ipv6Ptr->PTR6RECORD);
+                    buildAAAARecord(&ipv6Ptr->ip6Addr,ipv6Ptr->AAAARECORD);
             }
     }
 }
@@ -803,10 +840,12 @@ PRIVATE void freeResources()
     /*
      * Free resources in case of fatal error
      */
+        freeLinks();
         if (Names != NULL)
                 deleteNameList(&Names);
         if (Ifaces != NULL)
                 delNetIfList(&Ifaces);
+        freeIfSlots();
         if (Rlist != NULL)
                 deleteRList(&Rlist);
         if (Conflicts != NULL)
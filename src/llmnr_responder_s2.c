@@ -1,14 +1,11 @@
 /* Macros */
-#define BACKLOG 10
 #define _GNU_SOURCE
-#define POLLINGSZ 4
 #define MAXWAITING 5
-#define NLBUFSZ 1024
-#define QUESTMINSZ 17
-#define NLTIMEOUT 20
+#define TRUNCSLOTS 256
+#define FNVPRIME 16777619U
+#define HOSTSFILE "/etc/llmnr/llmnr.hosts"
 
 /* Includes */
-#include <poll.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -17,13 +14,16 @@
 #include <unistd.h>
 #include <signal.h>
 #include <pthread.h>
-#include <sys/ioctl.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <arpa/inet.h>
 #include <linux/if_arp.h>
 #include <linux/rtnetlink.h>
 
 /* Own includes */
 #include "../include/llmnr_defs.h"
+#include "../include/llmnr_ifset.h"
 #include "../include/llmnr_names.h"
 #include "../include/llmnr_net_interface.h"
 #include "../include/llmnr_rr.h"
@@ -32,10 +32,24 @@
 #include "../include/llmnr_str_list.h"
 #include "../include/llmnr_syslog.h"
 #include "../include/llmnr_signals.h"
+#include "../include/llmnr_registry.h"
 #include "../include/llmnr_packet.h"
+#include "../include/llmnr_answer_cache.h"
 #include "../include/llmnr_sockets.h"
 #include "../include/llmnr_conflict.h"
 #include "../include/llmnr_conflict_list.h"
+#include "../include/llmnr_options.h"
+#include "../include/llmnr_stats.h"
+#include "../include/llmnr_worker_pool.h"
+#include "../include/llmnr_shards.h"
+#include "../include/llmnr_reactor.h"
+#include "../include/llmnr_timer_wheel.h"
+#include "../include/llmnr_query_filter.h"
+#include "../include/llmnr_kernel_filter.h"
+#include "../include/llmnr_tcp.h"
+#include "../include/llmnr_snapshot.h"
+#include "../include/llmnr_netlink.h"
+#include "../include/llmnr_iface_socks.h"
 #include "../include/llmnr_responder_s2.h"
 
 /* Enums & Structs */
@@ -47,53 +61,73 @@ enum _CONDITION {
         _CDARCONFLICT,
 };
 
-typedef struct {
-        NAME *cName;
-        NETIFACE *cIface;
-} CDARCONFLICT;
+/*
+ * Main sockets (See 'Socks')
+ */
+enum _SOCKETS {
+        _UDP4SOCK,
+        _UDP6SOCK,
+        _TCPSOCK,
+        _NLSOCK,
+        SOCKETSZ
+};
 
 /* Private prototypes */
 PRIVATE void start();
-PRIVATE void initialJoin(POLLFD *polling);
-PRIVATE void setDescriptorToPoll(POLLFD *pollArr, int i, int fd);
-PRIVATE void removeDescriptorFromPoll(POLLFD *pollArr, int i);
-PRIVATE void handleError(int err, POLLFD *pollArr, int i);
+PRIVATE void initialJoin();
+PRIVATE void setSocket(int i, int fd);
+PRIVATE void removeSocket(int i);
+PRIVATE void handleSocket(int fd, unsigned int events, void *sock);
+PRIVATE void handleSignal(int fd, unsigned int events, void *__);
+PRIVATE void reloadRegistry();
+PRIVATE void handleConflictEvent(int fd, unsigned int events, void *__);
+PRIVATE void notifyConflict();
+PRIVATE void handleError(int err, int i);
 PRIVATE void handleUdpQuery(int fd);
-PRIVATE void handleTcpQuery(int fd);
-PRIVATE void *handleUdpWorker(void *clientData);
-PRIVATE void *handleTcpWorker(void *clientData);
+PRIVATE int acceptClient(UDPCLIENT *client);
+PRIVATE int udpSocket(int family, int ifIndex);
+PRIVATE void joinIface(NETIFACE *iface);
+PRIVATE void leaveIface(NETIFACE *iface, INADDR *lost);
+PRIVATE void startUdp();
+PRIVATE void startTcpSide();
+PRIVATE int acceptTcpClient(TCPCLIENT *client);
+PRIVATE int handleUdpWorker(UDPCLIENT *client);
+PRIVATE int handleTcpQuery(TCPCLIENT *client, U_CHAR *query, int querySz,
+                           U_CHAR *answer, int answerSz);
+PRIVATE int finishUdpAnswer(UDPCLIENT *client, QUERY *query, int pktSz,
+                            int maxPayload);
+PRIVATE unsigned int truncKey(SA *from, QUERY *query);
 PRIVATE void checkConflicts();
-PRIVATE void _checkLinkLocalAddr(char *ipv6, char *_buff);
 PRIVATE void checkIfDown(NETIFACE *iface);
 PRIVATE void invokeCdar(U_CHAR type, int ifIndex, NAME *name);
-PRIVATE void *initialDefense(void *__);
-PRIVATE void *ifaceUpDefense(void *ifIndex);
-PRIVATE void *conflictDefense(void *cdarCond);
-PRIVATE void handleNetlinkQuery(POLLFD *polling, NETIFACE *ifaces);
-PRIVATE void getRta(struct nlmsghdr *nlMsg, POLLFD *polling, NETIFACE *ifaces);
-PRIVATE void addAddr (POLLFD *polling, NETIFACE *ifaces, int index, int fam, void *addr);
-PRIVATE void delAddr (POLLFD *polling, NETIFACE *ifaces, int index, int fam, void *addr);
-PRIVATE void sigTermHandler(int signo);
-PRIVATE void sigUsr2Handler(int signo);
-PRIVATE void freeResources(POLLFD *pollArr);
-PRIVATE int checkName(char *name, int ifIndex, U_CHAR *T);
-PRIVATE int checkPtrName(char *name, int ifIndex, int family);
-PRIVATE int _checkPtrName(char *name, NETIFIPV4 *ipv4s);
-PRIVATE int __checkPtrName(char *name, NETIFIPV6 *ipv6s);
-PRIVATE int checkLinkLocalAddr(char *name);
-PRIVATE U_CHAR threadsRunning();
+PRIVATE void cdarDone();
+PRIVATE void handleNetlinkQuery(int fd);
+PRIVATE void scheduleNetlink();
+PRIVATE void applyNetlink(int fd, unsigned int events, void *__);
+PRIVATE void applyLink(NLLINK *link);
+PRIVATE NETIFACE *linkIface(NETIFACE *ifaces, NLLINK *link);
+PRIVATE int syncIPv4s(NETIFACE *iface, NLLINK *link, INADDR *lost);
+PRIVATE int syncIPv6s(NETIFACE *iface, NLLINK *link);
+PRIVATE void printDebugInfo();
+PRIVATE void freeResources();
+PRIVATE int checkName(SNAPSHOT *snap, QUERY *query, int slot,
+                      HEADER *head, HOSTED **hosted);
+PRIVATE int checkPtrName(IFTABLE *table, char *name, int ifIndex);
 
 /* Glocal variables */
 int Flag;
 PRIVATE NAME *Names;
 PRIVATE RRLIST *Rlist;
+PRIVATE REGISTRY *Registry;
 PRIVATE NETIFACE *Ifaces;
 PRIVATE CONFLICT *Conflicts;
-PRIVATE pthread_t MainTid;
-PRIVATE U_CHAR RunningCDAR;
-PRIVATE volatile int ThreadsCount;
-PRIVATE pthread_mutex_t CountMutex;
+PRIVATE int Socks[SOCKETSZ];
+PRIVATE int SignalFd;
+PRIVATE int ConflictFd;
+PRIVATE int NlTimer;
+PRIVATE int NlPending;
 PRIVATE pthread_mutex_t ConflictMutex;
+PRIVATE unsigned int Truncated[TRUNCSLOTS];
 
 /* Functions definitions */
 PUBLIC void startS2(NAME *_N, NETIFACE *_I, RRLIST *_R, CONFLICT *_C)
@@ -104,19 +138,14 @@ PUBLIC void startS2(NAME *_N, NETIFACE *_I, RRLIST *_R, CONFLICT *_C)
         pthread_mutexattr_t attr;
 
         Flag = 1;
-        ThreadsCount = 0;
-        RunningCDAR = 0;
         Names = _N;
         Ifaces = _I;
         Rlist = _R;
         Conflicts = _C;
-        MainTid = pthread_self();
         srandom(time(NULL));
 
         pthread_mutexattr_init(&attr);
         pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ERRORCHECK);
-        if (pthread_mutex_init(&CountMutex,&attr))
-                pthread_mutex_init(&CountMutex,NULL);
         if (pthread_mutex_init(&ConflictMutex,&attr))
                 pthread_mutex_init(&ConflictMutex,NULL);
         pthread_mutexattr_destroy(&attr);
@@ -126,72 +155,225 @@ PUBLIC void startS2(NAME *_N, NETIFACE *_I, RRLIST *_R, CONFLICT *_C)
 PRIVATE void start()
 {
     /*
-     * - Create the sockets and set them to be polled
-     * - Set the signal handler
-     * - Invoke the initial cdar process for every interface
-     * - Check if any conflict pending
-     * - Poll the sockets
-     * Note: Is necessary to wait all running threads to be
-     * done before launch the netlink socket handler (for
-     * data structures consistency)
+     * - Block the "special" signals (they are read from a
+     *   signalfd) before any thread is created
+     * - Create the event loop along with the timer wheel, the
+     *   conflicts eventfd and the netlink batch timer
+     * - Load the hosted names (See llmnr_registry.h)
+     * - Publish the first snapshot of the data structures (the
+     *   ones the queries are answered with, See llmnr_snapshot.h)
+     * - Allocate the answer cache (See llmnr_answer_cache.h)
+     * - Build the filter attached to the UDP sockets (See
+     *   llmnr_kernel_filter.h) and the local addresses set
+     *   (See llmnr_net_interface.h)
+     * - Start the UDP side (See startUdp()) and the TCP one (See
+     *   startTcpSide())
+     * - Create the sockets and register their handlers
+     * - Start the conflict detection (See llmnr_conflict.h) and
+     *   probe every name on every interface
+     * - Run the event loop
      */
-        struct pollfd polling[POLLINGSZ];
-        int i, udpSock4, udpSock6, tcpSock, netLinkSock;
-
-        udpSock4 = 0;
-        udpSock6 = 0;
-        tcpSock = 0;
-        netLinkSock = 0;
-        memset(polling,0,sizeof(struct pollfd));
-        memset(polling + 1,0,sizeof(struct pollfd));
-        memset(polling + 2,0,sizeof(struct pollfd));
-        memset(polling + 3,0,sizeof(struct pollfd));
-        udpSock4 = createUdpSocket(AF_INET);
-        udpSock6 = createUdpSocket(AF_INET6);
-        tcpSock = createTcpSock();
-        netLinkSock = createNetLinkSocket();
-        setDescriptorToPoll(polling,0,udpSock4);
-        setDescriptorToPoll(polling,1,udpSock6);
-        setDescriptorToPoll(polling,2,tcpSock);
-        setDescriptorToPoll(polling,3,netLinkSock);
-        fillMcastVars();
+        int i;
+
+        for (i = 0; i < SOCKETSZ; i++)
+                Socks[i] = -1;
         handleSignals();
-        handleSpecSignals(SIGTERM,sigTermHandler);
-        handleSpecSignals(SIGUSR2,sigUsr2Handler);
-        initialJoin(polling);
+        SignalFd = createSignalFd();
+        ConflictFd = eventfd(0,EFD_NONBLOCK | EFD_CLOEXEC);
+        if (loadRegistry(HOSTSFILE,&Registry))
+                logError(ENOMEMORY,"hosted names");
+        if (newReactor() || startTimerWheel() ||
+            addHandler(SignalFd,EPOLLIN,handleSignal,NULL) ||
+            addHandler(ConflictFd,EPOLLIN,handleConflictEvent,NULL) ||
+            publishSnapshot(Names,Ifaces,Rlist,Registry)) {
+                logError(FORCED_EXIT,NULL);
+                freeResources();
+        }
+        NlTimer = newTimer(applyNetlink,NULL);
+        if (startAnswerCache(getOption(OPT_ANSWERCACHE)))
+                logError(ENOMEMORY,"answer cache");
+        if (buildKernelFilter(Names,Registry,getOption(OPT_KERNELFILTER)))
+                logError(ENOMEMORY,"kernel filter");
+        if (fillLocalAddrs(Ifaces))
+                logError(ENOMEMORY,"local addresses");
+        startUdp();
+        startTcpSide();
+        setSocket(_NLSOCK,netlinkSocket());
+        fillMcastVars();
+        initialJoin();
+        if (startCdar(Ifaces,cdarDone))
+                logError(ESOCKERR,"conflict detection");
         invokeCdar(_CDARINIT,0,NULL);
 
         while (Flag) {
-                checkConflicts();
-                if (poll(polling,POLLINGSZ,-1) < 0) {
-                        if (errno == EINTR) {
-                                checkConflicts();
-                                continue;
-                        }
+                if (runReactor(-1)) {
+                        logError(FORCED_EXIT,NULL);
+                        break;
                 }
-                for (i=0; i < POLLINGSZ; i++) {
-                        if (polling[i].revents & POLLIN) {
-                                if (i == 0 || i == 1) {
-                                        handleUdpQuery(polling[i].fd);
-                                } else if (i == 2) {
-                                        handleTcpQuery(polling[i].fd);
-                                } else if (i == 3) {
-                                    if (!threadsRunning())
-                                            handleNetlinkQuery(polling,Ifaces);
-                                }
-
-                        } else if (polling[i].revents & POLLERR) {
-                                handleError(EPOLLERR,polling,i);
-
-                        } else if (polling[i].revents & POLLHUP) {
-                                handleError(EPOLLERR,polling,i);
-                        }
+        }
+        freeResources();
+}
+
+PRIVATE void startUdp()
+{
+    /*
+     * - Sharded mode ('shards' > 0): the pool only holds the
+     *   client slots and the shard threads receive and answer
+     *   (See llmnr_shards.h). If the shards can't be started
+     *   fall back to the regular mode
+     * - Regular mode: one UDP socket per family handled by the
+     *   event loop, queries answered by the pool of workers
+     * With 'iface_sockets' the interfaces open their own sockets
+     * for the multicast queries (See llmnr_iface_socks.h), the
+     * sockets of each family (or of each shard) join no group
+     * and only get the unicast ones
+     */
+        int sndBatch, sndBudget, perIface;
+
+        sndBatch = getOption(OPT_SENDBATCH);
+        sndBudget = getOption(OPT_SENDBUDGET);
+        perIface = getOption(OPT_IFACESOCKS);
+        if (perIface)
+                startIfaceSocks(getOption(OPT_RECVBATCH),acceptClient);
+        if (getOption(OPT_SHARDS) > 0) {
+                if (!startPool(0,getOption(OPT_QUEUESZ),sndBatch,sndBudget,
+                               handleUdpWorker)) {
+                        if (!startShards(getOption(OPT_SHARDS),
+                                         getOption(OPT_SHARDCPUS),
+                                         getOption(OPT_SHARDSTEER),
+                                         getOption(OPT_RECVBATCH),
+                                         perIface,acceptClient))
+                                return;
+                        stopPool();
                 }
+                logError(ESOCKERR,"UDP shards");
+        }
+        setSocket(_UDP4SOCK,createUdpSocket(AF_INET,perIface));
+        setSocket(_UDP6SOCK,createUdpSocket(AF_INET6,perIface));
+        if (startPool(getOption(OPT_WORKERS),getOption(OPT_QUEUESZ),
+                      sndBatch,sndBudget,handleUdpWorker)) {
+                logError(FORCED_EXIT,NULL);
+                freeResources();
+        }
+}
+
+PRIVATE void startTcpSide()
+{
+    /*
+     * Listening socket handled by the event loop, connections
+     * by the TCP front end (See llmnr_tcp.h)
+     */
+        if (startTcp(getOption(OPT_TCPCLIENTS),getOption(OPT_TCPIDLE),
+                     getOption(OPT_TCPLIFETIME),acceptTcpClient,
+                     handleTcpQuery)) {
+                logError(ESOCKERR,"TCP front end");
+                return;
+        }
+        setSocket(_TCPSOCK,createTcpSock(getOption(OPT_TCPBACKLOG)));
+}
+
+PRIVATE void handleSocket(int fd, unsigned int events, void *sock)
+{
+    /*
+     * Handler of the main sockets. 'sock' is the position of
+     * the socket in 'Socks'
+     */
+        long i;
+
+        i = (long)sock;
+        if (events & EPOLLIN) {
+                if (i == _UDP4SOCK || i == _UDP6SOCK) {
+                        handleUdpQuery(fd);
+                } else if (i == _TCPSOCK) {
+                        acceptTcpClients(fd);
+                } else if (i == _NLSOCK) {
+                        handleNetlinkQuery(fd);
+                }
+
+        } else if (events & (EPOLLERR | EPOLLHUP)) {
+                handleError(ESOCKPOLL,i);
         }
-        freeResources(polling);
 }
 
-PRIVATE void initialJoin(POLLFD *polling)
+PRIVATE void handleSignal(int fd, unsigned int events, void *__)
+{
+    /*
+     * - 'SIGTERM': the event loop ends (Stop daemon)
+     * - 'SIGUSR2': print a lot of things (Debug purposes)
+     * - 'SIGHUP': load the hosts file again
+     */
+        int signo;
+
+        events = events;
+        __ = __;
+        while ((signo = readSignalFd(fd)) > 0) {
+                if (signo == SIGTERM)
+                        Flag = 0;
+                else if (signo == SIGUSR2)
+                        printDebugInfo();
+                else if (signo == SIGHUP)
+                        reloadRegistry();
+        }
+}
+
+PRIVATE void reloadRegistry()
+{
+    /*
+     * Replace the registry of the hosted names with a new one
+     * (See llmnr_registry.h). The old one goes away along with
+     * the last snapshot using it, and every interface gets a new
+     * answer generation, so his cached answers are not used
+     * anymore. The kernel filter is built again for the new
+     * names and attached again to every UDP socket (See
+     * llmnr_kernel_filter.h). If the file can't be loaded the old
+     * one is kept
+     */
+        int i;
+        REGISTRY *registry;
+        NETIFACE *iface;
+
+        if (loadRegistry(HOSTSFILE,&registry)) {
+                logError(ENOMEMORY,"hosted names");
+                return;
+        }
+        dropRegistry(&Registry);
+        Registry = registry;
+        for (iface = Ifaces; iface != NULL; iface = iface->next)
+                invalidateAnswers(iface);
+        publishSnapshot(Names,Ifaces,Rlist,Registry);
+        if (buildKernelFilter(Names,Registry,getOption(OPT_KERNELFILTER)))
+                logError(ENOMEMORY,"kernel filter");
+        for (i = _UDP4SOCK; i <= _UDP6SOCK; i++)
+                attachKernelFilter(Socks[i]);
+        attachShardsFilter();
+        attachIfaceSocksFilter();
+}
+
+PRIVATE void notifyConflict()
+{
+    /*
+     * Wake up the main thread to check for conflicts
+     * (Called by the threads that add conflicts)
+     */
+        uint64_t one;
+
+        one = 1;
+        if (write(ConflictFd,&one,sizeof(one)) < 0)
+                return;
+}
+
+PRIVATE void handleConflictEvent(int fd, unsigned int events, void *__)
+{
+        uint64_t count;
+
+        events = events;
+        __ = __;
+        if (read(fd,&count,sizeof(count)) < 0)
+                return;
+        checkConflicts();
+}
+
+PRIVATE void initialJoin()
 {
     /*
      * For every LLMNR interface do the initial multicast join
@@ -202,7 +384,7 @@ PRIVATE void initialJoin(POLLFD *polling)
                 return;
         current = Ifaces;
         for (; current != NULL; current = current->next)
-                joinMcastGroup(polling,current);
+                joinIface(current);
 }
 
 PRIVATE void invokeCdar(U_CHAR type, int ifIndex, NAME *name)
@@ -214,233 +396,202 @@ PRIVATE void invokeCdar(U_CHAR type, int ifIndex, NAME *name)
      *   must query his own hostname (s) (this happens only one time)
      * - When an interface goes up
      * - When a query with the 'CONFLICT' flag is received
-     * Even though the cdar process is done by a separated thread the
-     * 'RunningCDAR' flag is used to ensure that one and only
-     * one cdar process thread is running (for data structures
-     * consistency)
+     * The probes just start here, they run in the event loop
+     * (all of them at the same time, See llmnr_conflict.h) and
+     * cdarDone() publishes their outcome
      */
-        int *index;
-        pthread_t tid;
+        NAME *cName;
         NETIFACE *iface;
-        pthread_attr_t detach;
-        CDARCONFLICT *cdarCond;
-
-        pthread_attr_init(&detach);
-        pthread_attr_setdetachstate(&detach,PTHREAD_CREATE_DETACHED);
 
         if (type == _CDARINIT) {
-                pthread_create(&tid,&detach,initialDefense,NULL);
+                for (cName = Names; cName != NULL; cName = cName->next) {
+                        if (cName->name == NULL)
+                                continue;
+                        iface = Ifaces;
+                        for (; iface != NULL; iface = iface->next) {
+                                if (iface->flags & _IFF_NOIF)
+                                        continue;
+                                if (!(iface->flags & _IFF_RUNNING))
+                                        continue;
+                                cDar(cName,iface);
+                        }
+                }
 
         } else if (type == _CDARIFACEUP) {
-                index = calloc(1,sizeof(int));
-                if (index == NULL)
+                iface = getNetIfNodeByIndex(Ifaces,ifIndex);
+                if (iface == NULL)
                         return;
-                *index = ifIndex;
-                if (pthread_create(&tid,&detach,ifaceUpDefense,(void *)index))
-                        free(index);
+                for (cName = Names; cName != NULL; cName = cName->next) {
+                        if (cName->name == NULL)
+                                continue;
+                        cDar(cName,iface);
+                }
 
         } else if (type == _CDARCONFLICT) {
                 iface = getNetIfNodeByIndex(Ifaces,ifIndex);
                 if (iface == NULL)
                         return;
-                cdarCond = calloc(1,sizeof(CDARCONFLICT));
-                if (cdarCond == NULL)
-                        return;
-                cdarCond->cName = name;
-                cdarCond->cIface = iface;
-                if (pthread_create(&tid,&detach,conflictDefense,
-                                   (void *)cdarCond))
-                        free(cdarCond);
+                cDar(name,iface);
         }
 }
 
-PRIVATE void *initialDefense(void *__)
+PRIVATE void cdarDone()
 {
     /*
-     * For every interface, do the inital conflict detection
-     * This happens only one time
+     * Some probes are done (See llmnr_conflict.h). Their outcome
+     * goes to a new snapshot
      */
-        NAME *cName;
-        NETIFACE *cIface;
+        publishSnapshot(Names,Ifaces,Rlist,Registry);
+}
 
-        __ =__;
-        if (Names == NULL || Ifaces == NULL)
-                return NULL;
-        cName = Names;
-        for (; cName != NULL; cName = cName->next) {
-                if (cName->name == NULL)
-                        continue;
-                for (cIface = Ifaces; cIface != NULL; cIface = cIface->next) {
-                        if (cIface->flags & _IFF_NOIF)
-                                continue;
-                        if (!(cIface->flags & _IFF_RUNNING))
-                                continue;
-                        cDar(cName,cIface,Ifaces);
-                }
+PRIVATE void handleUdpQuery(int fd)
+{
+    /*
+     * Drain up to 'recv_batch' queries with a single recvmmsg()
+     * into free slots of the worker pool and queue them to be
+     * answered. recvmmsg() (with ancillary data) is used because
+     * is crucial to know which interface received every query.
+     * (See receiveClients())
+     */
+        int i, count;
+        UDPCLIENT *clients[MAXRCVBATCH];
+
+        count = receiveClients(fd,clients,getOption(OPT_RECVBATCH),0);
+        for (i = 0; i < count; i++) {
+                if (acceptClient(clients[i]))
+                        releasePoolSlot(clients[i]);
+                else
+                        enqueueClient(clients[i]);
         }
-        return NULL;
 }
 
-PRIVATE void *ifaceUpDefense(void *ifIndex)
+PRIVATE int acceptClient(UDPCLIENT *client)
 {
     /*
-     * Conflict detection when an interface goes up
-     * Important to mention that the process that
-     * handles the interfaces changes can only be
-     * run when theres no other threads running
+     * Only queries received by a known interface and passing
+     * the prefilter (See llmnr_query_filter.h) are answered.
+     * Nothing is allocated here, dropped queries just give
+     * back their slot
+     * (Also the shards filter, so it may run in several threads)
      */
-        int index;
-        NAME *cName;
-        U_CHAR flag;
+        int result;
+        SNAPSHOT *snap;
         NETIFACE *iface;
 
-        flag = 0;
-        cName = Names;
-        index = *((int *)ifIndex);
-        iface = getNetIfNodeByIndex(Ifaces,index);
-        for (; cName != NULL; cName = cName->next) {
-                if (cName->name == NULL)
-                        continue;
-                cDar(cName,iface,Ifaces);
+        iface = NULL;
+        result = QF_PASS;
+        snap = enterSnapshot();
+        if (snap != NULL) {
+                iface = getIfByIndex(snap->ifTable,client->recviface);
+                if (iface != NULL)
+                        result = filterQuery(snap->qFilter,client->rcvBuffer,
+                                             client->rcvSz);
         }
-        free(ifIndex);
-        RunningCDAR = 0;
-        pthread_mutex_lock(&ConflictMutex);
-        if (countConflicts(Conflicts) > 1)
-                flag = 1;
-        pthread_mutex_unlock(&ConflictMutex);
-        if (flag)
-                sendSignal(MainTid);
-        return NULL;
+        exitSnapshot();
+        if (iface == NULL) {
+                incStat(STAT_DROPIFACE);
+                return FAILURE;
+        }
+        switch (result) {
+        case QF_HEADER: incStat(STAT_DROPHEADER); return FAILURE;
+        case QF_QNAME: incStat(STAT_DROPQNAME); return FAILURE;
+        case QF_NOTOURS: incStat(STAT_DROPNOTOURS); return FAILURE;
+        }
+        client->id = (U_CHAR)random();
+        return SUCCESS;
 }
 
-PRIVATE void *conflictDefense(void *cdarCond)
+PRIVATE int udpSocket(int family, int ifIndex)
 {
     /*
-     * Conflict detection and resolution when a
-     * conflict query received.
+     * Returns the UDP socket where the LLMNR multicast groups of
+     * interface 'ifIndex' must be joined (See llmnr_shards.h)
      */
-        U_CHAR flag;
-        CDARCONFLICT *cdarC;
-
-        flag = 0;
-        if (Names == NULL || Ifaces == NULL)
-                return NULL;
-        cdarC = (CDARCONFLICT *)cdarCond;
-        cDar(cdarC->cName,cdarC->cIface,Ifaces);
-        free(cdarC);
-        RunningCDAR = 0;
-        pthread_mutex_lock(&ConflictMutex);
-        if (countConflicts(Conflicts) > 1)
-                flag = 1;
-        pthread_mutex_unlock(&ConflictMutex);
-        if (flag)
-                sendSignal(MainTid);
-        return NULL;
+        if (shardsRunning())
+                return getShardSocket(family,ifIndex);
+        return Socks[family == AF_INET ? _UDP4SOCK : _UDP6SOCK];
 }
 
-PRIVATE void handleUdpQuery(int fd)
+PRIVATE void joinIface(NETIFACE *iface)
 {
     /*
-     * Receive the query using recvmsg() and
-     * start a thread to attend the petition.
-     * recvmsg() is used because is crucial to know
-     * which interface received the query. Also when
-     * the thread is started a mutex is used to update
-     * a variable that keeps the count of the running
-     * threads
+     * Join the LLMNR multicast groups on 'iface': through his own
+     * sockets (See llmnr_iface_socks.h) or through the UDP socket
+     * of each family (See udpSocket())
      */
-        pthread_t tid;
-        UDPCLIENT *client;
-        NETIFACE *iface;
-        struct iovec iov;
-        struct msghdr msg;
-        pthread_attr_t detach;
-        char auxBuffer[RCVBUFSZ];
-
-        memset(&client,0,sizeof(client));
-        client = calloc(1,sizeof(UDPCLIENT));
-        if (client == NULL) {
-                recvfrom(fd,auxBuffer,RCVBUFSZ,0,NULL,NULL);
-                return;
-        }
-        iov.iov_base = client->rcvBuffer;
-        iov.iov_len = RCVBUFSZ;
-        msg.msg_name = &client->from;
-        msg.msg_namelen = sizeof(SA_STORAGE);
-        msg.msg_iov = &iov;
-        msg.msg_iovlen = 1;
-        msg.msg_control = client->ancBuffer;
-        msg.msg_controllen = ANCBUFSZ;
-        msg.msg_flags = 0;
-        if (recvmsg(fd,&msg,0) < QUESTMINSZ) {
-                free(client);
-                return;
-        }
-        client->id = (U_CHAR)random();
-        client->socket = fd;
-        client->pktinfo4 = NULL;
-        client->pktinfo6 = NULL;
-        if (getPktInfo(client->from.ss_family,&msg,client)) {
-                free(client);
+        if (ifaceSocksRunning()) {
+                openIfaceSocks(iface);
                 return;
         }
-        iface = getNetIfNodeByIndex(Ifaces,client->recviface);
-        if (iface == NULL) {
-                free(client);
+        joinMcastGroup(udpSocket(AF_INET,iface->ifIndex),
+                       udpSocket(AF_INET6,iface->ifIndex),iface);
+}
+
+PRIVATE void leaveIface(NETIFACE *iface, INADDR *lost)
+{
+    /*
+     * Same thing that joinIface() but leaving the groups of the
+     * families 'iface' has no ips of. 'lost' is one of his old
+     * IPv4s (See leaveMcastGroup())
+     */
+        if (ifaceSocksRunning()) {
+                closeIfaceSocks(iface);
                 return;
         }
-        pthread_attr_init(&detach);
-        pthread_attr_setdetachstate(&detach,PTHREAD_CREATE_DETACHED);
-        pthread_mutex_lock(&CountMutex);
-        if (pthread_create(&tid,&detach,handleUdpWorker,client))
-                free(client);
-        else
-                ThreadsCount++;
-        pthread_mutex_unlock(&CountMutex);
+        leaveMcastGroup(udpSocket(AF_INET,iface->ifIndex),
+                        udpSocket(AF_INET6,iface->ifIndex),iface,lost);
 }
 
-PRIVATE void *handleUdpWorker(void *clientData)
+PRIVATE int handleUdpWorker(UDPCLIENT *client)
 {
     /*
-     * Responds the query. Check a bunch of stuff
-     * about the header and the query itself. When
-     * done decrement the 'ThreadsCount' variable.
+     * Build the answer to the query (Called by the pool
+     * workers, which send it). Check a bunch of stuff about
+     * the header and the query itself.
      * If the query is a conflict alarm then add it
      * to the 'CONFLICT' list and send a signal to
      * the main thread to notify the conflict
      * On normal query, head is reused
+     * The query is answered with the current snapshot of the
+     * data structures (no lock is taken)
+     * Returns the answer size (0 when nothing must be sent)
      */
-        int pktSz;
         NAME *aux;
         HEADER head;
         QUERY query;
-        PKTSND pktSnd;
+        int pktSz, maxPayload;
+        SNAPSHOT *snap;
+        HOSTED *hosted;
+        NETIFACE *iface;
         DSTRUCTURE dsts;
         PKTPARAMS params;
-        UDPCLIENT *client;
         U_CHAR namePtr[2];
 
-        if (clientData == NULL)
-                return NULL;
-        client = (UDPCLIENT *)clientData;
-        memset(&head,0,sizeof(head));
-        memset(&query,0,sizeof(query));
-        getHeader(client->rcvBuffer,&head);
-
-        if (head.QR != 0 || head.OPCODE != 0 || head.QDCOUNT != 1 ||
-            head.ANCOUNT != 0 || head.NSCOUNT != 0)
+        if (client == NULL)
+                return 0;
+        snap = enterSnapshot();
+        if (snap == NULL)
+                goto CleanHUW;
+        iface = getIfByIndex(snap->ifTable,client->recviface);
+        if (iface == NULL)
+                goto CleanHUW;
+        if (parseQuery(client->rcvBuffer,client->rcvSz,&head,&query))
                 goto CleanHUW;
-        getQuery(client->rcvBuffer,&query);
+        hosted = NULL;
         if (query.QTYPE == PTR) {
-                if (checkPtrName(query.QNAME,client->recviface,
-                                 client->from.ss_family))
+                if (checkPtrName(snap->ifTable,query.QNAME,
+                                 client->recviface))
                         goto CleanHUW;
-                head.T = 0;
+                head.FLAGS &= ~HFLAG_T;
         } else {
-                if (checkName(query.QNAME,client->recviface,&head.T))
+                if (checkName(snap,&query,iface->slot,&head,&hosted))
                         goto CleanHUW;
-                if (head.C == 1) {
+                if (head.FLAGS & HFLAG_C) {
+                        /*
+                         * The conflict must point to the master node
+                         * (cdar changes it). The 'NAME' list never
+                         * changes after start up, only his nodes do
+                         */
                         aux = getNameNodeByName(query.QNAME,Names);
                         if (aux == NULL)
                                 goto CleanHUW;
@@ -448,7 +599,7 @@ PRIVATE void *handleUdpWorker(void *clientData)
                         addConflict(aux,query.QTYPE,&client->from,client->recviface,
                                     Conflicts);
                         pthread_mutex_unlock(&ConflictMutex);
-                        sendSignal(MainTid);
+                        notifyConflict();
                         goto CleanHUW;
                 }
         }
@@ -458,700 +609,604 @@ PRIVATE void *handleUdpWorker(void *clientData)
         params.query = &query;
         params.ipType = client->iptype;
         params.rcvIface = client->recviface;
+        params.iface = iface;
+        params.hosted = hosted;
+        maxPayload = getOption(OPT_EDNSPAYLOAD);
         params.pktBuff = client->sndPkt;
-        params.pktBuffSz = SNDBUFSZ;
+        params.pktBuffSz = answerBufferSz(&query,maxPayload);
         params.namePtr = (U_SHORT *)namePtr;
-        dsts.names = Names;
-        dsts.ifaces = Ifaces;
-        dsts.rList = Rlist;
-        pktSz = attachAnswer(&params,&dsts);
-        pktSnd.fd = client->socket;
-        pktSnd.ifIndex = client->recviface;
-        pktSnd.pktBuff = client->sndPkt;
-        pktSnd.pktSz = pktSz;
-        pktSnd.to = (SA *)&client->from;
-        if (head.T != 0)
-            poll(0,0,random() % JITTER_INTERVAL);
-        sendUDPacket(&pktSnd);
+        dsts.names = snap->names;
+        dsts.ifaces = snap->ifaces;
+        dsts.rList = snap->rList;
+        if (maxPayload > 0 && query.ednsVersion > EDNSVERSION)
+                pktSz = attachBadVersion(&params);
+        else
+                pktSz = attachCachedAnswer(&params,&dsts);
+        exitSnapshot();
+        pktSz = finishUdpAnswer(client,&query,pktSz,maxPayload);
+        client->delay = 0;
+        if (head.FLAGS & HFLAG_T)
+                client->delay = random() % JITTER_INTERVAL;
+        return pktSz;
 
         CleanHUW:
-        free(client);
-        pthread_mutex_lock(&CountMutex);
-        ThreadsCount--;
-        if (ThreadsCount <= 0) {
-                if (ThreadsCount < 0)
-                    ThreadsCount = 0;
-        }
-        pthread_mutex_unlock(&CountMutex);
-        return NULL;
+        exitSnapshot();
+        return 0;
 }
 
-PRIVATE void handleTcpQuery(int fd)
+PRIVATE int finishUdpAnswer(UDPCLIENT *client, QUERY *query, int pktSz,
+                            int maxPayload)
 {
     /*
-     * Same thing that does handleUdpQuery() but
-     * this time for TCP. Use of getsockname() (instead
-     * of recvmsg) to know the interface that received
-     * the query
+     * Attach the OPT record (EDNS0 queries) and count what the
+     * answer size did. A truncated answer is remembered in
+     * 'Truncated' so the TCP retry of the querier can be told
+     * apart from any other TCP query (See handleTcpQuery())
+     * Returns the final answer size
      */
-        SA_IN6 name;
-        pthread_t tid;
-        socklen_t fromLen;
-        TCPCLIENT *client;
-        pthread_attr_t detach;
-
-        fromLen = sizeof(SA_IN6);
-        client = calloc(1,sizeof(TCPCLIENT));
-        if (client == NULL) {
-                accept(fd,NULL,NULL);
-                return;
+        U_SHORT flags;
+        unsigned int key;
+
+        if (pktSz <= HEADSZ)
+                return pktSz;
+        memcpy(&flags,client->sndPkt + sizeof(U_SHORT),sizeof(U_SHORT));
+        if (query->udpSize > 0 && maxPayload > 0) {
+                incStat(STAT_EDNSQUERIES);
+                if (pktSz > SNDBUFSZ && !(ntohs(flags) & HFLAG_TC))
+                        incStat(STAT_EDNSSAVED);
         }
-        memset(&name,0,sizeof(SA_IN6));
-        client->socket = accept(fd,(SA *)&client->from,&fromLen);
-        fromLen = sizeof(SA_IN6);
-        if (getsockname(client->socket,(SA *)&name,&fromLen) < 0) {
-                free(client);
-                return;
+        if (ntohs(flags) & HFLAG_TC) {
+                incStat(STAT_UDPTRUNCATED);
+                key = truncKey((SA *)&client->from,query);
+                __atomic_store_n(&Truncated[key % TRUNCSLOTS],key,
+                                 __ATOMIC_RELAXED);
         }
-        getTcpPktInfo(&name,client,Ifaces);
-        if (client->recvIface == 0) {
-                free(client);
-                return;
+        return attachOptRecord(client->sndPkt,pktSz,query,maxPayload);
+}
+
+PRIVATE unsigned int truncKey(SA *from, QUERY *query)
+{
+    /*
+     * Querier address (IPv4 mapped addresses as IPv4, TCP comes
+     * through the IPv6 socket), QNAME and QTYPE. Never 0 (an
+     * empty slot)
+     */
+        int i, len;
+        U_CHAR *addr;
+        unsigned int hash;
+
+        if (from->sa_family == AF_INET) {
+                addr = (U_CHAR *)&((SA_IN *)from)->sin_addr;
+                len = IPV4LEN;
+        } else {
+                addr = ((SA_IN6 *)from)->sin6_addr.s6_addr;
+                len = IPV6LEN;
+                if (IN6_IS_ADDR_V4MAPPED(&((SA_IN6 *)from)->sin6_addr)) {
+                        addr += IPV6LEN - IPV4LEN;
+                        len = IPV4LEN;
+                }
         }
-        pthread_attr_init(&detach);
-        pthread_attr_setdetachstate(&detach,PTHREAD_CREATE_DETACHED);
-        pthread_mutex_lock(&CountMutex);
-        if (pthread_create(&tid,&detach,handleTcpWorker,(void *)client))
-                free(client);
-        else
-                ThreadsCount++;
-        pthread_mutex_unlock(&CountMutex);
+        hash = (query->nameHash ^ query->QTYPE) * FNVPRIME;
+        for (i = 0; i < len; i++)
+                hash = (hash ^ addr[i]) * FNVPRIME;
+        return hash | 1;
+}
+
+PRIVATE int acceptTcpClient(TCPCLIENT *client)
+{
+    /*
+     * Use of getsockname() (instead of recvmsg) to know the
+     * interface that received the connection. Called by the
+     * TCP front end (See llmnr_tcp.h) in the main thread, so
+     * the local addresses set can be read
+     */
+        SA_IN6 name;
+        socklen_t nameLen;
+
+        nameLen = sizeof(SA_IN6);
+        memset(&name,0,sizeof(SA_IN6));
+        if (getsockname(client->socket,(SA *)&name,&nameLen) < 0)
+                return FAILURE;
+        getTcpPktInfo(&name,client);
+        if (client->recvIface == 0)
+                return FAILURE;
+        return SUCCESS;
 }
 
-PRIVATE void *handleTcpWorker(void *clientData)
+PRIVATE int handleTcpQuery(TCPCLIENT *client, U_CHAR *query, int querySz,
+                           U_CHAR *answer, int answerSz)
 {
     /*
-     * Same thing that does handleUdpWorker() but this
-     * time for TCP
+     * Same thing that does handleUdpWorker() but this time for
+     * one query of a TCP connection (Called by the TCP front
+     * end, See llmnr_tcp.h)
+     * Returns the answer size (0 when nothing must be sent)
      */
-        int pktSz, rcved;
         HEADER head;
-        QUERY query;
-        PKTSND pktSnd;
+        QUERY qry;
+        unsigned int key;
+        int pktSz, maxPayload;
+        SNAPSHOT *snap;
+        HOSTED *hosted;
+        NETIFACE *iface;
         DSTRUCTURE dsts;
         PKTPARAMS params;
-        TCPCLIENT *client;
         U_CHAR namePtr[2];
 
-        if (clientData == NULL)
-                return NULL;
-        client = (TCPCLIENT *)clientData;
-        if ((rcved = recv(client->socket,client->rcvBuffer,RCVBUFSZ,0)) < QUESTMINSZ)
-                goto CleanHTW;
-        memset(&head,0,sizeof(head));
-        memset(&query,0,sizeof(query));
-        getHeader(client->rcvBuffer,&head);
-        if (head.QR != 0 || head.OPCODE != 0 || head.QDCOUNT != 1 ||
-            head.ANCOUNT != 0 || head.NSCOUNT != 0 || head.C == 1)
-                goto CleanHTW;
-        getQuery(client->rcvBuffer,&query);
-        if (query.QTYPE == PTR) {
-                if (checkPtrName(query.QNAME,client->recvIface,AF_INET))
-                        goto CleanHTW;
-                head.T = 0;
+        pktSz = 0;
+        snap = enterSnapshot();
+        if (snap == NULL)
+                goto CleanHTQ;
+        iface = getIfByIndex(snap->ifTable,client->recvIface);
+        if (iface == NULL)
+                goto CleanHTQ;
+        if (parseQuery(query,querySz,&head,&qry) || head.FLAGS & HFLAG_C)
+                goto CleanHTQ;
+        hosted = NULL;
+        if (qry.QTYPE == PTR) {
+                if (checkPtrName(snap->ifTable,qry.QNAME,client->recvIface))
+                        goto CleanHTQ;
+                head.FLAGS &= ~HFLAG_T;
         } else {
-                if (checkName(query.QNAME,client->recvIface,&head.T))
-                        goto CleanHTW;
+                if (checkName(snap,&qry,iface->slot,&head,&hosted))
+                        goto CleanHTQ;
         }
+        key = truncKey((SA *)&client->from,&qry);
+        if (__atomic_compare_exchange_n(&Truncated[key % TRUNCSLOTS],&key,0,
+                                        0,__ATOMIC_RELAXED,__ATOMIC_RELAXED))
+                incStat(STAT_TCPFALLBACKS);
+        maxPayload = getOption(OPT_EDNSPAYLOAD);
+        if (qry.udpSize > 0 && maxPayload > 0)
+                answerSz -= OPTRECORDSZ;
         namePtr[0] = 0xC0;
         namePtr[1] = HEADSZ;
         params.head = &head;
-        params.query = &query;
+        params.query = &qry;
         params.ipType = client->ipType;
         params.rcvIface = client->recvIface;
-        params.pktBuff = client->sndPkt;
-        params.pktBuffSz = TCPBUFFSZ;
+        params.iface = iface;
+        params.hosted = hosted;
+        params.pktBuff = answer;
+        params.pktBuffSz = answerSz;
         params.namePtr = (U_SHORT *)namePtr;
-        dsts.names = Names;
-        dsts.ifaces = Ifaces;
-        dsts.rList = Rlist;
-        pktSz = attachAnswer(&params,&dsts);
-
-        pktSnd.fd = client->socket;
-        pktSnd.ifIndex = client->recvIface;
-        pktSnd.pktBuff = client->sndPkt;
-        pktSnd.pktSz = pktSz;
-        pktSnd.to = NULL;
-        sendTCPacket(&pktSnd);
-
-        CleanHTW:
-        close(client->socket);
-        free(client);
-        pthread_mutex_lock(&CountMutex);
-        ThreadsCount--;
-        if (ThreadsCount <= 0) {
-                if (ThreadsCount < 0)
-                    ThreadsCount = 0;
-        }
-        pthread_mutex_unlock(&CountMutex);
-        return NULL;
+        dsts.names = snap->names;
+        dsts.ifaces = snap->ifaces;
+        dsts.rList = snap->rList;
+        if (maxPayload > 0 && qry.ednsVersion > EDNSVERSION)
+                pktSz = attachBadVersion(&params);
+        else
+                pktSz = attachCachedAnswer(&params,&dsts);
+        pktSz = attachOptRecord(answer,pktSz,&qry,maxPayload);
+
+        CleanHTQ:
+        exitSnapshot();
+        return pktSz;
 }
 
-PRIVATE void handleNetlinkQuery(POLLFD *polling, NETIFACE *ifaces)
+PRIVATE void handleNetlinkQuery(int fd)
 {
     /*
-     * Process that handles network interfaces changes
-     * Can only be run when there's no thread running (cdar,
-     * handleUdpWorker() or handleTcpWorker())
+     * Process that handles network interfaces changes. The
+     * notifications just update the links table (See
+     * llmnr_netlink.h), a burst of them (a bridge with lots of
+     * ports going up, a renumbering...) is applied as a single
+     * batch (See applyNetlink())
+     * If notifications were lost and the table could not be
+     * rebuilt the socket is opened again
      */
-        int len;
-        struct iovec iov;
-        struct msghdr msg;
-        struct nlmsghdr *nlhdr;
-        unsigned char buff[NLBUFSZ];
-
-        iov.iov_base = buff;
-        iov.iov_len = NLBUFSZ;
-        msg.msg_name = NULL;
-        msg.msg_namelen = 0;
-        msg.msg_iov = &iov;
-        msg.msg_iovlen = 1;
-        msg.msg_control = NULL;
-        msg.msg_controllen = 0;
-        msg.msg_flags = 0;
-        len = recvmsg(polling[3].fd,&msg,0);
-        if (len < 0)
+        int changes;
+
+        changes = readNetlink(fd);
+        if (changes < 0) {
+                handleError(ESOCKPOLL,_NLSOCK);
                 return;
-        nlhdr = (struct nlmsghdr *)buff;
-        for (; NLMSG_OK(nlhdr, len); nlhdr = NLMSG_NEXT(nlhdr,len)) {
-                if (nlhdr->nlmsg_type == NLMSG_DONE)
-                        break;
-                else if (nlhdr->nlmsg_type == NLMSG_NOOP)
-                        continue;
-                else if (nlhdr->nlmsg_type == NLMSG_ERROR)
-                        break;
-                /* Future reference (maybe)
-                 * if (nlhdr->nlmsg_type == RTM_GETLINK)
-                 *      ;
-                 * else if (nlhdr->nlmsg_type == RTM_DELLINK)
-                 *      ;
-                 */
-                if (nlhdr->nlmsg_type == RTM_NEWADDR) {
-                        getRta(nlhdr,polling,ifaces);
-                } else if (nlhdr->nlmsg_type == RTM_DELADDR) {
-                        getRta(nlhdr,polling,ifaces);
-                }
         }
+        if (changes > 0)
+                scheduleNetlink();
 }
 
-PRIVATE void getRta(struct nlmsghdr *nlMsg, POLLFD *polling, NETIFACE *ifaces)
+PRIVATE void scheduleNetlink()
 {
     /*
-     * Parse the netlink message (See NETLINK(3))
+     * The batch is applied 'netlink_batch' milliseconds after
+     * its first change (not after the last one: a never ending
+     * burst can't delay it forever)
      */
-        int index, msgType;
-        struct in_addr *i4;
-        struct in6_addr *i6;
-        struct ifaddrmsg *ip;
-        struct rtattr *attrs;
-        int rtAttrLen, family;
-
-        ip = (struct ifaddrmsg *) NLMSG_DATA(nlMsg);
-        attrs = IFA_RTA(ip);
-        rtAttrLen = IFA_PAYLOAD(nlMsg);
-        family = ip->ifa_family;
-        index = ip->ifa_index;
-        msgType = nlMsg->nlmsg_type;
-
-        for (; RTA_OK(attrs,rtAttrLen); attrs = RTA_NEXT(attrs,rtAttrLen)) {
-                if (attrs->rta_type == IFA_ADDRESS) {
-                        if (family == AF_INET) {
-                                i4 = (struct in_addr*) RTA_DATA(attrs);
-                                if (msgType == RTM_NEWADDR)
-                                        addAddr(polling,ifaces,index,AF_INET,
-                                               (void *)i4);
-                                else if (msgType == RTM_DELADDR)
-                                        delAddr(polling,ifaces,index,AF_INET,
-                                                (void *)i4);
-                        } else if (family == AF_INET6) {
-                                i6 = (struct in6_addr*) RTA_DATA(attrs);
-                                if (msgType == RTM_NEWADDR)
-                                        addAddr(polling,ifaces,index,AF_INET6,
-                                               (void *)i6);
-                                else if (msgType == RTM_DELADDR)
-                                        delAddr(polling,ifaces,index,AF_INET6,
-                                            (void *)i6);
-                        }
-                }
+        long ms;
+
+        if (NlPending)
+                return;
+        ms = getOption(OPT_NLBATCH);
+        if (ms == 0 || NlTimer < 0 || armTimer(NlTimer,ms)) {
+                applyNetlink(NlTimer,EPOLLIN,NULL);
+                return;
         }
+        NlPending = TRUE;
 }
 
-PRIVATE U_CHAR threadsRunning()
+PRIVATE void applyNetlink(int fd, unsigned int events, void *__)
 {
     /*
-     * Checks if there is any thread running. If any
-     * then wait 'LLMNR_TIMEOUT' milliseconds and try
-     * again
+     * Apply the batch: every changed link once (See applyLink())
+     * and then a single snapshot. The queries being answered
+     * are not waited (See llmnr_snapshot.h)
      */
-        U_CHAR ret;
-
-        ret = TRUE;
-        if (!RunningCDAR) {
-                pthread_mutex_lock(&CountMutex);
-                if (ThreadsCount <= 0) {
-                        if (ThreadsCount < 0)
-                                ThreadsCount = 0;
-                        ret = FALSE;
-                }
-                pthread_mutex_unlock(&CountMutex);
-        }
-        if (ret)
-		poll(0,0,NLTIMEOUT);
-        return ret;
+        fd = fd;
+        events = events;
+        __ = __;
+        NlPending = FALSE;
+        commitNetlink(applyLink);
+        publishSnapshot(Names,Ifaces,Rlist,Registry);
+        incStat(STAT_NLBATCHES);
 }
 
-PRIVATE void addAddr (POLLFD *polling, NETIFACE *ifaces, int index, int fam, void *addr)
+PRIVATE void applyLink(NLLINK *link)
 {
     /*
-     * A new ip addres has been added to the interface. If the interface
-     * does not exists (i.e the interface went up) then add a new
-     * interface to the 'NETIFACE' list, join the interface to the LLMNR
-     * multicast group and launch the 'cDar' process. If it does exists
-     * then just add the new ip to his corresponding 'NETIFACE' node
+     * Bring the interface of 'link' in line with the kernel
+     * view: the ips added and removed since the last batch
+     * (See syncIPv4s()), then (one time) the answers, the
+     * multicast membership and the running state. An interface
+     * runs while his link runs and he has ips. The one that
+     * goes up launches the 'cDar' process, the one that goes
+     * down is cleaned (See checkIfDown())
+     * The node of a removed link is freed (and his slot given
+     * back, See llmnr_ifset.h) unless it came from the config
+     * file
+     * Note: In linux, an interface goes down when it has no
+     * ip assigned to it
      */
-        INADDR *ip4;
-        IN6ADDR *ip6;
+        int flags, changes;
+        INADDR lost;
         NETIFACE *iface;
-        NETIFIPV4 *ip4Node;
-        NETIFIPV6 *ip6Node;
-        char ifName[IFNAMSIZ];
 
-        if (ifaces == NULL)
+        iface = linkIface(Ifaces,link);
+        if (iface == NULL)
+                return;
+        flags = iface->flags;
+        changes = syncIPv4s(iface,link,&lost);
+        changes += syncIPv6s(iface,link);
+        if (changes > 0)
+                invalidateAnswers(iface);
+        leaveIface(iface,&lost);
+        if (link->gone && iface->flags & _IFF_DYNAMIC) {
+                checkIfDown(iface);
+                delNetIfNode(iface,Ifaces);
                 return;
-        iface = NULL;
-        _if_indexToName(index,ifName);
-        iface = getNetIfNodeByIndex(ifaces,index);
-
-        if (iface == NULL) {
-                iface = getNetIfNodeByName(ifaces,ifName);
-                if (iface != NULL)
-                        iface->ifIndex = index;
-        }
-        if (iface == NULL) {
-                if (ifaces->flags & _IFF_STATIC) {
-                        return;
-                } else {
-                        if (addNetIfNode(ifName,0,_IFF_DYNAMIC,ifaces) < 0)
-                                return;
-                        iface = getNetIfNodeByIndex(ifaces,index);
-                }
-        }
-        switch (fam) {
-        case AF_INET:
-                ip4 = (INADDR *)addr;
-                if (addNetIfIPv4(ip4,iface) < 0)
-                        return;
-                ip4Node = getNetIfIpv4Node(iface,ip4);
-                buildARecord(ip4,ip4Node->ARECORD,
-                             ip4Node->PTR4RECORD);
-                break;
-        case AF_INET6:
-                ip6 = (IN6ADDR *)addr;
-                if (addNetIfIPv6(ip6,iface) < 0)
-                        return;
-                ip6Node = getNetIfIpv6Node(iface,ip6);
-                buildAAAARecord(ip6,ip6Node->AAAARECORD,
-                                ip6Node->PTR6RECORD);
-                break;
         }
-        joinMcastGroup(polling,iface);
-        if (iface->flags & _IFF_CDAR)
+        if (!(link->flags & IFF_RUNNING) ||
+            !(iface->flags & (_IFF_INET | _IFF_INET6))) {
+                if ((flags | iface->flags) & _IFF_RUNNING)
+                        checkIfDown(iface);
                 return;
-        /*
-         * For every ip that belongs to the "reporting" interface a
-         * netlink message is generated by the kernel. So, before
-         * launching the cdar process the '_INET6' flag is checked
-         * (i.e the interface has at least one IPv6 in the 'NETIFACE'
-         *  list). If the flag is down then check (at kernel level) if
-         * the interface has an IPv6 (at least a link local address).
-         * If it has it then dont launch cdar and wait for the next
-         * netlink message
-         */
-        if (!(iface->flags & _IFF_INET6)) {
-                if (!checkLinkLocalAddr(iface->name))
-                        return;
         }
-        RunningCDAR = 1;
-        invokeCdar(_CDARIFACEUP,iface->ifIndex,NULL);
+        iface->flags |= _IFF_RUNNING;
+        if (!(flags & _IFF_RUNNING))
+                invalidateAnswers(iface);
+        joinIface(iface);
+        if (!(iface->flags & _IFF_CDAR))
+                invokeCdar(_CDARIFACEUP,iface->ifIndex,NULL);
 }
 
-PRIVATE void delAddr (POLLFD *polling, NETIFACE *ifaces, int index, int fam, void *addr)
+PRIVATE NETIFACE *linkIface(NETIFACE *ifaces, NLLINK *link)
 {
     /*
-     * Remove an ip from the interface and leave (if necessary)
-     * the multicast group.
-     * Note: In linux, an interface goes down when it has no
-     * ip assigned to it
+     * The 'NETIFACE' node of 'link'. If there is none (and the
+     * interfaces are not the ones of the config file) a link
+     * with ips gets a new one. Loopback links are not LLMNR
+     * interfaces
      */
-        INADDR copy;
         NETIFACE *iface;
-        char ifName[IFNAMSIZ];
 
-        iface = NULL;
-        _if_indexToName(index,ifName);
-        iface = getNetIfNodeByIndex(ifaces,index);
-        if (iface == NULL) {
-                iface = getNetIfNodeByName(ifaces,ifName);
+        if (ifaces == NULL)
+                return NULL;
+        iface = getNetIfNodeByIndex(ifaces,link->ifIndex);
+        if (iface == NULL && !link->gone) {
+                iface = getNetIfNodeByName(ifaces,link->name);
                 if (iface != NULL)
-                        iface->ifIndex = index;
+                        iface->ifIndex = link->ifIndex;
         }
-        if (iface == NULL)
-                return;
-        switch (fam) {
-        case AF_INET:
-                memcpy(&copy,addr,sizeof(INADDR));
-                remNetIfIPv4(iface,(INADDR *)addr);
-                break;
-        case AF_INET6:
-                remNetIfIPv6(iface,(IN6ADDR *)addr);
-                break;
-        }
-        leaveMcastGroup(polling,iface,&copy);
-        checkIfDown(iface);
+        if (iface != NULL || link->gone)
+                return iface;
+        if (ifaces->flags & _IFF_STATIC || link->flags & IFF_LOOPBACK)
+                return NULL;
+        if (link->addrs4 == NULL && link->addrs6 == NULL)
+                return NULL;
+        if (addNetIfNode(link->name,link->ifIndex,0,_IFF_DYNAMIC,ifaces) < 0)
+                return NULL;
+        return getNetIfNodeByIndex(ifaces,link->ifIndex);
 }
 
-PRIVATE void checkIfDown(NETIFACE *iface)
+PRIVATE int syncIPv4s(NETIFACE *iface, NLLINK *link, INADDR *lost)
 {
     /*
-     * If the interface goes down then turn off some flags
-     * and update (if necessary) the mirror interfaces
-     * (See llmnr_net_interface.h). Also update the 'NAME'
-     * authorivative lists (See llmnr_names.h)
+     * Remove the IPv4s 'link' no longer has and add the new ones
+     * (along with their 'A' record and the local addresses set,
+     * See llmnr_net_interface.h). 'lost' is one of the removed
+     * (See leaveMcastGroup())
+     * Returns how many ips changed
      */
-        int i, sock;
-        NAME *current;
-        NETIFACE *aux;
-        struct ifreq ifr;
-
-        sock = socket(AF_INET,SOCK_DGRAM,0);
-        memset(&ifr, 0, sizeof(ifr));
-        if (iface->name == NULL)
-                return;
-        strcpy(ifr.ifr_name,iface->name);
-
-        if (ioctl(sock, SIOCGIFFLAGS, &ifr) < 0)
-                return;
-        if (ifr.ifr_flags & IFF_RUNNING)
-                return;
-        iface->flags &= ~_IFF_CDAR;
-        iface->flags &= ~_IFF_RUNNING;
-        iface->flags &= ~_IFF_CONFLICT;
-        for (current = Names; current != NULL; current = current->next) {
-                if (current->name == NULL)
+        int changes;
+        NLADDR *addr;
+        NETIFIPV4 *current, *next;
+
+        changes = 0;
+        memset(lost,0,sizeof(INADDR));
+        for (current = iface->IPv4s; current != NULL; current = next) {
+                next = current->next;
+                if (current->ipType == NOIP)
                         continue;
-                if (current->authOnSz >= 1)
-                        delAuthOn(current,iface->ifIndex);
-                if (current->notAuthOnSz >= 1)
-                        delNotAuthOn(current,iface->ifIndex);
+                if (linkHasAddr(link,AF_INET,&current->ip4Addr))
+                        continue;
+                memcpy(lost,&current->ip4Addr,sizeof(INADDR));
+                delLocalAddr(iface,AF_INET,lost);
+                remNetIfIPv4(iface,lost);
+                changes++;
         }
-        for (i = 0; i < iface->mirrorIfSz; i++) {
-                aux = getNetIfNodeByIndex(Ifaces,iface->mirrorIfs[i]);
-                if (aux == NULL)
+        for (addr = link->addrs4; addr != NULL; addr = addr->next) {
+                if (getNetIfIpv4Node(iface,(INADDR *)addr->addr) != NULL)
                         continue;
-                delMirrorIf(aux,iface->ifIndex);
-                delMirrorIf(iface,iface->mirrorIfs[i]);
-                aux->flags &= ~_IFF_CONFLICT;
+                addNetIfIPv4((INADDR *)addr->addr,iface);
+                current = getNetIfIpv4Node(iface,(INADDR *)addr->addr);
+                if (current == NULL)
+                        continue;
+                addLocalAddr(iface,AF_INET,addr->addr);
+                buildARecord(&current->ip4Addr,current->ARECORD);
+                changes++;
         }
+        return changes;
 }
 
-PRIVATE int checkLinkLocalAddr(char *name)
+PRIVATE int syncIPv6s(NETIFACE *iface, NLLINK *link)
 {
     /*
-     * Checks if this 'iface' has a link local ipv6 at
-     * "kernel level" (See /proc/net/if_inet6 file)
+     * Same thing that syncIPv4s() but for IPv6
      */
-        char *ptr;
-        FILE *file;
-        IN6ADDR ipv6;
-        STRNODE *list;
-        char buff[55 + IFNAMSIZ];
-        char path[] = "/proc/net/if_inet6";
-
-        file = fopen(path,"r");
-        if (file == NULL)
-                return FAILURE;
-        memset(&ipv6,0,sizeof(ipv6));
-        while (fgets(buff,sizeof(buff),file) != NULL) {
-                trim(buff,'\n');
-                list = split(buff,32);
-                ptr = getNodeAt(list,6);
-                if (ptr != NULL) {
-                        if (!strcasecmp(name,ptr)) {
-                                ptr = getNodeAt(list,1);
-                                _checkLinkLocalAddr(ptr,buff);
-                                if (inet_pton(AF_INET6,buff,&(ipv6)) <= 0)
-                                        return FAILURE;
-                                if (ip6Type(&ipv6) == LINKLOCALIP) {
-                                        fclose(file);
-                                        deleteStrNodeList(&list);
-                                        return SUCCESS;
-                                }
-                        }
-                }
-                deleteStrNodeList(&list);
+        int changes;
+        NLADDR *addr;
+        NETIFIPV6 *current, *next;
+
+        changes = 0;
+        for (current = iface->IPv6s; current != NULL; current = next) {
+                next = current->next;
+                if (current->ipType == NOIP)
+                        continue;
+                if (linkHasAddr(link,AF_INET6,&current->ip6Addr))
+                        continue;
+                delLocalAddr(iface,AF_INET6,&current->ip6Addr);
+                remNetIfIPv6(iface,&current->ip6Addr);
+                changes++;
+        }
+        for (addr = link->addrs6; addr != NULL; addr = addr->next) {
+                if (getNetIfIpv6Node(iface,(IN6ADDR *)addr->addr) != NULL)
+                        continue;
+                addNetIfIPv6((IN6ADDR *)addr->addr,iface);
+                current = getNetIfIpv6Node(iface,(IN6ADDR *)addr->addr);
+                if (current == NULL)
+                        continue;
+                addLocalAddr(iface,AF_INET6,addr->addr);
+                buildAAAARecord(&current->ip6Addr,current->AAAARECORD);
+                changes++;
         }
-        fclose(file);
-        return FAILURE;
+        return changes;
 }
 
-PRIVATE void _checkLinkLocalAddr(char *ipv6, char *_buff)
+PRIVATE void checkIfDown(NETIFACE *iface)
 {
     /*
-     * checkLinkLocalAddr() helper. Fills the missing ":"
-     * in ipv6 string
+     * The interface went down (his link is not running, See
+     * llmnr_netlink.h): turn off some flags and update (if
+     * necessary) the mirror interfaces (See
+     * llmnr_net_interface.h). Also update the 'NAME'
+     * authorivative lists (See llmnr_names.h). The answers of
+     * every interface involved change. The probes of the
+     * interface and his probe sockets are gone (See
+     * llmnr_conflict.h)
      */
-        int i, j;
-        char *ptr;
-        char buff[55 + IFNAMSIZ];
-
-        i = 0;
-        j = 1;
-        ptr = ipv6;
-        memset(buff,0,sizeof(buff));
-        while (*ptr) {
-                buff[i++] = *ptr++;
-                j++;
-                if (j == 5) {
-                        buff[i++] = ':';
-                        j = 1;
-                }
+        int i;
+        NAME *current;
+        NETIFACE *aux;
+
+        cdarIfaceDown(iface);
+        iface->flags &= ~_IFF_CDAR;
+        iface->flags &= ~_IFF_RUNNING;
+        iface->flags &= ~_IFF_CONFLICT;
+        for (current = Names; current != NULL; current = current->next) {
+                if (current->name == NULL)
+                        continue;
+                delAuthOn(current,iface->slot);
+                delNotAuthOn(current,iface->slot);
+        }
+        invalidateAnswers(iface);
+        i = nextInIfSet(&iface->mirrorIfs,0);
+        for (; i >= 0; i = nextInIfSet(&iface->mirrorIfs,i + 1)) {
+                delMirrorIf(iface,i);
+                aux = getNetIfNodeBySlot(Ifaces,i);
+                if (aux == NULL)
+                        continue;
+                delMirrorIf(aux,iface->slot);
+                if (ifSetSz(&aux->mirrorIfs) == 0)
+                        aux->flags &= ~_IFF_CONFLICT;
+                invalidateAnswers(aux);
         }
-        if (buff[i - 1] == ':')
-                buff[i - 1] = 0;
-        else if (buff[i] == ':')
-                buff[i] = 0;
-        memset(_buff,0,strlen(_buff));
-        strcpy(_buff,buff);
 }
 
 PRIVATE void checkConflicts()
 {
     /*
-     * Checks pending conflicts. If any then launch
-     * cdar process
+     * Checks pending conflicts. Launch the cdar process for
+     * every one of them (the probes run at the same time)
      */
         int ifIndex;
         NAME *cName;
         CONFLICT *current;
 
-        if (RunningCDAR)
-                return;
         pthread_mutex_lock(&ConflictMutex);
-        current = getNextConflict(Conflicts);
-        if (current == NULL) {
-                pthread_mutex_unlock(&ConflictMutex);
-                return;
+        while ((current = getNextConflict(Conflicts)) != NULL) {
+                cName = current->cName;
+                ifIndex = current->ifIndex;
+                if (Conflicts->logPath != NULL)
+                        logConflict(current,Conflicts->logPath);
+                remConflict(current,Conflicts);
+                invokeCdar(_CDARCONFLICT,ifIndex,cName);
         }
-        cName = current->cName;
-        ifIndex = current->ifIndex;
-        if (Conflicts->logPath != NULL)
-                logConflict(current,Conflicts->logPath);
-        remConflict(current,Conflicts);
-        RunningCDAR = 1;
-        invokeCdar(_CDARCONFLICT,ifIndex,cName);
         pthread_mutex_unlock(&ConflictMutex);
 }
 
-PRIVATE int checkName(char *name, int ifIndex, U_CHAR *T)
+PRIVATE int checkName(SNAPSHOT *snap, QUERY *query, int slot,
+                      HEADER *head, HOSTED **hosted)
 {
     /*
-     * Checks the name queried name against the 'NAME' list.
-     * In other words: The query was for me?
+     * Checks the name queried name against the 'NAME' index
+     * (the whole name, case insensitive). In other words: The
+     * query was for me (on the interface of 'slot', See
+     * llmnr_ifset.h)?
+     * If not one of my names, it may be a hosted one ('hosted',
+     * See llmnr_registry.h), authoritative on every interface.
+     * Hosted records of one of my names are used, but my names
+     * keep their own rules
      * Note: Header is reused. Mark 'T' bit allready
      */
-        int i;
+        int auth;
         NAME *current;
 
-        if (name == NULL)
+        if (query->QNAME == NULL)
                 return FAILURE;
-        current = Names;
-        for (; current != NULL; current = current->next) {
-                if (current->name == NULL)
-                        continue;
-                if (strncasecmp(current->name,name,strlen(current->name)))
-                        continue;
-                for (i = 0; i < current->notAuthOnSz; i++) {
-                        if (current->notAuthOn[i] == ifIndex)
-                                return FAILURE;
-                }
-                *T = current->nameStatus;
-                return SUCCESS;
-        }
-        return FAILURE;
-}
-
-PRIVATE int checkPtrName(char *name, int ifIndex, int family)
-{
-    /*
-     * Same thing that checkName() but this time with 'PTR' names
-     */
-        int ret;
-        NETIFACE *iface;
-
-        ret = FAILURE;
-        iface = getNetIfNodeByIndex(Ifaces,ifIndex);
-        if (iface == NULL)
+        *hosted = lookupHosted(snap->registry,query->QNAME,query->nameLen,
+                               query->nameHash);
+        current = lookupName(snap->nameIndex,query->QNAME,query->nameLen,
+                             query->nameHash,slot,&auth);
+        if ((current == NULL && *hosted == NULL) ||
+            (current != NULL && !auth))
                 return FAILURE;
-        if (family == AF_INET) {
-                ret = _checkPtrName(name,iface->IPv4s);
-                if (ret)
-                        ret = __checkPtrName(name,iface->IPv6s);
-        } else if (family == AF_INET6) {
-                ret = __checkPtrName(name,iface->IPv6s);
-                if (ret)
-                        ret = _checkPtrName(name,iface->IPv4s);
-        }
-        return ret;
+        head->FLAGS &= ~HFLAG_T;
+        if (current != NULL && current->nameStatus == TENTATIVE)
+                head->FLAGS |= HFLAG_T;
+        if (*hosted != NULL)
+                incStat(STAT_HOSTEDQUERIES);
+        return SUCCESS;
 }
 
-PRIVATE int _checkPtrName(char *name, NETIFIPV4 *ipv4s)
+PRIVATE int checkPtrName(IFTABLE *table, char *name, int ifIndex)
 {
     /*
-     * checkPtrName() helper for "IPv4 names"
+     * Same thing that checkName() but this time with 'PTR' names:
+     * the name is decoded into an address, which must be one of
+     * the interface that received the query (any family)
      */
-        NETIFIPV4 *current;
+        int family;
+        U_CHAR addr[IPV6LEN];
 
-        if (ipv4s == NULL)
+        if (name == NULL || ptrNameToAddr(name,&family,addr))
                 return FAILURE;
-        current = ipv4s;
-        for (; current != NULL; current = current->next) {
-                if (current->ipType == NOIP)
-                        continue;
-                if (!strcasecmp(current->PTR4RECORD,name))
-                        return SUCCESS;
-        }
-        return FAILURE;
-}
-
-PRIVATE int __checkPtrName(char *name, NETIFIPV6 *ipv6s)
-{
-    /*
-     * checkPtrName() helper for "IPv6 names"
-     */
-        NETIFIPV6 *current;
-
-        if (ipv6s == NULL)
+        if (!hasIfAddr(table,ifIndex,family,addr))
                 return FAILURE;
-        current = ipv6s;
-        for (; current != NULL; current = current->next) {
-                if (current->ipType == NOIP)
-                        continue;
-                if (!strcasecmp(current->PTR6RECORD,name))
-                        return SUCCESS;
-        }
-        return FAILURE;
+        return SUCCESS;
 }
 
-PRIVATE void setDescriptorToPoll(POLLFD *pollArr, int i, int fd)
+PRIVATE void setSocket(int i, int fd)
 {
     /*
-     * Given a socket, add it to the array of sockets to poll()
+     * Given a socket, save it in 'Socks' (position 'i') and
+     * register his handler in the event loop
      * Note: position 0 of the array is reserved for the UDP (IPv4)
      * main socket. Position 1 to the UDP (IPv6) main socket. 2 for
-     * TCP (IPv4 & IPv6) main socket and position 4 for netlink
+     * TCP (IPv4 & IPv6) main socket and position 3 for netlink
      * socket
      */
-        if (fd <= 0) {
-                handleError(ESOCKERR,NULL,i);
-                pollArr[i].fd = -1;
-                pollArr[i].events = 0;
-
-                if (pollArr[0].fd < 0 && pollArr[1].fd < 0 &&
-                    pollArr[2].fd < 0) {
+        if (fd <= 0 || addHandler(fd,EPOLLIN,handleSocket,(void *)(long)i)) {
+                if (fd > 0)
+                        close(fd);
+                handleError(ESOCKERR,i);
+                Socks[i] = -1;
+
+                if (Socks[_UDP4SOCK] < 0 && Socks[_UDP6SOCK] < 0 &&
+                    Socks[_TCPSOCK] < 0 && !shardsRunning() &&
+                    !ifaceSocksRunning()) {
                         logError(FORCED_EXIT,NULL);
-                        freeResources(pollArr);
+                        freeResources();
                 }
                 return;
         }
-        pollArr[i].fd = fd;
-        pollArr[i].events = POLLIN;
+        Socks[i] = fd;
 }
 
-PRIVATE void removeDescriptorFromPoll(POLLFD *pollArr, int i)
+PRIVATE void removeSocket(int i)
 {
     /*
-     * Remove a socket from the poll() array
+     * Remove a socket from the event loop and close it
      */
-        if (pollArr[i].fd > 0) {
-                close(pollArr[i].fd);
-                pollArr[i].fd = -1;
-                pollArr[i].events = 0;
+        if (Socks[i] > 0) {
+                delHandler(Socks[i]);
+                close(Socks[i]);
+                Socks[i] = -1;
         }
 }
 
-PRIVATE void sigTermHandler(int signo)
-{
-    /*
-     * when 'SIGTERM' received infinite loop ends
-     * (Stop daemon)
-     */
-        signo = signo;
-        Flag = 0;
-        return;
-}
-
-PRIVATE void sigUsr2Handler(int signo)
+PRIVATE void printDebugInfo()
 {
     /*
      * When 'SIGUSR2' received print a lot of things
      * (Debug purposes)
      */
-        signo = signo;
         printNames(Names);
         printIfaces(Ifaces);
+        printPoolStats();
+        printShardStats();
+        printIfaceSockStats();
+        printTcpStats();
+        printToStream("Conflict probes running: %d\n",runningProbes());
+        if (!shardsRunning())
+                printToStream("UDP kernel drops: IPv4 %ld, IPv6 %ld\n",
+                              kernelDrops(Socks[_UDP4SOCK]),
+                              kernelDrops(Socks[_UDP6SOCK]));
+        printSnapshotStats();
+        printRegistry(Registry);
+        printStats();
         //printRList(Rlist);
-        return;
 }
 
-PRIVATE void handleError(int err, POLLFD *pollArr, int i)
+PRIVATE void handleError(int err, int i)
 {
     /*
      * Handle and log errors
      */
-        int newFd;
         switch (err) {
-        case EPOLLERR:
-                removeDescriptorFromPoll(pollArr,i);
+        case ESOCKPOLL:
+                removeSocket(i);
                 switch (i) {
-                case 0:
-                        newFd = createUdpSocket(AF_INET);
-                        setDescriptorToPoll(pollArr,0,newFd);
+                case _UDP4SOCK:
+                        setSocket(_UDP4SOCK,
+                                  createUdpSocket(AF_INET,
+                                                  ifaceSocksRunning()));
                         break;
-                case 1:
-                        newFd = createUdpSocket(AF_INET6);
-                        setDescriptorToPoll(pollArr,1,newFd);
+                case _UDP6SOCK:
+                        setSocket(_UDP6SOCK,
+                                  createUdpSocket(AF_INET6,
+                                                  ifaceSocksRunning()));
                         break;
-                case 2:
-                        newFd = createTcpSock();
-                        setDescriptorToPoll(pollArr,2,newFd);
+                case _TCPSOCK:
+                        setSocket(_TCPSOCK,
+                                  createTcpSock(getOption(OPT_TCPBACKLOG)));
                         break;
-                case 3:
-                        newFd = createNetLinkSocket();
-                        setDescriptorToPoll(pollArr,3,newFd);
+                case _NLSOCK:
+                        setSocket(_NLSOCK,openNetlink());
+                        scheduleNetlink();
                         break;
                 }
                 break;
         case ESOCKERR:
                 switch (i) {
-                case 0:
+                case _UDP4SOCK:
                         logError(ESOCKERR,"IPv4 UDP socket");
                         break;
-                case 1: logError(ESOCKERR,"IPv6 UDP socket");
+                case _UDP6SOCK:
+                        logError(ESOCKERR,"IPv6 UDP socket");
                         break;
-                case 2:
+                case _TCPSOCK:
                         logError(ESOCKERR,"TCP socket");
                         break;
-                case 3:
+                case _NLSOCK:
                         logError(ESOCKERR,"Netlink socket");
                         break;
                 }
@@ -1159,18 +1214,36 @@ PRIVATE void handleError(int err, POLLFD *pollArr, int i)
         }
 }
 
-PRIVATE void freeResources(POLLFD *pollArr)
+PRIVATE void freeResources()
 {
+        int i;
+
+        stopIfaceSocks();
+        stopShards();
+        stopPool();
+        stopTcp();
+        stopCdar();
+        stopAnswerCache();
+        freeKernelFilter();
+        stopTimerWheel();
         closeLog();
         //closeStream();
-        removeDescriptorFromPoll(pollArr,0);
-        removeDescriptorFromPoll(pollArr,1);
-        removeDescriptorFromPoll(pollArr,2);
-        removeDescriptorFromPoll(pollArr,3);
+        for (i = 0; i < SOCKETSZ; i++)
+                removeSocket(i);
+        closeReactor();
+        if (SignalFd > 0)
+                close(SignalFd);
+        if (ConflictFd > 0)
+                close(ConflictFd);
+        freeSnapshots();
+        dropRegistry(&Registry);
+        freeLocalAddrs();
+        freeLinks();
         if (Names != NULL)
                 deleteNameList(&Names);
         if (Ifaces != NULL)
                 delNetIfList(&Ifaces);
+        freeIfSlots();
         if (Rlist != NULL)
                 deleteRList(&Rlist);
         if (Conflicts != NULL)
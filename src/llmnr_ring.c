@@ -0,0 +1,142 @@
+/* Macros */
+
+/* Includes */
+#include <stdlib.h>
+
+/* Own includes */
+#include "../include/llmnr_defs.h"
+#include "../include/llmnr_ring.h"
+
+/* Enums & Structs */
+
+/* Private prototypes */
+
+/* Glocal variables */
+
+/* Functions definitions */
+PUBLIC RING *newRing(unsigned long size)
+{
+    /*
+     * Creates a ring able to hold 'size' pointers. 'size'
+     * is rounded up to the next power of two so positions
+     * can be masked instead of using the modulo operator
+     */
+        RING *ring;
+        unsigned long i, realSz;
+
+        realSz = 2;
+        while (realSz < size)
+                realSz <<= 1;
+        ring = calloc(1,sizeof(RING));
+        if (ring == NULL)
+                return NULL;
+        ring->cells = calloc(realSz,sizeof(RINGCELL));
+        if (ring->cells == NULL) {
+                free(ring);
+                return NULL;
+        }
+        for (i = 0; i < realSz; i++)
+                ring->cells[i].seq = i;
+        ring->mask = realSz - 1;
+        ring->head = 0;
+        ring->tail = 0;
+        return ring;
+}
+
+PUBLIC void deleteRing(RING **ring)
+{
+        if (ring == NULL || *ring == NULL)
+                return;
+        free((*ring)->cells);
+        free(*ring);
+        *ring = NULL;
+}
+
+PUBLIC int ringPush(RING *ring, void *data)
+{
+    /*
+     * Store 'data' at the tail of the ring. A cell is free
+     * for the producer owning position 'pos' when his sequence
+     * number equals 'pos'. Once written, the sequence is moved
+     * to 'pos + 1' to hand over the cell to consumers
+     */
+        long diff;
+        RINGCELL *cell;
+        unsigned long pos, seq;
+
+        pos = __atomic_load_n(&ring->tail,__ATOMIC_RELAXED);
+        for (;;) {
+                cell = &ring->cells[pos & ring->mask];
+                seq = __atomic_load_n(&cell->seq,__ATOMIC_ACQUIRE);
+                diff = (long)seq - (long)pos;
+                if (diff == 0) {
+                        if (__atomic_compare_exchange_n(&ring->tail,&pos,
+                                                        pos + 1,1,
+                                                        __ATOMIC_RELAXED,
+                                                        __ATOMIC_RELAXED))
+                                break;
+                } else if (diff < 0) {
+                        return FAILURE;
+                } else {
+                        pos = __atomic_load_n(&ring->tail,__ATOMIC_RELAXED);
+                }
+        }
+        cell->data = data;
+        __atomic_store_n(&cell->seq,pos + 1,__ATOMIC_RELEASE);
+        return SUCCESS;
+}
+
+PUBLIC void *ringPop(RING *ring)
+{
+    /*
+     * Take the pointer at the head of the ring. Same thing
+     * that ringPush() but the cell is ready when his sequence
+     * equals 'pos + 1'. Once read, the sequence is moved a whole
+     * lap ahead so the cell can be reused by producers
+     */
+        long diff;
+        void *data;
+        RINGCELL *cell;
+        unsigned long pos, seq;
+
+        pos = __atomic_load_n(&ring->head,__ATOMIC_RELAXED);
+        for (;;) {
+                cell = &ring->cells[pos & ring->mask];
+                seq = __atomic_load_n(&cell->seq,__ATOMIC_ACQUIRE);
+                diff = (long)seq - (long)(pos + 1);
+                if (diff == 0) {
+                        if (__atomic_compare_exchange_n(&ring->head,&pos,
+                                                        pos + 1,1,
+                                                        __ATOMIC_RELAXED,
+                                                        __ATOMIC_RELAXED))
+                                break;
+                } else if (diff < 0) {
+                        return NULL;
+                } else {
+                        pos = __atomic_load_n(&ring->head,__ATOMIC_RELAXED);
+                }
+        }
+        data = cell->data;
+        __atomic_store_n(&cell->seq,pos + ring->mask + 1,__ATOMIC_RELEASE);
+        return data;
+}
+
+PUBLIC unsigned long ringCount(RING *ring)
+{
+    /*
+     * Approximate number of pointers stored in the ring
+     * (exact when there's no concurrent push or pop)
+     */
+        unsigned long head, tail;
+
+        head = __atomic_load_n(&ring->head,__ATOMIC_RELAXED);
+        tail = __atomic_load_n(&ring->tail,__ATOMIC_RELAXED);
+        if (tail < head)
+                return 0;
+        return tail - head;
+}
+
+PUBLIC unsigned long ringSize(RING *ring)
+{
+        return ring->mask + 1;
+}
@@ -2,6 +2,8 @@
 #define INTSZ 4
 #define USHORTSZ 2
 #define RRPARTIALSZ 10
+#define PTR4DOMAIN "\x07in-addr\x04" "arpa"
+#define PTR6DOMAIN "\x03ip6\x04" "arpa"
 
 /* Includes */
 #include <stdio.h>
@@ -11,6 +13,7 @@
 
 /* Own includes */
 #include "../include/llmnr_defs.h"
+#include "../include/llmnr_ifset.h"
 #include "../include/llmnr_names.h"
 #include "../include/llmnr_print.h"
 #include "../include/llmnr_utils.h"
@@ -19,13 +22,19 @@
 /* Private prototypes */
 PRIVATE void copyRR(U_CHAR *RR, RESRECORD *resRec);
 PRIVATE void copyRdata(int type, U_CHAR *rDataPtr, void *rData, int rDataLen);
-PRIVATE void fillPtrRR(int type, void *ip, char *ptrRec);
-PRIVATE void hexToAsciiPtr(U_CHAR byte, char *ret);
+PRIVATE int ptr4NameToAddr(U_CHAR *label, U_CHAR *addr);
+PRIVATE int ptr6NameToAddr(U_CHAR *label, U_CHAR *addr);
 PRIVATE void printResRecord(U_CHAR *rr, int rrLen);
 PRIVATE void printType(int type);
-PRIVATE U_CHAR hexToAsciiPtrH(U_CHAR nibble);
 
 /* Glocal variables */
+PRIVATE const U_CHAR Nibbles[256] = {
+        ['0'] = 1, ['1'] = 2, ['2'] = 3, ['3'] = 4, ['4'] = 5,
+        ['5'] = 6, ['6'] = 7, ['7'] = 8, ['8'] = 9, ['9'] = 10,
+        ['a'] = 11, ['b'] = 12, ['c'] = 13, ['d'] = 14, ['e'] = 15,
+        ['f'] = 16, ['A'] = 11, ['B'] = 12, ['C'] = 13, ['D'] = 14,
+        ['E'] = 15, ['F'] = 16
+};
 
 /* Function definitions */
 PUBLIC RRLIST *rrListHead()
@@ -94,13 +103,11 @@ PUBLIC int deleteRList(RRLIST **list)
         return SUCCESS;
 }
 
-PUBLIC void buildARecord(INADDR *ipv4, U_CHAR *aRec, char *ptrRec)
+PUBLIC void buildARecord(INADDR *ipv4, U_CHAR *aRec)
 {
     /*
      * Given an IPv4, build his derivated 'A' 'RESRECORD'
-     * Also derives the associated 'PTR' "name" (See RFC 1035)
      * 'aRec' is a pointer to 'ARECORD'
-     * 'ptrRec' is a pointer to 'PTR4RECORD'
      * (See llmnr_net_interface.h)
      */
         A_RR arr;
@@ -116,10 +123,9 @@ PUBLIC void buildARecord(INADDR *ipv4, U_CHAR *aRec, char *ptrRec)
         rr.RDATA = (void *)&arr;
         copyRR(aRec,&rr);
         copyRdata(A,aRec + RRPARTIALSZ,&arr,IPV4LEN);
-        fillPtrRR(AF_INET,ipv4,ptrRec);
 }
 
-PUBLIC void buildAAAARecord(IN6ADDR *ipv6, U_CHAR *aaaaRec, char *ptrRec)
+PUBLIC void buildAAAARecord(IN6ADDR *ipv6, U_CHAR *aaaaRec)
 {
     /*
      * Same thing that 'buildARecord' but for IPv6 instead
@@ -137,7 +143,54 @@ PUBLIC void buildAAAARecord(IN6ADDR *ipv6, U_CHAR *aaaaRec, char *ptrRec)
         rr.RDATA = (void *)&aaaarr;
         copyRR(aaaaRec,&rr);
         copyRdata(AAAA,aaaaRec + RRPARTIALSZ,&aaaarr,IPV6LEN);
-        fillPtrRR(AF_INET6,ipv6->s6_addr,ptrRec);
+}
+
+PUBLIC int ptrNameToAddr(char *name, int *family, U_CHAR *addr)
+{
+    /*
+     * Given a "PTR name" (DNS format, See RFC 1035) get the
+     * address it points to (network order) and his family
+     * ('addr' must fit an IPv6)
+     */
+        if (ptr4NameToAddr((U_CHAR *)name,addr) == SUCCESS) {
+                *family = AF_INET;
+                return SUCCESS;
+        }
+        if (ptr6NameToAddr((U_CHAR *)name,addr) == SUCCESS) {
+                *family = AF_INET6;
+                return SUCCESS;
+        }
+        return FAILURE;
+}
+
+PUBLIC int addrToPtrName(int family, U_CHAR *addr, char *name)
+{
+    /*
+     * The other way around of ptrNameToAddr(): write into 'name'
+     * ('PTRNAMEMAX' bytes at least) the "PTR name" of 'addr'
+     * Returns the name size (trailing zero included)
+     */
+        int i, len;
+        char *ptr;
+
+        ptr = name;
+        if (family == AF_INET) {
+                for (i = IPV4LEN - 1; i >= 0; i--) {
+                        len = sprintf(ptr + 1,"%u",addr[i]);
+                        *ptr = len;
+                        ptr += len + 1;
+                }
+                strcpy(ptr,PTR4DOMAIN);
+        } else {
+                for (i = IPV6LEN - 1; i >= 0; i--) {
+                        *ptr++ = 1;
+                        *ptr++ = "0123456789abcdef"[addr[i] & 0xF];
+                        *ptr++ = 1;
+                        *ptr++ = "0123456789abcdef"[addr[i] >> 4];
+                }
+                strcpy(ptr,PTR6DOMAIN);
+        }
+        return ptr - name + strlen(ptr) + 1;
 }
 
 PUBLIC void fillPtrRecord(NAME *names)
@@ -331,102 +384,53 @@ PRIVATE void copyRdata(int type, U_CHAR *rDataPtr, void *rData, int rDataLen)
         }
 }
 
-PRIVATE void fillPtrRR(int type, void *ip, char *ptrRec)
+PRIVATE int ptr4NameToAddr(U_CHAR *label, U_CHAR *addr)
 {
     /*
-     * Given an ip of type 'type' (IPv4 or IPv6) build his
-     * corresponding PTR name (See RFC 1035) and store it
-     * into 'ptrRec'
-     *
+     * "d.c.b.a.in-addr.arpa" -> a.b.c.d. Every label must be a
+     * decimal number (0 - 255) without leading zeros
      */
-        int i;
-        char str[16];
-        U_CHAR *ptr;
-        char *aux, auxStr[75];
-        char newName[HOSTNAMEMAX + 1];
-        char domain4[] = "in-addr.arpa.";
-        char domain6[] = "ip6.arpa.";
-
-    /* IPvX its in network order */
-        memset(auxStr,0,75);
-        memset(newName,0,HOSTNAMEMAX + 1);
-        ptr = (U_CHAR *)ip;
-
-        switch (type) {
-
-        case AF_INET:
-                for (i = IPV4LEN - 1; i >= 0; i--) {
-                        memset(str,0,16);
-                        sprintf(str, "%d", (ptr[i]));
-                        strcat(auxStr,str);
-                        strcat(auxStr,".");
+        int i, j, value;
+        U_CHAR digit;
+
+        for (i = IPV4LEN - 1; i >= 0; i--) {
+                if (label[0] < 1 || label[0] > 3 ||
+                    (label[0] > 1 && label[1] == '0'))
+                        return FAILURE;
+                value = 0;
+                for (j = 1; j <= label[0]; j++) {
+                        digit = label[j] - '0';
+                        if (digit > 9)
+                                return FAILURE;
+                        value = value * 10 + digit;
                 }
-                strcpy(newName,auxStr);
-                strcat(newName,domain4);
-                break;
-
-        case AF_INET6:
-                aux = auxStr;
-                for (i = IPV6LEN - 1; i >=0; i--) {
-                        hexToAsciiPtr(ptr[i],aux);
-                        aux[1] = '.';
-                        aux[3] = '.';
-                        aux += 4;
-                }
-                strcpy(newName,auxStr);
-                strcat(newName,domain6);
-                break;
+                if (value > 0xFF)
+                        return FAILURE;
+                addr[i] = value;
+                label += label[0] + 1;
         }
-        strToDnsStr(newName,ptrRec);
+        return strcasecmp((char *)label,PTR4DOMAIN) ? FAILURE : SUCCESS;
 }
 
-PRIVATE void hexToAsciiPtr(U_CHAR byte, char *ret)
+PRIVATE int ptr6NameToAddr(U_CHAR *label, U_CHAR *addr)
 {
     /*
-     * Special hex to ascii (PTR name only)
-     * Given a byte will halve it, exchange it and turn it
-     * into two chars separeted by a "."
-     * Example: 0xAB -> "B.A"
+     * "l.h.(...).ip6.arpa" -> hl(...). Every label is one hex
+     * digit, low nibble first. 'Nibbles' holds the value + 1
+     * of every hex digit (0 means it is not one)
      */
-       U_CHAR highNibble, lowNibble;
-
-        highNibble = byte >> 4;
-        lowNibble = byte & 0x0F;
-        ret[0] = hexToAsciiPtrH(lowNibble);
-        ret[2] = hexToAsciiPtrH(highNibble);
-}
-
-PRIVATE U_CHAR hexToAsciiPtrH(U_CHAR nibble)
-{
-    /*
-     * Helper function for 'hexToAsciiPtr'
-     * Given a hex number will turn it into ascii character
-     */
-        U_CHAR ret;
-
-        switch (nibble) {
-        case 0x0:
-        case 0x1:
-        case 0x2:
-        case 0x3:
-        case 0x4:
-        case 0x5:
-        case 0x6:
-        case 0x7:
-        case 0x8:
-        case 0x9:
-                ret = nibble + 48;
-                break;
-        case 0xA:
-        case 0xB:
-        case 0xC:
-        case 0xD:
-        case 0xE:
-        case 0xF:
-                ret = nibble + 87;
-                break;
+        int i;
+        U_CHAR low, high;
+
+        for (i = IPV6LEN - 1; i >= 0; i--) {
+                if (label[0] != 1 || (low = Nibbles[label[1]]) == 0)
+                        return FAILURE;
+                if (label[2] != 1 || (high = Nibbles[label[3]]) == 0)
+                        return FAILURE;
+                addr[i] = (high - 1) << 4 | (low - 1);
+                label += 4;
         }
-        return ret;
+        return strcasecmp((char *)label,PTR6DOMAIN) ? FAILURE : SUCCESS;
 }
 
 PRIVATE void printResRecord(U_CHAR *rr, int rrLen)
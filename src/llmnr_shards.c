@@ -0,0 +1,492 @@
+/* Macros */
+#define _GNU_SOURCE
+#define SHARDEVENTS 3
+#define MINOWNERSSZ 64
+
+/* Includes */
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <linux/filter.h>
+
+/* Own includes */
+#include "../include/llmnr_defs.h"
+#include "../include/llmnr_ifset.h"
+#include "../include/llmnr_names.h"
+#include "../include/llmnr_net_interface.h"
+#include "../include/llmnr_rr.h"
+#include "../include/llmnr_print.h"
+#include "../include/llmnr_sockets.h"
+#include "../include/llmnr_registry.h"
+#include "../include/llmnr_kernel_filter.h"
+#include "../include/llmnr_worker_pool.h"
+#include "../include/llmnr_shards.h"
+
+/* Enums & Structs */
+/*
+ * 'owners' tells the interface sockets the shard polls (See
+ * addShardSocket()): entry 'fd' is the index of the interface
+ * of the socket 'fd', 0 if none ('ownersSz' entries,
+ * 'ifSocks' sockets). Guarded by 'lock'
+ */
+typedef struct {
+        int fd4;
+        int fd6;
+        int epFd;
+        int stopFd;
+        int cpu;
+        long rcvd;
+        int ifSocks;
+        int ownersSz;
+        int *owners;
+        pthread_mutex_t lock;
+        pthread_t tid;
+        U_CHAR started;
+} SHARD;
+
+/* Private prototypes */
+PRIVATE int openShard(SHARD *shard, int steering, int perIface);
+PRIVATE int startShard(SHARD *shard);
+PRIVATE void *shardLoop(void *shard);
+PRIVATE void drainShard(SHARD *shard, int fd, int ifIndex);
+PRIVATE int watchFd(SHARD *shard, int fd, int ifIndex);
+PRIVATE int setOwner(SHARD *shard, int fd, int ifIndex);
+PRIVATE int ownedBy(SHARD *shard, int fd, int ifIndex);
+PRIVATE int getCpus(long cpuMask, int *cpus);
+PRIVATE void attachSteering(int fd);
+PRIVATE void closeShard(SHARD *shard);
+
+/* Glocal variables */
+PRIVATE int ShardsSz;
+PRIVATE int RcvBatch;
+PRIVATE SHARD *Shards;
+PRIVATE shardfilter Filter;
+
+/* Functions definitions */
+PUBLIC int startShards(int shards, long cpuMask, int steering, int rcvBatch,
+                       int perIface, shardfilter filter)
+{
+    /*
+     * - Open the sockets of every shard (in order, the position
+     *   of a socket in the reuseport group is his shard number).
+     *   With 'perIface' they join no group (unicast queries
+     *   only), the shards also poll the sockets of the
+     *   interfaces (See addShardSocket())
+     * - Attach the steering program (if asked)
+     * - Start the shard threads, pinned round robin to the CPUs
+     *   of 'cpuMask' (0 means every CPU we are allowed to run on)
+     */
+        int i, cpusSz, cpus[CPU_SETSIZE];
+
+        if (shards <= 0 || shards > MAXSHARDS || filter == NULL)
+                return FAILURE;
+        cpusSz = getCpus(cpuMask,cpus);
+        if (cpusSz <= 0)
+                return FAILURE;
+        Shards = calloc(shards,sizeof(SHARD));
+        if (Shards == NULL)
+                return FAILURE;
+        ShardsSz = shards;
+        RcvBatch = rcvBatch;
+        Filter = filter;
+        for (i = 0; i < ShardsSz; i++) {
+                Shards[i].cpu = cpus[i % cpusSz];
+                pthread_mutex_init(&Shards[i].lock,NULL);
+                if (openShard(&Shards[i],steering,perIface)) {
+                        stopShards();
+                        return FAILURE;
+                }
+        }
+        if (steering == STEER_CBPF) {
+                attachSteering(Shards[0].fd4);
+                attachSteering(Shards[0].fd6);
+        }
+        for (i = 0; i < ShardsSz; i++) {
+                if (startShard(&Shards[i])) {
+                        stopShards();
+                        return FAILURE;
+                }
+        }
+        return SUCCESS;
+}
+
+PUBLIC void stopShards()
+{
+    /*
+     * Wake up every shard thread through his stop eventfd,
+     * wait for them and close the sockets
+     */
+        int i;
+        uint64_t one;
+
+        if (Shards == NULL)
+                return;
+        one = 1;
+        for (i = 0; i < ShardsSz; i++) {
+                if (!Shards[i].started)
+                        continue;
+                if (write(Shards[i].stopFd,&one,sizeof(one)) < 0)
+                        continue;
+                pthread_join(Shards[i].tid,NULL);
+        }
+        for (i = 0; i < ShardsSz; i++) {
+                closeShard(&Shards[i]);
+                free(Shards[i].owners);
+                pthread_mutex_destroy(&Shards[i].lock);
+        }
+        free(Shards);
+        Shards = NULL;
+        ShardsSz = 0;
+}
+
+PUBLIC int shardsRunning()
+{
+        return Shards != NULL;
+}
+
+PUBLIC int getShardSocket(int family, int ifIndex)
+{
+    /*
+     * Returns the socket (of 'family') that receives the
+     * multicast queries of interface 'ifIndex'
+     */
+        SHARD *shard;
+
+        if (Shards == NULL || ifIndex < 0)
+                return FAILURE;
+        shard = &Shards[ifIndex % ShardsSz];
+        return family == AF_INET ? shard->fd4 : shard->fd6;
+}
+
+PUBLIC int addShardSocket(int fd, int ifIndex)
+{
+    /*
+     * The socket 'fd' of interface 'ifIndex' (See
+     * llmnr_iface_socks.h) is polled from now on by the shard
+     * 'ifIndex % K', so the queries of an interface are always
+     * answered on the same CPU
+     */
+        int res;
+        SHARD *shard;
+
+        if (Shards == NULL || ifIndex <= 0)
+                return FAILURE;
+        shard = &Shards[ifIndex % ShardsSz];
+        pthread_mutex_lock(&shard->lock);
+        res = setOwner(shard,fd,ifIndex);
+        if (!res && watchFd(shard,fd,ifIndex)) {
+                setOwner(shard,fd,0);
+                res = FAILURE;
+        }
+        pthread_mutex_unlock(&shard->lock);
+        return res;
+}
+
+PUBLIC void delShardSocket(int fd, int ifIndex)
+{
+    /*
+     * Stop polling the socket 'fd' of interface 'ifIndex' and
+     * close it. It is done under the lock of the shard so the
+     * shard can tell (See shardLoop()) a pending event of a
+     * closed socket: by then his number might even be reused by
+     * the socket of another interface, which is told apart by
+     * his owner
+     */
+        SHARD *shard;
+
+        if (Shards == NULL || ifIndex <= 0) {
+                close(fd);
+                return;
+        }
+        shard = &Shards[ifIndex % ShardsSz];
+        pthread_mutex_lock(&shard->lock);
+        epoll_ctl(shard->epFd,EPOLL_CTL_DEL,fd,NULL);
+        setOwner(shard,fd,0);
+        close(fd);
+        pthread_mutex_unlock(&shard->lock);
+}
+
+PUBLIC void attachShardsFilter()
+{
+    /*
+     * Attach the current kernel filter to the sockets of every
+     * shard (the interface sockets are not theirs, See
+     * llmnr_iface_socks.h)
+     */
+        int i;
+
+        for (i = 0; i < ShardsSz; i++) {
+                attachKernelFilter(Shards[i].fd4);
+                attachKernelFilter(Shards[i].fd6);
+        }
+}
+
+PUBLIC void printShardStats()
+{
+        int i;
+
+        for (i = 0; i < ShardsSz; i++) {
+                printToStream("Shard %d (CPU %d): %ld queries",i,Shards[i].cpu,
+                              __atomic_load_n(&Shards[i].rcvd,
+                                              __ATOMIC_RELAXED));
+                if (Shards[i].ifSocks > 0)
+                        printToStream(", %d interface sockets",
+                                      Shards[i].ifSocks);
+                printToStream(", kernel drops: IPv4 %ld, IPv6 %ld\n",
+                              kernelDrops(Shards[i].fd4),
+                              kernelDrops(Shards[i].fd6));
+        }
+}
+
+PRIVATE int openShard(SHARD *shard, int steering, int perIface)
+{
+    /*
+     * Create the sockets of the shard (unicast only with
+     * 'perIface'), his epoll instance and his stop eventfd
+     */
+        shard->fd4 = shard->fd6 = -1;
+        shard->epFd = epoll_create1(EPOLL_CLOEXEC);
+        shard->stopFd = eventfd(0,EFD_NONBLOCK | EFD_CLOEXEC);
+        if (shard->epFd < 0 || shard->stopFd < 0)
+                return FAILURE;
+        if (watchFd(shard,shard->stopFd,0))
+                return FAILURE;
+        shard->fd4 = createShardSocket(AF_INET,perIface);
+        shard->fd6 = createShardSocket(AF_INET6,perIface);
+        if (shard->fd4 < 0 || shard->fd6 < 0)
+                return FAILURE;
+        if (steering == STEER_INCOMING_CPU) {
+                setsockopt(shard->fd4,SOL_SOCKET,SO_INCOMING_CPU,
+                           &shard->cpu,sizeof(int));
+                setsockopt(shard->fd6,SOL_SOCKET,SO_INCOMING_CPU,
+                           &shard->cpu,sizeof(int));
+        }
+        if (watchFd(shard,shard->fd4,0) || watchFd(shard,shard->fd6,0))
+                return FAILURE;
+        return SUCCESS;
+}
+
+PRIVATE int watchFd(SHARD *shard, int fd, int ifIndex)
+{
+    /*
+     * Add 'fd' to the epoll instance of the shard. The event
+     * carries the descriptor and the interface of the socket
+     * (0 for the shard own descriptors)
+     */
+        struct epoll_event event;
+
+        memset(&event,0,sizeof(event));
+        event.events = EPOLLIN;
+        event.data.u64 = (uint64_t)ifIndex << 32 | (uint32_t)fd;
+        if (epoll_ctl(shard->epFd,EPOLL_CTL_ADD,fd,&event) < 0)
+                return FAILURE;
+        return SUCCESS;
+}
+
+PRIVATE int setOwner(SHARD *shard, int fd, int ifIndex)
+{
+    /*
+     * Set the interface of the socket 'fd' (0 if it is not
+     * polled anymore). The table grows as needed
+     */
+        int size, *owners;
+
+        if (fd < 0)
+                return FAILURE;
+        if (fd >= shard->ownersSz) {
+                if (ifIndex == 0)
+                        return SUCCESS;
+                size = shard->ownersSz == 0 ? MINOWNERSSZ : shard->ownersSz;
+                while (size <= fd)
+                        size *= 2;
+                owners = realloc(shard->owners,size * sizeof(int));
+                if (owners == NULL)
+                        return FAILURE;
+                memset(owners + shard->ownersSz,0,
+                       (size - shard->ownersSz) * sizeof(int));
+                shard->owners = owners;
+                shard->ownersSz = size;
+        }
+        if (shard->owners[fd] == 0 && ifIndex > 0)
+                shard->ifSocks++;
+        else if (shard->owners[fd] > 0 && ifIndex == 0)
+                shard->ifSocks--;
+        shard->owners[fd] = ifIndex;
+        return SUCCESS;
+}
+
+PRIVATE int ownedBy(SHARD *shard, int fd, int ifIndex)
+{
+    /*
+     * Returns TRUE if the shard polls the socket 'fd' of
+     * interface 'ifIndex'
+     */
+        if (fd < 0 || fd >= shard->ownersSz)
+                return FALSE;
+        return shard->owners[fd] == ifIndex;
+}
+
+PRIVATE int startShard(SHARD *shard)
+{
+    /*
+     * Start the shard thread pinned to his CPU. Signals are
+     * blocked so they are always delivered to the main thread
+     */
+        int res;
+        cpu_set_t cpuSet;
+        sigset_t all, old;
+        pthread_attr_t attr;
+
+        pthread_attr_init(&attr);
+        CPU_ZERO(&cpuSet);
+        CPU_SET(shard->cpu,&cpuSet);
+        pthread_attr_setaffinity_np(&attr,sizeof(cpu_set_t),&cpuSet);
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK,&all,&old);
+        res = pthread_create(&shard->tid,&attr,shardLoop,shard);
+        pthread_sigmask(SIG_SETMASK,&old,NULL);
+        pthread_attr_destroy(&attr);
+        if (res)
+                return FAILURE;
+        shard->started = TRUE;
+        return SUCCESS;
+}
+
+PRIVATE void *shardLoop(void *shard)
+{
+    /*
+     * Wait for queries on the shard sockets and answer them,
+     * until the stop eventfd is written. The event of an
+     * interface socket is only handled if the socket is still
+     * ours and still belongs to the interface of the event (See
+     * delShardSocket())
+     */
+        int i, fd, ifIndex, ready, err;
+        SHARD *myShard;
+        socklen_t errLen;
+        struct epoll_event events[SHARDEVENTS];
+
+        myShard = (SHARD *)shard;
+        for (;;) {
+                ready = epoll_wait(myShard->epFd,events,SHARDEVENTS,-1);
+                for (i = 0; i < ready; i++) {
+                        fd = (int)(uint32_t)events[i].data.u64;
+                        ifIndex = (int)(events[i].data.u64 >> 32);
+                        if (fd == myShard->stopFd)
+                                return NULL;
+                        if (ifIndex > 0) {
+                                pthread_mutex_lock(&myShard->lock);
+                                if (!ownedBy(myShard,fd,ifIndex)) {
+                                        pthread_mutex_unlock(&myShard->lock);
+                                        continue;
+                                }
+                        }
+                        if (events[i].events & EPOLLERR) {
+                                errLen = sizeof(err);
+                                getsockopt(fd,SOL_SOCKET,SO_ERROR,&err,
+                                           &errLen);
+                        }
+                        if (events[i].events & EPOLLIN)
+                                drainShard(myShard,fd,ifIndex);
+                        if (ifIndex > 0)
+                                pthread_mutex_unlock(&myShard->lock);
+                }
+        }
+        return NULL;
+}
+
+PRIVATE void drainShard(SHARD *shard, int fd, int ifIndex)
+{
+    /*
+     * Receive a batch of queries, keep the ones the filter
+     * accepts and answer them right here
+     */
+        int i, count, valid;
+        UDPCLIENT *clients[MAXRCVBATCH];
+
+        count = receiveClients(fd,clients,RcvBatch,ifIndex);
+        if (count <= 0)
+                return;
+        __atomic_fetch_add(&shard->rcvd,count,__ATOMIC_RELAXED);
+        valid = 0;
+        for (i = 0; i < count; i++) {
+                if (Filter(clients[i]))
+                        releasePoolSlot(clients[i]);
+                else
+                        clients[valid++] = clients[i];
+        }
+        answerInline(clients,valid);
+}
+
+PRIVATE int getCpus(long cpuMask, int *cpus)
+{
+    /*
+     * Fill 'cpus' with the CPUs of 'cpuMask' (bit N is CPU N)
+     * that we are allowed to run on. Mask 0 means all of them
+     * Returns the number of CPUs
+     */
+        int i, count;
+        cpu_set_t allowed;
+
+        count = 0;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0,sizeof(cpu_set_t),&allowed) < 0)
+                return FAILURE;
+        for (i = 0; i < CPU_SETSIZE; i++) {
+                if (!CPU_ISSET(i,&allowed))
+                        continue;
+                if (cpuMask != 0 && (i >= 63 || !(cpuMask & (1L << i))))
+                        continue;
+                cpus[count++] = i;
+        }
+        return count;
+}
+
+PRIVATE void attachSteering(int fd)
+{
+    /*
+     * Attach to the reuseport group of 'fd' a cBPF program that
+     * selects the shard pinned to the CPU that received the
+     * packet. CPUs without a shard fall back to 'CPU % shards'.
+     * If the kernel refuses the program the 4-tuple hash is kept
+     */
+        int i, n;
+        struct sock_fprog prog;
+        struct sock_filter code[2 * MAXSHARDS + 3];
+
+        n = 0;
+        code[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+                                                 SKF_AD_OFF + SKF_AD_CPU);
+        for (i = 0; i < ShardsSz; i++) {
+                code[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ |
+                                                         BPF_K,
+                                                         Shards[i].cpu,0,1);
+                code[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K,i);
+        }
+        code[n++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_MOD | BPF_K,
+                                                 ShardsSz);
+        code[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_A,0);
+        prog.len = n;
+        prog.filter = code;
+        setsockopt(fd,SOL_SOCKET,SO_ATTACH_REUSEPORT_CBPF,&prog,sizeof(prog));
+}
+
+PRIVATE void closeShard(SHARD *shard)
+{
+        if (shard->fd4 > 0)
+                close(shard->fd4);
+        if (shard->fd6 > 0)
+                close(shard->fd6);
+        if (shard->epFd > 0)
+                close(shard->epFd);
+        if (shard->stopFd > 0)
+                close(shard->stopFd);
+        shard->fd4 = shard->fd6 = shard->epFd = shard->stopFd = -1;
+}
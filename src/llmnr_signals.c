@@ -3,6 +3,9 @@
 /* Includes */
 #include <signal.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/signalfd.h>
 
 /* Own includes */
 #include "../include/llmnr_defs.h"
@@ -28,52 +31,62 @@ PUBLIC void handleSignals()
 
         for (signo = 1; signo <= 31; signo++) {
                 if (signo != SIGKILL && signo != SIGSTOP &&
-                    signo != SIGTERM && signo != SIGUSR2)
+                    signo != SIGTERM && signo != SIGUSR2 &&
+                    signo != SIGHUP)
                 mySignal(signo,ignoreSignal);
         }
 }
 
-PUBLIC void handleSpecSignals(int signo, sighandler funcHandler)
+PUBLIC int createSignalFd()
 {
     /*
-     * Handle "special" signals. Special means use another
-     * function handler for this signals
+     * "Special" signals (SIGTERM, SIGUSR2 and SIGHUP) are blocked
+     * and read from a signalfd in the event loop instead of being
+     * handled asynchronously. Must be called from the main
+     * thread before any other thread is created, so every
+     * thread inherits the mask
+     * Returns the signalfd
      */
-        if (signo == SIGTERM || signo == SIGUSR2)
-                mySignal(signo,funcHandler);
+        sigset_t mask;
+
+        sigemptyset(&mask);
+        sigaddset(&mask,SIGTERM);
+        sigaddset(&mask,SIGUSR2);
+        sigaddset(&mask,SIGHUP);
+        if (pthread_sigmask(SIG_BLOCK,&mask,NULL))
+                return FAILURE;
+        return signalfd(-1,&mask,SFD_NONBLOCK | SFD_CLOEXEC);
+}
+
+PUBLIC int readSignalFd(int fd)
+{
+    /*
+     * Returns the next pending signal of the signalfd 'fd'
+     * (FAILURE if none)
+     */
+        struct signalfd_siginfo info;
+
+        if (read(fd,&info,sizeof(info)) != sizeof(info))
+                return FAILURE;
+        return info.ssi_signo;
 }
 
 PRIVATE sighandler mySignal(int signo, sighandler functionHandler)
 {
     /*
      * Set the function handler for a given signal.
-     * If the signal is "SIGUSR1" then set SA_INTERRUPT flag
-     * For any other signal set SA_RESTART flag (restart syscalls)
+     * Set SA_RESTART flag (restart syscalls)
      */
         struct sigaction act, oact;
 
         act.sa_handler = functionHandler;
         sigemptyset(&act.sa_mask);
-        act.sa_flags = 0;
-        if (signo == SIGUSR1)
-                act.sa_flags |= SA_INTERRUPT;
-        else
-                act.sa_flags |= SA_RESTART;
+        act.sa_flags = SA_RESTART;
         if (sigaction(signo,&act,&oact) < 0)
                 return SIG_ERR;
         return oact.sa_handler;
 }
 
-PUBLIC void sendSignal(const pthread_t tid)
-{
-    /*
-     * Send 'SIGUSR1' signal to thread 'tid'
-     * This is used to wake up the main thread
-     * and check for conflicts
-     */
-        pthread_kill(tid,SIGUSR1);
-}
-
 PRIVATE void ignoreSignal(int signo)
 {
     /*
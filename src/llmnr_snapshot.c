@@ -0,0 +1,243 @@
+/* Macros */
+#define MAXREADERS 256
+#define CACHELINE 64
+
+/* Includes */
+#include <sched.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <pthread.h>
+#include <netinet/in.h>
+
+/* Own includes */
+#include "../include/llmnr_defs.h"
+#include "../include/llmnr_ifset.h"
+#include "../include/llmnr_names.h"
+#include "../include/llmnr_net_interface.h"
+#include "../include/llmnr_rr.h"
+#include "../include/llmnr_print.h"
+#include "../include/llmnr_registry.h"
+#include "../include/llmnr_query_filter.h"
+#include "../include/llmnr_snapshot.h"
+
+/* Enums & Structs */
+
+/*
+ * A reader slot (one per thread that reads snapshots). 'epoch'
+ * is the epoch seen when the thread entered his read section
+ * (0 out of it). Padded so readers don't share cache lines
+ */
+typedef struct {
+        long epoch;
+        int used;
+        char pad[CACHELINE - sizeof(long) - sizeof(int)];
+} READER;
+
+/* Private prototypes */
+PRIVATE READER *getReader();
+PRIVATE void releaseReader(void *reader);
+PRIVATE void createReaderKey();
+PRIVATE void reclaimSnapshots();
+PRIVATE void freeSnapshot(SNAPSHOT *snap);
+
+/* Glocal variables */
+PRIVATE long Epoch = 1;
+PRIVATE long Published;
+PRIVATE long Reclaimed;
+PRIVATE SNAPSHOT *Current;
+PRIVATE SNAPSHOT *Retired;
+PRIVATE READER Readers[MAXREADERS];
+PRIVATE pthread_key_t ReaderKey;
+PRIVATE pthread_once_t ReaderKeyOnce = PTHREAD_ONCE_INIT;
+PRIVATE pthread_mutex_t WriterMutex = PTHREAD_MUTEX_INITIALIZER;
+PRIVATE __thread READER *MyReader;
+
+/* Functions definitions */
+PUBLIC int publishSnapshot(NAME *names, NETIFACE *ifaces, RRLIST *rList,
+                           REGISTRY *registry)
+{
+    /*
+     * - Copy the master lists into a new snapshot
+     * - Make it the current one (readers entering from now on
+     *   will see it)
+     * - Retire the old one with the new epoch: it can only be
+     *   freed when no reader is in a read section entered
+     *   before this epoch
+     * If the copy fails the current snapshot is kept
+     */
+        SNAPSHOT *snap, *old;
+
+        snap = calloc(1,sizeof(SNAPSHOT));
+        if (snap == NULL)
+                return FAILURE;
+        snap->names = copyNameList(names);
+        snap->nameIndex = newNameIndex(snap->names);
+        snap->ifaces = copyNetIfList(ifaces);
+        snap->ifTable = newIfTable(snap->ifaces);
+        snap->qFilter = newQueryFilter(snap->names,snap->ifaces,registry);
+        snap->rList = rList;
+        snap->registry = holdRegistry(registry);
+        if ((names != NULL && snap->names == NULL) ||
+            snap->nameIndex == NULL || snap->ifTable == NULL ||
+            snap->qFilter == NULL ||
+            (ifaces != NULL && snap->ifaces == NULL)) {
+                freeSnapshot(snap);
+                return FAILURE;
+        }
+        pthread_mutex_lock(&WriterMutex);
+        old = __atomic_exchange_n(&Current,snap,__ATOMIC_SEQ_CST);
+        if (old != NULL) {
+                old->epoch = __atomic_add_fetch(&Epoch,1,__ATOMIC_SEQ_CST);
+                old->next = Retired;
+                Retired = old;
+        }
+        Published++;
+        reclaimSnapshots();
+        pthread_mutex_unlock(&WriterMutex);
+        return SUCCESS;
+}
+
+PUBLIC SNAPSHOT *enterSnapshot()
+{
+    /*
+     * Enter a read section and return the current snapshot
+     * (NULL if none was published yet). The snapshot stays
+     * valid until exitSnapshot() is called. Read sections
+     * can't be nested
+     */
+        if (MyReader == NULL)
+                MyReader = getReader();
+        __atomic_store_n(&MyReader->epoch,
+                         __atomic_load_n(&Epoch,__ATOMIC_SEQ_CST),
+                         __ATOMIC_SEQ_CST);
+        return __atomic_load_n(&Current,__ATOMIC_SEQ_CST);
+}
+
+PUBLIC void exitSnapshot()
+{
+        if (MyReader != NULL)
+                __atomic_store_n(&MyReader->epoch,0,__ATOMIC_RELEASE);
+}
+
+PUBLIC void freeSnapshots()
+{
+    /*
+     * Free every snapshot. Called on exit, once the
+     * readers are gone
+     */
+        SNAPSHOT *next;
+
+        pthread_mutex_lock(&WriterMutex);
+        if (Current != NULL)
+                freeSnapshot(Current);
+        Current = NULL;
+        for (; Retired != NULL; Retired = next) {
+                next = Retired->next;
+                freeSnapshot(Retired);
+        }
+        pthread_mutex_unlock(&WriterMutex);
+}
+
+PUBLIC void printSnapshotStats()
+{
+        int pending;
+        SNAPSHOT *current;
+
+        pending = 0;
+        pthread_mutex_lock(&WriterMutex);
+        for (current = Retired; current != NULL; current = current->next)
+                pending++;
+        printToStream("Snapshots: %ld published, %ld reclaimed, %d pending. "
+                      "Epoch %ld\n",Published,Reclaimed,pending,
+                      __atomic_load_n(&Epoch,__ATOMIC_RELAXED));
+        pthread_mutex_unlock(&WriterMutex);
+}
+
+PRIVATE READER *getReader()
+{
+    /*
+     * Take a free reader slot for the calling thread (it is
+     * given back when the thread exits). If every slot is
+     * taken wait for one
+     */
+        int i, unused;
+
+        pthread_once(&ReaderKeyOnce,createReaderKey);
+        for (;;) {
+                for (i = 0; i < MAXREADERS; i++) {
+                        unused = 0;
+                        if (__atomic_compare_exchange_n(&Readers[i].used,
+                                                        &unused,1,0,
+                                                        __ATOMIC_ACQUIRE,
+                                                        __ATOMIC_RELAXED)) {
+                                pthread_setspecific(ReaderKey,&Readers[i]);
+                                return &Readers[i];
+                        }
+                }
+                sched_yield();
+        }
+        return NULL;
+}
+
+PRIVATE void releaseReader(void *reader)
+{
+    /*
+     * Thread exit: give back his reader slot
+     */
+        READER *myReader;
+
+        myReader = (READER *)reader;
+        __atomic_store_n(&myReader->epoch,0,__ATOMIC_RELEASE);
+        __atomic_store_n(&myReader->used,0,__ATOMIC_RELEASE);
+}
+
+PRIVATE void createReaderKey()
+{
+        pthread_key_create(&ReaderKey,releaseReader);
+}
+
+PRIVATE void reclaimSnapshots()
+{
+    /*
+     * Free the retired snapshots that no reader can be using:
+     * the ones retired on an epoch older or equal than the
+     * oldest epoch of the readers in a read section
+     * Note: 'WriterMutex' must be held
+     */
+        int i;
+        long minEpoch, epoch;
+        SNAPSHOT **ptr, *dispose;
+
+        minEpoch = LONG_MAX;
+        for (i = 0; i < MAXREADERS; i++) {
+                epoch = __atomic_load_n(&Readers[i].epoch,__ATOMIC_SEQ_CST);
+                if (epoch != 0 && epoch < minEpoch)
+                        minEpoch = epoch;
+        }
+        ptr = &Retired;
+        while (*ptr != NULL) {
+                if ((*ptr)->epoch > minEpoch) {
+                        ptr = &(*ptr)->next;
+                        continue;
+                }
+                dispose = *ptr;
+                *ptr = dispose->next;
+                freeSnapshot(dispose);
+                Reclaimed++;
+        }
+}
+
+PRIVATE void freeSnapshot(SNAPSHOT *snap)
+{
+    /*
+     * 'rList' belongs to the master lists. 'registry' is just
+     * one reference less
+     */
+        delNameIndex(&snap->nameIndex);
+        delIfTable(&snap->ifTable);
+        delQueryFilter(&snap->qFilter);
+        dropRegistry(&snap->registry);
+        deleteNameList(&snap->names);
+        delNetIfList(&snap->ifaces);
+        free(snap);
+}
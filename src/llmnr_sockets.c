@@ -1,23 +1,36 @@
 /* Macros */
-#define BACKLOG 5
 #define _GNU_SOURCE
+#ifndef IPV6_MULTICAST_ALL
+#define IPV6_MULTICAST_ALL 29
+#endif
+#ifndef SO_BINDTOIFINDEX
+#define SO_BINDTOIFINDEX 62
+#endif
+#define NLRCVBUF (1 << 20)
 
 /* Includes */
 #include <poll.h>
 #include <string.h>
 #include <unistd.h>
+#include <net/if.h>
 #include <netinet/in.h>
 #include <linux/rtnetlink.h>
 
 /* Own includes */
 #include "../include/llmnr_defs.h"
+#include "../include/llmnr_ifset.h"
 #include "../include/llmnr_utils.h"
 #include "../include/llmnr_net_interface.h"
+#include "../include/llmnr_names.h"
+#include "../include/llmnr_registry.h"
+#include "../include/llmnr_kernel_filter.h"
 #include "../include/llmnr_sockets.h"
 
 /* Enums & Structs */
 
 /* Private prototypes */
+PRIVATE int _createUdpSocket(int family, int shard, int unicast);
+PRIVATE int checkDst(int family, void *dst, void *local);
 PRIVATE int addMembership(int fd, int fam, int ifIndex, INADDR *addr);
 PRIVATE int dropMembership(int fd, int fam, int ifIndex, INADDR *addr);
 
@@ -29,31 +42,39 @@ PRIVATE IN6ADDR MCAST6;
 PUBLIC int createNetLinkSocket()
 {
     /*
-     * Creates a Netlink socket and sucribe to 'RTMGRP_IPV4_IFADDR'
-     * and 'RTMGRP_IPV6_IFADDR' "multicast" groups. Through this im
-     * allowed to know changes on network interfaces
+     * Creates a Netlink socket and sucribe to 'RTMGRP_LINK',
+     * 'RTMGRP_IPV4_IFADDR' and 'RTMGRP_IPV6_IFADDR' "multicast"
+     * groups. Through this im allowed to know changes on network
+     * interfaces (See llmnr_netlink.h). The receive buffer is
+     * big enough to hold the burst of a lot of interfaces going
+     * up at once (SO_RCVBUFFORCE ignores 'rmem_max', if not
+     * allowed 'rmem_max' is the limit)
      */
-        int newFd;
+        int newFd, size;
         struct sockaddr_nl bindNl;
 
         newFd = 0;
         memset(&bindNl,0,sizeof(bindNl));
         bindNl.nl_family = AF_NETLINK;
         bindNl.nl_pid = getpid();
-        bindNl.nl_groups = RTMGRP_IPV4_IFADDR |
+        bindNl.nl_groups = RTMGRP_LINK |
+                           RTMGRP_IPV4_IFADDR |
                            RTMGRP_IPV6_IFADDR;
-        /* RTMGRP_LINK Future reference (maybe) */
 
-        newFd = socket(AF_NETLINK,SOCK_RAW,NETLINK_ROUTE);
+        newFd = socket(AF_NETLINK,SOCK_RAW | SOCK_CLOEXEC,NETLINK_ROUTE);
         if (newFd < 0)
                 return FAILURE;
+        size = NLRCVBUF;
+        if (setsockopt(newFd,SOL_SOCKET,SO_RCVBUFFORCE,&size,sizeof(size)))
+                setsockopt(newFd,SOL_SOCKET,SO_RCVBUF,&size,sizeof(size));
         if (bind(newFd,(SA *)&bindNl,sizeof(bindNl)) < 0) {
+                close(newFd);
                 return FAILURE;
         }
         return newFd;
 }
 
-PUBLIC int createUdpSocket(int family)
+PUBLIC int createUdpSocket(int family, int unicast)
 {
     /*
      * Creates main udp socket for listening petitions (IPv4 & IPv6)
@@ -63,12 +84,36 @@ PUBLIC int createUdpSocket(int family)
      * - IPV6_V6ONLY
      * - IP_TTL
      * - IPV6_UNICAST_HOPS
+     * With 'unicast' the socket joins no group: IP_MULTICAST_ALL
+     * (IPV6_MULTICAST_ALL) is disabled and 'SO_REUSEADDR' set, so
+     * it shares the port with the sockets of the interfaces (See
+     * createIfaceSocket()) and only gets the unicast queries
+     * The kernel filter is attached (See llmnr_kernel_filter.h)
+     */
+        return _createUdpSocket(family,FALSE,unicast);
+}
+
+PUBLIC int createShardSocket(int family, int unicast)
+{
+    /*
+     * Same thing that createUdpSocket() but the socket joins the
+     * 'SO_REUSEPORT' group of 'LLMNRPORT' (every shard has one).
+     * IP_MULTICAST_ALL (IPV6_MULTICAST_ALL) is disabled, so the
+     * socket only receives the multicast queries of the
+     * interfaces it joined by itself (See joinMcastGroup()), or
+     * none with 'unicast'
      */
+        return _createUdpSocket(family,TRUE,unicast);
+}
+
+PRIVATE int _createUdpSocket(int family, int shard, int unicast)
+{
         SA_IN bind4;
         SA_IN6 bind6;
-        int fd, yes, res;
+        int fd, yes, no, res;
 
         fd = 0;
+        no = 0;
         if (family == AF_INET) {
                 memset(&bind4,0,sizeof(bind4));
                 fd = socket(AF_INET,SOCK_DGRAM,IPPROTO_UDP);
@@ -78,11 +123,25 @@ PUBLIC int createUdpSocket(int family)
                 res = setsockopt(fd,IPPROTO_IP,IP_PKTINFO,&yes,sizeof(yes));
                 if (res < 0)
                         return FAILURE;
+                if (shard) {
+                        if (setsockopt(fd,SOL_SOCKET,SO_REUSEPORT,&yes,
+                                       sizeof(yes))) {
+                                close(fd);
+                                return FAILURE;
+                        }
+                }
+                if (shard || unicast)
+                        setsockopt(fd,IPPROTO_IP,IP_MULTICAST_ALL,&no,
+                                   sizeof(no));
+                if (unicast)
+                        setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&yes,
+                                   sizeof(yes));
                 yes = 0xFF;
                 setsockopt(fd,IPPROTO_IP,IP_TTL,&yes,sizeof(yes));
                 bind4.sin_family = AF_INET;
                 bind4.sin_port = htons(LLMNRPORT);
                 bind4.sin_addr.s_addr = INADDR_ANY;
+                attachKernelFilter(fd);
                 res = bind(fd,(SA *)&bind4,sizeof(bind4));
                 if (res < 0)
                         return FAILURE;
@@ -98,12 +157,26 @@ PUBLIC int createUdpSocket(int family)
                                  sizeof(yes));
                 if (res < 0)
                         return FAILURE;
+                if (shard) {
+                        if (setsockopt(fd,SOL_SOCKET,SO_REUSEPORT,&yes,
+                                       sizeof(yes))) {
+                                close(fd);
+                                return FAILURE;
+                        }
+                }
+                if (shard || unicast)
+                        setsockopt(fd,IPPROTO_IPV6,IPV6_MULTICAST_ALL,&no,
+                                   sizeof(no));
+                if (unicast)
+                        setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&yes,
+                                   sizeof(yes));
                 setsockopt(fd,IPPROTO_IPV6,IPV6_V6ONLY,&yes,sizeof(yes));
                 yes = 0xFF;
                 setsockopt(fd,IPPROTO_IPV6,IPV6_UNICAST_HOPS,&yes,sizeof(yes));
                 bind6.sin6_family = AF_INET6;
                 bind6.sin6_port = htons(LLMNRPORT);
                 bind6.sin6_addr = in6addr_any;
+                attachKernelFilter(fd);
                 res = bind(fd,(SA *)&bind6,sizeof(bind6));
                 if (res < 0)
                         return FAILURE;
@@ -111,12 +184,93 @@ PUBLIC int createUdpSocket(int family)
         return fd;
 }
 
-PUBLIC int createTcpSock()
+PUBLIC int createIfaceSocket(int family, int ifIndex)
+{
+    /*
+     * Creates an UDP socket that only receives the LLMNR multicast
+     * queries of interface 'ifIndex' (See llmnr_iface_socks.h):
+     * - Bound to the device (SO_BINDTOIFINDEX, or SO_BINDTODEVICE
+     *   on older kernels) and to the multicast address itself
+     *   (224.0.0.252 or FF02::1:3), so no ancillary data is
+     *   needed. Unicast queries go to the socket of the family
+     *   (See createUdpSocket()), 'SO_REUSEADDR' lets both share
+     *   the port
+     * - IP_MULTICAST_ALL (IPV6_MULTICAST_ALL) disabled, the only
+     *   membership is his own, joined by interface index
+     * The kernel filter is attached (See llmnr_kernel_filter.h)
+     */
+        SA_IN bind4;
+        SA_IN6 bind6;
+        int fd, no, yes, hops, res;
+        char name[IFNAMSIZ];
+        struct ip_mreqn mreq;
+        struct ipv6_mreq mreq6;
+
+        no = 0;
+        yes = 1;
+        hops = 0xFF;
+        fd = socket(family,SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    IPPROTO_UDP);
+        if (fd < 0)
+                return FAILURE;
+        setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&yes,sizeof(yes));
+        if (setsockopt(fd,SOL_SOCKET,SO_BINDTOIFINDEX,&ifIndex,
+                       sizeof(ifIndex))) {
+                if (if_indextoname(ifIndex,name) == NULL ||
+                    setsockopt(fd,SOL_SOCKET,SO_BINDTODEVICE,name,
+                               strlen(name) + 1))
+                        goto CleanCIS;
+        }
+        attachKernelFilter(fd);
+        if (family == AF_INET) {
+                setsockopt(fd,IPPROTO_IP,IP_MULTICAST_ALL,&no,sizeof(no));
+                setsockopt(fd,IPPROTO_IP,IP_TTL,&hops,sizeof(hops));
+                memset(&bind4,0,sizeof(bind4));
+                bind4.sin_family = AF_INET;
+                bind4.sin_port = htons(LLMNRPORT);
+                memcpy(&bind4.sin_addr,&MCAST4,sizeof(INADDR));
+                if (bind(fd,(SA *)&bind4,sizeof(bind4)) < 0)
+                        goto CleanCIS;
+                memset(&mreq,0,sizeof(mreq));
+                memcpy(&mreq.imr_multiaddr,&MCAST4,sizeof(INADDR));
+                mreq.imr_ifindex = ifIndex;
+                res = setsockopt(fd,IPPROTO_IP,IP_ADD_MEMBERSHIP,&mreq,
+                                 sizeof(mreq));
+        } else {
+                setsockopt(fd,IPPROTO_IPV6,IPV6_MULTICAST_ALL,&no,sizeof(no));
+                setsockopt(fd,IPPROTO_IPV6,IPV6_UNICAST_HOPS,&hops,
+                           sizeof(hops));
+                hops = 1;
+                setsockopt(fd,IPPROTO_IPV6,IPV6_V6ONLY,&hops,sizeof(hops));
+                memset(&bind6,0,sizeof(bind6));
+                bind6.sin6_family = AF_INET6;
+                bind6.sin6_port = htons(LLMNRPORT);
+                bind6.sin6_scope_id = ifIndex;
+                memcpy(&bind6.sin6_addr,&MCAST6,sizeof(IN6ADDR));
+                if (bind(fd,(SA *)&bind6,sizeof(bind6)) < 0)
+                        goto CleanCIS;
+                memset(&mreq6,0,sizeof(mreq6));
+                memcpy(&mreq6.ipv6mr_multiaddr,&MCAST6,sizeof(IN6ADDR));
+                mreq6.ipv6mr_interface = ifIndex;
+                res = setsockopt(fd,IPPROTO_IPV6,IPV6_ADD_MEMBERSHIP,&mreq6,
+                                 sizeof(mreq6));
+        }
+        if (res < 0)
+                goto CleanCIS;
+        return fd;
+
+        CleanCIS:
+        close(fd);
+        return FAILURE;
+}
+
+PUBLIC int createTcpSock(int backlog)
 {
     /*
      * Creates listening TCP scoket. RFC 4795 stays that
      * a responder must listen on both protocols (UDP and TCP)
-     * This creates one dual-stack socket
+     * This creates one dual-stack, non-blocking socket (See
+     * llmnr_tcp.h)
      */
         SA_IN6 bind6;
         int newFd, no, yes;
@@ -130,7 +284,8 @@ PUBLIC int createTcpSock()
         bind6.sin6_port = htons(LLMNRPORT);
         bind6.sin6_addr = in6addr_any;
 
-        newFd = socket(AF_INET6,SOCK_STREAM,IPPROTO_TCP);
+        newFd = socket(AF_INET6,SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                       IPPROTO_TCP);
         if (newFd < 0)
                 return FAILURE;
         if (setsockopt(newFd,IPPROTO_IPV6,IPV6_V6ONLY,&no,sizeof(no)) < 0) {
@@ -143,29 +298,33 @@ PUBLIC int createTcpSock()
                 close(newFd);
                 return FAILURE;
         }
-        listen(newFd,BACKLOG);
+        if (listen(newFd,backlog) < 0) {
+                close(newFd);
+                return FAILURE;
+        }
         return newFd;
 }
 
-PUBLIC int createC4Sock(INADDR *ip)
+PUBLIC int createC4Sock(int ifIndex)
 {
     /*
      * Creates an IPv4 socket for sending multicast (to 224.0.0.252)
-     * packets. This sockets is used when resolving conflicts
+     * packets through 'ifIndex'. This socket is used when
+     * resolving conflicts, by every probe of the interface (See
+     * llmnr_conflict.h). The interface is given by index so the
+     * socket outlives the changes of his addresses
      * IP_MUlTICAST_LOOP disabled.
      */
         int fd;
         SA_IN bindd;
-        INADDR ipv4;
         unsigned int on;
+        struct ip_mreqn mreq;
 
-        if (ip == NULL)
-                return FAILURE;
-        fd = socket(AF_INET,SOCK_DGRAM,IPPROTO_UDP);
+        fd = socket(AF_INET,SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    IPPROTO_UDP);
         if (fd < 0)
                 return FAILURE;
         on = 0;
-        memcpy(&ipv4,ip,sizeof(INADDR));
         setsockopt(fd,IPPROTO_IP,IP_MULTICAST_LOOP,(void *)&on,
                        sizeof(unsigned int));
         on = 1;
@@ -184,8 +343,10 @@ PUBLIC int createC4Sock(INADDR *ip)
                 close(fd);
                 return FAILURE;
         }
-        if (setsockopt(fd,IPPROTO_IP,IP_MULTICAST_IF,(void *)&ipv4,
-                       sizeof(INADDR))) {
+        memset(&mreq,0,sizeof(mreq));
+        mreq.imr_ifindex = ifIndex;
+        if (setsockopt(fd,IPPROTO_IP,IP_MULTICAST_IF,(void *)&mreq,
+                       sizeof(mreq))) {
                 close(fd);
                 return FAILURE;
         }
@@ -201,7 +362,8 @@ PUBLIC int createC6Sock(int ifIndex)
         SA_IN6 bindd;
         unsigned int on;
 
-        fd = socket(AF_INET6,SOCK_DGRAM,IPPROTO_UDP);
+        fd = socket(AF_INET6,SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                    IPPROTO_UDP);
         if (fd < 0)
                 return FAILURE;
         on = 0;
@@ -213,8 +375,10 @@ PUBLIC int createC6Sock(int ifIndex)
         setsockopt(fd,IPPROTO_IPV6,IPV6_V6ONLY,(void *)&on,
                    sizeof(unsigned int));
         if (setsockopt(fd,IPPROTO_IPV6,IPV6_RECVPKTINFO,(void *)&on,
-                       sizeof(unsigned int)))
+                       sizeof(unsigned int))) {
+                close(fd);
                 return FAILURE;
+        }
         memset(&bindd,0,sizeof(bindd));
         bindd.sin6_family = AF_INET6;
         bindd.sin6_port = 0;
@@ -223,21 +387,21 @@ PUBLIC int createC6Sock(int ifIndex)
                 return FAILURE;
         }
         if (setsockopt(fd,IPPROTO_IPV6,IPV6_MULTICAST_IF,(void *)&ifIndex,
-                       sizeof(unsigned int))) {
+                       sizeof(int))) {
                 close(fd);
                 return FAILURE;
         }
         return fd;
 }
 
-PUBLIC void joinMcastGroup(POLLFD *polling, NETIFACE *iface)
+PUBLIC void joinMcastGroup(int sock4, int sock6, NETIFACE *iface)
 {
     /*
      * Given an interface ('NETIFACE') this function will join
      * that interface to the LLMNR multicast groups (224.0.0.252
      * and FF02::1:3)
-     * Note: polling[0].fd holds the IPv4 UDP main socket
-     * Note2: polling[1].fd holds the IPv6 UDP main socket
+     * Note: sock4 is the IPv4 UDP main socket
+     * Note2: sock6 is the IPv6 UDP main socket
      */
         INADDR *ip4;
 
@@ -247,34 +411,35 @@ PUBLIC void joinMcastGroup(POLLFD *polling, NETIFACE *iface)
         if (iface->flags & _IFF_INET) {
                 if (!(iface->flags & _IFF_MCAST4)) {
                         ip4 = getFirstValidAddr(iface);
-                        if (!addMembership(polling[0].fd,AF_INET,0,ip4))
+                        if (!addMembership(sock4,AF_INET,0,ip4))
                                 iface->flags |= _IFF_MCAST4;
                 }
         }
         if (iface->flags & _IFF_INET6) {
                 if (!(iface->flags & _IFF_MCAST6)) {
-                        if (!addMembership(polling[1].fd,AF_INET6,
+                        if (!addMembership(sock6,AF_INET6,
                                      iface->ifIndex,NULL))
                                 iface->flags |= _IFF_MCAST6;
                 }
         }
 }
 
-PUBLIC void leaveMcastGroup(POLLFD *polling, NETIFACE *iface, INADDR *copy)
+PUBLIC void leaveMcastGroup(int sock4, int sock6, NETIFACE *iface,
+                            INADDR *copy)
 {
     /*
      * Same thing that joinMcastGroup() but this time with leaving
      */
         if (!(iface->flags & _IFF_INET)) {
                 if (iface->flags & _IFF_MCAST4) {
-                        if (!dropMembership(polling[0].fd,AF_INET,0,copy))
+                        if (!dropMembership(sock4,AF_INET,0,copy))
                                 iface->flags &= ~_IFF_MCAST4;
 
                 }
         }
         if (!(iface->flags & _IFF_INET6)) {
                 if (iface->flags & _IFF_MCAST6) {
-                        if (!dropMembership(polling[1].fd,AF_INET6,
+                        if (!dropMembership(sock6,AF_INET6,
                                            iface->ifIndex,NULL))
                                 iface->flags &= ~_IFF_MCAST6;
                 }
@@ -352,8 +517,7 @@ PUBLIC int getPktInfo(int family, struct msghdr *msg, UDPCLIENT *client)
      * Get some extra info about a received packet. This extra info
      * includes:
      * - Know the interface number from where it came the packet
-     * - Know the destiny ip address of the packet (If a query
-     *   is sent to a no multicast address it must be discarded)
+     * - Know the destiny ip address of the packet (See checkDst())
      * - Ancillary data is used (see recvmsg() socket api)
      */
         SA_IN6 *ip6;
@@ -366,8 +530,8 @@ PUBLIC int getPktInfo(int family, struct msghdr *msg, UDPCLIENT *client)
                         client->pktinfo4 = (struct in_pktinfo *) CMSG_DATA(cmsgPtr);
                         client->recviface = client->pktinfo4->ipi_ifindex;
                         client->iptype = IPV4IP;
-                        return isMulticast(&client->pktinfo4->ipi_addr,
-                                              &MCAST4,AF_INET);
+                        return checkDst(AF_INET,&client->pktinfo4->ipi_addr,
+                                        &client->pktinfo4->ipi_spec_dst);
 
                 } else if (family == AF_INET6
                            && cmsgPtr->cmsg_level == IPPROTO_IPV6
@@ -376,13 +540,107 @@ PUBLIC int getPktInfo(int family, struct msghdr *msg, UDPCLIENT *client)
                         client->recviface = client->pktinfo6->ipi6_ifindex;
                         ip6 = (SA_IN6 *)&client->from;
                         client->iptype = ip6Type(&ip6->sin6_addr);
-                        return isMulticast(&client->pktinfo6->ipi6_addr,&MCAST6,
-                                           AF_INET6);
+                        return checkDst(AF_INET6,&client->pktinfo6->ipi6_addr,
+                                        NULL);
                 }
         }
         return FAILURE;
 }
 
+PRIVATE int checkDst(int family, void *dst, void *local)
+{
+    /*
+     * A query is taken if sent to the LLMNR multicast address or
+     * to one of our unicast addresses (the conflict notices of
+     * RFC 4795 4.2 come that way). Any other group and the IPv4
+     * broadcasts are discarded: the kernel hands those with a
+     * 'local' address (ipi_spec_dst) other than the destiny
+     */
+        if (family == AF_INET) {
+                if (!isMulticast(dst,&MCAST4,AF_INET))
+                        return SUCCESS;
+                if (IN_MULTICAST(ntohl(((INADDR *)dst)->s_addr)))
+                        return FAILURE;
+                return memcmp(dst,local,sizeof(INADDR)) ? FAILURE : SUCCESS;
+        }
+        if (!isMulticast(dst,&MCAST6,AF_INET6))
+                return SUCCESS;
+        return IN6_IS_ADDR_MULTICAST((IN6ADDR *)dst) ? FAILURE : SUCCESS;
+}
+
+PUBLIC int recvUdpBatch(int fd, UDPCLIENT **clients, int count, int ifIndex)
+{
+    /*
+     * Receive up to 'count' datagrams with a single recvmmsg().
+     * Every message points to the buffers of his own client slot
+     * (data, peer address and ancillary data), so getPktInfo()
+     * resolves the receiving interface of each packet. The
+     * sockets of an interface ('ifIndex' > 0, See
+     * createIfaceSocket()) get no ancillary data: the interface
+     * is 'ifIndex' and the destination the multicast address
+     * Returns how many of the first 'clients' were filled. A
+     * filled client with 'rcvSz' 0 holds an invalid packet
+     * (too short or sent to an address we don't answer)
+     */
+        int i, rcved;
+        SA_IN6 *ip6;
+        UDPCLIENT *client;
+        struct iovec iov[MAXRCVBATCH];
+        struct mmsghdr msgs[MAXRCVBATCH];
+
+        if (count > MAXRCVBATCH)
+                count = MAXRCVBATCH;
+        for (i = 0; i < count; i++) {
+                client = clients[i];
+                iov[i].iov_base = client->rcvBuffer;
+                iov[i].iov_len = RCVBUFSZ;
+                msgs[i].msg_hdr.msg_name = &client->from;
+                msgs[i].msg_hdr.msg_namelen = sizeof(SA_STORAGE);
+                msgs[i].msg_hdr.msg_iov = &iov[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+                msgs[i].msg_hdr.msg_control = NULL;
+                msgs[i].msg_hdr.msg_controllen = 0;
+                if (ifIndex <= 0) {
+                        msgs[i].msg_hdr.msg_control = client->ancBuffer;
+                        msgs[i].msg_hdr.msg_controllen = ANCBUFSZ;
+                }
+                msgs[i].msg_hdr.msg_flags = 0;
+                msgs[i].msg_len = 0;
+        }
+        rcved = recvmmsg(fd,msgs,count,MSG_DONTWAIT,NULL);
+        if (rcved <= 0)
+                return 0;
+        for (i = 0; i < rcved; i++) {
+                client = clients[i];
+                client->rcvSz = msgs[i].msg_len;
+                client->socket = fd;
+                client->pktinfo4 = NULL;
+                client->pktinfo6 = NULL;
+                if (client->rcvSz < QUESTMINSZ) {
+                        client->rcvSz = 0;
+                        continue;
+                }
+                /*
+                 * Slots are reused, wipe whatever the previous query
+                 * left behind the received bytes
+                 */
+                memset(client->rcvBuffer + client->rcvSz,0,
+                       RCVBUFSZ - client->rcvSz);
+                if (ifIndex > 0) {
+                        client->recviface = ifIndex;
+                        client->iptype = IPV4IP;
+                        ip6 = (SA_IN6 *)&client->from;
+                        if (client->from.ss_family == AF_INET6)
+                                client->iptype = ip6Type(&ip6->sin6_addr);
+                        continue;
+                }
+                if (getPktInfo(client->from.ss_family,&msgs[i].msg_hdr,
+                               client))
+                        client->rcvSz = 0;
+        }
+        return rcved;
+}
+
 PUBLIC int __getPktInfo(int family, void *ip, struct msghdr *msg)
 {
     /*
@@ -417,45 +675,28 @@ PUBLIC int __getPktInfo(int family, void *ip, struct msghdr *msg)
         return ifIndex;
 }
 
-PUBLIC void getTcpPktInfo(SA_IN6 *name, TCPCLIENT *client, NETIFACE *ifaces)
+PUBLIC void getTcpPktInfo(SA_IN6 *name, TCPCLIENT *client)
 {
     /*
      * Same thing that getPktInfo(). Ancillary data isn't available
      * in TCP sockets. Instead used getsockname() to know the destiny
      * ip address. With the destiny ip we obtain the interface that
-     * received the packet (Looking a match through the 'NETIFACE'list)
+     * received the packet (one lookup in the local addresses set,
+     * See llmnr_net_interface.h)
      * Note: The TCP socket is a dual-stack socket (Works with IPv6 & IPv4)
      */
-        INADDR *ip4;
-        IN6ADDR *ip6;
-        NETIFACE *current;
+        LOCALADDR *local;
 
-        current = ifaces;
         if (name->sin6_addr.s6_addr[0] == 0 &&
             name->sin6_addr.s6_addr[10] == 0xFF &&
-            name->sin6_addr.s6_addr[11] == 0xFF) {
-
-                ip4 = (INADDR *) ((name->sin6_addr.s6_addr) + 12);
-                for (; current != NULL; current = current->next) {
-                        if (current->flags & _IFF_NOIF)
-                                continue;
-                        if (getNetIfIpv4Node(current,ip4) != NULL) {
-                                client->recvIface = current->ifIndex;
-                                client->ipType = IPV4IP;
-                                break;
-                        }
-                }
-        } else {
-                ip6 = &name->sin6_addr;
-                for (; current != NULL; current = current->next) {
-                        if (current->flags & _IFF_NOIF)
-                                continue;
-                        if (getNetIfIpv6Node(current,ip6) != NULL) {
-                                client->recvIface = current->ifIndex;
-                                client->ipType = ip6Type(ip6);
-                        }
-                }
-        }
+            name->sin6_addr.s6_addr[11] == 0xFF)
+                local = getLocalAddr(AF_INET,name->sin6_addr.s6_addr + 12,0);
+        else
+                local = getLocalAddr(AF_INET6,&name->sin6_addr,0);
+        if (local == NULL)
+                return;
+        client->recvIface = local->ifIndex;
+        client->ipType = local->ipType;
 }
 
 PUBLIC void fillMcastVars()
@@ -0,0 +1,97 @@
+/* Macros */
+
+/* Includes */
+
+/* Own includes */
+#include "../include/llmnr_defs.h"
+#include "../include/llmnr_print.h"
+#include "../include/llmnr_stats.h"
+
+/* Enums & Structs */
+
+/* Private prototypes */
+
+/* Glocal variables */
+PRIVATE long Stats[STATSZ];
+PRIVATE const char *StatsNames[STATSZ] = {
+        "UDP queries received",
+        "UDP receive batches (recvmmsg)",
+        "UDP queries queued",
+        "UDP queries dropped (queue full)",
+        "UDP queue depth high-water mark",
+        "UDP answers sent",
+        "UDP send batches (sendmmsg)",
+        "UDP answers delayed (jitter)",
+        "Answer cache hits",
+        "Answer cache misses",
+        "UDP queries dropped (unknown interface)",
+        "UDP queries dropped (not a standard query)",
+        "UDP queries dropped (malformed QNAME)",
+        "UDP queries dropped (not our name)",
+        "TCP connections accepted",
+        "TCP connections refused",
+        "TCP queries",
+        "TCP connections timed out",
+        "Queries with an OPT record (EDNS0)",
+        "UDP truncations avoided (EDNS0)",
+        "UDP answers truncated",
+        "TCP fallbacks after a truncated answer",
+        "Netlink notifications read",
+        "Netlink batches applied",
+        "Netlink resyncs (notifications lost)",
+        "Queries for hosted names",
+};
+
+/* Functions definitions */
+PUBLIC void incStat(int stat)
+{
+        __atomic_fetch_add(&Stats[stat],1,__ATOMIC_RELAXED);
+}
+
+PUBLIC void addStat(int stat, long value)
+{
+        __atomic_fetch_add(&Stats[stat],value,__ATOMIC_RELAXED);
+}
+
+PUBLIC void maxStat(int stat, long value)
+{
+    /*
+     * Keep in 'stat' the biggest value ever seen (gauges
+     * like the queue depth high-water mark)
+     */
+        long current;
+
+        current = __atomic_load_n(&Stats[stat],__ATOMIC_RELAXED);
+        while (value > current) {
+                if (__atomic_compare_exchange_n(&Stats[stat],&current,value,
+                                                1,__ATOMIC_RELAXED,
+                                                __ATOMIC_RELAXED))
+                        break;
+        }
+}
+
+PUBLIC long getStat(int stat)
+{
+        return __atomic_load_n(&Stats[stat],__ATOMIC_RELAXED);
+}
+
+PUBLIC void printStats()
+{
+        int i;
+
+        for (i = 0; i < STATSZ; i++)
+                printToStream("%s: %ld\n",StatsNames[i],getStat(i));
+        if (getStat(STAT_UDPBATCHES) > 0)
+                printToStream("UDP average batch fill: %.2f\n",
+                              (double)getStat(STAT_UDPRCVD) /
+                              getStat(STAT_UDPBATCHES));
+        if (getStat(STAT_UDPSNDBATCHES) > 0)
+                printToStream("UDP average send batch fill: %.2f\n",
+                              (double)getStat(STAT_UDPSENT) /
+                              getStat(STAT_UDPSNDBATCHES));
+        if (getStat(STAT_CACHEHITS) + getStat(STAT_CACHEMISSES) > 0)
+                printToStream("Answer cache hit ratio: %.2f\n",
+                              (double)getStat(STAT_CACHEHITS) /
+                              (getStat(STAT_CACHEHITS) +
+                               getStat(STAT_CACHEMISSES)));
+}
@@ -34,10 +34,11 @@ PRIVATE const char LOGFILE[] = "Cannot log conflicts on ";
 PRIVATE const char CREATECONFFILE[] = "Error creating config file ";
 PRIVATE const char CREATEPIDFILE[] = "Error creating pid file ";
 PRIVATE const char WRITECONFIGFILE[] = "Error writing config file ";
-PRIVATE const char GETIFADDRS[] = "Daemon halted! getifaddrs() failed ";
+PRIVATE const char IFDUMP[] = "Daemon halted! Network interfaces dump failed ";
 PRIVATE const char SOCKERR[] = "Error on listening socket ";
 PRIVATE const char SYSFAIL1[] = "Syscall fail. Conf file may be ignored ";
 PRIVATE const char SYSFAIL2[] = "Syscall fail. Loggin disable ";
+PRIVATE const char NOMEMORY[] = "Not enough memory. Running without ";
 PRIVATE const char FORCEDEXIT[] = "Daemon HALTED! ";
 PRIVATE const char CONFLICT[] = "Conflict ";
 
@@ -144,8 +145,8 @@ PUBLIC void logError(int type, char *logStr)
                 strncat(logBuffer,logStr,len);
                 strncat(logBuffer,")",len);
                 break;
-        case EGETIFADDRS:
-                strcpy(logBuffer,GETIFADDRS);
+        case EIFDUMP:
+                strcpy(logBuffer,IFDUMP);
                 strncat(logBuffer,"(",len);
                 strncat(logBuffer,logStr,len);
                 strncat(logBuffer,")",len);
@@ -168,6 +169,12 @@ PUBLIC void logError(int type, char *logStr)
                 strncat(logBuffer,logStr,len);
                 strncat(logBuffer,")",len);
                 break;
+        case ENOMEMORY:
+                strcpy(logBuffer,NOMEMORY);
+                strncat(logBuffer,"(",len);
+                strncat(logBuffer,logStr,len);
+                strncat(logBuffer,")",len);
+                break;
         case FORCED_EXIT:
                 strcpy(logBuffer,FORCEDEXIT);
                 break;
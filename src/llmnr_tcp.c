@@ -0,0 +1,339 @@
+/* Macros */
+#define _GNU_SOURCE
+#define FRAMESZ 2
+#define MAXFRAMESZ (FRAMESZ + TCPBUFFSZ)
+#define SNDBUFFSZ (4 * MAXFRAMESZ)
+#define SWEEPMS 100
+
+/* Includes */
+#include <time.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+
+/* Own includes */
+#include "../include/llmnr_defs.h"
+#include "../include/llmnr_ifset.h"
+#include "../include/llmnr_names.h"
+#include "../include/llmnr_net_interface.h"
+#include "../include/llmnr_print.h"
+#include "../include/llmnr_stats.h"
+#include "../include/llmnr_reactor.h"
+#include "../include/llmnr_sockets.h"
+#include "../include/llmnr_tcp.h"
+
+/* Enums & Structs */
+
+/*
+ * A connection. 'rcvd' bytes of 'rcvBuffer' are pending (at
+ * most one frame). Bytes from 'sndOff' to 'sndLen' of
+ * 'sndBuffer' are waiting to be sent
+ */
+typedef struct tcpConn {
+        TCPCLIENT client;
+        long start;
+        long lastActive;
+        int rcvd;
+        int sndOff;
+        int sndLen;
+        unsigned int events;
+        U_CHAR rcvBuffer[FRAMESZ + RCVBUFSZ];
+        U_CHAR sndBuffer[SNDBUFFSZ];
+        struct tcpConn *prev;
+        struct tcpConn *next;
+} TCPCONN;
+
+/* Private prototypes */
+PRIVATE void handleConn(int fd, unsigned int events, void *conn);
+PRIVATE int readConn(TCPCONN *conn);
+PRIVATE int answerQueries(TCPCONN *conn);
+PRIVATE int writeConn(TCPCONN *conn);
+PRIVATE void watchConn(TCPCONN *conn);
+PRIVATE int hasRoom(TCPCONN *conn);
+PRIVATE void closeConn(TCPCONN *conn);
+PRIVATE void sweep(int fd, unsigned int events, void *__);
+PRIVATE long nowMs();
+
+/* Glocal variables */
+PRIVATE int MaxClients;
+PRIVATE int ClientsSz;
+PRIVATE int SweepTimer = -1;
+PRIVATE long IdleMs;
+PRIVATE long LifeMs;
+PRIVATE TCPCONN *Conns;
+PRIVATE tcpaccept Accept;
+PRIVATE tcpanswer Answer;
+
+/* Functions definitions */
+PUBLIC int startTcp(int maxClients, long idleMs, long lifeMs,
+                    tcpaccept accept, tcpanswer answer)
+{
+    /*
+     * Create the timeouts timer (it only ticks while there are
+     * connections)
+     */
+        if (maxClients <= 0 || accept == NULL || answer == NULL)
+                return FAILURE;
+        SweepTimer = newTimer(sweep,NULL);
+        if (SweepTimer < 0)
+                return FAILURE;
+        MaxClients = maxClients;
+        IdleMs = idleMs;
+        LifeMs = lifeMs;
+        Accept = accept;
+        Answer = answer;
+        return SUCCESS;
+}
+
+PUBLIC void stopTcp()
+{
+        while (Conns != NULL)
+                closeConn(Conns);
+        if (SweepTimer >= 0)
+                delHandler(SweepTimer);
+        SweepTimer = -1;
+}
+
+PUBLIC void acceptTcpClients(int fd)
+{
+    /*
+     * Accept every pending connection (the listening socket is
+     * non-blocking) and register it in the event loop
+     */
+        int sock;
+        long now;
+        socklen_t fromLen;
+        TCPCONN *conn;
+        SA_IN6 from;
+
+        for (;;) {
+                fromLen = sizeof(SA_IN6);
+                sock = accept4(fd,(SA *)&from,&fromLen,
+                               SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (sock < 0)
+                        return;
+                conn = NULL;
+                if (ClientsSz < MaxClients)
+                        conn = calloc(1,sizeof(TCPCONN));
+                if (conn == NULL) {
+                        incStat(STAT_TCPREFUSED);
+                        close(sock);
+                        continue;
+                }
+                conn->client.socket = sock;
+                memcpy(&conn->client.from,&from,sizeof(SA_IN6));
+                conn->events = EPOLLIN;
+                if (Accept(&conn->client) ||
+                    addHandler(sock,EPOLLIN,handleConn,conn)) {
+                        incStat(STAT_TCPREFUSED);
+                        close(sock);
+                        free(conn);
+                        continue;
+                }
+                now = nowMs();
+                conn->start = now;
+                conn->lastActive = now;
+                conn->next = Conns;
+                if (Conns != NULL)
+                        Conns->prev = conn;
+                Conns = conn;
+                if (ClientsSz++ == 0)
+                        armTimer(SweepTimer,SWEEPMS);
+                incStat(STAT_TCPACCEPTED);
+        }
+}
+
+PUBLIC void printTcpStats()
+{
+        printToStream("TCP connections: %d open (max %d)\n",ClientsSz,
+                      MaxClients);
+}
+
+PRIVATE void handleConn(int fd, unsigned int events, void *conn)
+{
+    /*
+     * Connection state machine: flush what is pending, read
+     * and answer every complete query, then watch for whatever
+     * is needed next
+     */
+        TCPCONN *myConn;
+
+        fd = fd;
+        myConn = (TCPCONN *)conn;
+        if (events & (EPOLLERR | EPOLLHUP)) {
+                closeConn(myConn);
+                return;
+        }
+        if (events & EPOLLOUT && writeConn(myConn)) {
+                closeConn(myConn);
+                return;
+        }
+        if (events & EPOLLIN && readConn(myConn)) {
+                closeConn(myConn);
+                return;
+        }
+        watchConn(myConn);
+}
+
+PRIVATE int readConn(TCPCONN *conn)
+{
+    /*
+     * Read until the socket is drained or the output buffer
+     * is full. Frames are read one at a time ('rcvBuffer' holds
+     * the biggest one), so pipelined queries are never merged
+     * Returns FAILURE if the connection must be closed
+     */
+        int n, need, len;
+
+        while (hasRoom(conn)) {
+                need = FRAMESZ;
+                if (conn->rcvd >= FRAMESZ) {
+                        len = conn->rcvBuffer[0] << 8 | conn->rcvBuffer[1];
+                        if (len < QUESTMINSZ || len > RCVBUFSZ)
+                                return FAILURE;
+                        need = FRAMESZ + len;
+                }
+                n = recv(conn->client.socket,conn->rcvBuffer + conn->rcvd,
+                         need - conn->rcvd,0);
+                if (n == 0)
+                        return FAILURE;
+                if (n < 0)
+                        return errno == EAGAIN || errno == EWOULDBLOCK ||
+                               errno == EINTR ? SUCCESS : FAILURE;
+                conn->rcvd += n;
+                conn->lastActive = nowMs();
+                if (need > FRAMESZ && conn->rcvd == need &&
+                    answerQueries(conn))
+                        return FAILURE;
+        }
+        return SUCCESS;
+}
+
+PRIVATE int answerQueries(TCPCONN *conn)
+{
+    /*
+     * Answer the query in 'rcvBuffer', append the answer (with
+     * his length) to the output buffer and try to send it
+     * Returns FAILURE if the connection must be closed
+     */
+        int sz;
+        U_CHAR *frame;
+
+        if (conn->sndOff == conn->sndLen)
+                conn->sndOff = conn->sndLen = 0;
+        if (SNDBUFFSZ - conn->sndLen < MAXFRAMESZ) {
+                memmove(conn->sndBuffer,conn->sndBuffer + conn->sndOff,
+                        conn->sndLen - conn->sndOff);
+                conn->sndLen -= conn->sndOff;
+                conn->sndOff = 0;
+        }
+        frame = conn->sndBuffer + conn->sndLen;
+        incStat(STAT_TCPQUERIES);
+        sz = Answer(&conn->client,conn->rcvBuffer + FRAMESZ,
+                    conn->rcvd - FRAMESZ,frame + FRAMESZ,TCPBUFFSZ);
+        conn->rcvd = 0;
+        if (sz <= 0)
+                return SUCCESS;
+        frame[0] = sz >> 8;
+        frame[1] = sz & 0xFF;
+        conn->sndLen += FRAMESZ + sz;
+        return writeConn(conn);
+}
+
+PRIVATE int writeConn(TCPCONN *conn)
+{
+    /*
+     * Send as much as the socket takes
+     * Returns FAILURE if the connection must be closed
+     */
+        int n;
+
+        while (conn->sndOff < conn->sndLen) {
+                n = send(conn->client.socket,conn->sndBuffer + conn->sndOff,
+                         conn->sndLen - conn->sndOff,MSG_NOSIGNAL);
+                if (n < 0)
+                        return errno == EAGAIN || errno == EWOULDBLOCK ||
+                               errno == EINTR ? SUCCESS : FAILURE;
+                conn->sndOff += n;
+                conn->lastActive = nowMs();
+        }
+        conn->sndOff = conn->sndLen = 0;
+        return SUCCESS;
+}
+
+PRIVATE void watchConn(TCPCONN *conn)
+{
+    /*
+     * Read while the output buffer has room for another answer,
+     * wait for writability while something is pending
+     */
+        unsigned int events;
+
+        events = 0;
+        if (hasRoom(conn))
+                events |= EPOLLIN;
+        if (conn->sndOff < conn->sndLen)
+                events |= EPOLLOUT;
+        if (events != conn->events && !modHandler(conn->client.socket,
+                                                  events))
+                conn->events = events;
+}
+
+PRIVATE int hasRoom(TCPCONN *conn)
+{
+    /*
+     * Checks if the output buffer can take another answer
+     */
+        return SNDBUFFSZ - (conn->sndLen - conn->sndOff) >= MAXFRAMESZ;
+}
+
+PRIVATE void closeConn(TCPCONN *conn)
+{
+        delHandler(conn->client.socket);
+        close(conn->client.socket);
+        if (conn->prev != NULL)
+                conn->prev->next = conn->next;
+        else
+                Conns = conn->next;
+        if (conn->next != NULL)
+                conn->next->prev = conn->prev;
+        free(conn);
+        if (--ClientsSz == 0)
+                armTimer(SweepTimer,0);
+}
+
+PRIVATE void sweep(int fd, unsigned int events, void *__)
+{
+    /*
+     * Close the connections idle for too long or open for too
+     * long. Rearmed while there are connections
+     */
+        long now;
+        TCPCONN *current, *next;
+
+        fd = fd;
+        events = events;
+        __ = __;
+        now = nowMs();
+        for (current = Conns; current != NULL; current = next) {
+                next = current->next;
+                if (now - current->lastActive >= IdleMs ||
+                    now - current->start >= LifeMs) {
+                        incStat(STAT_TCPTIMEOUTS);
+                        closeConn(current);
+                }
+        }
+        if (ClientsSz > 0)
+                armTimer(SweepTimer,SWEEPMS);
+}
+
+PRIVATE long nowMs()
+{
+        struct timespec now;
+
+        clock_gettime(CLOCK_MONOTONIC,&now);
+        return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
@@ -0,0 +1,186 @@
+/* Macros */
+#define WHEELSZ 512
+#define WHEELMASK (WHEELSZ - 1)
+#define TICK 1
+
+/* Includes */
+#include <time.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+/* Own includes */
+#include "../include/llmnr_defs.h"
+#include "../include/llmnr_reactor.h"
+#include "../include/llmnr_timer_wheel.h"
+
+/* Enums & Structs */
+typedef struct wheelentry {
+        long expire;
+        timercb callback;
+        void *data;
+        struct wheelentry *next;
+} WHEELENTRY;
+
+/* Private prototypes */
+PRIVATE void tick(int fd, unsigned int events, void *__);
+PRIVATE long nextExpire(long now);
+PRIVATE long nowMs();
+
+/* Glocal variables */
+PRIVATE int TimerFd = -1;
+PRIVATE int Count;
+PRIVATE long LastTick;
+PRIVATE long NextExpire;
+PRIVATE WHEELENTRY *Wheel[WHEELSZ];
+PRIVATE pthread_mutex_t WheelMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Functions definitions */
+PUBLIC int startTimerWheel()
+{
+    /*
+     * Register the wheel timer in the event loop. The timer is
+     * only armed while there are pending timers, and only for
+     * the earliest deadline among them (See nextExpire())
+     */
+        TimerFd = newTimer(tick,NULL);
+        if (TimerFd < 0)
+                return FAILURE;
+        LastTick = nowMs();
+        return SUCCESS;
+}
+
+PUBLIC void stopTimerWheel()
+{
+    /*
+     * Drop every pending timer (callbacks are not called)
+     */
+        int i;
+        WHEELENTRY *next;
+
+        if (TimerFd >= 0)
+                delHandler(TimerFd);
+        TimerFd = -1;
+        pthread_mutex_lock(&WheelMutex);
+        for (i = 0; i < WHEELSZ; i++) {
+                for (; Wheel[i] != NULL; Wheel[i] = next) {
+                        next = Wheel[i]->next;
+                        free(Wheel[i]);
+                }
+        }
+        Count = 0;
+        pthread_mutex_unlock(&WheelMutex);
+}
+
+PUBLIC int addTimer(long ms, timercb callback, void *data)
+{
+    /*
+     * Call 'callback' with 'data' in 'ms' milliseconds
+     */
+        long now;
+        WHEELENTRY *entry;
+
+        if (TimerFd < 0 || callback == NULL)
+                return FAILURE;
+        entry = malloc(sizeof(WHEELENTRY));
+        if (entry == NULL)
+                return FAILURE;
+        now = nowMs();
+        entry->expire = now + (ms < TICK ? TICK : ms);
+        entry->callback = callback;
+        entry->data = data;
+        pthread_mutex_lock(&WheelMutex);
+        entry->next = Wheel[entry->expire & WHEELMASK];
+        Wheel[entry->expire & WHEELMASK] = entry;
+        if (Count++ == 0 || entry->expire < NextExpire) {
+                NextExpire = entry->expire;
+                armTimer(TimerFd,NextExpire - now);
+        }
+        pthread_mutex_unlock(&WheelMutex);
+        return SUCCESS;
+}
+
+PUBLIC int pendingTimers()
+{
+        return __atomic_load_n(&Count,__ATOMIC_RELAXED);
+}
+
+PRIVATE void tick(int fd, unsigned int events, void *__)
+{
+    /*
+     * Visit the slots of every tick elapsed since the last
+     * visit and call the expired timers. Timers of later
+     * rounds (same slot, bigger deadline) stay in the wheel.
+     * The timer is armed again for the earliest one left.
+     * Callbacks are called out of the lock, so they can add
+     * new timers
+     */
+        long now, t;
+        WHEELENTRY **ptr, *entry, *expired;
+
+        fd = fd;
+        events = events;
+        __ = __;
+        expired = NULL;
+        now = nowMs();
+        pthread_mutex_lock(&WheelMutex);
+        for (t = LastTick + 1; t <= now && t <= LastTick + WHEELSZ; t++) {
+                ptr = &Wheel[t & WHEELMASK];
+                while (*ptr != NULL) {
+                        entry = *ptr;
+                        if (entry->expire > now) {
+                                ptr = &entry->next;
+                                continue;
+                        }
+                        *ptr = entry->next;
+                        entry->next = expired;
+                        expired = entry;
+                        Count--;
+                }
+        }
+        LastTick = now;
+        if (Count > 0) {
+                NextExpire = nextExpire(now);
+                armTimer(TimerFd,NextExpire > now ? NextExpire - now : TICK);
+        }
+        pthread_mutex_unlock(&WheelMutex);
+
+        for (; expired != NULL; expired = entry) {
+                entry = expired->next;
+                expired->callback(expired->data);
+                free(expired);
+        }
+}
+
+PRIVATE long nextExpire(long now)
+{
+    /*
+     * Earliest deadline of the pending timers (at least one).
+     * The slots are visited from the next tick on: the first
+     * timer of his own round found is the earliest one.
+     * Otherwise every slot gets visited and the earliest of the
+     * later rounds is taken
+     * (Called with the lock held)
+     */
+        long t, first;
+        WHEELENTRY *entry;
+
+        first = -1;
+        for (t = now + 1; t <= now + WHEELSZ; t++) {
+                entry = Wheel[t & WHEELMASK];
+                for (; entry != NULL; entry = entry->next) {
+                        if (entry->expire == t)
+                                return t;
+                        if (first < 0 || entry->expire < first)
+                                first = entry->expire;
+                }
+        }
+        return first;
+}
+
+PRIVATE long nowMs()
+{
+        struct timespec now;
+
+        clock_gettime(CLOCK_MONOTONIC,&now);
+        return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
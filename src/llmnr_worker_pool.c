@@ -0,0 +1,506 @@
+/* Macros */
+#define _GNU_SOURCE
+
+/* Includes */
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <netinet/in.h>
+
+/* Own includes */
+#include "../include/llmnr_defs.h"
+#include "../include/llmnr_ifset.h"
+#include "../include/llmnr_names.h"
+#include "../include/llmnr_net_interface.h"
+#include "../include/llmnr_rr.h"
+#include "../include/llmnr_print.h"
+#include "../include/llmnr_stats.h"
+#include "../include/llmnr_ring.h"
+#include "../include/llmnr_sockets.h"
+#include "../include/llmnr_registry.h"
+#include "../include/llmnr_packet.h"
+#include "../include/llmnr_timer_wheel.h"
+#include "../include/llmnr_worker_pool.h"
+
+/*
+ * sem_clockwait() came with glibc 2.30. Before it the pending
+ * count is kept behind a condition variable on CLOCK_MONOTONIC
+ */
+#if defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 30))
+#define HAVE_SEM_CLOCKWAIT
+#endif
+
+/* Enums & Structs */
+/*
+ * Answers held by a worker waiting to be flushed
+ */
+typedef struct {
+        int count;
+        struct timespec first;
+        UDPCLIENT *clients[MAXSNDBATCH];
+        PKTSND pkts[MAXSNDBATCH];
+} SNDBATCH;
+
+/*
+ * Number of queued slots the workers wait on
+ */
+typedef struct {
+#ifdef HAVE_SEM_CLOCKWAIT
+        sem_t sem;
+#else
+        unsigned int count;
+        pthread_mutex_t lock;
+        pthread_cond_t cond;
+#endif
+} PENDING;
+
+/* Private prototypes */
+PRIVATE void *workerLoop(void *batch);
+PRIVATE int waitWork(SNDBATCH *batch);
+PRIVATE void answerClient(SNDBATCH *batch, UDPCLIENT *client);
+PRIVATE void holdAnswer(SNDBATCH *batch, UDPCLIENT *client, int pktSz);
+PRIVATE void flushBatch(SNDBATCH *batch);
+PRIVATE void sendDelayed(void *slot);
+PRIVATE long batchAge(SNDBATCH *batch);
+PRIVATE int initPending();
+PRIVATE void postPending();
+PRIVATE int waitPending(struct timespec *deadline);
+PRIVATE void freePool();
+
+/* Glocal variables */
+PRIVATE int Running;
+PRIVATE int WorkersSz;
+PRIVATE int SlotsSz;
+PRIVATE int SndBatchSz;
+PRIVATE long SndBudget;
+PRIVATE PENDING Pending;
+PRIVATE RING *FreeRing;
+PRIVATE RING *WorkRing;
+PRIVATE UDPCLIENT *Slots;
+PRIVATE pthread_t *Workers;
+PRIVATE SNDBATCH *Batches;
+PRIVATE poolhandler Handler;
+
+/* Functions definitions */
+PUBLIC int startPool(int workers, int queueSz, int sndBatch, int sndBudget,
+                     poolhandler handler)
+{
+    /*
+     * - Preallocate every client slot and push them into the
+     *   free ring
+     * - Start 'workers' threads, each one with his own batch of
+     *   answers to send. Signals are blocked on the workers so
+     *   they are always delivered to the main thread. With no
+     *   workers the pool only holds the slots and the receiving
+     *   threads answer by themselves (See answerInline())
+     */
+        int i;
+        sigset_t all, old;
+
+        if (workers < 0 || queueSz <= 0 || handler == NULL)
+                return FAILURE;
+        Handler = handler;
+        SlotsSz = queueSz;
+        WorkersSz = 0;
+        SndBatchSz = sndBatch < 1 ? 1 : sndBatch;
+        if (SndBatchSz > MAXSNDBATCH)
+                SndBatchSz = MAXSNDBATCH;
+        SndBudget = sndBudget;
+        Slots = calloc(queueSz,sizeof(UDPCLIENT));
+        Workers = calloc(workers + 1,sizeof(pthread_t));
+        Batches = calloc(workers + 1,sizeof(SNDBATCH));
+        FreeRing = newRing(queueSz);
+        WorkRing = newRing(queueSz);
+        if (Slots == NULL || Workers == NULL || Batches == NULL ||
+            FreeRing == NULL || WorkRing == NULL ||
+            initPending()) {
+                freePool();
+                return FAILURE;
+        }
+        for (i = 0; i < queueSz; i++)
+                ringPush(FreeRing,&Slots[i]);
+
+        Running = 1;
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK,&all,&old);
+        for (i = 0; i < workers; i++) {
+                if (pthread_create(&Workers[i],NULL,workerLoop,&Batches[i]))
+                        break;
+                WorkersSz++;
+        }
+        pthread_sigmask(SIG_SETMASK,&old,NULL);
+        if (WorkersSz == 0 && workers > 0) {
+                freePool();
+                return FAILURE;
+        }
+        return SUCCESS;
+}
+
+PUBLIC void stopPool()
+{
+    /*
+     * Wake up every worker, wait for them to finish and
+     * release the pool resources
+     */
+        int i;
+
+        if (Slots == NULL)
+                return;
+        __atomic_store_n(&Running,0,__ATOMIC_RELEASE);
+        for (i = 0; i < WorkersSz; i++)
+                postPending();
+        for (i = 0; i < WorkersSz; i++)
+                pthread_join(Workers[i],NULL);
+        freePool();
+}
+
+PUBLIC UDPCLIENT *getPoolSlot()
+{
+    /*
+     * Take a free client slot. NULL means every slot is either
+     * queued or being answered
+     */
+        return ringPop(FreeRing);
+}
+
+PUBLIC void releasePoolSlot(UDPCLIENT *client)
+{
+        if (client == NULL)
+                return;
+        ringPush(FreeRing,client);
+}
+
+PUBLIC int receiveClients(int fd, UDPCLIENT **clients, int max, int ifIndex)
+{
+    /*
+     * Drain up to 'max' queries from 'fd' (the socket of interface
+     * 'ifIndex', 0 for a wildcard one) with a single
+     * recvmmsg() into free slots (See recvUdpBatch()). If the
+     * pool has no free slot one query is read and dropped.
+     * Slots that got no valid query are given back
+     * Returns the number of 'clients' holding a query
+     */
+        int i, count, rcved, valid;
+        char auxBuffer[RCVBUFSZ];
+
+        if (max > MAXRCVBATCH)
+                max = MAXRCVBATCH;
+        for (count = 0; count < max; count++) {
+                clients[count] = getPoolSlot();
+                if (clients[count] == NULL)
+                        break;
+        }
+        if (count == 0) {
+                if (recvfrom(fd,auxBuffer,RCVBUFSZ,0,NULL,NULL) >= 0)
+                        incStat(STAT_UDPDROPFULL);
+                return 0;
+        }
+        rcved = recvUdpBatch(fd,clients,count,ifIndex);
+        if (rcved > 0) {
+                incStat(STAT_UDPBATCHES);
+                addStat(STAT_UDPRCVD,rcved);
+        }
+        valid = 0;
+        for (i = 0; i < count; i++) {
+                if (i >= rcved || clients[i]->rcvSz == 0)
+                        releasePoolSlot(clients[i]);
+                else
+                        clients[valid++] = clients[i];
+        }
+        return valid;
+}
+
+PUBLIC void answerInline(UDPCLIENT **clients, int count)
+{
+    /*
+     * Answer 'clients' in the calling thread (instead of
+     * queueing them to the workers) and send the answers
+     * together before returning
+     */
+        int i;
+        SNDBATCH batch;
+
+        batch.count = 0;
+        for (i = 0; i < count; i++) {
+                answerClient(&batch,clients[i]);
+                if (batch.count >= SndBatchSz)
+                        flushBatch(&batch);
+        }
+        flushBatch(&batch);
+}
+
+PUBLIC int enqueueClient(UDPCLIENT *client)
+{
+    /*
+     * Queue a filled slot and wake up one worker. The work ring
+     * is as big as the number of slots so it can't overflow
+     */
+        if (ringPush(WorkRing,client)) {
+                releasePoolSlot(client);
+                incStat(STAT_UDPDROPFULL);
+                return FAILURE;
+        }
+        postPending();
+        incStat(STAT_UDPQUEUED);
+        maxStat(STAT_UDPQUEUEMAX,ringCount(WorkRing));
+        return SUCCESS;
+}
+
+PRIVATE void *workerLoop(void *batch)
+{
+    /*
+     * Wait for queued slots and answer them. Answers are held
+     * in the worker batch until one of the flush conditions is
+     * met. An answer that must be delayed (RFC 4795 jitter) is
+     * handed to the timer wheel along with his slot, so the
+     * worker moves on to the next query. If the wheel can't take
+     * it the answer is sent without delay
+     */
+        UDPCLIENT *client;
+        SNDBATCH *sndBatch;
+
+        sndBatch = (SNDBATCH *)batch;
+        while (__atomic_load_n(&Running,__ATOMIC_ACQUIRE)) {
+                if (waitWork(sndBatch))
+                        continue;
+                client = ringPop(WorkRing);
+                if (client == NULL)
+                        continue;
+                answerClient(sndBatch,client);
+                if (sndBatch->count == 0)
+                        continue;
+                if (sndBatch->count >= SndBatchSz ||
+                    ringCount(WorkRing) == 0 || batchAge(sndBatch) >= SndBudget)
+                        flushBatch(sndBatch);
+        }
+        flushBatch(sndBatch);
+        return NULL;
+}
+
+PRIVATE int waitWork(SNDBATCH *batch)
+{
+    /*
+     * Wait for a queued slot. While answers are held the wait
+     * is bounded by what is left of the latency budget; when
+     * the budget runs out the batch is flushed. The deadline is
+     * taken on CLOCK_MONOTONIC so a step of the wall clock can't
+     * stretch it
+     * Returns FAILURE when there is no slot to pop
+     */
+        long left;
+        struct timespec deadline;
+
+        if (batch->count == 0)
+                return waitPending(NULL);
+        left = SndBudget - batchAge(batch);
+        if (left < 0)
+                left = 0;
+        clock_gettime(CLOCK_MONOTONIC,&deadline);
+        deadline.tv_nsec += left * 1000;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000;
+        deadline.tv_nsec %= 1000000000;
+        if (!waitPending(&deadline))
+                return SUCCESS;
+        if (errno == ETIMEDOUT)
+                flushBatch(batch);
+        return FAILURE;
+}
+
+PRIVATE void answerClient(SNDBATCH *batch, UDPCLIENT *client)
+{
+    /*
+     * Build the answer of 'client' (pool handler) and hold it in
+     * 'batch'. No answer, the slot is given back. Delayed answer,
+     * the slot goes to the timer wheel
+     */
+        int pktSz;
+
+        pktSz = Handler(client);
+        if (pktSz <= 0) {
+                releasePoolSlot(client);
+                return;
+        }
+        if (client->delay > 0) {
+                client->sndSz = pktSz;
+                if (!addTimer(client->delay,sendDelayed,client)) {
+                        incStat(STAT_UDPDELAYED);
+                        return;
+                }
+        }
+        holdAnswer(batch,client,pktSz);
+}
+
+PRIVATE void holdAnswer(SNDBATCH *batch, UDPCLIENT *client, int pktSz)
+{
+    /*
+     * Add the answer left in 'client' to the batch. The answer
+     * goes out through the interface that received the query
+     */
+        PKTSND *pktSnd;
+
+        if (batch->count == 0)
+                clock_gettime(CLOCK_MONOTONIC,&batch->first);
+        pktSnd = &batch->pkts[batch->count];
+        pktSnd->fd = client->socket;
+        pktSnd->ifIndex = client->recviface;
+        pktSnd->pktBuff = client->sndPkt;
+        pktSnd->pktSz = pktSz;
+        pktSnd->to = (SA *)&client->from;
+        batch->clients[batch->count] = client;
+        batch->count++;
+}
+
+PRIVATE void flushBatch(SNDBATCH *batch)
+{
+    /*
+     * Send every held answer and give the slots back
+     */
+        int i;
+
+        if (batch->count == 0)
+                return;
+        sendUDPBatch(batch->pkts,batch->count);
+        incStat(STAT_UDPSNDBATCHES);
+        addStat(STAT_UDPSENT,batch->count);
+        for (i = 0; i < batch->count; i++)
+                releasePoolSlot(batch->clients[i]);
+        batch->count = 0;
+}
+
+PRIVATE void sendDelayed(void *slot)
+{
+    /*
+     * Timer wheel callback: the jitter of the answer left in
+     * 'slot' is over. Send it and give the slot back
+     */
+        PKTSND pktSnd;
+        UDPCLIENT *client;
+
+        client = (UDPCLIENT *)slot;
+        pktSnd.fd = client->socket;
+        pktSnd.ifIndex = client->recviface;
+        pktSnd.pktBuff = client->sndPkt;
+        pktSnd.pktSz = client->sndSz;
+        pktSnd.to = (SA *)&client->from;
+        sendUDPacket(&pktSnd);
+        incStat(STAT_UDPSENT);
+        releasePoolSlot(client);
+}
+
+PRIVATE long batchAge(SNDBATCH *batch)
+{
+    /*
+     * Microseconds since the oldest held answer was added
+     */
+        struct timespec now;
+
+        if (batch->count == 0)
+                return 0;
+        clock_gettime(CLOCK_MONOTONIC,&now);
+        return (now.tv_sec - batch->first.tv_sec) * 1000000 +
+               (now.tv_nsec - batch->first.tv_nsec) / 1000;
+}
+
+PRIVATE int initPending()
+{
+#ifdef HAVE_SEM_CLOCKWAIT
+        return sem_init(&Pending.sem,0,0) < 0 ? FAILURE : SUCCESS;
+#else
+        pthread_condattr_t attr;
+
+        Pending.count = 0;
+        if (pthread_condattr_init(&attr))
+                return FAILURE;
+        if (pthread_condattr_setclock(&attr,CLOCK_MONOTONIC) ||
+            pthread_cond_init(&Pending.cond,&attr)) {
+                pthread_condattr_destroy(&attr);
+                return FAILURE;
+        }
+        pthread_condattr_destroy(&attr);
+        if (pthread_mutex_init(&Pending.lock,NULL)) {
+                pthread_cond_destroy(&Pending.cond);
+                return FAILURE;
+        }
+        return SUCCESS;
+#endif
+}
+
+PRIVATE void postPending()
+{
+#ifdef HAVE_SEM_CLOCKWAIT
+        sem_post(&Pending.sem);
+#else
+        pthread_mutex_lock(&Pending.lock);
+        Pending.count++;
+        pthread_cond_signal(&Pending.cond);
+        pthread_mutex_unlock(&Pending.lock);
+#endif
+}
+
+PRIVATE int waitPending(struct timespec *deadline)
+{
+    /*
+     * Take one from the pending count, waiting for it up to
+     * 'deadline' (CLOCK_MONOTONIC, NULL waits for as long as it
+     * takes)
+     * Returns FAILURE with 'errno' set to ETIMEDOUT when the
+     * deadline is over
+     */
+#ifdef HAVE_SEM_CLOCKWAIT
+        if (deadline == NULL)
+                return sem_wait(&Pending.sem) < 0 ? FAILURE : SUCCESS;
+        return sem_clockwait(&Pending.sem,CLOCK_MONOTONIC,deadline) < 0 ?
+               FAILURE : SUCCESS;
+#else
+        int res;
+
+        res = 0;
+        pthread_mutex_lock(&Pending.lock);
+        while (Pending.count == 0 && res == 0) {
+                if (deadline == NULL)
+                        res = pthread_cond_wait(&Pending.cond,&Pending.lock);
+                else
+                        res = pthread_cond_timedwait(&Pending.cond,
+                                                     &Pending.lock,deadline);
+        }
+        if (Pending.count > 0) {
+                Pending.count--;
+                res = 0;
+        }
+        pthread_mutex_unlock(&Pending.lock);
+        if (res == 0)
+                return SUCCESS;
+        errno = res;
+        return FAILURE;
+#endif
+}
+
+PRIVATE void freePool()
+{
+        if (Slots != NULL)
+                free(Slots);
+        if (Workers != NULL)
+                free(Workers);
+        if (Batches != NULL)
+                free(Batches);
+        deleteRing(&FreeRing);
+        deleteRing(&WorkRing);
+        Slots = NULL;
+        Workers = NULL;
+        Batches = NULL;
+        WorkersSz = 0;
+}
+
+PUBLIC void printPoolStats()
+{
+        if (Slots == NULL)
+                return;
+        printToStream("Workers: %d. Queue depth: %lu/%d. Free slots: %lu\n",
+                      WorkersSz,ringCount(WorkRing),SlotsSz,
+                      ringCount(FreeRing));
+}